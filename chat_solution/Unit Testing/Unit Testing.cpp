@@ -4,8 +4,21 @@ extern "C"
 {
 // Project libraries
 #include "../networking/networking.h"
+#include "../hashtable/epoch.h"
 #include "../hashtable/hashtable.h"
+#include "../hashtable/shardedhashtable.h"
+#include "../linkedlist/blockpool.h"
 #include "../linkedlist/linkedlist.h"
+#include "../linkedlist/intrusivelist.h"
+#include "../linkedlist/mpscqueue.h"
+#include "../linkedlist/unrolledlist.h"
+#include "../server_application/Messages.h"
+#include "../server_application/s_sendqueue.h"
+
+#define INTMAP_TYPE   IDMAP
+#define INTMAP_PREFIX IdMap
+#define INTMAP_KEY    ULONGLONG
+#include "../hashtable/intmap.h"
 }
 
 // Global BOOL for this client's state
@@ -89,8 +102,485 @@ TEST_METHOD(FreeFn)
     WORD wResult = LinkedListDestroy(LinkedList, free);
     Assert::AreEqual((WORD)EXIT_SUCCESS, wResult);
 } // TEST_METHOD(FreeFn)
+TEST_METHOD(NodeChunks)
+{
+    PLINKEDLIST LinkedList = NULL;
+    WORD        wValue     = 1;
+
+    Assert::AreEqual((int)SUCCESS,
+                     (int)LinkedListInitCapacity(&LinkedList, 64));
+    Assert::AreEqual((DWORD)1, LinkedList->m_dwHeapAllocs);
+
+    for (DWORD dwCounter = 0; dwCounter < 64; dwCounter++)
+    {
+        Assert::AreEqual((int)SUCCESS,
+                         (int)LinkedListInsert(LinkedList, &wValue, 0));
+    }
+    Assert::AreEqual((DWORD)1, LinkedList->m_dwHeapAllocs);
+
+    // NOTE: Removed nodes are re-used, churn never reaches the heap.
+    for (DWORD dwCounter = 0; dwCounter < 1000; dwCounter++)
+    {
+        Assert::IsTrue(&wValue == LinkedListRemove(LinkedList, 0, NULL));
+        Assert::AreEqual((int)SUCCESS,
+                         (int)LinkedListInsert(LinkedList, &wValue,
+                                               LinkedList->m_dwSize));
+    }
+    Assert::AreEqual((DWORD)1, LinkedList->m_dwHeapAllocs);
+
+    // NOTE: Past the reserved nodes the list grows by LIST_CHUNK_MIN.
+    for (DWORD dwCounter = 0; dwCounter <= LIST_CHUNK_MIN; dwCounter++)
+    {
+        Assert::AreEqual((int)SUCCESS,
+                         (int)LinkedListInsert(LinkedList, &wValue, 0));
+    }
+    Assert::AreEqual((DWORD)3, LinkedList->m_dwHeapAllocs);
+    Assert::AreEqual((DWORD)(64 + LIST_CHUNK_MIN + 1), LinkedList->m_dwSize);
+
+    Assert::AreEqual((int)SUCCESS, (int)LinkedListDestroy(LinkedList, NULL));
+} // TEST_METHOD(NodeChunks)
+TEST_METHOD(InsertMiddle)
+{
+    PLINKEDLIST LinkedList = NULL;
+    WORD        wValue[4]  = {0, 1, 2, 3};
+
+    Assert::AreEqual((int)SUCCESS, (int)LinkedListInit(&LinkedList));
+    LinkedListInsert(LinkedList, &wValue[0], 0);
+    LinkedListInsert(LinkedList, &wValue[2], 1);
+    LinkedListInsert(LinkedList, &wValue[3], 2);
+
+    // NOTE: Inserting between two nodes keeps the node after it.
+    Assert::AreEqual((int)SUCCESS,
+                     (int)LinkedListInsert(LinkedList, &wValue[1], 1));
+    Assert::AreEqual((DWORD)4, LinkedList->m_dwSize);
+    for (DWORD dwIndex = 0; dwIndex < 4; dwIndex++)
+    {
+        Assert::IsTrue(&wValue[dwIndex] ==
+                       LinkedListReturn(LinkedList, dwIndex));
+    }
+
+    Assert::AreEqual((int)SUCCESS, (int)LinkedListDestroy(LinkedList, NULL));
+} // TEST_METHOD(InsertMiddle)
+TEST_METHOD(Cursor)
+{
+    PLINKEDLIST      LinkedList = NULL;
+    LINKEDLISTCURSOR Cursor;
+    WORD             wValue[100];
+    PVOID            pData   = NULL;
+    DWORD            dwIndex = 0;
+
+    Assert::AreEqual((int)SUCCESS, (int)LinkedListInit(&LinkedList));
+    LinkedListCursorInit(LinkedList, &Cursor);
+    Assert::IsNull(LinkedListCursorNext(&Cursor));
+
+    for (dwIndex = 0; dwIndex < 100; dwIndex++)
+    {
+        wValue[dwIndex] = (WORD)dwIndex;
+        LinkedListInsert(LinkedList, &wValue[dwIndex], LinkedList->m_dwSize);
+    }
+
+    // NOTE: Removes the head, the tail and every other node in between.
+    dwIndex = 0;
+    LinkedListCursorInit(LinkedList, &Cursor);
+    while (NULL != (pData = LinkedListCursorNext(&Cursor)))
+    {
+        Assert::IsTrue(&wValue[dwIndex] == pData);
+        if ((0 == (dwIndex % 2)) || (99 == dwIndex))
+        {
+            Assert::IsTrue(pData == LinkedListCursorRemove(&Cursor, NULL));
+            Assert::IsNull(LinkedListCursorRemove(&Cursor, NULL));
+        }
+        dwIndex++;
+    }
+    Assert::AreEqual((DWORD)100, dwIndex);
+    Assert::AreEqual((DWORD)49, LinkedList->m_dwSize);
+    Assert::IsTrue(&wValue[1] == LinkedList->m_pHead->m_pData);
+    Assert::IsTrue(&wValue[97] == LinkedList->m_pTail->m_pData);
+    Assert::IsTrue(LinkedList->m_pHead == LinkedList->m_pTail->m_pNext);
+
+    dwIndex = 1;
+    LinkedListCursorInit(LinkedList, &Cursor);
+    while (NULL != (pData = LinkedListCursorNext(&Cursor)))
+    {
+        Assert::IsTrue(&wValue[dwIndex] == pData);
+        Assert::IsTrue(pData == LinkedListCursorRemove(&Cursor, NULL));
+        dwIndex += 2;
+    }
+    Assert::AreEqual((DWORD)0, LinkedList->m_dwSize);
+    Assert::IsNull(LinkedList->m_pHead);
+    Assert::IsNull(LinkedList->m_pTail);
+
+    // NOTE: The emptied list is still usable.
+    Assert::AreEqual((int)SUCCESS,
+                     (int)LinkedListInsert(LinkedList, &wValue[0], 0));
+    Assert::IsTrue(&wValue[0] == LinkedListReturn(LinkedList, 0));
+
+    Assert::AreEqual((int)SUCCESS, (int)LinkedListDestroy(LinkedList, NULL));
+} // TEST_METHOD(Cursor)
+// NOTE: Linked through m_Link, m_wValue sits before it so the list has to
+// apply a non-zero offset.
+typedef struct LINKEDVALUE
+{
+    WORD     m_wValue;
+    LISTLINK m_Link;
+} LINKEDVALUE, *PLINKEDVALUE;
+TEST_METHOD(IntrusiveList)
+{
+    INTRUSIVELIST List;
+    LINKEDVALUE   aValues[10];
+    PLINKEDVALUE  pValue = NULL;
+    WORD          wExpected = 0;
+
+    INTRUSIVE_LIST_INIT(&List, LINKEDVALUE, m_Link);
+    Assert::IsNull(IntrusiveListFirst(&List));
+    Assert::IsNull(IntrusiveListPopFront(&List));
+
+    for (WORD wIndex = 0; wIndex < 10; wIndex++)
+    {
+        aValues[wIndex].m_wValue = wIndex;
+    }
+    for (WORD wIndex = 1; wIndex < 10; wIndex++)
+    {
+        IntrusiveListPushBack(&List, &aValues[wIndex]);
+    }
+    IntrusiveListPushFront(&List, &aValues[0]);
+    Assert::AreEqual((DWORD)10, List.m_dwSize);
+
+    // NOTE: Removes the head, the tail and a node in the middle.
+    IntrusiveListRemove(&List, &aValues[0]);
+    IntrusiveListRemove(&List, &aValues[9]);
+    IntrusiveListRemove(&List, &aValues[5]);
+    Assert::AreEqual((DWORD)7, List.m_dwSize);
+
+    wExpected = 1;
+    for (pValue = (PLINKEDVALUE)IntrusiveListFirst(&List); NULL != pValue;
+         pValue = (PLINKEDVALUE)IntrusiveListNext(&List, pValue))
+    {
+        Assert::AreEqual(wExpected, pValue->m_wValue);
+        wExpected += (4 == wExpected) ? 2 : 1;
+    }
+    Assert::AreEqual((WORD)9, wExpected);
+
+    Assert::IsTrue(&aValues[1] == IntrusiveListPopFront(&List));
+    IntrusiveListClear(&List, NULL);
+    Assert::AreEqual((DWORD)0, List.m_dwSize);
+    Assert::IsNull(IntrusiveListFirst(&List));
+
+    // NOTE: The emptied list is still usable.
+    IntrusiveListPushBack(&List, &aValues[3]);
+    Assert::IsTrue(&aValues[3] == IntrusiveListFirst(&List));
+    Assert::IsTrue(&aValues[3] == IntrusiveListPopFront(&List));
+} // TEST_METHOD(IntrusiveList)
+static void UnrolledListFree(PVOID pData) { (*(PDWORD)pData)++; }
+// NOTE: Mirrors random inserts and removes in a plain array, enough of them
+// that nodes split, empty and merge, and checks both agree throughout.
+TEST_METHOD(UnrolledList)
+{
+    const DWORD   dwValues = 600;
+    PUNROLLEDLIST pList    = NULL;
+    DWORD         adwFreed[dwValues];
+    PVOID         apMirror[dwValues];
+    DWORD         dwMirror = 0;
+    DWORD         dwSeed   = 7;
+    DWORD         dwFreed  = 0;
+
+    ZeroMemory(adwFreed, sizeof(adwFreed));
+    Assert::AreEqual((int)SUCCESS, (int)UnrolledListInit(&pList));
+    Assert::IsNull(UnrolledListReturn(pList, 0));
+    Assert::IsNull(UnrolledListRemove(pList, 0, NULL));
+    Assert::AreNotEqual((int)SUCCESS,
+                        (int)UnrolledListInsert(pList, &adwFreed[0], 1));
+
+    for (DWORD dwOp = 0; dwOp < 4 * dwValues; dwOp++)
+    {
+        dwSeed       = (dwSeed * 1103515245) + 12345;
+        DWORD dwRand = dwSeed >> 8;
+
+        // NOTE: Grows for the first half and shrinks for the second.
+        BOOL bInsert = (dwOp < 2 * dwValues) ? (0 != (dwRand % 4))
+                                             : (0 == (dwRand % 4));
+        if ((0 == dwMirror) || (bInsert && (dwMirror < dwValues)))
+        {
+            DWORD dwIndex = (0 == (dwRand & 16)) ? dwMirror
+                                                 : (dwRand % (dwMirror + 1));
+            PVOID pData = &adwFreed[dwMirror];
+
+            Assert::AreEqual((int)SUCCESS,
+                             (int)UnrolledListInsert(pList, pData, dwIndex));
+            MoveMemory(&apMirror[dwIndex + 1], &apMirror[dwIndex],
+                       (dwMirror - dwIndex) * sizeof(PVOID));
+            apMirror[dwIndex] = pData;
+            dwMirror += 1;
+        }
+        else if (!bInsert)
+        {
+            DWORD dwIndex = dwRand % dwMirror;
+
+            Assert::IsTrue(apMirror[dwIndex] ==
+                           UnrolledListRemove(pList, dwIndex, NULL));
+            dwMirror -= 1;
+            MoveMemory(&apMirror[dwIndex], &apMirror[dwIndex + 1],
+                       (dwMirror - dwIndex) * sizeof(PVOID));
+        }
+        else
+        {
+            continue;
+        }
+
+        Assert::AreEqual(dwMirror, pList->m_dwSize);
+        if (0 != dwMirror)
+        {
+            Assert::IsTrue(apMirror[dwRand % dwMirror] ==
+                           UnrolledListReturn(pList, dwRand % dwMirror));
+        }
+        Assert::IsTrue(pList->m_dwNodes <= dwMirror);
+        Assert::IsTrue((pList->m_dwNodes * UNROLLED_SLOTS) >= dwMirror);
+    }
+
+    UNROLLEDLISTCURSOR Cursor;
+    PVOID              pData   = NULL;
+    DWORD              dwIndex = 0;
+
+    UnrolledListCursorInit(pList, &Cursor);
+    while (NULL != (pData = UnrolledListCursorNext(&Cursor)))
+    {
+        Assert::IsTrue(apMirror[dwIndex] == pData);
+        Assert::IsTrue(apMirror[dwIndex] == UnrolledListReturn(pList, dwIndex));
+        dwIndex += 1;
+    }
+    Assert::AreEqual(dwMirror, dwIndex);
+
+    Assert::AreEqual((int)SUCCESS,
+                     (int)UnrolledListDestroy(pList, UnrolledListFree));
+    for (DWORD dwCounter = 0; dwCounter < dwValues; dwCounter++)
+    {
+        dwFreed += adwFreed[dwCounter];
+    }
+    Assert::AreEqual(dwMirror, dwFreed);
+} // TEST_METHOD(UnrolledList)
+typedef struct QUEUEDVALUE
+{
+    LISTLINK m_Link;
+    DWORD    m_dwProducer;
+    DWORD    m_dwSequence;
+} QUEUEDVALUE, *PQUEUEDVALUE;
+typedef struct MPSCPRODUCER
+{
+    PMPSCQUEUE   pQueue;
+    PQUEUEDVALUE pValues;
+    DWORD        dwCount;
+} MPSCPRODUCER, *PMPSCPRODUCER;
+static DWORD WINAPI
+MpscProducer(PVOID pParam)
+{
+    PMPSCPRODUCER pProducer = (PMPSCPRODUCER)pParam;
+
+    for (DWORD dwCounter = 0; dwCounter < pProducer->dwCount; dwCounter++)
+    {
+        MpscQueuePush(pProducer->pQueue, &pProducer->pValues[dwCounter]);
+    }
+    return 0;
+}
+// NOTE: Four threads push while this one pops. Every value has to come out
+// once, and each producer's values in the order it pushed them.
+TEST_METHOD(MpscQueue)
+{
+    const DWORD  dwProducers = 4;
+    const DWORD  dwCount     = 20000;
+    MPSCQUEUE    Queue;
+    MPSCPRODUCER aProducers[dwProducers];
+    HANDLE       ahThreads[dwProducers];
+    DWORD        adwNext[dwProducers];
+    PQUEUEDVALUE pValues  = new QUEUEDVALUE[dwProducers * dwCount];
+    PQUEUEDVALUE pValue   = NULL;
+    DWORD        dwPopped = 0;
+
+    MPSC_QUEUE_INIT(&Queue, QUEUEDVALUE, m_Link);
+    Assert::IsTrue(MpscQueueIsEmpty(&Queue));
+    Assert::IsNull(MpscQueuePop(&Queue));
+
+    // NOTE: A single object goes in and out, the stub is pushed behind it.
+    pValues[0].m_dwProducer = 0;
+    MpscQueuePush(&Queue, &pValues[0]);
+    Assert::IsFalse(MpscQueueIsEmpty(&Queue));
+    Assert::IsTrue(&pValues[0] == MpscQueuePop(&Queue));
+    Assert::IsTrue(MpscQueueIsEmpty(&Queue));
+    Assert::IsNull(MpscQueuePop(&Queue));
+
+    for (DWORD dwProducer = 0; dwProducer < dwProducers; dwProducer++)
+    {
+        PQUEUEDVALUE pFirst = &pValues[dwProducer * dwCount];
+
+        for (DWORD dwCounter = 0; dwCounter < dwCount; dwCounter++)
+        {
+            pFirst[dwCounter].m_dwProducer = dwProducer;
+            pFirst[dwCounter].m_dwSequence = dwCounter;
+        }
+        adwNext[dwProducer]            = 0;
+        aProducers[dwProducer].pQueue  = &Queue;
+        aProducers[dwProducer].pValues = pFirst;
+        aProducers[dwProducer].dwCount = dwCount;
+    }
+    for (DWORD dwProducer = 0; dwProducer < dwProducers; dwProducer++)
+    {
+        ahThreads[dwProducer] = CreateThread(NULL, 0, MpscProducer,
+                                             &aProducers[dwProducer], 0, NULL);
+        Assert::IsNotNull(ahThreads[dwProducer]);
+    }
+
+    while (dwPopped < (dwProducers * dwCount))
+    {
+        pValue = (PQUEUEDVALUE)MpscQueuePop(&Queue);
+        if (NULL == pValue)
+        {
+            continue;
+        }
+
+        Assert::AreEqual(adwNext[pValue->m_dwProducer], pValue->m_dwSequence);
+        adwNext[pValue->m_dwProducer] += 1;
+        dwPopped += 1;
+    }
+
+    for (DWORD dwProducer = 0; dwProducer < dwProducers; dwProducer++)
+    {
+        WaitForSingleObject(ahThreads[dwProducer], INFINITE);
+        CloseHandle(ahThreads[dwProducer]);
+        Assert::AreEqual(dwCount, adwNext[dwProducer]);
+    }
+    Assert::IsTrue(MpscQueueIsEmpty(&Queue));
+    Assert::IsNull(MpscQueuePop(&Queue));
+
+    MpscQueuePush(&Queue, &pValues[0]);
+    MpscQueuePush(&Queue, &pValues[1]);
+    MpscQueueClear(&Queue, NULL);
+    Assert::IsTrue(MpscQueueIsEmpty(&Queue));
+    delete[] pValues;
+} // TEST_METHOD(MpscQueue)
+// NOTE: Freed blocks are reused last in, first out, and only m_wMaxFree of
+// them are kept, the rest go back to the heap.
+TEST_METHOD(BlockPool)
+{
+    const DWORD dwBlocks = 8;
+    BLOCKPOOL   Pool;
+    PBYTE       apBlocks[dwBlocks];
+
+    BlockPoolInit(&Pool, 1, 1);
+    Assert::AreEqual((DWORD)sizeof(SLIST_ENTRY), Pool.m_dwBlockSize);
+    BlockPoolDestroy(&Pool);
+
+    BlockPoolInit(&Pool, 100, 4);
+    for (DWORD dwCounter = 0; dwCounter < dwBlocks; dwCounter++)
+    {
+        apBlocks[dwCounter] = (PBYTE)BlockPoolAlloc(&Pool);
+        Assert::IsNotNull(apBlocks[dwCounter]);
+        FillMemory(apBlocks[dwCounter], 100, (BYTE)dwCounter);
+    }
+    Assert::AreEqual((LONG)dwBlocks, Pool.m_lBlocks);
+    for (DWORD dwCounter = 0; dwCounter < dwBlocks; dwCounter++)
+    {
+        for (DWORD dwByte = 0; dwByte < 100; dwByte++)
+        {
+            Assert::AreEqual((BYTE)dwCounter, apBlocks[dwCounter][dwByte]);
+        }
+    }
+
+    for (DWORD dwCounter = 0; dwCounter < dwBlocks; dwCounter++)
+    {
+        BlockPoolFree(&Pool, apBlocks[dwCounter]);
+    }
+    Assert::AreEqual((LONG)4, Pool.m_lBlocks);
+
+    for (DWORD dwCounter = 4; dwCounter > 0; dwCounter--)
+    {
+        Assert::IsTrue(apBlocks[dwCounter - 1] == BlockPoolAlloc(&Pool));
+    }
+    Assert::AreEqual((LONG)4, Pool.m_lBlocks);
+    apBlocks[4] = (PBYTE)BlockPoolAlloc(&Pool);
+    Assert::IsNotNull(apBlocks[4]);
+    Assert::AreEqual((LONG)5, Pool.m_lBlocks);
+
+    for (DWORD dwCounter = 0; dwCounter < 5; dwCounter++)
+    {
+        BlockPoolFree(&Pool, apBlocks[dwCounter]);
+    }
+    Assert::AreEqual((LONG)4, Pool.m_lBlocks);
+    BlockPoolDestroy(&Pool);
+    Assert::AreEqual((LONG)0, Pool.m_lBlocks);
+    Assert::IsNull(BlockPoolAlloc(NULL));
+} // TEST_METHOD(BlockPool)
 } // TEST_CLASS(LinkedListTest)
 ;
+static VOID
+StoreData(PVOID pData, PVOID pContext)
+{
+    *(PVOID *)pContext = pData;
+}
+
+static BOOL
+CountData(PVOID pData, PVOID pContext)
+{
+    UNREFERENCED_PARAMETER(pData);
+    *(PDWORD)pContext += 1;
+    return TRUE;
+}
+
+static VOID
+CountFree(PVOID pData)
+{
+    *(PLONG)pData += 1;
+}
+
+typedef struct EPOCHREADER
+{
+    PEPOCH            pEpoch;
+    PSHARDEDHASHTABLE pShardedTable;
+    LONG volatile     lInside;
+    LONG volatile     lLeave;
+    DWORD             dwMisses;
+} EPOCHREADER, *PEPOCHREADER;
+
+// NOTE: Stays inside the epoch until told to leave.
+static DWORD WINAPI
+EpochReader(PVOID pParam)
+{
+    PEPOCHREADER pReader = (PEPOCHREADER)pParam;
+
+    EpochEnter(pReader->pEpoch);
+    InterlockedExchange(&pReader->lInside, 1);
+    while (0 == pReader->lLeave)
+    {
+        Sleep(1);
+    }
+    EpochExit(pReader->pEpoch);
+
+    return 0;
+}
+
+// NOTE: Looks up keys "user0" to "user99", which stay in the table, until
+// told to leave.
+static DWORD WINAPI
+ReadMostlyReader(PVOID pParam)
+{
+    PEPOCHREADER pReader           = (PEPOCHREADER)pParam;
+    CHAR         caKey[KEY_LENGTH] = {0};
+    WORD         wKeyLen           = 0;
+    PVOID        pFound            = NULL;
+
+    for (DWORD dwCounter = 0; 0 == pReader->lLeave; dwCounter++)
+    {
+        wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%lu",
+                                  dwCounter % 100);
+        if (!ShardedHashTableVisitEntry(pReader->pShardedTable, caKey, wKeyLen,
+                                        StoreData, &pFound))
+        {
+            pReader->dwMisses++;
+        }
+        InterlockedExchange(&pReader->lInside, 1);
+    }
+
+    return 0;
+}
+
 TEST_CLASS(HashTableTest){public :
                               TEST_METHOD(PrimeTest){Assert::IsTrue(IsPrime(7));
 Assert::IsTrue(IsPrime(11003));
@@ -107,7 +597,8 @@ TEST_METHOD(HashInitDestroy)
     WORD       wInitCapacity = 5;
     HASHTABLE *pHashTable    = NULL;
     Assert::AreEqual((int)SUCCESS,
-                     (int)HashTableInit(&pHashTable, wInitCapacity, NULL));
+                     (int)HashTableInit(&pHashTable, wInitCapacity, NULL,
+                                        HASHTABLE_CAPACITY_POW2));
     Assert::IsNotNull(pHashTable);
 
     Assert::AreEqual((int)SUCCESS, (int)HashTableDestroy(pHashTable, NULL));
@@ -117,7 +608,8 @@ TEST_METHOD(HashAddEntries)
     WORD       wInitCapacity = 5;
     HASHTABLE *pHashTable    = NULL;
     Assert::AreEqual((int)SUCCESS,
-                     (int)HashTableInit(&pHashTable, wInitCapacity, NULL));
+                     (int)HashTableInit(&pHashTable, wInitCapacity, NULL,
+                                        HASHTABLE_CAPACITY_POW2));
     Assert::IsNotNull(pHashTable);
 
     WORD wValue[3] = {1, 2, 3};
@@ -150,7 +642,8 @@ TEST_METHOD(LargeCapacity)
     WORD       wInitCapacity = 65534;
     HASHTABLE *pHashTable    = NULL;
     Assert::AreEqual((int)SUCCESS,
-                     (int)HashTableInit(&pHashTable, wInitCapacity, NULL));
+                     (int)HashTableInit(&pHashTable, wInitCapacity, NULL,
+                                        HASHTABLE_CAPACITY_POW2));
     Assert::IsNotNull(pHashTable);
 
     Assert::AreEqual((int)SUCCESS, (int)HashTableDestroy(pHashTable, NULL));
@@ -160,7 +653,8 @@ TEST_METHOD(ReHash)
     WORD       wInitCapacity = 5;
     HASHTABLE *pHashTable    = NULL;
     Assert::AreEqual((int)SUCCESS,
-                     (int)HashTableInit(&pHashTable, wInitCapacity, NULL));
+                     (int)HashTableInit(&pHashTable, wInitCapacity, NULL,
+                                        HASHTABLE_CAPACITY_POW2));
     Assert::IsNotNull(pHashTable);
 
     WORD wValue[3] = {1, 2, 3};
@@ -194,9 +688,1236 @@ TEST_METHOD(ReHash)
 
     Assert::AreEqual((int)SUCCESS, (int)HashTableDestroy(pHashTable, NULL));
 } // TEST_METHOD(ReHash)
+TEST_METHOD(RemoveReinsert)
+{
+    WORD       wInitCapacity = 5;
+    WORD       wEntries      = 2000;
+    HASHTABLE *pHashTable    = NULL;
+    Assert::AreEqual((int)SUCCESS,
+                     (int)HashTableInit(&pHashTable, wInitCapacity, NULL,
+                                        HASHTABLE_CAPACITY_POW2));
+    Assert::IsNotNull(pHashTable);
+
+    static WORD waValues[2000];
+    CHAR        caKey[KEY_LENGTH] = {0};
+    WORD        wKeyLen           = 0;
+
+    for (WORD wCounter = 0; wCounter < wEntries; wCounter++)
+    {
+        waValues[wCounter] = wCounter;
+        wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%hu", wCounter);
+        Assert::AreEqual((int)SUCCESS,
+                         (int)HashTableNewEntry(pHashTable, &waValues[wCounter],
+                                                caKey, wKeyLen));
+    }
+
+    // NOTE: Removing and re-inserting half the keys churns tombstones.
+    for (WORD wRound = 0; wRound < 4; wRound++)
+    {
+        for (WORD wCounter = 0; wCounter < wEntries; wCounter += 2)
+        {
+            wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%hu", wCounter);
+            Assert::IsTrue(&waValues[wCounter] ==
+                           HashTableDestroyEntry(pHashTable, caKey, wKeyLen));
+        }
+        Assert::AreEqual((int)(wEntries / 2), (int)pHashTable->m_dwSize);
+
+        for (WORD wCounter = 0; wCounter < wEntries; wCounter += 2)
+        {
+            wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%hu", wCounter);
+            Assert::AreEqual(
+                (int)SUCCESS,
+                (int)HashTableNewEntry(pHashTable, &waValues[wCounter], caKey,
+                                       wKeyLen));
+        }
+    }
+
+    for (WORD wCounter = 0; wCounter < wEntries; wCounter++)
+    {
+        wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%hu", wCounter);
+        Assert::IsTrue(&waValues[wCounter] ==
+                       HashTableReturnEntry(pHashTable, caKey, wKeyLen));
+    }
+
+    Assert::AreEqual((int)SUCCESS, (int)HashTableDestroy(pHashTable, NULL));
+} // TEST_METHOD(RemoveReinsert)
+TEST_METHOD(PrimeCapacity)
+{
+    Assert::AreEqual((DWORD)2, CapacityGroupCount(CAPACITY_PRIME, 1));
+    Assert::AreEqual((DWORD)131, CapacityGroupCount(CAPACITY_PRIME, 100));
+    Assert::AreEqual((DWORD)128, CapacityGroupCount(CAPACITY_POW2, 100));
+    Assert::AreEqual((DWORD)0, CapacityGroupCount(CAPACITY_PRIME, MAXDWORD));
+
+    HASHTABLE *pHashTable = NULL;
+    Assert::AreEqual((int)SUCCESS,
+                     (int)HashTableInit(&pHashTable, MIN_CAPACITY, NULL,
+                                        HASHTABLE_CAPACITY_PRIME));
+    Assert::IsNotNull(pHashTable);
+
+    static WORD waValues[3000];
+    CHAR        caKey[KEY_LENGTH] = {0};
+    WORD        wKeyLen           = 0;
+
+    for (WORD wCounter = 0; wCounter < 3000; wCounter++)
+    {
+        wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%hu", wCounter);
+        Assert::AreEqual((int)SUCCESS,
+                         (int)HashTableNewEntry(pHashTable, &waValues[wCounter],
+                                                caKey, wKeyLen));
+    }
+
+    Assert::IsTrue(IsPrime((WORD)pHashTable->m_Slots.m_Reduce.m_dwGroupCount));
+
+    for (WORD wCounter = 0; wCounter < 3000; wCounter++)
+    {
+        wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%hu", wCounter);
+        Assert::IsTrue(&waValues[wCounter] ==
+                       HashTableReturnEntry(pHashTable, caKey, wKeyLen));
+    }
+
+    Assert::AreEqual((int)SUCCESS, (int)HashTableDestroy(pHashTable, NULL));
+} // TEST_METHOD(PrimeCapacity)
+TEST_METHOD(ChurnAllocations)
+{
+    HASHTABLE *pHashTable = NULL;
+    Assert::AreEqual((int)SUCCESS, (int)HashTableInit(&pHashTable, 890, NULL,
+                                                      HASHTABLE_CAPACITY_POW2));
+    // NOTE: The slots and the value array.
+    Assert::AreEqual((DWORD)2, pHashTable->m_dwHeapAllocs);
+
+    static WORD waValues[890];
+    CHAR        caKey[KEY_LENGTH] = {0};
+    WORD        wKeyLen           = 0;
+    DWORD       dwAllocs          = 0;
+
+    for (DWORD dwCounter = 0; dwCounter < 890; dwCounter++)
+    {
+        wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%lu", dwCounter);
+        Assert::AreEqual((int)SUCCESS,
+                         (int)HashTableNewEntry(pHashTable,
+                                                &waValues[dwCounter], caKey,
+                                                wKeyLen));
+    }
+    Assert::AreEqual((DWORD)2, pHashTable->m_dwHeapAllocs);
+
+    // NOTE: Logins and logouts of different users. Just under half full, the
+    // table keeps filling with tombstones and re-hashing at the same size.
+    // The first re-hashes allocate, after that the spare array is re-used.
+    for (DWORD dwRound = 0; dwRound < 2; dwRound++)
+    {
+        if (1 == dwRound)
+        {
+            dwAllocs = pHashTable->m_dwHeapAllocs;
+        }
+
+        for (DWORD dwCounter = 0; dwCounter < 200000; dwCounter++)
+        {
+            DWORD dwOld = (dwRound * 200000) + dwCounter;
+
+            wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%lu", dwOld);
+            Assert::IsTrue(&waValues[dwOld % 890] ==
+                           HashTableDestroyEntry(pHashTable, caKey, wKeyLen));
+
+            wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%lu",
+                                      dwOld + 890);
+            Assert::AreEqual((int)SUCCESS,
+                             (int)HashTableNewEntry(pHashTable,
+                                                    &waValues[dwOld % 890],
+                                                    caKey, wKeyLen));
+        }
+    }
+    Assert::AreEqual(dwAllocs, pHashTable->m_dwHeapAllocs);
+    Assert::AreEqual((DWORD)890, pHashTable->m_dwSize);
+
+    Assert::AreEqual((int)SUCCESS, (int)HashTableDestroy(pHashTable, NULL));
+} // TEST_METHOD(ChurnAllocations)
+TEST_METHOD(DenseValues)
+{
+    HASHTABLE *pHashTable = NULL;
+    Assert::AreEqual((int)SUCCESS,
+                     (int)HashTableInit(&pHashTable, MIN_CAPACITY, NULL,
+                                        HASHTABLE_CAPACITY_POW2));
+
+    static BYTE     baSeen[3000];
+    CHAR            caKey[KEY_LENGTH] = {0};
+    WORD            wKeyLen           = 0;
+    DWORD           dwCount           = 0;
+    PVOID          *ppValues          = NULL;
+    PBYTE           pData             = NULL;
+    HASHTABLECURSOR Cursor            = {0};
+
+    // NOTE: Growing from the minimum capacity leaves entries mid migration
+    // while others are removed, every move has to keep the array dense.
+    for (DWORD dwCounter = 0; dwCounter < 3000; dwCounter++)
+    {
+        wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%lu", dwCounter);
+        Assert::AreEqual((int)SUCCESS,
+                         (int)HashTableNewEntry(pHashTable, &baSeen[dwCounter],
+                                                caKey, wKeyLen));
+
+        if ((0 == (dwCounter % 3)) && (0 < dwCounter))
+        {
+            wKeyLen =
+                (WORD)sprintf_s(caKey, KEY_LENGTH, "user%lu", dwCounter / 3);
+            Assert::IsTrue(&baSeen[dwCounter / 3] ==
+                           HashTableDestroyEntry(pHashTable, caKey, wKeyLen));
+        }
+    }
+
+    ppValues = HashTableValues(pHashTable, &dwCount);
+    Assert::AreEqual(pHashTable->m_dwSize, dwCount);
+    for (DWORD dwCounter = 0; dwCounter < dwCount; dwCounter++)
+    {
+        Assert::IsTrue(pHashTable->m_ppValueEntries[dwCounter]->m_pData ==
+                       ppValues[dwCounter]);
+    }
+
+    HashTableCursorInit(pHashTable, &Cursor);
+    while (NULL != (pData = (PBYTE)HashTableCursorNext(&Cursor)))
+    {
+        *pData += 1;
+    }
+
+    for (DWORD dwCounter = 0; dwCounter < 3000; dwCounter++)
+    {
+        BOOL bRemoved = (0 < dwCounter) && (dwCounter <= 999);
+
+        Assert::AreEqual(bRemoved ? 0 : 1, (int)baSeen[dwCounter]);
+    }
+
+    Assert::AreEqual((int)SUCCESS, (int)HashTableDestroy(pHashTable, NULL));
+} // TEST_METHOD(DenseValues)
+TEST_METHOD(BatchLookup)
+{
+    HASHTABLE *pHashTable = NULL;
+    Assert::AreEqual((int)SUCCESS,
+                     (int)HashTableInit(&pHashTable, MIN_CAPACITY, NULL,
+                                        HASHTABLE_CAPACITY_POW2));
+
+    static WORD waValues[500];
+    static CHAR caaKeys[700][KEY_LENGTH];
+    PCHAR       pszaKeys[700]  = {0};
+    WORD        waKeyLens[700] = {0};
+    PVOID       paData[700]    = {0};
+
+    // NOTE: 500 inserts from the minimum capacity leave the table part way
+    // through a migration.
+    for (WORD wCounter = 0; wCounter < 700; wCounter++)
+    {
+        pszaKeys[wCounter]  = caaKeys[wCounter];
+        waKeyLens[wCounter] = (WORD)sprintf_s(caaKeys[wCounter], KEY_LENGTH,
+                                              "user%hu", wCounter);
+        if (wCounter < 500)
+        {
+            Assert::AreEqual((int)SUCCESS,
+                             (int)HashTableNewEntry(pHashTable,
+                                                    &waValues[wCounter],
+                                                    pszaKeys[wCounter],
+                                                    waKeyLens[wCounter]));
+        }
+    }
+    pszaKeys[3]  = NULL;
+    waKeyLens[4] = KEY_LENGTH + 1;
+
+    Assert::AreEqual((DWORD)498, HashTableReturnEntries(pHashTable, pszaKeys,
+                                                        waKeyLens, 700,
+                                                        paData));
+    for (WORD wCounter = 0; wCounter < 700; wCounter++)
+    {
+        BOOL bFound = (wCounter < 500) && (3 != wCounter) && (4 != wCounter);
+
+        Assert::IsTrue((bFound ? &waValues[wCounter] : NULL) ==
+                       paData[wCounter]);
+    }
+
+    Assert::AreEqual((int)SUCCESS, (int)HashTableDestroy(pHashTable, NULL));
+} // TEST_METHOD(BatchLookup)
+// NOTE: Keys from the longest allowed down to one byte, each pair differing
+// only in its last byte, so every offset of the wide compare gets checked.
+TEST_METHOD(LongKeys)
+{
+    HASHTABLE *pHashTable = NULL;
+    Assert::AreEqual((int)SUCCESS,
+                     (int)HashTableInit(&pHashTable, MIN_CAPACITY, NULL,
+                                        HASHTABLE_CAPACITY_POW2));
+
+    static WORD waValues[KEY_LENGTH + 1][2];
+    CHAR        caKey[KEY_LENGTH] = {0};
+
+    FillMemory(caKey, KEY_LENGTH, 'k');
+    for (WORD wKeyLen = 1; wKeyLen <= KEY_LENGTH; wKeyLen++)
+    {
+        for (WORD wLast = 0; wLast < 2; wLast++)
+        {
+            caKey[wKeyLen - 1] = (CHAR)('a' + wLast);
+            Assert::AreEqual((int)SUCCESS,
+                             (int)HashTableNewEntry(pHashTable,
+                                                    &waValues[wKeyLen][wLast],
+                                                    caKey, wKeyLen));
+        }
+        caKey[wKeyLen - 1] = 'k';
+    }
+
+    for (WORD wKeyLen = 1; wKeyLen <= KEY_LENGTH; wKeyLen++)
+    {
+        for (WORD wLast = 0; wLast < 2; wLast++)
+        {
+            caKey[wKeyLen - 1] = (CHAR)('a' + wLast);
+            Assert::IsTrue(&waValues[wKeyLen][wLast] ==
+                           HashTableReturnEntry(pHashTable, caKey, wKeyLen));
+        }
+        caKey[wKeyLen - 1] = 'k';
+        Assert::IsNull(HashTableReturnEntry(pHashTable, caKey, wKeyLen));
+    }
+
+    Assert::AreEqual((int)SUCCESS, (int)HashTableDestroy(pHashTable, NULL));
+} // TEST_METHOD(LongKeys)
+TEST_METHOD(ShrinkMaintenance)
+{
+    HASHTABLE *pHashTable = NULL;
+    Assert::AreEqual((int)SUCCESS,
+                     (int)HashTableInit(&pHashTable, MIN_CAPACITY, NULL,
+                                        HASHTABLE_CAPACITY_POW2));
+
+    static WORD waValues[4000];
+    CHAR        caKey[KEY_LENGTH] = {0};
+    WORD        wKeyLen           = 0;
+    DWORD       dwPeak            = 0;
+    DWORD       dwShrunk          = 0;
+
+    for (DWORD dwCounter = 0; dwCounter < 4000; dwCounter++)
+    {
+        wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%lu", dwCounter);
+        Assert::AreEqual((int)SUCCESS,
+                         (int)HashTableNewEntry(pHashTable,
+                                                &waValues[dwCounter], caKey,
+                                                wKeyLen));
+    }
+    Assert::AreEqual((int)SUCCESS, (int)HashTableMaintenance(pHashTable));
+    dwPeak = pHashTable->m_Slots.m_dwCapacity;
+
+    // NOTE: Removals alone never shrink the table.
+    for (DWORD dwCounter = 100; dwCounter < 4000; dwCounter++)
+    {
+        wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%lu", dwCounter);
+        Assert::IsTrue(&waValues[dwCounter] ==
+                       HashTableDestroyEntry(pHashTable, caKey, wKeyLen));
+    }
+    Assert::AreEqual(dwPeak, pHashTable->m_Slots.m_dwCapacity);
+
+    Assert::AreEqual((int)SUCCESS, (int)HashTableMaintenance(pHashTable));
+    dwShrunk = pHashTable->m_Slots.m_dwCapacity;
+    Assert::IsTrue(dwShrunk < dwPeak);
+    Assert::IsNull(pHashTable->m_OldSlots.m_pCtrl);
+    Assert::IsTrue(pHashTable->m_dwValueCapacity <= 400);
+
+    // NOTE: Hysteresis, a shrunk table is left alone until it has doubled or
+    // halved.
+    Assert::AreEqual((int)SUCCESS, (int)HashTableMaintenance(pHashTable));
+    Assert::AreEqual(dwShrunk, pHashTable->m_Slots.m_dwCapacity);
+    for (DWORD dwCounter = 100; dwCounter < 150; dwCounter++)
+    {
+        wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%lu", dwCounter);
+        Assert::AreEqual((int)SUCCESS,
+                         (int)HashTableNewEntry(pHashTable,
+                                                &waValues[dwCounter], caKey,
+                                                wKeyLen));
+    }
+    Assert::AreEqual(dwShrunk, pHashTable->m_Slots.m_dwCapacity);
+
+    for (DWORD dwCounter = 0; dwCounter < 150; dwCounter++)
+    {
+        wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%lu", dwCounter);
+        Assert::IsTrue(&waValues[dwCounter] ==
+                       HashTableReturnEntry(pHashTable, caKey, wKeyLen));
+    }
+
+    Assert::AreEqual((int)SUCCESS, (int)HashTableDestroy(pHashTable, NULL));
+} // TEST_METHOD(ShrinkMaintenance)
+static void IdMapFree(PVOID pData) { (*(PDWORD)pData)++; }
+TEST_METHOD(IntegerMap)
+{
+    PIDMAP       pMap = NULL;
+    static DWORD dwaValues[4000];
+    DWORD        dwPeak = 0;
+
+    Assert::AreEqual((int)SUCCESS, (int)IdMapInit(&pMap, 0));
+
+    // NOTE: Socket values step by four, the mix still has to spread them.
+    for (DWORD dwCounter = 0; dwCounter < 4000; dwCounter++)
+    {
+        Assert::AreEqual((int)SUCCESS,
+                         (int)IdMapInsert(pMap, (ULONGLONG)dwCounter * 4,
+                                          &dwaValues[dwCounter]));
+    }
+    Assert::AreEqual((int)ERR_INVALID_PARAM,
+                     (int)IdMapInsert(pMap, 8, &dwaValues[0]));
+    Assert::AreEqual((int)ERR_GENERIC, (int)IdMapInsert(pMap, 1, NULL));
+    Assert::AreEqual((DWORD)4000, IdMapSize(pMap));
+    dwPeak = pMap->m_dwMask + 1;
+
+    // NOTE: Removing every other key shifts later entries of a probe run back
+    // into the holes, the rest must all stay reachable.
+    for (DWORD dwCounter = 1; dwCounter < 4000; dwCounter += 2)
+    {
+        Assert::IsTrue(&dwaValues[dwCounter] ==
+                       IdMapRemove(pMap, (ULONGLONG)dwCounter * 4));
+    }
+    Assert::IsNull(IdMapRemove(pMap, 4));
+    for (DWORD dwCounter = 0; dwCounter < 4000; dwCounter++)
+    {
+        PVOID pExpected = (dwCounter & 1) ? NULL : &dwaValues[dwCounter];
+        Assert::IsTrue(pExpected ==
+                       IdMapFind(pMap, (ULONGLONG)dwCounter * 4));
+    }
+
+    // NOTE: Half full is not sparse enough to shrink, a tenth is.
+    Assert::AreEqual((int)SUCCESS, (int)IdMapMaintenance(pMap));
+    Assert::AreEqual(dwPeak, pMap->m_dwMask + 1);
+    for (DWORD dwCounter = 0; dwCounter < 3600; dwCounter += 2)
+    {
+        Assert::IsTrue(&dwaValues[dwCounter] ==
+                       IdMapRemove(pMap, (ULONGLONG)dwCounter * 4));
+    }
+    Assert::AreEqual((int)SUCCESS, (int)IdMapMaintenance(pMap));
+    Assert::IsTrue((pMap->m_dwMask + 1) < dwPeak);
+    Assert::AreEqual((DWORD)200, IdMapSize(pMap));
+    for (DWORD dwCounter = 3600; dwCounter < 4000; dwCounter += 2)
+    {
+        Assert::IsTrue(&dwaValues[dwCounter] ==
+                       IdMapFind(pMap, (ULONGLONG)dwCounter * 4));
+    }
+
+    ZeroMemory(dwaValues, sizeof(dwaValues));
+    Assert::AreEqual((int)SUCCESS, (int)IdMapDestroy(pMap, IdMapFree));
+    for (DWORD dwCounter = 0; dwCounter < 4000; dwCounter++)
+    {
+        DWORD dwExpected = ((dwCounter >= 3600) && !(dwCounter & 1)) ? 1 : 0;
+        Assert::AreEqual(dwExpected, dwaValues[dwCounter]);
+    }
+} // TEST_METHOD(IntegerMap)
+// NOTE: Built in Debug, where the projects define HASHTABLE_STATS.
+#ifdef HASHTABLE_STATS
+TEST_METHOD(Statistics)
+{
+    HASHTABLE *pHashTable = NULL;
+    Assert::AreEqual((int)SUCCESS,
+                     (int)HashTableInit(&pHashTable, MIN_CAPACITY, NULL,
+                                        HASHTABLE_CAPACITY_POW2));
+
+    static WORD    waValues[1100];
+    CHAR           caKey[KEY_LENGTH] = {0};
+    WORD           wKeyLen           = 0;
+    HASHTABLESTATS Stats             = {0};
+    DWORD          dwHistogram       = 0;
+
+    for (DWORD dwCounter = 0; dwCounter < 1100; dwCounter++)
+    {
+        wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%lu", dwCounter);
+        if (dwCounter < 1000)
+        {
+            Assert::AreEqual((int)SUCCESS,
+                             (int)HashTableNewEntry(pHashTable,
+                                                    &waValues[dwCounter],
+                                                    caKey, wKeyLen));
+        }
+    }
+    for (DWORD dwCounter = 0; dwCounter < 1100; dwCounter++)
+    {
+        wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%lu", dwCounter);
+        HashTableReturnEntry(pHashTable, caKey, wKeyLen);
+    }
+    for (DWORD dwCounter = 0; dwCounter < 10; dwCounter++)
+    {
+        wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%lu", dwCounter);
+        Assert::IsNotNull(HashTableDestroyEntry(pHashTable, caKey, wKeyLen));
+    }
+
+    HashTableGetStats(pHashTable, &Stats);
+    Assert::AreEqual((DWORD)990, Stats.m_dwSize);
+    Assert::AreEqual((ULONGLONG)1000, Stats.m_ullInserts);
+    Assert::AreEqual((ULONGLONG)10, Stats.m_ullRemoves);
+    Assert::AreEqual((ULONGLONG)1100, Stats.m_ullLookups);
+    Assert::AreEqual((ULONGLONG)100, Stats.m_ullLookupMisses);
+    Assert::IsTrue(Stats.m_ullLookupGroups >= Stats.m_ullLookups);
+    Assert::IsTrue(Stats.m_ullMissGroups >= Stats.m_ullLookupMisses);
+    Assert::IsTrue(0 < Stats.m_ullReHashes);
+    Assert::IsTrue(0 < Stats.m_dwMaxProbe);
+    Assert::IsTrue(Stats.m_dwSize <= Stats.m_dwCapacity);
+
+    for (DWORD dwBucket = 0; dwBucket < HASHTABLE_STATS_PROBES; dwBucket++)
+    {
+        dwHistogram += Stats.m_adwProbeHistogram[dwBucket];
+    }
+    Assert::AreEqual(Stats.m_dwSize, dwHistogram);
+
+    Assert::AreEqual((int)SUCCESS, (int)HashTableDestroy(pHashTable, NULL));
+} // TEST_METHOD(Statistics)
+#endif // HASHTABLE_STATS
+// NOTE: Hashes only cover wKeyLen bytes, so binary keys full of zero bytes
+// (e.g. SOCKETs) still spread and never read past the key.
+TEST_METHOD(BinaryKeys)
+{
+    BYTE      baKey[16] = {0};
+    ULONGLONG ullSeed   = 0;
+
+    Assert::IsTrue(HashTableProcessSeed(&ullSeed));
+    for (WORD wKeyLen = 1; wKeyLen < sizeof(baKey); wKeyLen++)
+    {
+        Assert::AreNotEqual(HashTableDefaultHash(baKey, wKeyLen, ullSeed),
+                            HashTableDefaultHash(baKey, wKeyLen + 1, ullSeed));
+    }
+    Assert::AreNotEqual(HashTableDefaultHash(baKey, 8, 1),
+                        HashTableDefaultHash(baKey, 8, 2));
+
+    HASHTABLE *pHashTable = NULL;
+    Assert::AreEqual((int)SUCCESS,
+                     (int)HashTableInit(&pHashTable, MIN_CAPACITY, NULL,
+                                        HASHTABLE_CAPACITY_POW2));
+
+    static ULONGLONG ullaSockets[1000];
+    for (DWORD dwCounter = 0; dwCounter < 1000; dwCounter++)
+    {
+        ullaSockets[dwCounter] = (ULONGLONG)(dwCounter * 4) + 0x100;
+        Assert::AreEqual(
+            (int)SUCCESS,
+            (int)HashTableNewEntry(pHashTable, &ullaSockets[dwCounter],
+                                   (PCHAR)&ullaSockets[dwCounter],
+                                   sizeof(ULONGLONG)));
+    }
+
+    for (DWORD dwCounter = 0; dwCounter < 1000; dwCounter++)
+    {
+        ULONGLONG ullKey = ullaSockets[dwCounter];
+        Assert::IsTrue(&ullaSockets[dwCounter] ==
+                       HashTableReturnEntry(pHashTable, (PCHAR)&ullKey,
+                                            sizeof(ULONGLONG)));
+    }
+
+    Assert::AreEqual((int)SUCCESS, (int)HashTableDestroy(pHashTable, NULL));
+} // TEST_METHOD(BinaryKeys)
+TEST_METHOD(ShardedTable)
+{
+    SHARDEDHASHTABLE *pShardedTable = NULL;
+    Assert::AreEqual((int)SUCCESS,
+                     (int)ShardedHashTableInit(&pShardedTable, MIN_CAPACITY,
+                                               NULL, HASHTABLE_CAPACITY_POW2));
+    Assert::IsNotNull(pShardedTable);
+
+    static WORD waValues[2000];
+    CHAR        caKey[KEY_LENGTH] = {0};
+    WORD        wKeyLen           = 0;
+
+    for (WORD wCounter = 0; wCounter < 2000; wCounter++)
+    {
+        wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%hu", wCounter);
+        Assert::AreEqual((int)SUCCESS,
+                         (int)ShardedHashTableNewEntry(pShardedTable,
+                                                       &waValues[wCounter],
+                                                       caKey, wKeyLen));
+    }
+    Assert::AreEqual((DWORD)2000, ShardedHashTableSize(pShardedTable));
+
+    // NOTE: A taken key is told apart from a failed insert.
+    Assert::AreEqual((int)DUPLICATE_KEY,
+                     (int)ShardedHashTableNewEntry(pShardedTable, &waValues[0],
+                                                   caKey, wKeyLen));
+    Assert::AreEqual((DWORD)2000, ShardedHashTableSize(pShardedTable));
+
+    // NOTE: Every shard should have taken part of the keys.
+    for (DWORD dwShard = 0; dwShard < SHARD_COUNT; dwShard++)
+    {
+        Assert::AreNotEqual(
+            (DWORD)0, pShardedTable->m_aShards[dwShard].m_pHashTable->m_dwSize);
+    }
+
+    for (WORD wCounter = 0; wCounter < 2000; wCounter += 2)
+    {
+        wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%hu", wCounter);
+        Assert::IsTrue(&waValues[wCounter] ==
+                       ShardedHashTableDestroyEntry(pShardedTable, caKey,
+                                                    wKeyLen));
+    }
+    Assert::AreEqual((DWORD)1000, ShardedHashTableSize(pShardedTable));
+
+    for (WORD wCounter = 0; wCounter < 2000; wCounter++)
+    {
+        PVOID pFound = NULL;
+        wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%hu", wCounter);
+        BOOL bFound = ShardedHashTableVisitEntry(pShardedTable, caKey, wKeyLen,
+                                                 StoreData, &pFound);
+
+        Assert::AreEqual((BOOL)(wCounter % 2), bFound);
+        Assert::IsTrue((wCounter % 2) ? (&waValues[wCounter] == pFound)
+                                      : (NULL == pFound));
+    }
+
+    DWORD dwVisited = 0;
+    ShardedHashTableForEach(pShardedTable, CountData, &dwVisited);
+    Assert::AreEqual((DWORD)1000, dwVisited);
+
+    Assert::AreEqual((int)SUCCESS,
+                     (int)ShardedHashTableDestroy(pShardedTable, NULL));
+} // TEST_METHOD(ShardedTable)
+TEST_METHOD(EpochReclamation)
+{
+    PEPOCH      pEpoch  = NULL;
+    LONG        lFreed  = 0;
+    EPOCHREADER Reader  = {0};
+    HANDLE      hReader = NULL;
+
+    Assert::AreEqual((int)SUCCESS, (int)EpochInit(&pEpoch));
+
+    // NOTE: With no reader inside, the global epoch moves on every reclaim.
+    EpochRetire(pEpoch, &lFreed, CountFree);
+    for (DWORD dwCounter = 0; (dwCounter < 4) && (0 == lFreed); dwCounter++)
+    {
+        EpochReclaim(pEpoch);
+    }
+    Assert::AreEqual((LONG)1, lFreed);
+
+    Reader.pEpoch = pEpoch;
+    hReader       = CreateThread(NULL, 0, EpochReader, &Reader, 0, NULL);
+    Assert::IsNotNull(hReader);
+    while (0 == Reader.lInside)
+    {
+        Sleep(1);
+    }
+
+    // NOTE: A reader that entered before the retire holds it back.
+    EpochRetire(pEpoch, &lFreed, CountFree);
+    for (DWORD dwCounter = 0; dwCounter < 4; dwCounter++)
+    {
+        EpochReclaim(pEpoch);
+    }
+    Assert::AreEqual((LONG)1, lFreed);
+
+    InterlockedExchange(&Reader.lLeave, 1);
+    WaitForSingleObject(hReader, INFINITE);
+    CloseHandle(hReader);
+
+    for (DWORD dwCounter = 0; (dwCounter < 4) && (1 == lFreed); dwCounter++)
+    {
+        EpochReclaim(pEpoch);
+    }
+    Assert::AreEqual((LONG)2, lFreed);
+
+    // NOTE: Deferring never frees, the next reclaim does.
+    EpochDefer(pEpoch, &lFreed, CountFree);
+    Assert::AreEqual((LONG)2, lFreed);
+    for (DWORD dwCounter = 0; (dwCounter < 4) && (2 == lFreed); dwCounter++)
+    {
+        EpochReclaim(pEpoch);
+    }
+    Assert::AreEqual((LONG)3, lFreed);
+
+    // NOTE: Destroying frees whatever is still retired.
+    EpochRetire(pEpoch, &lFreed, CountFree);
+    EpochDestroy(pEpoch);
+    Assert::AreEqual((LONG)4, lFreed);
+} // TEST_METHOD(EpochReclamation)
+TEST_METHOD(ReadMostlyTable)
+{
+    SHARDEDHASHTABLE *pShardedTable = NULL;
+    Assert::AreEqual((int)SUCCESS,
+                     (int)ShardedHashTableInit(&pShardedTable, MIN_CAPACITY,
+                                               NULL,
+                                               HASHTABLE_CAPACITY_POW2 |
+                                                   HASHTABLE_READ_MOSTLY));
+    Assert::IsNotNull(pShardedTable->m_pEpoch);
+
+    static WORD waValues[4000];
+    CHAR        caKey[KEY_LENGTH] = {0};
+    WORD        wKeyLen           = 0;
+    EPOCHREADER Reader            = {0};
+    HANDLE      hReader           = NULL;
+
+    for (WORD wCounter = 0; wCounter < 100; wCounter++)
+    {
+        wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%hu", wCounter);
+        Assert::AreEqual((int)SUCCESS,
+                         (int)ShardedHashTableNewEntry(pShardedTable,
+                                                       &waValues[wCounter],
+                                                       caKey, wKeyLen));
+    }
+
+    Reader.pShardedTable = pShardedTable;
+    hReader = CreateThread(NULL, 0, ReadMostlyReader, &Reader, 0, NULL);
+    Assert::IsNotNull(hReader);
+    while (0 == Reader.lInside)
+    {
+        Sleep(1);
+    }
+
+    // NOTE: Every shard re-hashes several times, fills with tombstones and
+    // is shrunk again while the reader is looking up the first hundred keys.
+    for (WORD wRound = 0; wRound < 2; wRound++)
+    {
+        for (WORD wCounter = 100; wCounter < 4000; wCounter++)
+        {
+            wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%hu", wCounter);
+            Assert::AreEqual((int)SUCCESS,
+                             (int)ShardedHashTableNewEntry(
+                                 pShardedTable, &waValues[wCounter], caKey,
+                                 wKeyLen));
+        }
+        for (WORD wCounter = 100; wCounter < 4000; wCounter++)
+        {
+            wKeyLen = (WORD)sprintf_s(caKey, KEY_LENGTH, "user%hu", wCounter);
+            Assert::IsTrue(&waValues[wCounter] ==
+                           ShardedHashTableDestroyEntry(pShardedTable, caKey,
+                                                        wKeyLen));
+        }
+        ShardedHashTableMaintenance(pShardedTable);
+    }
+
+    InterlockedExchange(&Reader.lLeave, 1);
+    WaitForSingleObject(hReader, INFINITE);
+    CloseHandle(hReader);
+    Assert::AreEqual((DWORD)0, Reader.dwMisses);
+    Assert::AreEqual((DWORD)100, ShardedHashTableSize(pShardedTable));
+
+    DWORD dwVisited = 0;
+    ShardedHashTableForEach(pShardedTable, CountData, &dwVisited);
+    Assert::AreEqual((DWORD)100, dwVisited);
+
+    LONG lFreed = 0;
+    ShardedHashTableRetire(pShardedTable, &lFreed, CountFree);
+    Assert::AreEqual((int)SUCCESS,
+                     (int)ShardedHashTableDestroy(pShardedTable, NULL));
+    Assert::AreEqual((LONG)1, lFreed);
+} // TEST_METHOD(ReadMostlyTable)
 } // TEST_CLASS(HashTableTest)
 ;
 
+TEST_CLASS(MessagesTest){public :
+
+// NOTE: Covers every kernel's block and tail sizes, from unaligned buffers,
+// and checks a copy converts only its own characters.
+TEST_METHOD(WideByteOrder)
+{
+    WCHAR caSource[100];
+    WCHAR caDest[100];
+
+    for (INT iOffset = 0; iOffset < 2; iOffset++)
+    {
+        for (INT iLen = 0; iLen <= 80; iLen++)
+        {
+            PWCHAR pSource = caSource + iOffset;
+            PWCHAR pDest   = caDest + iOffset;
+
+            for (INT iCounter = 0; iCounter < 90; iCounter++)
+            {
+                pSource[iCounter] = (WCHAR)(0x1234 + (iCounter * 0x0F1));
+                pDest[iCounter]   = L'#';
+            }
+
+            WstrHostToNetCopy(pDest, pSource, iLen);
+            for (INT iCounter = 0; iCounter < iLen; iCounter++)
+            {
+                WCHAR Expected = (WCHAR)(0x1234 + (iCounter * 0x0F1));
+
+                Assert::AreEqual(Expected, pSource[iCounter]);
+                Assert::AreEqual((WCHAR)((Expected >> 8) | (Expected << 8)),
+                                 pDest[iCounter]);
+            }
+            Assert::AreEqual((WCHAR)L'#', pDest[iLen]);
+
+            WstrNetToHost(pDest, iLen);
+            for (INT iCounter = 0; iCounter < iLen; iCounter++)
+            {
+                Assert::AreEqual(pSource[iCounter], pDest[iCounter]);
+            }
+            Assert::AreEqual((WCHAR)L'#', pDest[iLen]);
+
+            WstrNetToHostCopy(pDest, pSource, iLen);
+            WstrHostToNet(pDest, iLen);
+            for (INT iCounter = 0; iCounter < iLen; iCounter++)
+            {
+                Assert::AreEqual(pSource[iCounter], pDest[iCounter]);
+            }
+        }
+    }
+} // TEST_METHOD(WideByteOrder)
+} // TEST_CLASS(MessagesTest)
+;
+
+// NOTE: A user with its send queue set up and no socket, so the queue can be
+// driven directly.
+typedef struct SENDQUEUEUSER
+{
+    USERS Users;
+    USER  User;
+} SENDQUEUEUSER, *PSENDQUEUEUSER;
+
+static PSENDQUEUEUSER
+SendQueueUserCreate(DWORD dwMsgs, DWORD dwBytes, DWORD dwPolicy)
+{
+    PSENDQUEUEUSER pQueueUser = (PSENDQUEUEUSER)HeapAlloc(
+        GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(SENDQUEUEUSER));
+    if (NULL == pQueueUser)
+    {
+        return NULL;
+    }
+
+    pQueueUser->Users.m_dwSendQueueMsgs  = dwMsgs;
+    pQueueUser->Users.m_dwSendQueueBytes = dwBytes;
+    pQueueUser->Users.m_dwSendPolicy     = dwPolicy;
+    MsgPoolsInit(&pQueueUser->Users.m_MsgPools);
+    pQueueUser->User.m_pUsers = &pQueueUser->Users;
+    SendLanesInit(&pQueueUser->User);
+    return pQueueUser;
+}
+
+static VOID
+SendQueueUserDestroy(PSENDQUEUEUSER pQueueUser)
+{
+    SendLanesClear(&pQueueUser->User);
+    MsgPoolsDestroy(&pQueueUser->Users.m_MsgPools);
+    HeapFree(GetProcessHeap(), NO_OPTION, pQueueUser);
+}
+
+// NOTE: Queues a message with wLen characters of text the way
+// ManageBodyMsgQueueAdd does, short of starting the send.
+static HRESULT
+QueueTestMsg(PUSER pUser, INT8 iSendClass, WORD wLen)
+{
+    static WCHAR caText[BUFF_SIZE];
+    for (WORD wCounter = 0; wCounter < wLen; wCounter++)
+    {
+        caText[wCounter] = L'a' + (wCounter % 26);
+    }
+
+    HRESULT hResult = SendQueueReserve(pUser, iSendClass,
+                                       HEADER_LEN + (wLen * sizeof(WCHAR)));
+    if (S_OK != hResult)
+    {
+        return hResult;
+    }
+
+    PMSGPOOLS pPools = &pUser->m_pUsers->m_MsgPools;
+    PMSGBODY  pBody  = CreateMsgBody(pPools, wLen, 0, caText, caText);
+    AddMsgToQueue(pUser, iSendClass, TYPE_CHAT, STYPE_EMPTY, OPCODE_RES, wLen,
+                  0, pBody);
+    ReleaseMsgBody(pPools, pBody);
+    return S_OK;
+}
+
+// NOTE: The text length of the batch's dwMsg message.
+static WORD
+BatchMsgLen(PUSER pUser, DWORD dwMsg)
+{
+    return (WORD)(pUser->m_SendBatch.m_apMsgs[dwMsg]
+                      ->m_wsaBuffer[BODY_INDEX_1]
+                      .len /
+                  sizeof(WCHAR));
+}
+
+// NOTE: Sends nothing, only pops and frees every batch as a completed send
+// would. Returns the number of messages popped.
+static DWORD
+DrainSendQueue(PUSER pUser)
+{
+    DWORD dwDrained = 0;
+    DWORD dwMsgs    = 0;
+    while (0 != (dwMsgs = FillSendBatch(pUser)))
+    {
+        dwDrained += dwMsgs;
+        ReleaseSendBatch(pUser);
+    }
+
+    return dwDrained;
+}
+
+TEST_CLASS(SendQueueTest){public :
+
+// NOTE: Under SEND_POLICY_DROP_OLDEST the oldest broadcasts make room for
+// new messages, which otherwise queue in order.
+TEST_METHOD(SendQueueCaps)
+{
+    PSENDQUEUEUSER pQueueUser =
+        SendQueueUserCreate(4, MAXDWORD / 2, SEND_POLICY_DROP_OLDEST);
+    Assert::IsNotNull(pQueueUser);
+    PUSER pUser = &pQueueUser->User;
+
+    for (WORD wLen = 1; wLen <= 4; wLen++)
+    {
+        Assert::AreEqual(S_OK,
+                         QueueTestMsg(pUser, SEND_CLASS_BROADCAST, wLen));
+    }
+    Assert::AreEqual(S_OK, QueueTestMsg(pUser, SEND_CLASS_DIRECT, 5));
+    Assert::AreEqual(S_OK, QueueTestMsg(pUser, SEND_CLASS_BROADCAST, 6));
+    Assert::AreEqual((LONG)4, pUser->m_lQueuedMsgs);
+    Assert::AreEqual(
+        (LONG64)2, pQueueUser->Users.m_SendQueueStats.m_llBroadcastsDropped);
+
+    // NOTE: The direct lane goes first, then the broadcasts left.
+    Assert::AreEqual((DWORD)4, FillSendBatch(pUser));
+    WORD waExpected[4] = {5, 3, 4, 6};
+    for (DWORD dwMsg = 0; dwMsg < 4; dwMsg++)
+    {
+        Assert::AreEqual(waExpected[dwMsg], BatchMsgLen(pUser, dwMsg));
+    }
+    ReleaseSendBatch(pUser);
+    Assert::AreEqual((LONG)0, pUser->m_lQueuedMsgs);
+    Assert::AreEqual((LONG)0, pUser->m_lQueuedBytes);
+
+    // NOTE: The byte cap drops the same way.
+    pQueueUser->Users.m_dwSendQueueBytes = 2 * (HEADER_LEN + 20);
+    Assert::AreEqual(S_OK, QueueTestMsg(pUser, SEND_CLASS_BROADCAST, 10));
+    Assert::AreEqual(S_OK, QueueTestMsg(pUser, SEND_CLASS_BROADCAST, 10));
+    Assert::AreEqual(S_OK, QueueTestMsg(pUser, SEND_CLASS_DIRECT, 10));
+    Assert::AreEqual((LONG)2, pUser->m_lQueuedMsgs);
+    Assert::AreEqual(
+        (LONG64)3, pQueueUser->Users.m_SendQueueStats.m_llBroadcastsDropped);
+    Assert::AreEqual((DWORD)2, DrainSendQueue(pUser));
+
+    SendQueueUserDestroy(pQueueUser);
+} // TEST_METHOD(SendQueueCaps)
+
+// NOTE: Direct messages are turned back to their sender, anything else that
+// doesn't fit is dropped.
+TEST_METHOD(SendPolicyReject)
+{
+    PSENDQUEUEUSER pQueueUser =
+        SendQueueUserCreate(2, MAXDWORD / 2, SEND_POLICY_REJECT);
+    Assert::IsNotNull(pQueueUser);
+    PUSER pUser = &pQueueUser->User;
+
+    Assert::AreEqual(S_OK, QueueTestMsg(pUser, SEND_CLASS_BROADCAST, 1));
+    Assert::AreEqual(S_OK, QueueTestMsg(pUser, SEND_CLASS_DIRECT, 2));
+    Assert::AreEqual(SEND_QUEUE_FULL,
+                     QueueTestMsg(pUser, SEND_CLASS_DIRECT, 3));
+    Assert::AreEqual(S_FALSE, QueueTestMsg(pUser, SEND_CLASS_BROADCAST, 4));
+    Assert::AreEqual(
+        (LONG64)1, pQueueUser->Users.m_SendQueueStats.m_llDirectRejected);
+    Assert::AreEqual((LONG64)1,
+                     pQueueUser->Users.m_SendQueueStats.m_llMsgsDropped);
+    Assert::AreEqual(
+        (LONG64)0, pQueueUser->Users.m_SendQueueStats.m_llBroadcastsDropped);
+    Assert::AreEqual((LONG)2, pUser->m_lQueuedMsgs);
+    Assert::AreEqual((DWORD)2, DrainSendQueue(pUser));
+
+    SendQueueUserDestroy(pQueueUser);
+} // TEST_METHOD(SendPolicyReject)
+
+// NOTE: The first overflow asks for the user to be disconnected, the rest
+// are dropped while that happens.
+TEST_METHOD(SendPolicyDisconnect)
+{
+    PSENDQUEUEUSER pQueueUser =
+        SendQueueUserCreate(1, MAXDWORD / 2, SEND_POLICY_DISCONNECT);
+    Assert::IsNotNull(pQueueUser);
+    PUSER pUser = &pQueueUser->User;
+
+    Assert::AreEqual(S_OK, QueueTestMsg(pUser, SEND_CLASS_DIRECT, 1));
+    Assert::AreEqual(CLIENT_REMOVE_ERR,
+                     QueueTestMsg(pUser, SEND_CLASS_BROADCAST, 2));
+    Assert::AreEqual(S_FALSE, QueueTestMsg(pUser, SEND_CLASS_DIRECT, 3));
+    Assert::AreEqual((LONG64)1,
+                     pQueueUser->Users.m_SendQueueStats.m_llDisconnects);
+    Assert::AreEqual((LONG64)2,
+                     pQueueUser->Users.m_SendQueueStats.m_llMsgsDropped);
+    Assert::AreEqual((DWORD)1, DrainSendQueue(pUser));
+
+    SendQueueUserDestroy(pQueueUser);
+} // TEST_METHOD(SendPolicyDisconnect)
+
+// NOTE: Replies are never dropped or turned back, under any policy, even with
+// the caps full. Only a client with SEND_REPLY_MAX of them unread is removed.
+TEST_METHOD(ReplyDelivery)
+{
+    DWORD daPolicies[3] = {SEND_POLICY_DROP_OLDEST, SEND_POLICY_DISCONNECT,
+                           SEND_POLICY_REJECT};
+
+    for (DWORD dwPolicy = 0; dwPolicy < 3; dwPolicy++)
+    {
+        PSENDQUEUEUSER pQueueUser =
+            SendQueueUserCreate(1, HEADER_LEN, daPolicies[dwPolicy]);
+        Assert::IsNotNull(pQueueUser);
+        PUSER pUser = &pQueueUser->User;
+
+        Assert::AreEqual(S_OK, QueueTestMsg(pUser, SEND_CLASS_BROADCAST, 0));
+        for (DWORD dwReply = 0; dwReply < SEND_REPLY_MAX; dwReply++)
+        {
+            Assert::AreEqual(
+                S_OK, SendQueueReserve(pUser, SEND_CLASS_REPLY, HEADER_LEN));
+            Assert::IsNotNull(
+                AddStaticMsgToQueue(pUser, STATIC_PACKET_CHAT_ACK));
+        }
+        Assert::AreEqual(CLIENT_REMOVE_ERR, SendQueueReserve(pUser,
+                                                             SEND_CLASS_REPLY,
+                                                             HEADER_LEN));
+        Assert::AreEqual((LONG)SEND_REPLY_MAX, pUser->m_lQueuedReplies);
+        Assert::AreEqual(
+            (LONG64)0, pQueueUser->Users.m_SendQueueStats.m_llMsgsDropped);
+        Assert::AreEqual(
+            (LONG64)0,
+            pQueueUser->Users.m_SendQueueStats.m_llBroadcastsDropped);
+
+        // NOTE: Replies go out first, and each one read makes room again.
+        Assert::AreEqual((DWORD)SEND_BATCH_MSGS, FillSendBatch(pUser));
+        Assert::AreEqual((INT8)SEND_CLASS_REPLY,
+                         pUser->m_SendBatch.m_apMsgs[0]->m_iSendClass);
+        ReleaseSendBatch(pUser);
+        Assert::AreEqual(
+            S_OK, SendQueueReserve(pUser, SEND_CLASS_REPLY, HEADER_LEN));
+        Assert::IsNotNull(AddStaticMsgToQueue(pUser, STATIC_PACKET_CHAT_ACK));
+
+        Assert::AreEqual((DWORD)(SEND_REPLY_MAX + 2 - SEND_BATCH_MSGS),
+                         DrainSendQueue(pUser));
+        Assert::AreEqual((LONG)0, pUser->m_lQueuedReplies);
+        Assert::AreEqual((LONG)0, pUser->m_lQueuedMsgs);
+        Assert::AreEqual((LONG)0, pUser->m_lQueuedBytes);
+
+        SendQueueUserDestroy(pQueueUser);
+    }
+} // TEST_METHOD(ReplyDelivery)
+
+// NOTE: A batch stops at SEND_BATCH_MSGS messages or SEND_BATCH_BYTES, and
+// leaves out empty bodies.
+TEST_METHOD(SendBatchLimits)
+{
+    PSENDQUEUEUSER pQueueUser =
+        SendQueueUserCreate(MAXDWORD / 2, MAXDWORD / 2, SEND_POLICY_REJECT);
+    Assert::IsNotNull(pQueueUser);
+    PUSER      pUser  = &pQueueUser->User;
+    PSENDBATCH pBatch = &pUser->m_SendBatch;
+
+    for (DWORD dwMsg = 0; dwMsg < SEND_BATCH_MSGS + 4; dwMsg++)
+    {
+        Assert::AreEqual(S_OK,
+                         QueueTestMsg(pUser, SEND_CLASS_BROADCAST,
+                                      (0 == (dwMsg % 2)) ? 0 : 3));
+    }
+    Assert::AreEqual((DWORD)SEND_BATCH_MSGS, FillSendBatch(pUser));
+    Assert::AreEqual((DWORD)(SEND_BATCH_MSGS + (SEND_BATCH_MSGS / 2)),
+                     pBatch->m_dwBuffers);
+    Assert::AreEqual((DWORD)((SEND_BATCH_MSGS * HEADER_LEN) +
+                             ((SEND_BATCH_MSGS / 2) * 3 * sizeof(WCHAR))),
+                     pBatch->m_dwBytestoMove);
+    ReleaseSendBatch(pUser);
+    Assert::AreEqual((DWORD)4, FillSendBatch(pUser));
+    ReleaseSendBatch(pUser);
+
+    // NOTE: The message that would take the batch over its bytes waits at
+    // the front of its lane for the next one.
+    static WCHAR caText[BUFF_SIZE];
+    PMSGPOOLS    pPools  = &pQueueUser->Users.m_MsgPools;
+    DWORD        dwBytes = HEADER_LEN + (2 * BUFF_SIZE * sizeof(WCHAR));
+    DWORD        dwFits  = SEND_BATCH_BYTES / dwBytes;
+    Assert::IsTrue(dwFits < SEND_BATCH_MSGS);
+    for (DWORD dwMsg = 0; dwMsg <= dwFits; dwMsg++)
+    {
+        Assert::AreEqual(
+            S_OK, SendQueueReserve(pUser, SEND_CLASS_BROADCAST, dwBytes));
+        PMSGBODY pBody =
+            CreateMsgBody(pPools, BUFF_SIZE, BUFF_SIZE, caText, caText);
+        Assert::IsNotNull(pBody);
+        PMSGHOLDER pMsgHolder =
+            AddMsgToQueue(pUser, SEND_CLASS_BROADCAST, TYPE_CHAT, STYPE_EMPTY,
+                          OPCODE_RES, BUFF_SIZE, BUFF_SIZE, pBody);
+        ReleaseMsgBody(pPools, pBody);
+        Assert::AreEqual(dwBytes, pMsgHolder->m_dwBytestoMove);
+    }
+    Assert::AreEqual(dwFits, FillSendBatch(pUser));
+    Assert::AreEqual(dwFits * THREE_BUFFERS, pBatch->m_dwBuffers);
+    Assert::IsTrue(pBatch->m_dwBytestoMove <= SEND_BATCH_BYTES);
+    ReleaseSendBatch(pUser);
+    Assert::AreEqual((DWORD)1, FillSendBatch(pUser));
+    ReleaseSendBatch(pUser);
+    Assert::IsTrue(SendLanesEmpty(pUser));
+    Assert::AreEqual((LONG)0, pUser->m_lQueuedBytes);
+
+    SendQueueUserDestroy(pQueueUser);
+} // TEST_METHOD(SendBatchLimits)
+
+// NOTE: Each batch takes up to its lane's weight from every lane in class
+// order, then fills up in class order.
+TEST_METHOD(SendLaneWeights)
+{
+    static const DWORD daWeights[SEND_LANES] = SEND_LANE_WEIGHTS;
+    PSENDQUEUEUSER     pQueueUser =
+        SendQueueUserCreate(MAXDWORD / 2, MAXDWORD / 2, SEND_POLICY_REJECT);
+    Assert::IsNotNull(pQueueUser);
+    PUSER pUser = &pQueueUser->User;
+
+    for (DWORD dwMsg = 0; dwMsg < 20; dwMsg++)
+    {
+        Assert::AreEqual(
+            S_OK, SendQueueReserve(pUser, SEND_CLASS_REPLY, HEADER_LEN));
+        Assert::IsNotNull(AddStaticMsgToQueue(pUser, STATIC_PACKET_CHAT_ACK));
+        Assert::AreEqual(S_OK, QueueTestMsg(pUser, SEND_CLASS_DIRECT, 1));
+        Assert::AreEqual(S_OK, QueueTestMsg(pUser, SEND_CLASS_BROADCAST, 2));
+    }
+
+    // NOTE: Messages each batch takes from each lane, 20 queued in each.
+    DWORD daaExpected[4][SEND_LANES] = {
+        {8, 4, 4}, {8, 4, 4}, {4, 8, 4}, {0, 4, 8}};
+    Assert::AreEqual((DWORD)8, daWeights[SEND_CLASS_REPLY]);
+    Assert::AreEqual((DWORD)4, daWeights[SEND_CLASS_DIRECT]);
+    Assert::AreEqual((DWORD)4, daWeights[SEND_CLASS_BROADCAST]);
+    for (DWORD dwBatch = 0; dwBatch < 4; dwBatch++)
+    {
+        DWORD daTaken[SEND_LANES] = {0};
+        DWORD dwMsgs              = FillSendBatch(pUser);
+        for (DWORD dwMsg = 0; dwMsg < dwMsgs; dwMsg++)
+        {
+            daTaken[pUser->m_SendBatch.m_apMsgs[dwMsg]->m_iSendClass]++;
+        }
+        for (DWORD dwLane = 0; dwLane < SEND_LANES; dwLane++)
+        {
+            Assert::AreEqual(daaExpected[dwBatch][dwLane], daTaken[dwLane]);
+        }
+
+        // NOTE: Replies still waiting go out ahead of the rest.
+        if (0 != daaExpected[dwBatch][SEND_CLASS_REPLY])
+        {
+            Assert::AreEqual((INT8)SEND_CLASS_REPLY,
+                             pUser->m_SendBatch.m_apMsgs[0]->m_iSendClass);
+        }
+        ReleaseSendBatch(pUser);
+    }
+    Assert::AreEqual((DWORD)0, FillSendBatch(pUser));
+
+    // NOTE: Every message's queueing delay was counted in its lane.
+    for (DWORD dwLane = 0; dwLane < SEND_LANES; dwLane++)
+    {
+        PSENDLANESTATS pStats = &pQueueUser->Users.m_aLaneStats[dwLane];
+        Assert::AreEqual((LONG64)20, pStats->m_llMsgs);
+        Assert::IsTrue(pStats->m_llDelayMax <= pStats->m_llDelayTotal);
+    }
+
+    SendQueueUserDestroy(pQueueUser);
+} // TEST_METHOD(SendLaneWeights)
+
+// NOTE: A body queued to two users is shared, each message holding its own
+// reference, and goes back to its pool only with the last of them.
+TEST_METHOD(SharedMsgBody)
+{
+    static WCHAR   caText[BUFF_SIZE];
+    PSENDQUEUEUSER pQueueUser =
+        SendQueueUserCreate(MAXDWORD / 2, MAXDWORD / 2, SEND_POLICY_REJECT);
+    Assert::IsNotNull(pQueueUser);
+    PUSER pUser  = &pQueueUser->User;
+    PUSER pOther = (PUSER)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                    sizeof(USER));
+    Assert::IsNotNull(pOther);
+    pOther->m_pUsers = &pQueueUser->Users;
+    SendLanesInit(pOther);
+
+    PMSGPOOLS pPools = &pQueueUser->Users.m_MsgPools;
+    PMSGBODY  pBody  = CreateMsgBody(pPools, 5, 3, caText, caText);
+    Assert::IsNotNull(pBody);
+    Assert::AreEqual((LONG)1, pBody->m_lRefs);
+    Assert::AreEqual((INT8)0, pBody->m_iClass);
+    PBLOCKPOOL pBodies = &pPools->m_aBodies[pBody->m_iClass];
+    Assert::AreEqual((LONG)1, pBodies->m_lBlocks);
+
+    DWORD dwBytes = HEADER_LEN + (8 * sizeof(WCHAR));
+    Assert::AreEqual(
+        S_OK, SendQueueReserve(pUser, SEND_CLASS_BROADCAST, dwBytes));
+    PMSGHOLDER pFirst = AddMsgToQueue(pUser, SEND_CLASS_BROADCAST, TYPE_CHAT,
+                                      STYPE_EMPTY, OPCODE_RES, 5, 3, pBody);
+    Assert::AreEqual(
+        S_OK, SendQueueReserve(pOther, SEND_CLASS_BROADCAST, dwBytes));
+    PMSGHOLDER pSecond =
+        AddMsgToQueue(pOther, SEND_CLASS_BROADCAST, TYPE_CHAT, STYPE_EMPTY,
+                      OPCODE_RES, 5, 3, pBody);
+    Assert::IsNotNull(pFirst);
+    Assert::IsNotNull(pSecond);
+    Assert::IsTrue(pFirst->m_pBody == pSecond->m_pBody);
+    Assert::IsTrue(pFirst->m_pBodyBufferTwo == pBody->m_caText + 6);
+    Assert::AreEqual((LONG)3, pBody->m_lRefs);
+    ReleaseMsgBody(pPools, pBody);
+    Assert::AreEqual((LONG)2, pBody->m_lRefs);
+
+    // NOTE: The first send completing leaves the body with the second.
+    Assert::AreEqual((DWORD)1, DrainSendQueue(pUser));
+    Assert::AreEqual((LONG)1, pBody->m_lRefs);
+    Assert::AreEqual((WORD)0, QueryDepthSList(&pBodies->m_FreeList));
+
+    Assert::AreEqual((DWORD)1, DrainSendQueue(pOther));
+    Assert::AreEqual((WORD)1, QueryDepthSList(&pBodies->m_FreeList));
+    Assert::AreEqual((LONG)1, pBodies->m_lBlocks);
+    Assert::AreEqual((WORD)2,
+                     QueryDepthSList(&pPools->m_Records.m_FreeList));
+
+    // NOTE: The next body of its class reuses the block.
+    PMSGBODY pReused = CreateMsgBody(pPools, 1, 1, caText, caText);
+    Assert::IsTrue(pBody == pReused);
+    Assert::AreEqual((LONG)1, pBodies->m_lBlocks);
+    ReleaseMsgBody(pPools, pReused);
+    Assert::AreEqual((WORD)1, QueryDepthSList(&pBodies->m_FreeList));
+
+    SendLanesClear(pOther);
+    HeapFree(GetProcessHeap(), NO_OPTION, pOther);
+    SendQueueUserDestroy(pQueueUser);
+} // TEST_METHOD(SharedMsgBody)
+
+// NOTE: The first REPLY_SLOTS static replies queue in the user's own slots,
+// later ones take pooled records. Sending them frees the slots again.
+TEST_METHOD(ReplySlots)
+{
+    PSENDQUEUEUSER pQueueUser =
+        SendQueueUserCreate(MAXDWORD / 2, MAXDWORD / 2, SEND_POLICY_REJECT);
+    Assert::IsNotNull(pQueueUser);
+    PUSER      pUser    = &pQueueUser->User;
+    PBLOCKPOOL pRecords = &pQueueUser->Users.m_MsgPools.m_Records;
+
+    for (DWORD dwReply = 0; dwReply < REPLY_SLOTS + 2; dwReply++)
+    {
+        Assert::AreEqual(
+            S_OK, SendQueueReserve(pUser, SEND_CLASS_REPLY, HEADER_LEN));
+        PMSGHOLDER pMsgHolder =
+            AddStaticMsgToQueue(pUser, STATIC_PACKET_CHAT_ACK);
+        Assert::IsNotNull(pMsgHolder);
+        Assert::AreEqual((DWORD)HEADER_LEN, pMsgHolder->m_dwBytestoMove);
+        if (dwReply < REPLY_SLOTS)
+        {
+            Assert::IsTrue(&pUser->m_aReplySlots[dwReply] == pMsgHolder);
+            Assert::IsNull(pMsgHolder->m_pPools);
+            Assert::AreEqual((LONG)0, pRecords->m_lBlocks);
+        }
+        else
+        {
+            Assert::IsNotNull(pMsgHolder->m_pPools);
+        }
+    }
+    Assert::AreEqual((LONG)((1 << REPLY_SLOTS) - 1),
+                     pUser->m_lReplySlotsUsed);
+    Assert::AreEqual((LONG)2, pRecords->m_lBlocks);
+
+    Assert::AreEqual((DWORD)(REPLY_SLOTS + 2), FillSendBatch(pUser));
+    ReleaseSendBatch(pUser);
+    Assert::AreEqual((LONG)0, pUser->m_lReplySlotsUsed);
+    Assert::AreEqual((LONG)0, pUser->m_lQueuedReplies);
+    Assert::AreEqual((WORD)2, QueryDepthSList(&pRecords->m_FreeList));
+
+    // NOTE: A slot freed on its own is the next one taken.
+    for (DWORD dwReply = 0; dwReply < 2; dwReply++)
+    {
+        Assert::AreEqual(
+            S_OK, SendQueueReserve(pUser, SEND_CLASS_REPLY, HEADER_LEN));
+        Assert::IsNotNull(AddStaticMsgToQueue(pUser, STATIC_PACKET_LOGIN_ACK));
+    }
+    Assert::AreEqual((DWORD)2, FillSendBatch(pUser));
+    ReleaseQueuedMsg(pUser, pUser->m_SendBatch.m_apMsgs[0]);
+    Assert::AreEqual((LONG)2, pUser->m_lReplySlotsUsed);
+    Assert::AreEqual(
+        S_OK, SendQueueReserve(pUser, SEND_CLASS_REPLY, HEADER_LEN));
+    Assert::IsTrue(&pUser->m_aReplySlots[0] ==
+                   AddStaticMsgToQueue(pUser, STATIC_PACKET_LOGOUT_ACK));
+    ReleaseQueuedMsg(pUser, pUser->m_SendBatch.m_apMsgs[1]);
+    Assert::AreEqual((DWORD)1, DrainSendQueue(pUser));
+    Assert::AreEqual((LONG)0, pUser->m_lReplySlotsUsed);
+    Assert::AreEqual((LONG)0, pUser->m_lQueuedMsgs);
+
+    SendQueueUserDestroy(pQueueUser);
+} // TEST_METHOD(ReplySlots)
+} // TEST_CLASS(SendQueueTest)
+;
+
 TEST_CLASS(NetworkTest){public : TEST_METHOD(EasyConnect){
     Assert::AreEqual((int)SUCCESS, (int)NetSetUp());
 
@@ -7,43 +7,137 @@
  *********************************************************************/
 #include <WinSock2.h>
 #include <Windows.h>
+#include <intrin.h>
 #include <stdio.h>
 
 #include "Messages.h"
 
-//NOTE: Conversion functions for ntoh and hton for PWSTR types.
-static WCHAR
-WcharHostToNet(WCHAR HostChar)
+//NOTE: Conversion functions for ntoh and hton for PWSTR types. Both swap the
+// two bytes of every character, so one set of kernels does either. Each
+// kernel reads a block before writing it, pDest may be pSource.
+typedef VOID (*PFNWSTRSWAP)(PWCHAR pDest, const WCHAR *pSource, INT iLen);
+
+static VOID
+WstrSwapScalar(PWCHAR pDest, const WCHAR *pSource, INT iLen)
 {
-	return (WCHAR)htons((WORD)HostChar);
+	for (INT iCounter = 0; iCounter < iLen; iCounter++)
+	{
+		pDest[iCounter] = (WCHAR)htons((WORD)pSource[iCounter]);
+	}
 }
 
-//WARNING: Can't trust function to know the length of the string, will
-//access further data if iLen longer than space allocated to pszString
-VOID
-WstrHostToNet(PWSTR pszString, INT iLen)
+#if defined(_M_IX86) || defined(_M_X64)
+//NOTE: One shuffle swaps 8 characters, the scalar loop takes the tail.
+static VOID
+WstrSwapSsse3(PWCHAR pDest, const WCHAR *pSource, INT iLen)
 {
-	for (INT iCounter = 0; iCounter < iLen; iCounter++)
+	const __m128i Swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10,
+		13, 12, 15, 14);
+	INT iCounter = 0;
+
+	for (; (iCounter + 8) <= iLen; iCounter += 8)
 	{
-		pszString[iCounter] = WcharHostToNet(pszString[iCounter]);
+		__m128i Block = _mm_loadu_si128((const __m128i *)(pSource + iCounter));
+		_mm_storeu_si128((__m128i *)(pDest + iCounter),
+			_mm_shuffle_epi8(Block, Swap));
 	}
+	WstrSwapScalar(pDest + iCounter, pSource + iCounter, iLen - iCounter);
 }
 
-static WCHAR
-WcharNetToHost(WCHAR HostChar)
+//NOTE: One shuffle swaps 16 characters, the shuffle works within each 16
+// byte half so both take the same pattern. AVX2 implies SSSE3, which takes
+// the tail.
+static VOID
+WstrSwapAvx2(PWCHAR pDest, const WCHAR *pSource, INT iLen)
 {
-	return (WCHAR)htons((WORD)HostChar);
+	const __m256i Swap = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11,
+		10, 13, 12, 15, 14, 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15,
+		14);
+	INT iCounter = 0;
+
+	for (; (iCounter + 16) <= iLen; iCounter += 16)
+	{
+		__m256i Block =
+			_mm256_loadu_si256((const __m256i *)(pSource + iCounter));
+		_mm256_storeu_si256((__m256i *)(pDest + iCounter),
+			_mm256_shuffle_epi8(Block, Swap));
+	}
+	WstrSwapSsse3(pDest + iCounter, pSource + iCounter, iLen - iCounter);
 }
+#endif
 
-//WARNING: Can't trust function to know the length of the string, will
-//access further data if iLen longer than space allocated to pszString
-VOID
-WstrNetToHost(PWSTR pszString, INT iLen)
+static VOID
+WstrSwapSelect(PWCHAR pDest, const WCHAR *pSource, INT iLen);
+
+static PFNWSTRSWAP volatile g_pfnWstrSwap = WstrSwapSelect;
+
+//NOTE: Runs on the first conversion and picks the widest kernel the CPU has
+// and, for AVX2, the OS saves the registers of. Threads racing through here
+// all store the same kernel.
+static VOID
+WstrSwapSelect(PWCHAR pDest, const WCHAR *pSource, INT iLen)
 {
-	for (INT iCounter = 0; iCounter < iLen; iCounter++)
+	PFNWSTRSWAP pfnSwap = WstrSwapScalar;
+
+#if defined(_M_IX86) || defined(_M_X64)
+	INT aiInfo[4] = { 0 };
+	__cpuid(aiInfo, 0);
+	INT iMaxLeaf = aiInfo[0];
+
+	__cpuid(aiInfo, 1);
+	BOOL bSsse3 = (0 != (aiInfo[2] & (1 << 9)));
+	BOOL bAvxSaved = (0 != (aiInfo[2] & (1 << 27))) &&
+		(0 != (aiInfo[2] & (1 << 28))) && (6 == (_xgetbv(0) & 6));
+	BOOL bAvx2 = FALSE;
+	if (bAvxSaved && (7 <= iMaxLeaf))
+	{
+		__cpuidex(aiInfo, 7, 0);
+		bAvx2 = (0 != (aiInfo[1] & (1 << 5)));
+	}
+
+	if (bAvx2)
 	{
-		pszString[iCounter] = WcharNetToHost(pszString[iCounter]);
+		pfnSwap = WstrSwapAvx2;
 	}
+	else if (bSsse3)
+	{
+		pfnSwap = WstrSwapSsse3;
+	}
+#endif
+
+	g_pfnWstrSwap = pfnSwap;
+	pfnSwap(pDest, pSource, iLen);
+}
+
+//WARNING: Takes iLen on trust. The kernels swap whole blocks of 8 or 16
+// characters up to iLen, past the end of pszString if it holds fewer.
+VOID
+WstrHostToNet(PWSTR pszString, INT iLen)
+{
+	g_pfnWstrSwap(pszString, pszString, iLen);
+}
+
+//WARNING: As WstrHostToNet, iLen is taken on trust.
+VOID
+WstrNetToHost(PWSTR pszString, INT iLen)
+{
+	g_pfnWstrSwap(pszString, pszString, iLen);
+}
+
+//NOTE: Copies iLen characters converting them on the way, in place of a
+// copy followed by a conversion. Embedded NULLs are copied like the rest.
+//WARNING: Both pszDest and pszSource must hold iLen characters.
+VOID
+WstrHostToNetCopy(PWSTR pszDest, PCWSTR pszSource, INT iLen)
+{
+	g_pfnWstrSwap(pszDest, pszSource, iLen);
+}
+
+//WARNING: Both pszDest and pszSource must hold iLen characters.
+VOID
+WstrNetToHostCopy(PWSTR pszDest, PCWSTR pszSource, INT iLen)
+{
+	g_pfnWstrSwap(pszDest, pszSource, iLen);
 }
 
 //End of file
@@ -78,4 +78,10 @@ WstrNetToHost(PWSTR pszString, INT iLen);
 VOID
 WstrHostToNet(PWSTR pszString, INT iLen);
 
+VOID
+WstrNetToHostCopy(PWSTR pszDest, PCWSTR pszSource, INT iLen);
+
+VOID
+WstrHostToNetCopy(PWSTR pszDest, PCWSTR pszSource, INT iLen);
+
 //End of file
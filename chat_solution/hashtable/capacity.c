@@ -0,0 +1,183 @@
+#include <Windows.h>
+
+#include "capacity.h"
+
+// NOTE: One prime group count per growth step, each roughly double the last.
+static const DWORD g_dwaPrimeGroups[] = {
+    2,        3,        5,        11,       17,       37,       67,
+    131,      257,      521,      1031,     2053,     4099,     8209,
+    16411,    32771,    65537,    131101,   262147,   524309,   1048583,
+    2097169,  4194319,  8388617,  16777259, 33554467, 67108879, 134217757,
+};
+
+// NOTE: Miller-Rabin with these witnesses is exact for every value below
+// 3,215,031,751, so a WORD never needs random rounds.
+static const DWORD g_dwaWitnesses[] = {2, 3, 5, 7};
+
+static DWORD ModularExponentiation(DWORD dwBase,
+                                   DWORD dwExponent,
+                                   DWORD dwModulus)
+{
+    DWORD dwResult = 1;
+    dwBase         = dwBase % dwModulus;
+
+    while (dwExponent > 0)
+    {
+        if (dwExponent % 2 == 1)
+        {
+            dwResult = (dwResult * dwBase) % dwModulus;
+        }
+
+        dwBase     = (dwBase * dwBase) % dwModulus;
+        dwExponent = dwExponent >> 1;
+    }
+
+    return dwResult;
+}
+
+BOOL IsPrime(WORD wValue)
+{
+    // NOTE: Factoring out powers of two.
+    DWORD dwOddInt     = wValue - 1;
+    DWORD dwPowerOfTwo = 0;
+    DWORD dwCounterOne = 0;
+    DWORD dwPrimeBase  = 0;
+    DWORD dwCalcOne    = 0;
+    DWORD dwCounterTwo = 0;
+    BOOL  bReturn      = FALSE;
+
+    if (wValue <= 1)
+    {
+        return FALSE;
+    }
+    else if (wValue <= 3)
+    {
+        return TRUE;
+    }
+    else if (wValue % 2 == 0)
+    {
+        return FALSE;
+    }
+
+    while (dwOddInt % 2 == 0)
+    {
+        dwPowerOfTwo += 1;
+        dwOddInt = dwOddInt / 2;
+    }
+
+    for (dwCounterOne = 0; dwCounterOne < ARRAYSIZE(g_dwaWitnesses);
+         dwCounterOne++)
+    {
+        dwPrimeBase = g_dwaWitnesses[dwCounterOne];
+
+        // NOTE: A witness equal to the value tells us nothing, and only the
+        // small primes in the witness list can hit this.
+        if (0 == (dwPrimeBase % wValue))
+        {
+            continue;
+        }
+
+        dwCalcOne = ModularExponentiation(dwPrimeBase, dwOddInt, wValue);
+
+        // NOTE: Test to see if strong base, will skip to next loop if not.
+        if ((1 == dwCalcOne) || ((DWORD)(wValue - 1) == dwCalcOne))
+        {
+            continue;
+        }
+
+        for (dwCounterTwo = 1; dwCounterTwo < dwPowerOfTwo; dwCounterTwo++)
+        {
+            dwCalcOne = ModularExponentiation(dwCalcOne, 2, wValue);
+
+            if ((DWORD)(wValue - 1) == dwCalcOne)
+            {
+                break;
+            }
+        }
+
+        if ((DWORD)(wValue - 1) != dwCalcOne)
+        {
+            goto EXIT;
+        }
+    }
+
+    bReturn = TRUE;
+EXIT:
+    return bReturn;
+}
+
+WORD NextPrime(WORD wValue)
+{
+    DWORD dwLoopValue = 0;
+
+    if (wValue <= 1)
+    {
+        return 2;
+    }
+
+    // NOTE: The search will start at the next odd number.
+    for (dwLoopValue = (wValue + 1) | 1; dwLoopValue <= MAXWORD;
+         dwLoopValue += 2)
+    {
+        if (IsPrime((WORD)dwLoopValue))
+        {
+            return (WORD)dwLoopValue;
+        }
+    }
+
+    return 0;
+}
+
+DWORD
+CapacityGroupCount(CAPACITYMODE Mode, DWORD dwMinGroups)
+{
+    DWORD dwGroups = 1;
+
+    if (CAPACITY_PRIME == Mode)
+    {
+        for (DWORD dwCounter = 0; dwCounter < ARRAYSIZE(g_dwaPrimeGroups);
+             dwCounter++)
+        {
+            if (g_dwaPrimeGroups[dwCounter] >= dwMinGroups)
+            {
+                return g_dwaPrimeGroups[dwCounter];
+            }
+        }
+
+        return 0;
+    }
+
+    while (dwGroups < dwMinGroups)
+    {
+        if (dwGroups > (CAPACITY_MAX_GROUPS / 2))
+        {
+            return 0;
+        }
+        dwGroups *= 2;
+    }
+
+    return dwGroups;
+}
+
+VOID
+CapacityReduceInit(PCAPACITYREDUCE pReduce,
+                   CAPACITYMODE    Mode,
+                   DWORD           dwGroupCount)
+{
+    unsigned long ulLog2 = 0;
+
+    pReduce->m_dwGroupCount  = dwGroupCount;
+    pReduce->m_dwShift       = 0;
+    pReduce->m_ullReciprocal = 0;
+
+    if (CAPACITY_PRIME == Mode)
+    {
+        pReduce->m_ullReciprocal = (MAXULONGLONG / dwGroupCount) + 1;
+        return;
+    }
+
+    _BitScanReverse(&ulLog2, dwGroupCount);
+    pReduce->m_dwShift = 32 - (DWORD)ulLog2;
+}
+
+// End of file
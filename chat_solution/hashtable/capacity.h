@@ -0,0 +1,66 @@
+#pragma once
+
+#include <Windows.h>
+#include <intrin.h>
+
+// NOTE: Capacity policies decide how many groups a slot array has and how a
+// hash is reduced to the group its probe starts at. Both are deterministic,
+// no primality testing happens while a table grows.
+typedef enum
+{
+    CAPACITY_POW2  = 0, // Power of two group counts, multiply-shift reduction.
+    CAPACITY_PRIME = 1, // Group counts from a prime table, reciprocal modulo.
+} CAPACITYMODE;
+
+// NOTE: Largest group count either policy hands out. Sixteen slots per group
+// keeps the slot count of the largest array within a DWORD.
+#define CAPACITY_MAX_GROUPS 134217757
+
+// NOTE: Fibonacci hashing constant, 2^32 divided by the golden ratio.
+#define CAPACITY_FIB_MULTIPLIER 2654435769u
+
+typedef struct CAPACITYREDUCE
+{
+    DWORD     m_dwGroupCount;
+    DWORD     m_dwShift;       // CAPACITY_POW2: 32 - log2(group count).
+    ULONGLONG m_ullReciprocal; // CAPACITY_PRIME: (2^64 / group count) + 1.
+} CAPACITYREDUCE, *PCAPACITYREDUCE;
+
+BOOL IsPrime(WORD wValue);
+
+// NOTE: Returns 0 if there is no larger prime that fits in a WORD.
+WORD NextPrime(WORD wValue);
+
+// NOTE: Returns the smallest group count of the policy that is at least
+// dwMinGroups, or 0 if that would be larger than CAPACITY_MAX_GROUPS.
+DWORD
+CapacityGroupCount(CAPACITYMODE Mode, DWORD dwMinGroups);
+
+VOID
+CapacityReduceInit(PCAPACITYREDUCE pReduce,
+                   CAPACITYMODE    Mode,
+                   DWORD           dwGroupCount);
+
+// NOTE: Maps a hash to a group index below m_dwGroupCount. Power of two
+// counts keep the high bits of a multiply, primes use Lemire's fastmod so
+// neither needs a divide.
+static inline DWORD
+CapacityReduce(PCAPACITYREDUCE pReduce, DWORD dwHash)
+{
+    if (0 == pReduce->m_ullReciprocal)
+    {
+        // NOTE: Shifting the 64-bit value keeps a shift of 32 (one group)
+        // defined.
+        return (DWORD)((ULONGLONG)(DWORD)(dwHash * CAPACITY_FIB_MULTIPLIER) >>
+                       pReduce->m_dwShift);
+    }
+
+#if defined(_M_X64) || defined(_M_ARM64)
+    return (DWORD)__umulh(pReduce->m_ullReciprocal * dwHash,
+                          pReduce->m_dwGroupCount);
+#else
+    return dwHash % pReduce->m_dwGroupCount;
+#endif
+}
+
+// End of file
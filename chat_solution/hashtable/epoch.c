@@ -0,0 +1,274 @@
+#include <Windows.h>
+#include <stdio.h>
+
+#include "epoch.h"
+
+RETURNTYPE
+EpochInit(PPEPOCH ppEpoch)
+{
+    RETURNTYPE Return = ERR_GENERIC;
+    PEPOCH     pEpoch = NULL;
+
+    if (NULL == ppEpoch)
+    {
+        DEBUG_PRINT("Input NULL");
+        goto EXIT;
+    }
+
+    pEpoch = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(EPOCH));
+    if (NULL == pEpoch)
+    {
+        DEBUG_ERROR("Failed to allocate epoch");
+        Return = ERR_MEMORY_ALLOCATION;
+        goto EXIT;
+    }
+
+    pEpoch->m_dwTlsIndex = TlsAlloc();
+    if (TLS_OUT_OF_INDEXES == pEpoch->m_dwTlsIndex)
+    {
+        DEBUG_ERROR("TlsAlloc failed");
+        goto CLEAN;
+    }
+
+    // NOTE: Records hold 0 while their thread is outside, so counting starts
+    // at 1.
+    pEpoch->m_llGlobal = 1;
+    InitializeSRWLock(&pEpoch->m_RetiredLock);
+
+    *ppEpoch = pEpoch;
+    Return   = SUCCESS;
+    goto EXIT;
+CLEAN:
+    ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pEpoch, sizeof(EPOCH));
+EXIT:
+    return Return;
+}
+
+static PEPOCHRECORD EpochClaimRecord(PEPOCH pEpoch)
+{
+    PEPOCHRECORD pRecord = NULL;
+
+    for (DWORD dwRecord = 0; dwRecord < EPOCH_MAX_THREADS; dwRecord++)
+    {
+        pRecord = &pEpoch->m_aRecords[dwRecord];
+
+        if ((0 != pRecord->m_lClaimed) ||
+            (0 != InterlockedCompareExchange(&pRecord->m_lClaimed, 1, 0)))
+        {
+            continue;
+        }
+
+        if (!TlsSetValue(pEpoch->m_dwTlsIndex, pRecord))
+        {
+            DEBUG_ERROR("TlsSetValue failed");
+            InterlockedExchange(&pRecord->m_lClaimed, 0);
+            return NULL;
+        }
+
+        return pRecord;
+    }
+
+    return NULL;
+}
+
+BOOL
+EpochEnter(PEPOCH pEpoch)
+{
+    PEPOCHRECORD pRecord = NULL;
+
+    if (NULL == pEpoch)
+    {
+        DEBUG_PRINT("Input NULL");
+        return FALSE;
+    }
+
+    pRecord = TlsGetValue(pEpoch->m_dwTlsIndex);
+    if (NULL == pRecord)
+    {
+        pRecord = EpochClaimRecord(pEpoch);
+        if (NULL == pRecord)
+        {
+            DEBUG_PRINT("No epoch record left for this thread");
+            return FALSE;
+        }
+    }
+
+    // NOTE: The exchange is a full barrier, none of the reader's loads can
+    // happen before its record shows it inside.
+    if (0 == pRecord->m_dwDepth)
+    {
+        InterlockedExchange64(&pRecord->m_llEpoch, pEpoch->m_llGlobal);
+    }
+    pRecord->m_dwDepth++;
+
+    return TRUE;
+}
+
+VOID
+EpochExit(PEPOCH pEpoch)
+{
+    PEPOCHRECORD pRecord = NULL;
+
+    if (NULL == pEpoch)
+    {
+        DEBUG_PRINT("Input NULL");
+        return;
+    }
+
+    pRecord = TlsGetValue(pEpoch->m_dwTlsIndex);
+    if ((NULL == pRecord) || (0 == pRecord->m_dwDepth))
+    {
+        DEBUG_PRINT("EpochExit without EpochEnter");
+        return;
+    }
+
+    pRecord->m_dwDepth--;
+    if (0 == pRecord->m_dwDepth)
+    {
+        WriteRelease64(&pRecord->m_llEpoch, 0);
+    }
+}
+
+// NOTE: Moves the global epoch on once every reader inside has seen the
+// current one. A reader can be at most one epoch behind the global epoch.
+static VOID EpochTryAdvance(PEPOCH pEpoch)
+{
+    LONG64 llGlobal = pEpoch->m_llGlobal;
+    LONG64 llLocal  = 0;
+
+    // NOTE: The caller's unlinking stores have to be visible before any
+    // record is checked.
+    MemoryBarrier();
+
+    for (DWORD dwRecord = 0; dwRecord < EPOCH_MAX_THREADS; dwRecord++)
+    {
+        llLocal = ReadAcquire64(&pEpoch->m_aRecords[dwRecord].m_llEpoch);
+        if ((0 != llLocal) && (llGlobal != llLocal))
+        {
+            return;
+        }
+    }
+
+    InterlockedCompareExchange64(&pEpoch->m_llGlobal, llGlobal + 1, llGlobal);
+}
+
+static VOID EpochFreeList(PEPOCHRETIRED pRetired)
+{
+    PEPOCHRETIRED pNext = NULL;
+
+    while (NULL != pRetired)
+    {
+        pNext = pRetired->m_pNext;
+        pRetired->m_pfnFree(pRetired->m_pData);
+        HeapFree(GetProcessHeap(), NO_OPTION, pRetired);
+        pRetired = pNext;
+    }
+}
+
+VOID
+EpochReclaim(PEPOCH pEpoch)
+{
+    PEPOCHRETIRED  pFree     = NULL;
+    PEPOCHRETIRED *ppRetired = NULL;
+    LONG64         llReclaim = 0;
+
+    if (NULL == pEpoch)
+    {
+        DEBUG_PRINT("Input NULL");
+        return;
+    }
+
+    // NOTE: Unlocked, so callers can reclaim after every write for free. An
+    // entry retired just after is left for the next call.
+    if (NULL == pEpoch->m_pRetired)
+    {
+        return;
+    }
+
+    EpochTryAdvance(pEpoch);
+
+    // NOTE: Readers still inside entered no earlier than one epoch back, so
+    // memory retired two epochs back can't be reached by any of them.
+    llReclaim = pEpoch->m_llGlobal - 2;
+
+    // NOTE: The list is newest first, everything from the first reclaimable
+    // entry on is at least as old.
+    AcquireSRWLockExclusive(&pEpoch->m_RetiredLock);
+    ppRetired = &pEpoch->m_pRetired;
+    while ((NULL != *ppRetired) && ((*ppRetired)->m_llEpoch > llReclaim))
+    {
+        ppRetired = &(*ppRetired)->m_pNext;
+    }
+    pFree      = *ppRetired;
+    *ppRetired = NULL;
+    ReleaseSRWLockExclusive(&pEpoch->m_RetiredLock);
+
+    EpochFreeList(pFree);
+}
+
+// NOTE: Waits until everything retired so far can be freed.
+static VOID EpochSynchronize(PEPOCH pEpoch)
+{
+    LONG64 llTarget = pEpoch->m_llGlobal + 2;
+
+    while (pEpoch->m_llGlobal < llTarget)
+    {
+        EpochTryAdvance(pEpoch);
+        SwitchToThread();
+    }
+}
+
+VOID
+EpochRetire(PEPOCH pEpoch, PVOID pData, VOID (*pfnFree)(PVOID))
+{
+    EpochDefer(pEpoch, pData, pfnFree);
+    EpochReclaim(pEpoch);
+}
+
+VOID
+EpochDefer(PEPOCH pEpoch, PVOID pData, VOID (*pfnFree)(PVOID))
+{
+    PEPOCHRETIRED pRetired = NULL;
+
+    if ((NULL == pEpoch) || (NULL == pfnFree))
+    {
+        DEBUG_PRINT("Input NULL");
+        return;
+    }
+
+    pRetired = HeapAlloc(GetProcessHeap(), NO_OPTION, sizeof(EPOCHRETIRED));
+    if (NULL == pRetired)
+    {
+        DEBUG_ERROR("Failed to allocate retired entry");
+        EpochSynchronize(pEpoch);
+        pfnFree(pData);
+        return;
+    }
+
+    pRetired->m_pData   = pData;
+    pRetired->m_pfnFree = pfnFree;
+
+    // NOTE: The epoch is read under the lock so the list stays ordered.
+    AcquireSRWLockExclusive(&pEpoch->m_RetiredLock);
+    pRetired->m_llEpoch = pEpoch->m_llGlobal;
+    pRetired->m_pNext   = pEpoch->m_pRetired;
+    pEpoch->m_pRetired  = pRetired;
+    ReleaseSRWLockExclusive(&pEpoch->m_RetiredLock);
+}
+
+VOID
+EpochDestroy(PEPOCH pEpoch)
+{
+    if (NULL == pEpoch)
+    {
+        DEBUG_PRINT("Input NULL");
+        return;
+    }
+
+    EpochFreeList(pEpoch->m_pRetired);
+    TlsFree(pEpoch->m_dwTlsIndex);
+
+    ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pEpoch, sizeof(EPOCH));
+}
+
+// End of file
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <Windows.h>
+
+#include "hashtable.h"
+
+// NOTE: Epoch based reclamation. Readers bracket their use of shared memory
+// with EpochEnter and EpochExit, writers hand memory they have unlinked to
+// EpochRetire instead of freeing it. Retired memory is freed once every
+// reader that might still see it has left, so readers never take a lock or
+// write to anything another thread reads.
+//
+// Each thread that enters claims one record the first time and keeps it for
+// the epoch's lifetime. Past EPOCH_MAX_THREADS threads EpochEnter fails and
+// the caller has to fall back to a lock.
+#define EPOCH_MAX_THREADS 128
+
+// NOTE: One cache line per record, a reader entering and exiting only ever
+// writes its own line.
+typedef struct DECLSPEC_CACHEALIGN EPOCHRECORD
+{
+    LONG64 volatile m_llEpoch;  // Global epoch seen on entering, 0 if outside.
+    LONG volatile   m_lClaimed; // Owned by a thread.
+    DWORD           m_dwDepth;  // Nested EpochEnter calls, owner only.
+} EPOCHRECORD, *PEPOCHRECORD;
+
+typedef struct EPOCHRETIRED
+{
+    struct EPOCHRETIRED *m_pNext;
+    PVOID                m_pData;
+    VOID (*m_pfnFree)(PVOID);
+    LONG64 m_llEpoch; // Global epoch when retired.
+} EPOCHRETIRED, *PEPOCHRETIRED;
+
+typedef struct EPOCH
+{
+    EPOCHRECORD     m_aRecords[EPOCH_MAX_THREADS];
+    LONG64 volatile m_llGlobal;
+    DWORD           m_dwTlsIndex; // Holds the calling thread's record.
+    SRWLOCK         m_RetiredLock;
+    PEPOCHRETIRED   m_pRetired; // Newest first.
+} EPOCH, *PEPOCH, **PPEPOCH;
+
+RETURNTYPE
+EpochInit(PPEPOCH ppEpoch);
+
+// NOTE: Wait free. Returns FALSE if no record was left for this thread, the
+// caller must not touch epoch protected memory without some other guard.
+// Calls nest, only the outermost pair announces the thread.
+BOOL
+EpochEnter(PEPOCH pEpoch);
+
+VOID
+EpochExit(PEPOCH pEpoch);
+
+// NOTE: pfnFree(pData) runs once no reader that entered before this call is
+// still inside. Must not be called between EpochEnter and EpochExit, if the
+// retired list can't grow this waits out the readers and frees right away.
+VOID
+EpochRetire(PEPOCH pEpoch, PVOID pData, VOID (*pfnFree)(PVOID));
+
+// NOTE: EpochRetire without the reclaim, for callers holding a lock that the
+// free functions of other retired memory mustn't run under. The caller calls
+// EpochReclaim once the lock is released.
+VOID
+EpochDefer(PEPOCH pEpoch, PVOID pData, VOID (*pfnFree)(PVOID));
+
+// NOTE: Frees whatever retired memory no reader can see any more. Retiring
+// already does this, it only needs calling when writes have stopped or after
+// EpochDefer.
+VOID
+EpochReclaim(PEPOCH pEpoch);
+
+// NOTE: Not thread safe, every reader must be done. Frees everything still
+// retired.
+VOID
+EpochDestroy(PEPOCH pEpoch);
+
+// End of file
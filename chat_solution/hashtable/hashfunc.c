@@ -0,0 +1,174 @@
+#include <Windows.h>
+#include <bcrypt.h>
+
+#include "hashfunc.h"
+
+#include <intrin.h>
+
+#pragma comment(lib, "bcrypt.lib")
+
+// NOTE: wyhash's default secret, odd constants with balanced bits.
+static const ULONGLONG g_ullaSecret[] = {
+    0x2d358dccaa6c78a5ull,
+    0x8bb84b93962eacc9ull,
+    0x4b33a62ed433d4a3ull,
+    0x4d5a2da51de1aa47ull,
+};
+
+static INIT_ONCE g_SeedOnce = INIT_ONCE_STATIC_INIT;
+static ULONGLONG g_ullSeed  = 0;
+
+// NOTE: Full 128-bit product of A and B, low half in A and high half in B.
+static inline VOID WyMultiply(PULONGLONG pullA, PULONGLONG pullB)
+{
+    ULONGLONG ullLow  = 0;
+    ULONGLONG ullHigh = 0;
+
+#if defined(_M_X64)
+    ullLow = _umul128(*pullA, *pullB, &ullHigh);
+#elif defined(_M_ARM64)
+    ullLow  = *pullA * *pullB;
+    ullHigh = __umulh(*pullA, *pullB);
+#else
+    ULONGLONG ullHH    = (*pullA >> 32) * (*pullB >> 32);
+    ULONGLONG ullHL    = (*pullA >> 32) * (DWORD)*pullB;
+    ULONGLONG ullLH    = (ULONGLONG)(DWORD)*pullA * (*pullB >> 32);
+    ULONGLONG ullLL    = (ULONGLONG)(DWORD)*pullA * (DWORD)*pullB;
+    ULONGLONG ullCarry = ((ullLL >> 32) + (DWORD)ullHL + (DWORD)ullLH) >> 32;
+
+    ullLow  = *pullA * *pullB;
+    ullHigh = ullHH + (ullHL >> 32) + (ullLH >> 32) + ullCarry;
+#endif
+
+    *pullA = ullLow;
+    *pullB = ullHigh;
+}
+
+static inline ULONGLONG WyMix(ULONGLONG ullA, ULONGLONG ullB)
+{
+    WyMultiply(&ullA, &ullB);
+    return ullA ^ ullB;
+}
+
+// NOTE: Unaligned reads, keys are copied into entries at any byte offset.
+static inline ULONGLONG WyRead8(PBYTE pbKey)
+{
+    ULONGLONG ullValue = 0;
+    memcpy(&ullValue, pbKey, sizeof(ullValue));
+    return ullValue;
+}
+
+static inline ULONGLONG WyRead4(PBYTE pbKey)
+{
+    DWORD dwValue = 0;
+    memcpy(&dwValue, pbKey, sizeof(dwValue));
+    return dwValue;
+}
+
+// NOTE: One to three bytes, the first, middle and last overlap as needed.
+static inline ULONGLONG WyRead3(PBYTE pbKey, WORD wKeyLen)
+{
+    return ((ULONGLONG)pbKey[0] << 16) |
+           ((ULONGLONG)pbKey[wKeyLen >> 1] << 8) | pbKey[wKeyLen - 1];
+}
+
+DWORD HashTableDefaultHash(PVOID pKey, WORD wKeyLen, ULONGLONG ullSeed)
+{
+    PBYTE     pbKey   = (PBYTE)pKey;
+    WORD      wLeft   = wKeyLen;
+    ULONGLONG ullA    = 0;
+    ULONGLONG ullB    = 0;
+    ULONGLONG ullHash = 0;
+
+    // NOTE: wyhash mixes the seed here on every call, the process seed is
+    // already uniformly random so that multiply is skipped.
+    ullSeed ^= g_ullaSecret[0];
+
+    // NOTE: Usernames of up to eight WCHARs take this path, two overlapping
+    // reads cover the key without a loop.
+    if (wKeyLen <= 16)
+    {
+        if (wKeyLen >= 4)
+        {
+            WORD wOffset = (wKeyLen >> 3) << 2;
+
+            ullA = (WyRead4(pbKey) << 32) | WyRead4(pbKey + wOffset);
+            ullB = (WyRead4(pbKey + wKeyLen - 4) << 32) |
+                   WyRead4(pbKey + wKeyLen - 4 - wOffset);
+        }
+        else if (wKeyLen > 0)
+        {
+            ullA = WyRead3(pbKey, wKeyLen);
+        }
+    }
+    else
+    {
+        while (wLeft > 16)
+        {
+            ullSeed = WyMix(WyRead8(pbKey) ^ g_ullaSecret[1],
+                            WyRead8(pbKey + 8) ^ ullSeed);
+            pbKey += 16;
+            wLeft -= 16;
+        }
+
+        ullA = WyRead8(pbKey + wLeft - 16);
+        ullB = WyRead8(pbKey + wLeft - 8);
+    }
+
+    ullA ^= g_ullaSecret[1];
+    ullB ^= ullSeed;
+    WyMultiply(&ullA, &ullB);
+    ullHash = WyMix(ullA ^ g_ullaSecret[0] ^ wKeyLen, ullB ^ g_ullaSecret[1]);
+
+    return (DWORD)(ullHash ^ (ullHash >> 32));
+}
+
+DWORD HashTableFNVHash(PVOID pKey, WORD wKeyLen, ULONGLONG ullSeed)
+{
+    PWCHAR      pcaKey      = (PWCHAR)pKey;
+    const DWORD dwFNVOffset = 2166136261;
+    const DWORD dwFNVPrime  = 16777619;
+    DWORD       dwHash      = dwFNVOffset ^ (DWORD)(ullSeed ^ (ullSeed >> 32));
+    WORD        wCounter    = 0;
+
+    for (wCounter = 0; wCounter < (wKeyLen / sizeof(WCHAR)); wCounter++)
+    {
+        dwHash = dwHash * dwFNVPrime;
+        dwHash ^= pcaKey[wCounter];
+    }
+
+    // NOTE: Binary keys can have an odd length.
+    if (wKeyLen % sizeof(WCHAR))
+    {
+        dwHash = dwHash * dwFNVPrime;
+        dwHash ^= ((PBYTE)pKey)[wKeyLen - 1];
+    }
+
+    return dwHash;
+}
+
+static BOOL CALLBACK GenerateSeed(PINIT_ONCE pInitOnce,
+                                  PVOID      pParameter,
+                                  PVOID     *ppContext)
+{
+    UNREFERENCED_PARAMETER(pInitOnce);
+    UNREFERENCED_PARAMETER(pParameter);
+    UNREFERENCED_PARAMETER(ppContext);
+
+    return BCRYPT_SUCCESS(BCryptGenRandom(NULL, (PUCHAR)&g_ullSeed,
+                                          sizeof(g_ullSeed),
+                                          BCRYPT_USE_SYSTEM_PREFERRED_RNG));
+}
+
+BOOL HashTableProcessSeed(PULONGLONG pullSeed)
+{
+    if (!InitOnceExecuteOnce(&g_SeedOnce, GenerateSeed, NULL, NULL))
+    {
+        return FALSE;
+    }
+
+    *pullSeed = g_ullSeed;
+    return TRUE;
+}
+
+// End of file
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <Windows.h>
+
+// NOTE: Hash functions take the key's length in bytes and never read past it,
+// keys can be WCHAR usernames or binary values like a SOCKET. The seed is
+// picked once per process so colliding keys can't be prepared ahead of time.
+// Any function with this signature can be passed to HashTableInit.
+
+// NOTE: wyhash style, reads the key 4, 8 or 16 bytes at a time and mixes with
+// 64-bit multiplies. This is the default.
+DWORD HashTableDefaultHash(PVOID pKey, WORD wKeyLen, ULONGLONG ullSeed);
+
+// NOTE: The original FNV-1 over WCHARs, one character per step. Kept for
+// comparison, the seed only changes the offset basis.
+DWORD HashTableFNVHash(PVOID pKey, WORD wKeyLen, ULONGLONG ullSeed);
+
+// NOTE: Returns FALSE if the system random number generator failed.
+BOOL HashTableProcessSeed(PULONGLONG pullSeed);
+
+// End of file
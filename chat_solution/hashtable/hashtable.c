@@ -1,206 +1,560 @@
 #include <Windows.h>
 #include <stdio.h>
-#include <time.h>
 
-#include "../linkedlist/linkedlist.h"
+#include "epoch.h"
 #include "hashtable.h"
 
-static DWORD ModularExponentiation(DWORD dwBase,
-                                   DWORD dwExponent,
-                                   DWORD dwModulus)
+#include <intrin.h>
+#if defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#endif
+
+// NOTE: Compares a stored key with one of the same length. Keys of sixteen
+// bytes or more are compared sixteen at a time, the last load overlapping the
+// one before it so neither key is read past its end. A shorter key can't be
+// loaded whole without reading past the caller's buffer, it is compared a
+// byte at a time.
+#if defined(_M_X64) || defined(_M_IX86)
+static inline BOOL KeyEqual(PCHAR pszStored, PCHAR pszKey, WORD wKeyLen)
 {
-    DWORD dwResult = 1;
-    dwBase         = dwBase % dwModulus;
+    __m128i Equal   = _mm_set1_epi8(-1);
+    WORD    wOffset = 0;
 
-    while (dwExponent > 0)
+    if (sizeof(__m128i) > wKeyLen)
     {
-        if (dwExponent % 2 == 1)
+        for (WORD wByte = 0; wByte < wKeyLen; wByte++)
         {
-            dwResult = (dwResult * dwBase) % dwModulus;
+            if (pszStored[wByte] != pszKey[wByte])
+            {
+                return FALSE;
+            }
+        }
+
+        return TRUE;
+    }
+
+    for (;;)
+    {
+        if ((wOffset + sizeof(__m128i)) > wKeyLen)
+        {
+            wOffset = wKeyLen - sizeof(__m128i);
         }
 
-        dwBase     = (dwBase * dwBase) % dwModulus;
-        dwExponent = dwExponent >> 1;
+        Equal = _mm_and_si128(
+            Equal, _mm_cmpeq_epi8(
+                       _mm_loadu_si128((const __m128i *)(pszStored + wOffset)),
+                       _mm_loadu_si128((const __m128i *)(pszKey + wOffset))));
+
+        wOffset += sizeof(__m128i);
+        if (wOffset >= wKeyLen)
+        {
+            break;
+        }
     }
 
-    return dwResult;
+    return (0xFFFF == _mm_movemask_epi8(Equal));
+}
+#else
+static inline BOOL KeyEqual(PCHAR pszStored, PCHAR pszKey, WORD wKeyLen)
+{
+    return (0 == memcmp(pszStored, pszKey, wKeyLen));
+}
+#endif
+
+// NOTE: Orders a lock-free reader's load of a control byte before its loads
+// of the entry behind it. x86 and x64 don't reorder loads, ARM needs the
+// barrier.
+#if defined(_M_X64) || defined(_M_IX86)
+#define SlotsAcquire() _ReadWriteBarrier()
+#else
+#define SlotsAcquire() MemoryBarrier()
+#endif
+
+static inline DWORD
+HashTableHashKey(PHASHTABLE pHashTable, PCHAR pszKey, WORD wKeyLen)
+{
+    return pHashTable->m_pfnHashFunction(pszKey, wKeyLen,
+                                         pHashTable->m_ullSeed);
+}
+
+// NOTE: The low seven bits of the hash (H2) are kept in the control byte, the
+// rest (H1) is reduced by the capacity policy to the group probing starts at.
+static inline BYTE HashH2(DWORD dwHash)
+{
+    return (BYTE)(CTRL_FULL | (dwHash & CTRL_H2_MASK));
+}
+
+static inline DWORD HashGroup(PHASHTABLESLOTS pSlots, DWORD dwHash)
+{
+    return CapacityReduce(&pSlots->m_Reduce, dwHash >> 7);
+}
+
+static inline DWORD NextGroup(PHASHTABLESLOTS pSlots, DWORD dwGroup)
+{
+    dwGroup += 1;
+
+    return (dwGroup == pSlots->m_Reduce.m_dwGroupCount) ? 0 : dwGroup;
+}
+
+// NOTE: Group match functions return a 16-bit mask, bit i set when slot i of
+// the group matches.
+#if defined(_M_X64) || defined(_M_IX86)
+static inline DWORD GroupMatch(PBYTE pGroupCtrl, BYTE bCtrl)
+{
+    __m128i Group = _mm_loadu_si128((const __m128i *)pGroupCtrl);
+
+    return (DWORD)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(Group, _mm_set1_epi8((CHAR)bCtrl)));
 }
 
-BOOL IsPrime(WORD wValue)
+static inline DWORD GroupMatchEmptyOrDeleted(PBYTE pGroupCtrl)
+{
+    __m128i Group = _mm_loadu_si128((const __m128i *)pGroupCtrl);
+
+    // NOTE: Only full slots have the high bit set.
+    return (~(DWORD)_mm_movemask_epi8(Group)) & 0xFFFF;
+}
+#else
+static inline DWORD GroupMatch(PBYTE pGroupCtrl, BYTE bCtrl)
 {
-    // NOTE: Factoring out powers of two.
-    DWORD dwOddInt     = wValue - 1;
-    DWORD dwPowerOfTwo = 0;
-    DWORD dwMaxNum     = wValue - 2;
-    DWORD dwMinNum     = 2;
-    DWORD dwRoundCount = 5;
-    DWORD dwCounterOne = 0;
-    DWORD dwPrimeBase  = 0;
-    DWORD dwCalcOne    = 0;
-    DWORD dwCalcTwo    = 0;
-    DWORD dwCounterTwo = 0;
-    BOOL  bReturn      = FALSE;
+    DWORD dwMask = 0;
 
-    if (wValue <= 1)
+    for (DWORD dwCounter = 0; dwCounter < GROUP_WIDTH; dwCounter++)
     {
-        return FALSE;
+        if (pGroupCtrl[dwCounter] == bCtrl)
+        {
+            dwMask |= (1 << dwCounter);
+        }
     }
-    else if (wValue <= 3)
+
+    return dwMask;
+}
+
+static inline DWORD GroupMatchEmptyOrDeleted(PBYTE pGroupCtrl)
+{
+    DWORD dwMask = 0;
+
+    for (DWORD dwCounter = 0; dwCounter < GROUP_WIDTH; dwCounter++)
     {
-        return TRUE;
+        if (0 == (pGroupCtrl[dwCounter] & CTRL_FULL))
+        {
+            dwMask |= (1 << dwCounter);
+        }
     }
 
-    while (dwOddInt % 2 == 0)
+    return dwMask;
+}
+#endif
+
+static inline DWORD GroupMatchEmpty(PBYTE pGroupCtrl)
+{
+    return GroupMatch(pGroupCtrl, CTRL_EMPTY);
+}
+
+static inline DWORD LowestSetBit(DWORD dwMask)
+{
+    unsigned long ulIndex = 0;
+
+    _BitScanForward(&ulIndex, dwMask);
+
+    return (DWORD)ulIndex;
+}
+
+static inline DWORD MaxLoad(DWORD dwCapacity)
+{
+    return (dwCapacity / MAX_LOAD_DENOMINATOR) * MAX_LOAD_NUMERATOR;
+}
+
+static inline BOOL HashTableMigrating(PHASHTABLE pHashTable)
+{
+    return (NULL != pHashTable->m_OldSlots.m_pCtrl);
+}
+
+#ifdef HASHTABLE_STATS
+// NOTE: Interlocked, lookups of a shared or read-mostly table count from
+// several threads at once.
+#define STATS_ADD(pHashTable, Counter, llValue)                               \
+    InterlockedExchangeAdd64(&(pHashTable)->m_Counters.Counter, (llValue))
+
+// NOTE: Groups probed to reach dwSlot, or to give up on a key of dwHash when
+// dwSlot is MAXDWORD.
+static DWORD
+SlotsProbeLength(PHASHTABLESLOTS pSlots, DWORD dwHash, DWORD dwSlot)
+{
+    DWORD dwGroup  = HashGroup(pSlots, dwHash);
+    DWORD dwGroups = 1;
+
+    if (MAXDWORD != dwSlot)
     {
-        dwPowerOfTwo += 1;
-        dwOddInt = dwOddInt / 2;
+        return ((dwSlot / GROUP_WIDTH) + pSlots->m_Reduce.m_dwGroupCount -
+                dwGroup) % pSlots->m_Reduce.m_dwGroupCount + 1;
     }
 
-    // NOTE: Seeding inside the loop would generate the same number each time
-    // due to the computational speed.
-    srand((DWORD)time(NULL));
-
-    for (dwCounterOne = 0; dwCounterOne < dwRoundCount; dwCounterOne++)
+    while ((0 == GroupMatchEmpty(pSlots->m_pCtrl + (dwGroup * GROUP_WIDTH))) &&
+           (dwGroups < pSlots->m_Reduce.m_dwGroupCount))
     {
-        // NOTE: Getting the number within range will decrease the randomness
-        // slightly our base for prime calculations will be determined.
-        dwPrimeBase = rand() % (dwMaxNum + 1 - dwMinNum) + dwMinNum;
-        dwCalcOne   = ModularExponentiation(dwPrimeBase, dwOddInt, wValue);
-        dwCalcTwo   = 0;
+        dwGroup = NextGroup(pSlots, dwGroup);
+        dwGroups++;
+    }
+
+    return dwGroups;
+}
+
+static VOID StatsLookup(PHASHTABLE      pHashTable,
+                        PHASHTABLESLOTS pSlots,
+                        DWORD           dwHash,
+                        DWORD           dwSlot)
+{
+    DWORD dwGroups = SlotsProbeLength(pSlots, dwHash, dwSlot);
 
-        // NOTE: Test to see if strong base, will skip to next loop if not.
-#pragma warning(push)
-#pragma warning(disable : 4389)
-        // NOTE: wValue can never be below four at this point in the code:
-        // compiler warnings can safely be ignored here.
-        if ((1 == dwCalcOne) || ((wValue - 1) == dwCalcOne))
-#pragma warning(pop)
+    STATS_ADD(pHashTable, m_llLookups, 1);
+    STATS_ADD(pHashTable, m_llLookupGroups, dwGroups);
+    if (MAXDWORD == dwSlot)
+    {
+        STATS_ADD(pHashTable, m_llLookupMisses, 1);
+        STATS_ADD(pHashTable, m_llMissGroups, dwGroups);
+    }
+}
+#else
+#define STATS_ADD(pHashTable, Counter, llValue)
+#define StatsLookup(pHashTable, pSlots, dwHash, dwSlot)
+#endif // HASHTABLE_STATS
+
+// NOTE: Returns the slot index holding the key, or MAXDWORD if not present.
+// Candidates with a different full hash are rejected without comparing keys.
+static DWORD SlotsFind(PHASHTABLESLOTS pSlots,
+                       PCHAR           pszKey,
+                       WORD            wKeyLen,
+                       DWORD           dwHash)
+{
+    DWORD           dwGroup    = HashGroup(pSlots, dwHash);
+    BYTE            bH2        = HashH2(dwHash);
+    DWORD           dwMatch    = 0;
+    DWORD           dwSlot     = 0;
+    PBYTE           pGroupCtrl = NULL;
+    PHASHTABLEENTRY pTempEntry = NULL;
 
+    for (DWORD dwProbe = 0; dwProbe < pSlots->m_Reduce.m_dwGroupCount;
+         dwProbe++)
+    {
+        pGroupCtrl = pSlots->m_pCtrl + (dwGroup * GROUP_WIDTH);
+        dwMatch    = GroupMatch(pGroupCtrl, bH2);
+        if (0 != dwMatch)
         {
-            continue;
+            SlotsAcquire();
         }
 
-        for (dwCounterTwo = 0; dwCounterTwo < dwPowerOfTwo; dwCounterTwo++)
+        while (0 != dwMatch)
         {
-            dwCalcTwo = ModularExponentiation(dwCalcOne, 2, wValue);
-#pragma warning(push)
-#pragma warning(disable : 4389)
-            // NOTE: wValue can never be below four at this point in the code:
-            // compiler warnings can safely be ignored here.
-            if ((1 == dwCalcTwo) && (1 != dwCalcOne) &&
-                (dwCalcOne != (wValue - 1)))
-#pragma warning(pop)
+            dwSlot     = (dwGroup * GROUP_WIDTH) + LowestSetBit(dwMatch);
+            pTempEntry = &pSlots->m_pSlots[dwSlot];
+
+            if ((pTempEntry->m_dwHash == dwHash) &&
+                (pTempEntry->m_wKeyLen == wKeyLen) &&
+                KeyEqual(pTempEntry->m_caKey, pszKey, wKeyLen))
             {
-                goto EXIT;
+                return dwSlot;
             }
 
-            dwCalcOne = dwCalcTwo;
+            dwMatch &= (dwMatch - 1);
         }
 
-        if (1 != dwCalcTwo)
+        // NOTE: Inserts fill the first group with room, so a key can't be
+        // stored past a group that still has an empty slot.
+        if (0 != GroupMatchEmpty(pGroupCtrl))
         {
-            goto EXIT;
+            break;
         }
+
+        dwGroup = NextGroup(pSlots, dwGroup);
     }
 
-    bReturn = TRUE;
-EXIT:
-    return bReturn;
+    return MAXDWORD;
 }
 
-WORD NextPrime(WORD wValue)
+// NOTE: Returns the first empty or deleted slot on the key's probe sequence.
+// There is always one, the load factor never lets the table fill up.
+static DWORD SlotsFindInsert(PHASHTABLESLOTS pSlots, DWORD dwHash)
 {
-    WORD wReturn      = 0;
-    WORD wDoubleValue = 0;
-    WORD wLoopValue   = 0;
+    DWORD dwGroup = HashGroup(pSlots, dwHash);
+    DWORD dwMatch = 0;
 
-    if (wValue <= 1)
+    for (;;)
     {
-        return 2;
+        dwMatch =
+            GroupMatchEmptyOrDeleted(pSlots->m_pCtrl + (dwGroup * GROUP_WIDTH));
+        if (0 != dwMatch)
+        {
+            return (dwGroup * GROUP_WIDTH) + LowestSetBit(dwMatch);
+        }
+
+        dwGroup = NextGroup(pSlots, dwGroup);
     }
+}
+
+// NOTE: Clears a full slot. If the group already has an empty slot, no probe
+// ever continued past it, so the slot can go straight back to empty.
+// Otherwise a tombstone keeps later keys in the probe sequence reachable.
+static VOID SlotsErase(PHASHTABLESLOTS pSlots, DWORD dwSlot)
+{
+    PBYTE pGroupCtrl =
+        pSlots->m_pCtrl + ((dwSlot / GROUP_WIDTH) * GROUP_WIDTH);
 
-    if (wValue == 2)
+    if (0 != GroupMatchEmpty(pGroupCtrl))
+    {
+        pSlots->m_pCtrl[dwSlot] = CTRL_EMPTY;
+        pSlots->m_dwGrowthLeft += 1;
+    }
+    else
     {
-        return 3;
+        pSlots->m_pCtrl[dwSlot] = CTRL_DELETED;
     }
 
-    // NOTE: The search will start at the next odd number.
-    if (wValue % 2 == 0)
+    SecureZeroMemory(&pSlots->m_pSlots[dwSlot], sizeof(HASHTABLEENTRY));
+}
+
+// NOTE: Bytes used by the control bytes and slots of dwCapacity slots, or 0
+// if that doesn't fit in a DWORD.
+static DWORD SlotsBytes(DWORD dwCapacity)
+{
+    ULONGLONG ullBytes =
+        (ULONGLONG)dwCapacity * (sizeof(BYTE) + sizeof(HASHTABLEENTRY));
+
+    if (ullBytes > MAXDWORD)
     {
-        wValue += 1;
+        return 0;
     }
-    else
+
+    return (DWORD)ullBytes;
+}
+
+// NOTE: Control bytes and slots share one block. Zeroed control bytes are all
+// CTRL_EMPTY.
+static VOID SlotsInit(PHASHTABLESLOTS pSlots,
+                      CAPACITYMODE    Mode,
+                      DWORD           dwGroupCount,
+                      PBYTE           pBlock)
+{
+    DWORD dwCapacity = dwGroupCount * GROUP_WIDTH;
+
+    pSlots->m_pCtrl        = pBlock;
+    pSlots->m_pSlots       = (PHASHTABLEENTRY)(pBlock + dwCapacity);
+    pSlots->m_dwCapacity   = dwCapacity;
+    pSlots->m_dwGrowthLeft = MaxLoad(dwCapacity);
+    CapacityReduceInit(&pSlots->m_Reduce, Mode, dwGroupCount);
+}
+
+static RETURNTYPE
+SlotsAlloc(PHASHTABLESLOTS pSlots, CAPACITYMODE Mode, DWORD dwGroupCount)
+{
+    DWORD dwCapacity = dwGroupCount * GROUP_WIDTH;
+    DWORD dwBytes    = SlotsBytes(dwCapacity);
+    PBYTE pBlock     = NULL;
+
+    // NOTE: CapacityGroupCount returns 0 past CAPACITY_MAX_GROUPS, which also
+    // keeps dwCapacity from overflowing.
+    if ((0 == dwGroupCount) || (0 == dwBytes))
+    {
+        DEBUG_PRINT("Capacity too large");
+        return ERR_INVALID_PARAM;
+    }
+
+    pBlock = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, dwBytes);
+    if (NULL == pBlock)
+    {
+        DEBUG_ERROR("Failed to allocate hash table slots");
+        return ERR_MEMORY_ALLOCATION;
+    }
+
+    SlotsInit(pSlots, Mode, dwGroupCount, pBlock);
+    return SUCCESS;
+}
+
+static VOID SlotsFree(PHASHTABLESLOTS pSlots)
+{
+    ZeroingHeapFree(GetProcessHeap(), NO_OPTION, (PVOID)&pSlots->m_pCtrl,
+                    SlotsBytes(pSlots->m_dwCapacity));
+    SecureZeroMemory(pSlots, sizeof(HASHTABLESLOTS));
+}
+
+// NOTE: Smallest group count of the table's policy whose slots hold dwEntries
+// entries under the maximum load factor.
+static DWORD GroupsForEntries(CAPACITYMODE Mode, DWORD dwEntries)
+{
+    ULONGLONG ullSlots =
+        (((ULONGLONG)dwEntries * MAX_LOAD_DENOMINATOR) / MAX_LOAD_NUMERATOR) + 1;
+    ULONGLONG ullGroups = (ullSlots + GROUP_WIDTH - 1) / GROUP_WIDTH;
+
+    if (ullGroups > CAPACITY_MAX_GROUPS)
     {
-        wValue += 2;
+        return 0;
     }
 
-    wDoubleValue = wValue * 2;
+    return CapacityGroupCount(Mode, (DWORD)ullGroups);
+}
+
+// NOTE: The value array and its entry back-references share one block.
+static DWORD ValuesBytes(DWORD dwCapacity)
+{
+    return dwCapacity * (sizeof(PVOID) + sizeof(PHASHTABLEENTRY));
+}
+
+// NOTE: Moves the values into an array of dwCapacity, at least m_dwSize.
+static RETURNTYPE ValuesResize(PHASHTABLE pHashTable, DWORD dwCapacity)
+{
+    PBYTE pBlock = NULL;
 
-    if (wValue > 32767)
+    if (dwCapacity > (MAXDWORD / (sizeof(PVOID) + sizeof(PHASHTABLEENTRY))))
     {
-        wDoubleValue = 65535;
+        DEBUG_PRINT("Capacity too large");
+        return ERR_INVALID_PARAM;
     }
 
-    // NOTE: Bertrand's postulate: for any int  > 3 there exists at least one
-    // prime number, p, such that n < p < 2n.
-    for (wLoopValue = wValue; wLoopValue < wDoubleValue; wLoopValue += 2)
+    pBlock = HeapAlloc(GetProcessHeap(), NO_OPTION, ValuesBytes(dwCapacity));
+    if (NULL == pBlock)
     {
-        if (IsPrime(wLoopValue))
-        {
-            wReturn = wLoopValue;
-            goto EXIT;
-        }
+        DEBUG_ERROR("Failed to allocate hash table values");
+        return ERR_MEMORY_ALLOCATION;
     }
+    pHashTable->m_dwHeapAllocs += 1;
 
-EXIT:
-    return wReturn;
+    if (NULL != pHashTable->m_ppValues)
+    {
+        CopyMemory(pBlock, pHashTable->m_ppValues,
+                   pHashTable->m_dwSize * sizeof(PVOID));
+        CopyMemory(pBlock + (dwCapacity * sizeof(PVOID)),
+                   pHashTable->m_ppValueEntries,
+                   pHashTable->m_dwSize * sizeof(PHASHTABLEENTRY));
+        ZeroingHeapFree(GetProcessHeap(), NO_OPTION,
+                        (PVOID *)&pHashTable->m_ppValues,
+                        ValuesBytes(pHashTable->m_dwValueCapacity));
+    }
+
+    pHashTable->m_ppValues = (PVOID *)pBlock;
+    pHashTable->m_ppValueEntries =
+        (PHASHTABLEENTRY *)(pBlock + (dwCapacity * sizeof(PVOID)));
+    pHashTable->m_dwValueCapacity = dwCapacity;
+
+    return SUCCESS;
+}
+
+// NOTE: Makes room for dwCapacity values. The array only grows here, so a
+// table that churns at a steady size stops calling the heap for it. Only
+// HashTableMaintenance shrinks it.
+static RETURNTYPE ValuesReserve(PHASHTABLE pHashTable, DWORD dwCapacity)
+{
+    if (dwCapacity <= pHashTable->m_dwValueCapacity)
+    {
+        return SUCCESS;
+    }
+
+    return ValuesResize(pHashTable, dwCapacity);
+}
+
+// NOTE: Fills the gap left by a removed value with the last one.
+static VOID ValuesRemove(PHASHTABLE pHashTable, DWORD dwIndex)
+{
+    DWORD dwLast = pHashTable->m_dwSize - 1;
+
+    pHashTable->m_ppValues[dwIndex]       = pHashTable->m_ppValues[dwLast];
+    pHashTable->m_ppValueEntries[dwIndex] = pHashTable->m_ppValueEntries[dwLast];
+    pHashTable->m_ppValueEntries[dwIndex]->m_dwValueIndex = dwIndex;
 }
 
-// NOTE: Return EXIT_SUCCESS if equal, EXIT_FAILURE if not.
-// WARNING: pszKEy2 is allocated by user. If pszKeyLen is longer, accessing
-// un-allocated memory.
-static RETURNTYPE CompareMemory(PCHAR pszKey1, PCHAR pszKey2, WORD wKeyLen)
+static inline BOOL HashTableReadMostly(PHASHTABLE pHashTable)
 {
-    RETURNTYPE Return = SUCCESS;
+    return (NULL != pHashTable->m_pEpoch);
+}
 
-    for (INT iCounter = 0; iCounter < wKeyLen; iCounter++)
+// NOTE: Brackets a change to the slots lock-free readers can see. The
+// interlocked increments are full barriers, the sequence is odd for exactly
+// as long as the change is in progress.
+static inline VOID HashTableWriteBegin(PHASHTABLE pHashTable)
+{
+    if (HashTableReadMostly(pHashTable))
     {
-        if (pszKey1[iCounter] != pszKey2[iCounter])
-        {
-            Return = ERR_GENERIC;
-            goto EXIT;
-        }
+        InterlockedIncrement(&pHashTable->m_lSequence);
     }
+}
 
-EXIT:
-    return Return;
+static inline VOID HashTableWriteEnd(PHASHTABLE pHashTable)
+{
+    if (HashTableReadMostly(pHashTable))
+    {
+        InterlockedIncrement(&pHashTable->m_lSequence);
+    }
 }
 
-static DWORD DefaultHashFunction(PVOID pKey)
+// NOTE: A writer can re-use a slot while a lock-free reader is comparing its
+// key, so the lookup is retried if a write overlapped it. Writes are rare,
+// nearly every lookup runs once.
+static PVOID HashTableReadMostlyFind(PHASHTABLE pHashTable,
+                                     PCHAR      pszKey,
+                                     WORD       wKeyLen,
+                                     DWORD      dwHash)
 {
-    PWCHAR      pcaKey      = (PWCHAR)pKey;
-    const DWORD dwFNVOffset = 2166136261;
-    const DWORD dwFNVPrime  = 16777619;
-    DWORD       dwHash      = dwFNVOffset;
-    WORD        wCounter    = 0;
+    PHASHTABLESLOTS pSlots    = NULL;
+    PVOID           pData     = NULL;
+    LONG            lSequence = 0;
+    DWORD           dwSlot    = 0;
 
-    for (wCounter = 0; wCounter <= KEY_LENGTH; wCounter++)
+    for (;;)
     {
-        if (pcaKey[wCounter] == 0)
+        lSequence = ReadAcquire(&pHashTable->m_lSequence);
+        if (0 != (lSequence & 1))
         {
-            break;
+            YieldProcessor();
+            continue;
+        }
+
+        pSlots = ReadPointerAcquire(
+            (PVOID const volatile *)&pHashTable->m_pPublished);
+        dwSlot = SlotsFind(pSlots, pszKey, wKeyLen, dwHash);
+        pData  = (MAXDWORD != dwSlot) ? pSlots->m_pSlots[dwSlot].m_pData : NULL;
+
+        SlotsAcquire();
+        if (lSequence == pHashTable->m_lSequence)
+        {
+            StatsLookup(pHashTable, pSlots, dwHash, dwSlot);
+            return pData;
         }
-        dwHash = dwHash * dwFNVPrime;
-        dwHash ^= pcaKey[wCounter];
+    }
+}
+
+// NOTE: Gives readers their own copy of m_Slots to load with one pointer, so
+// a re-hash can swap the control bytes, slots and capacity in one store.
+static RETURNTYPE HashTablePublish(PHASHTABLE pHashTable)
+{
+    PHASHTABLESLOTS pPublished =
+        HeapAlloc(GetProcessHeap(), NO_OPTION, sizeof(HASHTABLESLOTS));
+
+    if (NULL == pPublished)
+    {
+        DEBUG_ERROR("Failed to allocate published slots");
+        return ERR_MEMORY_ALLOCATION;
     }
 
-    return dwHash;
+    pHashTable->m_dwHeapAllocs += 1;
+
+    *pPublished = pHashTable->m_Slots;
+    WritePointerRelease((PVOID volatile *)&pHashTable->m_pPublished,
+                        pPublished);
+
+    return SUCCESS;
 }
 
-RETURNTYPE
-HashTableInit(PPHASHTABLE ppHashTable,
-              WORD        wCapacity,
-              DWORD (*pfnHashFunction)(PVOID))
+static VOID PublishedFree(PVOID pPublished)
+{
+    SlotsFree((PHASHTABLESLOTS)pPublished);
+    HeapFree(GetProcessHeap(), NO_OPTION, pPublished);
+}
+
+static RETURNTYPE
+HashTableCreate(PPHASHTABLE ppHashTable,
+                DWORD       dwCapacity,
+                DWORD (*pfnHashFunction)(PVOID, WORD, ULONGLONG),
+                DWORD  dwFlags,
+                PEPOCH pEpoch)
 {
     RETURNTYPE Return = ERR_GENERIC;
     PHASHTABLE pHashTable =
@@ -218,353 +572,539 @@ HashTableInit(PPHASHTABLE ppHashTable,
     }
     else
     {
-        pHashTable->m_pfnHashFunction = DefaultHashFunction;
+        pHashTable->m_pfnHashFunction = HashTableDefaultHash;
+    }
+
+    if (!HashTableProcessSeed(&pHashTable->m_ullSeed))
+    {
+        DEBUG_ERROR("HashTableProcessSeed failed");
+        goto CLEAN;
     }
 
-    if (MIN_CAPACITY > wCapacity)
+    if (HASHTABLE_CAPACITY_PRIME & dwFlags)
     {
-        pHashTable->m_wCapacity = MIN_CAPACITY;
+        pHashTable->m_CapacityMode = CAPACITY_PRIME;
     }
     else
     {
-        pHashTable->m_wCapacity = wCapacity;
+        pHashTable->m_CapacityMode = CAPACITY_POW2;
+    }
+
+    if (MIN_CAPACITY > dwCapacity)
+    {
+        dwCapacity = MIN_CAPACITY;
+    }
+
+    Return = SlotsAlloc(
+        &pHashTable->m_Slots, pHashTable->m_CapacityMode,
+        GroupsForEntries(pHashTable->m_CapacityMode, dwCapacity));
+    if (SUCCESS != Return)
+    {
+        DEBUG_PRINT("SlotsAlloc failed");
+        goto CLEAN;
     }
+    pHashTable->m_dwHeapAllocs += 1;
 
-    pHashTable->m_ppTable =
-        HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY,
-                  pHashTable->m_wCapacity * sizeof(PLINKEDLIST));
-    if (NULL == pHashTable->m_ppTable)
+    Return = ValuesReserve(pHashTable, dwCapacity);
+    if (SUCCESS != Return)
     {
-        DEBUG_ERROR("Failed to allocate hash table array");
+        DEBUG_PRINT("ValuesReserve failed");
+        SlotsFree(&pHashTable->m_Slots);
         goto CLEAN;
     }
 
-    Return       = SUCCESS;
+    if (NULL != pEpoch)
+    {
+        pHashTable->m_pEpoch = pEpoch;
+
+        Return = HashTablePublish(pHashTable);
+        if (SUCCESS != Return)
+        {
+            DEBUG_PRINT("HashTablePublish failed");
+            ZeroingHeapFree(GetProcessHeap(), NO_OPTION,
+                            (PVOID *)&pHashTable->m_ppValues,
+                            ValuesBytes(pHashTable->m_dwValueCapacity));
+            SlotsFree(&pHashTable->m_Slots);
+            goto CLEAN;
+        }
+    }
+
     *ppHashTable = pHashTable;
     goto EXIT;
 CLEAN:
     ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pHashTable,
-                             sizeof(HASHTABLE));
+                    sizeof(HASHTABLE));
 EXIT:
     return Return;
 }
 
-static RETURNTYPE DuplicateDataCheck(PLINKEDLIST pLinkedList, PCHAR pszKey)
+RETURNTYPE
+HashTableInit(PPHASHTABLE ppHashTable,
+              DWORD       dwCapacity,
+              DWORD (*pfnHashFunction)(PVOID, WORD, ULONGLONG),
+              DWORD dwFlags)
 {
-    RETURNTYPE      Return     = ERR_GENERIC;
-    WORD            wCounter   = 0;
-    PHASHTABLEENTRY pTempEntry = NULL;
+    return HashTableCreate(ppHashTable, dwCapacity, pfnHashFunction, dwFlags,
+                           NULL);
+}
 
-    if ((NULL == pLinkedList) || (NULL == pszKey))
+RETURNTYPE
+HashTableInitReadMostly(PPHASHTABLE ppHashTable,
+                        DWORD       dwCapacity,
+                        DWORD (*pfnHashFunction)(PVOID, WORD, ULONGLONG),
+                        DWORD  dwFlags,
+                        PEPOCH pEpoch)
+{
+    if (NULL == pEpoch)
     {
         DEBUG_PRINT("Input NULL");
-        goto EXIT;
+        return ERR_INVALID_PARAM;
+    }
+
+    return HashTableCreate(ppHashTable, dwCapacity, pfnHashFunction, dwFlags,
+                           pEpoch);
+}
+
+// NOTE: Moves up to dwSlotCount slots of the old array into the current one
+// and frees the old array once it has been fully walked. Migrated slots are
+// marked deleted so probes through the old array still reach later keys.
+static VOID HashTableMigrate(PHASHTABLE pHashTable, DWORD dwSlotCount)
+{
+    PHASHTABLESLOTS pOldSlots = &pHashTable->m_OldSlots;
+    DWORD           dwHash    = 0;
+    DWORD           dwSlot    = 0;
+
+    if (!HashTableMigrating(pHashTable))
+    {
+        return;
     }
 
-    for (wCounter = 0; wCounter < pLinkedList->m_wSize; wCounter++)
+    while ((0 < dwSlotCount) &&
+           (pHashTable->m_dwMigrateSlot < pOldSlots->m_dwCapacity))
     {
-        pTempEntry = LinkedListReturn(pLinkedList, wCounter);
-        if (NULL == pTempEntry)
+        DWORD dwOldSlot = pHashTable->m_dwMigrateSlot;
+
+        if (0 != (pOldSlots->m_pCtrl[dwOldSlot] & CTRL_FULL))
         {
-            DEBUG_PRINT("LinkedListReturn failed");
-            goto EXIT;
+            dwHash = pOldSlots->m_pSlots[dwOldSlot].m_dwHash;
+            dwSlot = SlotsFindInsert(&pHashTable->m_Slots, dwHash);
+
+            if (CTRL_EMPTY == pHashTable->m_Slots.m_pCtrl[dwSlot])
+            {
+                pHashTable->m_Slots.m_dwGrowthLeft -= 1;
+            }
+            pHashTable->m_Slots.m_pSlots[dwSlot] =
+                pOldSlots->m_pSlots[dwOldSlot];
+            pHashTable->m_Slots.m_pCtrl[dwSlot] = HashH2(dwHash);
+            pHashTable->m_ppValueEntries
+                [pHashTable->m_Slots.m_pSlots[dwSlot].m_dwValueIndex] =
+                &pHashTable->m_Slots.m_pSlots[dwSlot];
+            pOldSlots->m_pCtrl[dwOldSlot]       = CTRL_DELETED;
+            SecureZeroMemory(&pOldSlots->m_pSlots[dwOldSlot],
+                             sizeof(HASHTABLEENTRY));
         }
 
-        if (EXIT_SUCCESS ==
-            CompareMemory(pTempEntry->m_caKey, pszKey, pTempEntry->m_wKeyLen))
+        pHashTable->m_dwMigrateSlot++;
+        dwSlotCount--;
+    }
+
+    // NOTE: Entries were zeroed as they migrated, so the old array is freed
+    // without another full pass over it. An array the same size as the
+    // current one is kept for the next same size re-hash instead, so tables
+    // churning through tombstones stop calling the heap.
+    if (pHashTable->m_dwMigrateSlot == pOldSlots->m_dwCapacity)
+    {
+        if ((NULL == pHashTable->m_pSpareBlock) &&
+            (pOldSlots->m_dwCapacity == pHashTable->m_Slots.m_dwCapacity))
         {
-            DEBUG_PRINT("Duplicate key found");
-            Return = ERR_INVALID_PARAM;
-            goto EXIT;
+            pHashTable->m_pSpareBlock = pOldSlots->m_pCtrl;
+        }
+        else
+        {
+            HeapFree(GetProcessHeap(), NO_OPTION, pOldSlots->m_pCtrl);
         }
+        SecureZeroMemory(pOldSlots, sizeof(HASHTABLESLOTS));
+        pHashTable->m_dwMigrateSlot = 0;
     }
-
-    Return = SUCCESS;
-EXIT:
-    return Return;
 }
 
-static RETURNTYPE HashTableNewEntryCalc(PHASHTABLE      pHashTable,
-                                        PHASHTABLEENTRY pNewEntry)
+// NOTE: Copies every entry into the new slot array in one pass, leaving the
+// current array intact for readers, then publishes the new array and retires
+// the old one. Readers carry on in the old array meanwhile, it holds the same
+// entries.
+static RETURNTYPE
+HashTableReHashReadMostly(PHASHTABLE pHashTable, DWORD dwGroupCount)
 {
-    RETURNTYPE  Return       = ERR_GENERIC;
-    DWORD       dwHash       = 0;
-    DWORD       dwEntryIndex = 0;
-    PLINKEDLIST pTempList    = NULL;
-
-    if (((NULL == pHashTable) || (NULL == pHashTable->m_pfnHashFunction) ||
-         (NULL == pNewEntry)))
+    RETURNTYPE      Return     = ERR_GENERIC;
+    HASHTABLESLOTS  Current    = pHashTable->m_Slots;
+    PHASHTABLESLOTS pPublished = pHashTable->m_pPublished;
+    DWORD           dwHash     = 0;
+    DWORD           dwSlot     = 0;
+
+    Return = SlotsAlloc(&pHashTable->m_Slots, pHashTable->m_CapacityMode,
+                        dwGroupCount);
+    if (SUCCESS != Return)
     {
-        DEBUG_PRINT("Input NULL");
-        return EXIT_FAILURE;
+        DEBUG_PRINT("SlotsAlloc failed");
+        pHashTable->m_Slots = Current;
+        goto EXIT;
     }
+    pHashTable->m_dwHeapAllocs += 1;
 
-    dwHash = pHashTable->m_pfnHashFunction(pNewEntry->m_caKey);
-
-    dwEntryIndex = dwHash % (DWORD)pHashTable->m_wCapacity;
-
-    if (NULL == pHashTable->m_ppTable[dwEntryIndex])
+    for (DWORD dwOldSlot = 0; dwOldSlot < Current.m_dwCapacity; dwOldSlot++)
     {
-        LinkedListInit(&pTempList);
-        if (NULL == pTempList)
+        if (0 != (Current.m_pCtrl[dwOldSlot] & CTRL_FULL))
         {
-            DEBUG_PRINT("LinkedListInit failed");
-            goto EXIT;
-        }
+            dwHash = Current.m_pSlots[dwOldSlot].m_dwHash;
+            dwSlot = SlotsFindInsert(&pHashTable->m_Slots, dwHash);
 
-        if (EXIT_FAILURE == LinkedListInsert(pTempList, pNewEntry, 0))
-        {
-            DEBUG_PRINT("LinkedListInsert failed");
-            goto EXIT;
+            pHashTable->m_Slots.m_pSlots[dwSlot] = Current.m_pSlots[dwOldSlot];
+            pHashTable->m_Slots.m_pCtrl[dwSlot]  = HashH2(dwHash);
+            pHashTable->m_Slots.m_dwGrowthLeft -= 1;
         }
-
-        pHashTable->m_ppTable[dwEntryIndex] = pTempList;
     }
-    else
+
+    Return = HashTablePublish(pHashTable);
+    if (SUCCESS != Return)
     {
-        pTempList = pHashTable->m_ppTable[dwEntryIndex];
+        DEBUG_PRINT("HashTablePublish failed");
+        SlotsFree(&pHashTable->m_Slots);
+        pHashTable->m_Slots = Current;
+        goto EXIT;
+    }
 
-        Return = DuplicateDataCheck(pTempList, pNewEntry->m_caKey);
-        if (SUCCESS != Return)
+    // NOTE: Only now that the new array is kept can the value array point
+    // into it.
+    for (dwSlot = 0; dwSlot < pHashTable->m_Slots.m_dwCapacity; dwSlot++)
+    {
+        if (0 != (pHashTable->m_Slots.m_pCtrl[dwSlot] & CTRL_FULL))
         {
-            if (ERR_GENERIC == Return)
-            {
-                DEBUG_PRINT("DuplicateDataCheck failed");
-            }
-            goto EXIT;
+            pHashTable->m_ppValueEntries
+                [pHashTable->m_Slots.m_pSlots[dwSlot].m_dwValueIndex] =
+                &pHashTable->m_Slots.m_pSlots[dwSlot];
         }
     }
 
-    pHashTable->m_wSize++;
-    Return = SUCCESS;
+    // NOTE: The caller holds its write lock, other retired memory is left
+    // for it to reclaim once it lets go.
+    EpochDefer(pHashTable->m_pEpoch, pPublished, PublishedFree);
 EXIT:
     return Return;
 }
 
-// NOTE: On error, dLoadFactor will be less than zero.
-static double LoadFactor(PHASHTABLE pHashTable)
+// NOTE: Starts moving the entries into a new slot array of dwGroupCount
+// groups, larger, smaller or the same size as the current one. The caller
+// has finished any earlier migration.
+static RETURNTYPE HashTableResize(PHASHTABLE pHashTable, DWORD dwGroupCount)
 {
-    double dLoadFactor = -1;
+    RETURNTYPE     Return  = ERR_GENERIC;
+    HASHTABLESLOTS Current = pHashTable->m_Slots;
 
-    if (NULL == pHashTable)
+    if (HashTableReadMostly(pHashTable))
     {
-        DEBUG_PRINT("Input NULL");
-        goto EXIT;
+        return HashTableReHashReadMostly(pHashTable, dwGroupCount);
     }
 
-    if (0.0 == (double)pHashTable->m_wCapacity)
+    // NOTE: Only the control bytes of the spare array need clearing, its
+    // entries were zeroed as they migrated out.
+    if ((NULL != pHashTable->m_pSpareBlock) &&
+        (dwGroupCount == Current.m_Reduce.m_dwGroupCount))
     {
-        DEBUG_PRINT("Stop trying to divide by zero");
-        goto EXIT;
+        ZeroMemory(pHashTable->m_pSpareBlock, Current.m_dwCapacity);
+        SlotsInit(&pHashTable->m_Slots, pHashTable->m_CapacityMode,
+                  dwGroupCount, pHashTable->m_pSpareBlock);
+        pHashTable->m_pSpareBlock = NULL;
+    }
+    else
+    {
+        Return = SlotsAlloc(&pHashTable->m_Slots, pHashTable->m_CapacityMode,
+                            dwGroupCount);
+        if (SUCCESS != Return)
+        {
+            DEBUG_PRINT("SlotsAlloc failed");
+            pHashTable->m_Slots = Current;
+            goto EXIT;
+        }
+        pHashTable->m_dwHeapAllocs += 1;
+
+        // NOTE: The spare is the old capacity, of no use from here on.
+        if (NULL != pHashTable->m_pSpareBlock)
+        {
+            ZeroingHeapFree(GetProcessHeap(), NO_OPTION,
+                            (PVOID *)&pHashTable->m_pSpareBlock,
+                            SlotsBytes(Current.m_dwCapacity));
+        }
     }
 
-    dLoadFactor =
-        ((double)pHashTable->m_wSize) / ((double)pHashTable->m_wCapacity);
+    pHashTable->m_OldSlots      = Current;
+    pHashTable->m_dwMigrateSlot = 0;
 
+    Return = SUCCESS;
 EXIT:
-    return dLoadFactor;
+    return Return;
 }
 
-static PLINKEDLIST HashTabletoList(PHASHTABLE pHashTable)
+// NOTE: Starts a re-hash into a new slot array. The table grows to the next
+// group count of its policy unless most of the used slots are tombstones, in
+// which case the capacity is kept and the tombstones are dropped as the
+// entries migrate.
+static RETURNTYPE HashTableStartReHash(PHASHTABLE pHashTable)
 {
-    PLINKEDLIST     pHashTableList = NULL;
-    WORD            wCounter       = 0;
-    PLINKEDLIST     pTempList      = NULL;
-    WORD            iTempSize      = 0;
-    WORD            wCounter2      = 0;
-    PHASHTABLEENTRY pTempEntry     = NULL;
+    DWORD dwGroupCount = 0;
 
-    if (NULL == pHashTable)
-    {
-        DEBUG_PRINT("Input NULL");
-        return NULL;
-    }
+    // NOTE: Any earlier migration has to finish first, only two arrays are
+    // ever kept.
+    HashTableMigrate(pHashTable, MAXDWORD);
 
-    LinkedListInit(&pHashTableList);
-    if (NULL == pHashTableList)
+    dwGroupCount = pHashTable->m_Slots.m_Reduce.m_dwGroupCount;
+    if (pHashTable->m_dwSize > (MaxLoad(pHashTable->m_Slots.m_dwCapacity) / 2))
     {
-        DEBUG_PRINT("LinkedListInit failed");
-        return NULL;
+        dwGroupCount =
+            CapacityGroupCount(pHashTable->m_CapacityMode, dwGroupCount + 1);
     }
 
-    for (wCounter = 0; wCounter < pHashTable->m_wCapacity; wCounter++)
-    {
-        if (NULL != pHashTable->m_ppTable[wCounter])
-        {
-            pTempList = pHashTable->m_ppTable[wCounter];
-            iTempSize = pTempList->m_wSize;
+    return HashTableResize(pHashTable, dwGroupCount);
+}
 
-            for (wCounter2 = 0; wCounter2 < iTempSize; wCounter2++)
-            {
-                pTempEntry = LinkedListReturn(pTempList, wCounter2);
-                if (NULL == pTempEntry)
-                {
-                    DEBUG_PRINT("LinkedListReturn()");
-                    goto CLEAN;
-                }
-
-                if (SUCCESS != LinkedListInsert(pHashTableList, pTempEntry,
-                                                pHashTableList->m_wSize))
-                {
-                    DEBUG_PRINT("LinkedListInsert()");
-                    goto CLEAN;
-                }
-            }
+// NOTE: Statistics builds time every re-hash.
+static RETURNTYPE HashTableReHash(PHASHTABLE pHashTable)
+{
+#ifdef HASHTABLE_STATS
+    RETURNTYPE    Return  = ERR_GENERIC;
+    LARGE_INTEGER liStart = {0};
+    LARGE_INTEGER liEnd   = {0};
+    LONG64        llTicks = 0;
 
-            if (SUCCESS != LinkedListDestroy(pTempList, NULL))
-            {
-                DEBUG_PRINT("LinkedListDestroy failed");
-                goto CLEAN;
-            }
+    QueryPerformanceCounter(&liStart);
+    Return = HashTableStartReHash(pHashTable);
+    QueryPerformanceCounter(&liEnd);
 
-            pHashTable->m_ppTable[wCounter] = NULL;
+    if (SUCCESS == Return)
+    {
+        llTicks = liEnd.QuadPart - liStart.QuadPart;
+        STATS_ADD(pHashTable, m_llReHashes, 1);
+        STATS_ADD(pHashTable, m_llReHashTicks, llTicks);
+        if (llTicks > pHashTable->m_Counters.m_llMaxReHashTicks)
+        {
+            pHashTable->m_Counters.m_llMaxReHashTicks = llTicks;
         }
     }
 
-    goto EXIT;
-CLEAN:
-    LinkedListDestroy(pHashTableList, NULL);
-EXIT:
-    return pHashTableList;
+    return Return;
+#else
+    return HashTableStartReHash(pHashTable);
+#endif
 }
 
-static RETURNTYPE HashTableListToTable(PHASHTABLE  pHashTable,
-                                       PLINKEDLIST pLinkedList)
+RETURNTYPE
+HashTableMaintenance(PHASHTABLE pHashTable)
 {
-    RETURNTYPE      Return     = ERR_GENERIC;
-    WORD            iTempSize  = 0;
-    WORD            wCounter   = 0;
-    PHASHTABLEENTRY pTempEntry = NULL;
+    RETURNTYPE Return       = SUCCESS;
+    DWORD      dwEntries    = 0;
+    DWORD      dwGroupCount = 0;
 
-    if ((NULL == pHashTable) || (NULL == pLinkedList))
+    if (NULL == pHashTable)
     {
         DEBUG_PRINT("Input NULL");
-        goto EXIT;
+        return ERR_GENERIC;
     }
 
-    iTempSize = pLinkedList->m_wSize;
+    // NOTE: Moves whatever an earlier re-hash left, so the table isn't paying
+    // for two arrays any longer than it has to.
+    HashTableMigrate(pHashTable, MAXDWORD);
+
+    // NOTE: A shrunk table is half loaded, it has to double before it grows
+    // again or halve before it shrinks again.
+    if (pHashTable->m_dwSize >=
+        (MaxLoad(pHashTable->m_Slots.m_dwCapacity) / SHRINK_LOAD_DIVISOR))
+    {
+        goto EXIT;
+    }
 
-    for (wCounter = 0; wCounter < iTempSize; wCounter++)
+    dwEntries = pHashTable->m_dwSize * 2;
+    if (MIN_CAPACITY > dwEntries)
     {
-        pTempEntry = LinkedListReturn(pLinkedList, wCounter);
+        dwEntries = MIN_CAPACITY;
+    }
 
-        if (NULL == pTempEntry)
+    dwGroupCount = GroupsForEntries(pHashTable->m_CapacityMode, dwEntries);
+    if (dwGroupCount < pHashTable->m_Slots.m_Reduce.m_dwGroupCount)
+    {
+        Return = HashTableResize(pHashTable, dwGroupCount);
+        if (SUCCESS != Return)
         {
-            DEBUG_PRINT("LinkedListReturn failed");
-            Return = ERR_GENERIC;
+            DEBUG_PRINT("HashTableResize failed");
             goto EXIT;
         }
+        HashTableMigrate(pHashTable, MAXDWORD);
+    }
 
-        Return = HashTableNewEntryCalc(pHashTable, pTempEntry);
-        if (EXIT_SUCCESS != Return)
+    if (pHashTable->m_dwValueCapacity > (dwEntries * 2))
+    {
+        Return = ValuesResize(pHashTable, dwEntries);
+        if (SUCCESS != Return)
         {
-            if (EXIT_FAILURE != Return)
-            {
-                DEBUG_PRINT("HashTableNewEntryCalc failed");
-            }
-            goto EXIT;
+            DEBUG_PRINT("ValuesResize failed");
         }
     }
-
 EXIT:
     return Return;
 }
 
-static RETURNTYPE HashTableReHash(PHASHTABLE pHashTable)
+DWORD
+HashTableHash(PHASHTABLE pHashTable, PCHAR pszKey, WORD wKeyLen)
 {
-    RETURNTYPE  Return          = SUCCESS;
-    PLINKEDLIST pLinkedList     = NULL;
-    WORD        wCapacityHolder = pHashTable->m_wCapacity;
+    return HashTableHashKey(pHashTable, pszKey, wKeyLen);
+}
 
-    if (NULL == pHashTable)
+RETURNTYPE
+HashTableNewEntry(PHASHTABLE pHashTable,
+                  PVOID      pData,
+                  PCHAR      pszKey,
+                  WORD       wKeyLen)
+{
+    if ((NULL == pHashTable) || (NULL == pszKey))
     {
         DEBUG_PRINT("Input NULL");
-        goto EXIT;
+        return ERR_GENERIC;
     }
 
-    if (pHashTable->m_wCapacity >= MAX_PRIME_IN_RANGE)
+    RETURNTYPE Return = HashTableNewEntryHashed(
+        pHashTable, pData, pszKey, wKeyLen,
+        HashTableHashKey(pHashTable, pszKey, wKeyLen));
+
+    return (DUPLICATE_KEY == Return) ? ERR_INVALID_PARAM : Return;
+}
+
+RETURNTYPE
+HashTableNewEntryHashed(PHASHTABLE pHashTable,
+                        PVOID      pData,
+                        PCHAR      pszKey,
+                        WORD       wKeyLen,
+                        DWORD      dwHash)
+{
+    RETURNTYPE      Return    = ERR_GENERIC;
+    PHASHTABLEENTRY pNewEntry = NULL;
+    DWORD           dwSlot    = 0;
+
+    if ((NULL == pHashTable) || (NULL == pData) || (NULL == pszKey))
     {
-        DEBUG_PRINT("Re-hashing not possible. Size limitation, load factor may "
-                    "start to be non-ideal.\n");
-        Return = SUCCESS;
+        DEBUG_PRINT("Input NULL");
         goto EXIT;
     }
 
-    double dwLoadFactor = LoadFactor(pHashTable);
-    if (0 > dwLoadFactor)
+    if (KEY_LENGTH < wKeyLen)
     {
-        DEBUG_PRINT("LoadFactor()");
+        DEBUG_PRINT("wKeyLen too long");
         goto EXIT;
     }
 
-    if (dwLoadFactor < LOAD_FACTOR_UPDATE)
+    if (MAXDWORD == pHashTable->m_dwSize)
     {
-        Return = SUCCESS;
+        DEBUG_PRINT("Hash table full");
         goto EXIT;
     }
 
-    pLinkedList = HashTabletoList(pHashTable);
-    if (NULL == pLinkedList)
+    if ((MAXDWORD !=
+         SlotsFind(&pHashTable->m_Slots, pszKey, wKeyLen, dwHash)) ||
+        (HashTableMigrating(pHashTable) &&
+         (MAXDWORD !=
+          SlotsFind(&pHashTable->m_OldSlots, pszKey, wKeyLen, dwHash))))
     {
-        DEBUG_PRINT("HashTabletoList failed");
-        return EXIT_FAILURE;
+        DEBUG_PRINT("Duplicate key found");
+        Return = DUPLICATE_KEY;
+        goto EXIT;
     }
 
-    pHashTable->m_wSize = 0;
-
-    // A hash table's size greatly impacts how often clusters form.
-    // When the size is prime, clustering happens less.
-    pHashTable->m_wCapacity = NextPrime(wCapacityHolder);
-    if (0 == pHashTable->m_wCapacity)
+    // NOTE: Nothing has changed yet if the value array can't grow.
+    if (pHashTable->m_dwSize == pHashTable->m_dwValueCapacity)
     {
-        DEBUG_PRINT("NextPrime()");
-        goto CLEAN;
+        Return = ValuesReserve(pHashTable,
+                               (MAXDWORD / 2 < pHashTable->m_dwValueCapacity)
+                                   ? MAXDWORD
+                                   : pHashTable->m_dwValueCapacity * 2);
+        if (SUCCESS != Return)
+        {
+            DEBUG_PRINT("ValuesReserve failed");
+            goto EXIT;
+        }
     }
 
-    ZeroingHeapFree(GetProcessHeap(), NO_OPTION, (PVOID)&pHashTable->m_ppTable,
-                             wCapacityHolder * sizeof(PLINKEDLIST));
+    HashTableMigrate(pHashTable, MIGRATE_SLOTS_PER_OP);
+
+    dwSlot = SlotsFindInsert(&pHashTable->m_Slots, dwHash);
 
-    pHashTable->m_ppTable =
-        HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY,
-                  pHashTable->m_wCapacity * sizeof(PLINKEDLIST));
-    if (NULL == pHashTable->m_ppTable)
+    // NOTE: Re-using a tombstone doesn't use up any growth, only filling an
+    // empty slot does.
+    if ((CTRL_EMPTY == pHashTable->m_Slots.m_pCtrl[dwSlot]) &&
+        (0 == pHashTable->m_Slots.m_dwGrowthLeft))
     {
-        DEBUG_ERROR("HeapAlloc()");
-        goto CLEAN;
+        Return = HashTableReHash(pHashTable);
+        if (SUCCESS != Return)
+        {
+            DEBUG_PRINT("HashTableReHash failed");
+            goto EXIT;
+        }
+
+        HashTableMigrate(pHashTable, MIGRATE_SLOTS_PER_OP);
+        dwSlot = SlotsFindInsert(&pHashTable->m_Slots, dwHash);
     }
 
-    for (WORD wCounter = 0; wCounter < pHashTable->m_wCapacity; wCounter++)
+    if (CTRL_EMPTY == pHashTable->m_Slots.m_pCtrl[dwSlot])
     {
-        pHashTable->m_ppTable[wCounter] = NULL;
+        pHashTable->m_Slots.m_dwGrowthLeft -= 1;
     }
 
-    if (EXIT_FAILURE == HashTableListToTable(pHashTable, pLinkedList))
+    HashTableWriteBegin(pHashTable);
+    pNewEntry = &pHashTable->m_Slots.m_pSlots[dwSlot];
+    if (FAILED(memcpy_s(pNewEntry->m_caKey, KEY_LENGTH, pszKey, wKeyLen)))
     {
-        DEBUG_PRINT("HashTabletoList()");
-        goto CLEAN2;
+        DEBUG_ERROR("memcpy_s failed");
+        HashTableWriteEnd(pHashTable);
+        goto EXIT;
     }
+    pNewEntry->m_wKeyLen      = wKeyLen;
+    pNewEntry->m_dwHash       = dwHash;
+    pNewEntry->m_pData        = pData;
+    pNewEntry->m_dwValueIndex = pHashTable->m_dwSize;
+    pHashTable->m_Slots.m_pCtrl[dwSlot] = HashH2(dwHash);
+    HashTableWriteEnd(pHashTable);
+
+    pHashTable->m_ppValues[pHashTable->m_dwSize]       = pData;
+    pHashTable->m_ppValueEntries[pHashTable->m_dwSize] = pNewEntry;
+    pHashTable->m_dwSize++;
+    STATS_ADD(pHashTable, m_llInserts, 1);
 
     Return = SUCCESS;
-    goto CLEAN;
-CLEAN2:
-    ZeroingHeapFree(GetProcessHeap(), NO_OPTION, (PVOID)&pHashTable->m_ppTable,
-                             pHashTable->m_wCapacity * sizeof(PLINKEDLIST));
-CLEAN:
-    LinkedListDestroy(pLinkedList, NULL);
 EXIT:
     return Return;
 }
 
-RETURNTYPE
-HashTableNewEntry(PHASHTABLE pHashTable,
-                  PVOID      pData,
-                  PCHAR      pszKey,
-                  WORD       wKeyLen)
+PVOID
+HashTableReturnEntry(PHASHTABLE pHashTable, PCHAR pszKey, WORD wKeyLen)
 {
-    RETURNTYPE      Return    = SUCCESS;
-    PHASHTABLEENTRY pNewEntry = NULL;
+    if ((NULL == pHashTable) || (NULL == pszKey))
+    {
+        DEBUG_PRINT("Input NULL");
+        return NULL;
+    }
 
-    if ((NULL == pHashTable) || (NULL == pData) || (NULL == pszKey))
+    return HashTableReturnEntryHashed(
+        pHashTable, pszKey, wKeyLen,
+        HashTableHashKey(pHashTable, pszKey, wKeyLen));
+}
+
+PVOID
+HashTableReturnEntryHashed(PHASHTABLE pHashTable,
+                           PCHAR      pszKey,
+                           WORD       wKeyLen,
+                           DWORD      dwHash)
+{
+    DWORD dwSlot = 0;
+    PVOID pData  = NULL;
+
+    if ((NULL == pHashTable) || (NULL == pszKey) ||
+        (NULL == pHashTable->m_pfnHashFunction))
     {
         DEBUG_PRINT("Input NULL");
         goto EXIT;
@@ -576,115 +1116,161 @@ HashTableNewEntry(PHASHTABLE pHashTable,
         goto EXIT;
     }
 
-    if (EXIT_FAILURE == HashTableReHash(pHashTable))
+    if (HashTableReadMostly(pHashTable))
     {
-        DEBUG_PRINT("HashTableReHash failed");
+        pData = HashTableReadMostlyFind(pHashTable, pszKey, wKeyLen, dwHash);
         goto EXIT;
     }
 
-    pNewEntry =
-        HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(HASHTABLEENTRY));
-
-    if (NULL == pNewEntry)
+    // NOTE: Lookups don't migrate, so concurrent readers never write to the
+    // table.
+    dwSlot = SlotsFind(&pHashTable->m_Slots, pszKey, wKeyLen, dwHash);
+    if (MAXDWORD != dwSlot)
     {
-        DEBUG_ERROR("HeapAlloc failed");
+        pData = pHashTable->m_Slots.m_pSlots[dwSlot].m_pData;
+        StatsLookup(pHashTable, &pHashTable->m_Slots, dwHash, dwSlot);
         goto EXIT;
     }
 
-    if (FAILED(memcpy_s(pNewEntry->m_caKey, (KEY_LENGTH + 1), pszKey, wKeyLen)))
-    {
-        DEBUG_ERROR("wmemcpy_s failed");
-        goto CLEAN;
-    }
-    pNewEntry->m_pfnFreeFunction = NULL;
-    pNewEntry->m_wKeyLen         = wKeyLen;
-    pNewEntry->m_pData           = pData;
-
-    Return = HashTableNewEntryCalc(pHashTable, pNewEntry);
-    if (EXIT_SUCCESS != Return)
+    if (HashTableMigrating(pHashTable))
     {
-        if (EXIT_FAILURE == Return)
+        dwSlot = SlotsFind(&pHashTable->m_OldSlots, pszKey, wKeyLen, dwHash);
+        if (MAXDWORD != dwSlot)
         {
-            DEBUG_PRINT("HashTableNewEntryCalc()");
+            pData = pHashTable->m_OldSlots.m_pSlots[dwSlot].m_pData;
+            StatsLookup(pHashTable, &pHashTable->m_OldSlots, dwHash, dwSlot);
+            goto EXIT;
         }
-        goto CLEAN;
     }
 
-    Return = SUCCESS;
-    goto EXIT;
-CLEAN:
-    ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pNewEntry,
-                             sizeof(HASHTABLEENTRY));
+    StatsLookup(pHashTable, &pHashTable->m_Slots, dwHash, MAXDWORD);
+    DEBUG_PRINT("entry doesn't exist");
 EXIT:
-    return Return;
+    return pData;
 }
 
-PVOID
-HashTableReturnEntry(PHASHTABLE pHashTable, PCHAR pszKey, WORD wKeyLen)
+// NOTE: Prefetches the first group a key probes and the first entry in it
+// whose control byte matches, nearly always the key's own entry.
+static VOID SlotsPrefetch(PHASHTABLESLOTS pSlots, DWORD dwHash)
 {
-    DWORD           dwHash       = 0;
-    DWORD           dwEntryIndex = 0;
-    PLINKEDLIST     pTempList    = NULL;
-    WORD            iTempSize    = 0;
-    WORD            wCounter     = 0;
-    PHASHTABLEENTRY pTempEntry   = NULL;
-    PVOID           pData        = NULL;
+    DWORD dwGroup = HashGroup(pSlots, dwHash);
+    DWORD dwMatch =
+        GroupMatch(pSlots->m_pCtrl + (dwGroup * GROUP_WIDTH), HashH2(dwHash));
 
-    if ((NULL == pHashTable) || (NULL == pszKey) ||
-        (NULL == pHashTable->m_pfnHashFunction))
+    if (0 != dwMatch)
     {
-        DEBUG_PRINT("Input NULL");
-        goto EXIT;
+        PreFetchCacheLine(
+            PF_TEMPORAL_LEVEL_1,
+            &pSlots->m_pSlots[(dwGroup * GROUP_WIDTH) + LowestSetBit(dwMatch)]);
     }
+}
 
-    if (KEY_LENGTH < wKeyLen)
+DWORD
+HashTableReturnEntries(PHASHTABLE pHashTable,
+                       PCHAR     *ppszKeys,
+                       PWORD      pwKeyLens,
+                       DWORD      dwCount,
+                       PVOID     *ppData)
+{
+    DWORD           adwHashes[HASHTABLE_BATCH] = {0};
+    PHASHTABLESLOTS pSlots                     = NULL;
+    DWORD           dwBatch                    = 0;
+    DWORD           dwValid                    = 0; // Bit per usable key.
+    DWORD           dwFound                    = 0;
+    PCHAR           pszKey                     = NULL;
+
+    if ((NULL == pHashTable) || (NULL == ppszKeys) || (NULL == pwKeyLens) ||
+        (NULL == ppData))
     {
-        DEBUG_PRINT("wKeyLen too long");
-        goto EXIT;
+        DEBUG_PRINT("Input NULL");
+        return 0;
     }
 
-    dwHash = pHashTable->m_pfnHashFunction(pszKey);
+    // NOTE: Only used for prefetching, a read-mostly table's published slots
+    // may be replaced before the keys are resolved.
+    pSlots = HashTableReadMostly(pHashTable)
+                 ? ReadPointerAcquire(
+                       (PVOID const volatile *)&pHashTable->m_pPublished)
+                 : &pHashTable->m_Slots;
 
-    dwEntryIndex = dwHash % (DWORD)pHashTable->m_wCapacity;
-
-    if (NULL == pHashTable->m_ppTable[dwEntryIndex])
+    for (DWORD dwFirst = 0; dwFirst < dwCount; dwFirst += dwBatch)
     {
-        DEBUG_PRINT("entry doesn't exist");
-        goto EXIT;
-    }
-    else
-    {
-        pTempList = pHashTable->m_ppTable[dwEntryIndex];
+        dwBatch = ((dwCount - dwFirst) < HASHTABLE_BATCH) ? (dwCount - dwFirst)
+                                                          : HASHTABLE_BATCH;
+        dwValid = 0;
+
+        // NOTE: Hashing touches only the keys, every group load is in flight
+        // by the time the first one is needed.
+        for (DWORD dwKey = 0; dwKey < dwBatch; dwKey++)
+        {
+            pszKey = ppszKeys[dwFirst + dwKey];
+            if ((NULL == pszKey) || (KEY_LENGTH < pwKeyLens[dwFirst + dwKey]))
+            {
+                DEBUG_PRINT("Key invalid");
+                continue;
+            }
+
+            dwValid |= (1 << dwKey);
+            adwHashes[dwKey] = HashTableHashKey(pHashTable, pszKey,
+                                                pwKeyLens[dwFirst + dwKey]);
+            PreFetchCacheLine(
+                PF_TEMPORAL_LEVEL_1,
+                pSlots->m_pCtrl +
+                    (HashGroup(pSlots, adwHashes[dwKey]) * GROUP_WIDTH));
+        }
 
-        iTempSize = pTempList->m_wSize;
+        for (DWORD dwKey = 0; dwKey < dwBatch; dwKey++)
+        {
+            if (0 != (dwValid & (1 << dwKey)))
+            {
+                SlotsPrefetch(pSlots, adwHashes[dwKey]);
+            }
+        }
 
-        for (wCounter = 0; wCounter < iTempSize; wCounter++)
+        for (DWORD dwKey = 0; dwKey < dwBatch; dwKey++)
         {
-            pTempEntry = LinkedListReturn(pTempList, wCounter);
-            if (EXIT_SUCCESS ==
-                CompareMemory(pTempEntry->m_caKey, pszKey, wKeyLen))
+            ppData[dwFirst + dwKey] = NULL;
+            if (0 == (dwValid & (1 << dwKey)))
+            {
+                continue;
+            }
+
+            ppData[dwFirst + dwKey] = HashTableReturnEntryHashed(
+                pHashTable, ppszKeys[dwFirst + dwKey],
+                pwKeyLens[dwFirst + dwKey], adwHashes[dwKey]);
+            if (NULL != ppData[dwFirst + dwKey])
             {
-                pData = pTempEntry->m_pData;
-                goto EXIT;
+                dwFound++;
             }
         }
     }
 
-    DEBUG_PRINT("entry doesn't exist");
-EXIT:
-    return pData;
+    return dwFound;
 }
 
 PVOID
 HashTableDestroyEntry(PHASHTABLE pHashTable, PCHAR pszKey, WORD wKeyLen)
 {
-    DWORD           dwHash       = 0;
-    DWORD           dwEntryIndex = 0;
-    PLINKEDLIST     pTempList    = NULL;
-    WORD            iTempSize    = 0;
-    WORD            wCounter     = 0;
-    PHASHTABLEENTRY pTempEntry   = NULL;
-    PVOID           pData        = NULL;
+    if ((NULL == pHashTable) || (NULL == pszKey))
+    {
+        DEBUG_PRINT("Input NULL");
+        return NULL;
+    }
+
+    return HashTableDestroyEntryHashed(
+        pHashTable, pszKey, wKeyLen,
+        HashTableHashKey(pHashTable, pszKey, wKeyLen));
+}
+
+PVOID
+HashTableDestroyEntryHashed(PHASHTABLE pHashTable,
+                            PCHAR      pszKey,
+                            WORD       wKeyLen,
+                            DWORD      dwHash)
+{
+    PHASHTABLESLOTS pSlots = NULL;
+    DWORD           dwSlot = 0;
+    PVOID           pData  = NULL;
 
     if ((NULL == pHashTable) || (NULL == pszKey) ||
         (NULL == pHashTable->m_pfnHashFunction))
@@ -699,125 +1285,232 @@ HashTableDestroyEntry(PHASHTABLE pHashTable, PCHAR pszKey, WORD wKeyLen)
         goto EXIT;
     }
 
-    dwHash = pHashTable->m_pfnHashFunction(pszKey);
-
-    dwEntryIndex = dwHash % (DWORD)pHashTable->m_wCapacity;
+    pSlots = &pHashTable->m_Slots;
+    dwSlot = SlotsFind(pSlots, pszKey, wKeyLen, dwHash);
+    if ((MAXDWORD == dwSlot) && HashTableMigrating(pHashTable))
+    {
+        pSlots = &pHashTable->m_OldSlots;
+        dwSlot = SlotsFind(pSlots, pszKey, wKeyLen, dwHash);
+    }
 
-    if (NULL == pHashTable->m_ppTable[dwEntryIndex])
+    if (MAXDWORD == dwSlot)
     {
         DEBUG_PRINT("entry not found, key invalid");
         goto EXIT;
     }
-    else
-    {
-        pTempList = pHashTable->m_ppTable[dwEntryIndex];
 
-        iTempSize = pTempList->m_wSize;
+    pData = pSlots->m_pSlots[dwSlot].m_pData;
+    ValuesRemove(pHashTable, pSlots->m_pSlots[dwSlot].m_dwValueIndex);
+    HashTableWriteBegin(pHashTable);
+    SlotsErase(pSlots, dwSlot);
+    HashTableWriteEnd(pHashTable);
+    pHashTable->m_dwSize -= 1;
+    STATS_ADD(pHashTable, m_llRemoves, 1);
 
-        for (wCounter = 0; wCounter < iTempSize; wCounter++)
-        {
-            pTempEntry = LinkedListReturn(pTempList, wCounter);
+    HashTableMigrate(pHashTable, MIGRATE_SLOTS_PER_OP);
+EXIT:
+    return pData;
+}
 
-            if (SUCCESS == CompareMemory(pTempEntry->m_caKey, pszKey, wKeyLen))
-            {
-                if (NULL == LinkedListRemove(pTempList, wCounter, NULL))
-                {
-                    DEBUG_PRINT("LinkedListRemove()");
-                    goto EXIT;
-                }
-
-                if (0 == pTempList->m_wSize)
-                {
-                    if (EXIT_FAILURE == LinkedListDestroy(pTempList, NULL))
-                    {
-                        DEBUG_PRINT("LinkedListDestroy failed");
-                        goto EXIT;
-                    }
-
-                    pHashTable->m_ppTable[dwEntryIndex] = NULL;
-                }
-
-                pData = pTempEntry->m_pData;
-                ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pTempEntry,
-                                sizeof(HASHTABLEENTRY));
-
-                pHashTable->m_wSize -= 1;
-                goto EXIT;
-            }
-        }
+VOID
+HashTableForEach(PHASHTABLE pHashTable,
+                 BOOL (*pfnVisit)(PVOID pData, PVOID pContext),
+                 PVOID pContext)
+{
+    if ((NULL == pHashTable) || (NULL == pfnVisit))
+    {
+        DEBUG_PRINT("Input NULL");
+        return;
     }
 
-EXIT:
-    return pData;
+    for (DWORD dwIndex = 0; dwIndex < pHashTable->m_dwSize; dwIndex++)
+    {
+        if (FALSE == pfnVisit(pHashTable->m_ppValues[dwIndex], pContext))
+        {
+            return;
+        }
+    }
 }
 
-static void HashTableFreeHelper(PVOID pData)
+VOID
+HashTableCursorInit(PHASHTABLE pHashTable, PHASHTABLECURSOR pCursor)
 {
-    PHASHTABLEENTRY pTempEntry = (PHASHTABLEENTRY)pData;
-    if (NULL == pTempEntry)
+    if ((NULL == pHashTable) || (NULL == pCursor))
     {
-        DEBUG_PRINT("HashTableFreeHelper failed");
+        DEBUG_PRINT("Input NULL");
         return;
     }
 
-    if (NULL == pTempEntry->m_pfnFreeFunction)
+    pCursor->m_pHashTable = pHashTable;
+    pCursor->m_dwIndex    = 0;
+}
+
+PVOID
+HashTableCursorNext(PHASHTABLECURSOR pCursor)
+{
+    if ((NULL == pCursor) || (NULL == pCursor->m_pHashTable))
     {
-        ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pTempEntry,
-                        sizeof(HASHTABLEENTRY));
+        DEBUG_PRINT("Input NULL");
+        return NULL;
     }
-    else
+
+    if (pCursor->m_dwIndex >= pCursor->m_pHashTable->m_dwSize)
     {
-        pTempEntry->m_pfnFreeFunction(pTempEntry->m_pData);
-        ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pTempEntry,
-                        sizeof(HASHTABLEENTRY));
+        return NULL;
     }
+
+    return pCursor->m_pHashTable->m_ppValues[pCursor->m_dwIndex++];
+}
+
+PVOID *
+HashTableValues(PHASHTABLE pHashTable, PDWORD pdwCount)
+{
+    if ((NULL == pHashTable) || (NULL == pdwCount))
+    {
+        DEBUG_PRINT("Input NULL");
+        return NULL;
+    }
+
+    *pdwCount = pHashTable->m_dwSize;
+    return pHashTable->m_ppValues;
+}
+
+typedef struct FREECONTEXT
+{
+    VOID (*m_pfnFreeFunction)(PVOID);
+} FREECONTEXT, *PFREECONTEXT;
+
+static BOOL FreeVisit(PVOID pData, PVOID pContext)
+{
+    ((PFREECONTEXT)pContext)->m_pfnFreeFunction(pData);
+    return TRUE;
 }
 
 RETURNTYPE
 HashTableDestroy(PHASHTABLE pHashTable, VOID (*pfnFreeFunction)(PVOID))
 {
-    RETURNTYPE      Return     = ERR_GENERIC;
-    WORD            wCounter   = 0;
-    WORD            wCounter2  = 0;
-    PHASHTABLEENTRY pTempEntry = NULL;
+    RETURNTYPE  Return      = ERR_GENERIC;
+    FREECONTEXT FreeContext = {pfnFreeFunction};
 
-    if ((NULL == pHashTable) || (NULL == pHashTable->m_ppTable))
+    if ((NULL == pHashTable) || (NULL == pHashTable->m_Slots.m_pCtrl))
     {
         DEBUG_PRINT("Input NULL");
         goto EXIT;
     }
 
-    for (wCounter = 0; wCounter < pHashTable->m_wCapacity; wCounter++)
+    if (NULL != pfnFreeFunction)
     {
-        if (NULL != pHashTable->m_ppTable[wCounter])
-        {
-            for (wCounter2 = 0;
-                 wCounter2 < pHashTable->m_ppTable[wCounter]->m_wSize;
-                 wCounter2++)
-            {
-                pTempEntry = LinkedListReturn(pHashTable->m_ppTable[wCounter],
-                                              wCounter2);
-                pTempEntry->m_pfnFreeFunction = pfnFreeFunction;
-            }
-
-            if (SUCCESS != LinkedListDestroy(pHashTable->m_ppTable[wCounter],
-                                             &HashTableFreeHelper))
-            {
-                DEBUG_PRINT("LinkedListDestroy()");
-                goto CLEAN;
-            }
-        }
+        HashTableForEach(pHashTable, FreeVisit, &FreeContext);
     }
 
-    Return = SUCCESS;
-CLEAN:
-    ZeroingHeapFree(GetProcessHeap(), NO_OPTION, (PVOID)&pHashTable->m_ppTable,
-                             pHashTable->m_wCapacity * sizeof(PLINKEDLIST));
+    if (HashTableMigrating(pHashTable))
+    {
+        SlotsFree(&pHashTable->m_OldSlots);
+    }
+    // NOTE: The spare is always the current array's size.
+    if (NULL != pHashTable->m_pSpareBlock)
+    {
+        ZeroingHeapFree(GetProcessHeap(), NO_OPTION,
+                        (PVOID *)&pHashTable->m_pSpareBlock,
+                        SlotsBytes(pHashTable->m_Slots.m_dwCapacity));
+    }
+    SlotsFree(&pHashTable->m_Slots);
+    ZeroingHeapFree(GetProcessHeap(), NO_OPTION,
+                    (PVOID *)&pHashTable->m_ppValues,
+                    ValuesBytes(pHashTable->m_dwValueCapacity));
+
+    // NOTE: The published copy shares m_Slots' arrays, only the copy itself
+    // is left to free.
+    if (NULL != pHashTable->m_pPublished)
+    {
+        ZeroingHeapFree(GetProcessHeap(), NO_OPTION,
+                        (PVOID *)&pHashTable->m_pPublished,
+                        sizeof(HASHTABLESLOTS));
+    }
 
     ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pHashTable,
-                             sizeof(HASHTABLE));
+                    sizeof(HASHTABLE));
+
+    Return = SUCCESS;
 EXIT:
     return Return;
 }
 
+#ifdef HASHTABLE_STATS
+static VOID SlotsGetStats(PHASHTABLESLOTS pSlots, PHASHTABLESTATS pStats)
+{
+    DWORD dwGroups = 0;
+
+    pStats->m_dwCapacity += pSlots->m_dwCapacity;
+
+    for (DWORD dwSlot = 0; dwSlot < pSlots->m_dwCapacity; dwSlot++)
+    {
+        if (CTRL_DELETED == pSlots->m_pCtrl[dwSlot])
+        {
+            pStats->m_dwTombstones++;
+        }
+        if (0 == (pSlots->m_pCtrl[dwSlot] & CTRL_FULL))
+        {
+            continue;
+        }
+
+        dwGroups = SlotsProbeLength(pSlots, pSlots->m_pSlots[dwSlot].m_dwHash,
+                                    dwSlot);
+        pStats->m_adwProbeHistogram[(dwGroups < HASHTABLE_STATS_PROBES)
+                                        ? (dwGroups - 1)
+                                        : (HASHTABLE_STATS_PROBES - 1)]++;
+        if (dwGroups > pStats->m_dwMaxProbe)
+        {
+            pStats->m_dwMaxProbe = dwGroups;
+        }
+    }
+}
+
+static ULONGLONG TicksToMicroseconds(LONG64 llTicks)
+{
+    LARGE_INTEGER liFrequency = {0};
+
+    QueryPerformanceFrequency(&liFrequency);
+
+    return (ULONGLONG)((llTicks * 1000000) / liFrequency.QuadPart);
+}
+
+VOID
+HashTableGetStats(PHASHTABLE pHashTable, PHASHTABLESTATS pStats)
+{
+    PHASHTABLECOUNTERS pCounters = NULL;
+    ULONGLONG          ullMax    = 0;
+
+    if ((NULL == pHashTable) || (NULL == pStats))
+    {
+        DEBUG_PRINT("Input NULL");
+        return;
+    }
+
+    pStats->m_dwSize += pHashTable->m_dwSize;
+    SlotsGetStats(&pHashTable->m_Slots, pStats);
+    if (HashTableMigrating(pHashTable))
+    {
+        SlotsGetStats(&pHashTable->m_OldSlots, pStats);
+    }
+
+    pCounters = &pHashTable->m_Counters;
+    pStats->m_ullLookups += pCounters->m_llLookups;
+    pStats->m_ullLookupMisses += pCounters->m_llLookupMisses;
+    pStats->m_ullLookupGroups += pCounters->m_llLookupGroups;
+    pStats->m_ullMissGroups += pCounters->m_llMissGroups;
+    pStats->m_ullInserts += pCounters->m_llInserts;
+    pStats->m_ullRemoves += pCounters->m_llRemoves;
+    pStats->m_ullReHashes += pCounters->m_llReHashes;
+    pStats->m_ullReHashMicroseconds +=
+        TicksToMicroseconds(pCounters->m_llReHashTicks);
+
+    ullMax = TicksToMicroseconds(pCounters->m_llMaxReHashTicks);
+    if (ullMax > pStats->m_ullMaxReHashMicroseconds)
+    {
+        pStats->m_ullMaxReHashMicroseconds = ullMax;
+    }
+}
+#endif // HASHTABLE_STATS
+
 // End of file
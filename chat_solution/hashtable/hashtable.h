@@ -1,6 +1,10 @@
 #pragma once
 
-#include "../linkedlist/linkedlist.h"
+#include <Windows.h>
+#include <stdio.h>
+
+#include "capacity.h"
+#include "hashfunc.h"
 
 #ifndef CUSTOM_MACROS
 #define CUSTOM_MACROS
@@ -89,6 +93,10 @@ typedef enum
     do                                                                         \
     {                                                                          \
     } while (0)
+#define DEBUG_ERROR_SUPPLIED(error_code, fmt, ...)                             \
+    do                                                                         \
+    {                                                                          \
+    } while (0)
 #define DEBUG_WSAERROR(fmt, ...)                                               \
     do                                                                         \
     {                                                                          \
@@ -126,45 +134,167 @@ static inline VOID ZeroingHeapFree(HANDLE hHeap,
 
 #endif // CUSTOM_MACROS
 
-#define KEY_LENGTH   50
+#define KEY_LENGTH   46 // Fills an entry to 64 bytes on x64.
 #define MIN_CAPACITY 7 // WARNING: Do not set to 0 or library will divide by 0.
 
-// Once the load factor is above this set
-// value, the hash table will be re-hashed.
-// This allows for maximum efficiency when
-// adding new values. Per wikipedia, optimal load
-// factor for separate chaining hash tables is
-// between 1 and 3.
-#define LOAD_FACTOR_UPDATE 1.5
+// NOTE: The table is open addressed. Slots are grouped sixteen at a time and
+// every slot has one control byte in a contiguous array, so a whole group can
+// be checked for a key with a single SSE2 compare. Entries are stored inline
+// in a parallel slot array, so a lookup touches the group's control bytes and
+// the matching entry instead of walking bucket lists.
+#define GROUP_WIDTH 16
+
+// NOTE: Control byte values. Zeroed memory is an empty table. Full slots have
+// the high bit set and the low seven bits of the key's hash (H2) below it.
+#define CTRL_EMPTY   0x00
+#define CTRL_DELETED 0x01
+#define CTRL_FULL    0x80
+#define CTRL_H2_MASK 0x7F
+
+// Once inserts have used this fraction of the slots, the hash table will be
+// re-hashed. Open addressing with group probing stays fast up to a load
+// factor of 7/8, tombstones included.
+#define MAX_LOAD_NUMERATOR   7
+#define MAX_LOAD_DENOMINATOR 8
+
+// NOTE: Returned by HashTableNewEntryHashed and ShardedHashTableNewEntry when
+// the key is already in the table. It is kept clear of the RETURNTYPE codes,
+// so callers can tell a taken key from a failed insert.
+#define DUPLICATE_KEY 13
+
+// NOTE: HashTableInit flags. Power of two capacity is the cheaper default,
+// prime capacity spreads hashes with weak low bits more evenly.
+#define HASHTABLE_CAPACITY_POW2  0x0
+#define HASHTABLE_CAPACITY_PRIME 0x1
+
+// NOTE: Lookups run without a lock, see HashTableInitReadMostly. Only
+// ShardedHashTableInit takes this flag, it creates the epoch for its shards.
+#define HASHTABLE_READ_MOSTLY 0x2
+
+// NOTE: HashTableMaintenance shrinks a table once its entries fill less than
+// this fraction of its maximum load.
+#define SHRINK_LOAD_DIVISOR 4
 
-#define MAX_PRIME_IN_RANGE 65521 // Largest prime in unsigned 16-bit int range
-#define DUPLICATE_KEY      2
+// NOTE: Growth is incremental. When the table runs out of room a new slot
+// array is allocated and every insert or removal moves this many slots out of
+// the old array, so no single operation pays for the whole re-hash.
+#define MIGRATE_SLOTS_PER_OP (2 * GROUP_WIDTH)
 
+// NOTE: Keys are stored by length, not NUL terminated, so an entry fills one
+// 64-byte cache line on x64.
 typedef struct HASHTABLEENTRY
 {
     PVOID m_pData;
-    CHAR  m_caKey[KEY_LENGTH + 1];
+    DWORD m_dwHash;       // The key's full hash, re-hashing doesn't recompute.
+    DWORD m_dwValueIndex; // Position of m_pData in the table's value array.
+    CHAR  m_caKey[KEY_LENGTH];
     WORD  m_wKeyLen;
-    VOID (*m_pfnFreeFunction)(PVOID);
 } HASHTABLEENTRY, *PHASHTABLEENTRY;
 
+typedef struct HASHTABLESLOTS
+{
+    DWORD           m_dwCapacity;   // Number of slots, a whole number of groups.
+    DWORD           m_dwGrowthLeft; // Inserts into empty slots left.
+    CAPACITYREDUCE  m_Reduce;       // Maps a hash to its first group.
+    PBYTE           m_pCtrl;        // One control byte per slot.
+    PHASHTABLEENTRY m_pSlots;       // Entries, stored inline.
+} HASHTABLESLOTS, *PHASHTABLESLOTS;
+
+// NOTE: Statistics are opt-in. Without HASHTABLE_STATS defined nothing is
+// counted and the hot paths are unchanged. It changes HASHTABLE's layout, so
+// it has to be defined for the hashtable library and every project including
+// this header alike. The Debug configurations of the hashtable, server and
+// test projects define it.
+#ifdef HASHTABLE_STATS
+// NOTE: Probes longer than this many groups share the last bucket.
+#define HASHTABLE_STATS_PROBES 8
+
+typedef struct HASHTABLECOUNTERS
+{
+    LONG64 volatile m_llLookups;
+    LONG64 volatile m_llLookupMisses;
+    LONG64 volatile m_llLookupGroups; // Groups probed by all lookups.
+    LONG64 volatile m_llMissGroups;   // Groups probed by failed lookups.
+    LONG64 volatile m_llInserts;
+    LONG64 volatile m_llRemoves;
+    LONG64 volatile m_llReHashes;
+    LONG64 volatile m_llReHashTicks;    // QueryPerformanceCounter ticks.
+    LONG64 volatile m_llMaxReHashTicks;
+} HASHTABLECOUNTERS, *PHASHTABLECOUNTERS;
+
+typedef struct HASHTABLESTATS
+{
+    DWORD     m_dwSize;
+    DWORD     m_dwCapacity;   // Slots, both arrays while migrating.
+    DWORD     m_dwTombstones; // Deleted slots still taking up room.
+    DWORD     m_dwMaxProbe;   // Longest probe to an entry, in groups.
+    // Entries by the number of groups a lookup probes to reach them.
+    DWORD     m_adwProbeHistogram[HASHTABLE_STATS_PROBES];
+    ULONGLONG m_ullLookups;
+    ULONGLONG m_ullLookupMisses;
+    ULONGLONG m_ullLookupGroups;
+    ULONGLONG m_ullMissGroups;
+    ULONGLONG m_ullInserts;
+    ULONGLONG m_ullRemoves;
+    ULONGLONG m_ullReHashes;
+    ULONGLONG m_ullReHashMicroseconds;
+    ULONGLONG m_ullMaxReHashMicroseconds;
+} HASHTABLESTATS, *PHASHTABLESTATS;
+#endif // HASHTABLE_STATS
+
 typedef struct HASHTABLE
 {
-    WORD m_wSize;     // Max size is 65535.
-    WORD m_wCapacity; // Number of rows in hash table
-    DWORD (*m_pfnHashFunction)(PVOID);
-    PPLINKEDLIST m_ppTable;
+    DWORD                    m_dwSize;
+    DWORD                    (*m_pfnHashFunction)(PVOID, WORD, ULONGLONG);
+    ULONGLONG                m_ullSeed; // Passed to every hash call.
+    CAPACITYMODE             m_CapacityMode;
+    HASHTABLESLOTS           m_Slots;    // Receives every insert.
+    HASHTABLESLOTS           m_OldSlots; // Being migrated, m_pCtrl NULL if not.
+    DWORD                    m_dwMigrateSlot; // Next slot of m_OldSlots.
+    struct EPOCH            *m_pEpoch;        // Read-mostly tables only.
+    PHASHTABLESLOTS volatile m_pPublished;    // m_Slots as readers see it.
+    LONG volatile            m_lSequence; // Odd while a writer changes slots.
+    PBYTE                    m_pSpareBlock;  // Left by a same size re-hash.
+    DWORD                    m_dwHeapAllocs; // Heap allocations since init.
+    PVOID                   *m_ppValues;       // Every entry's data, dense.
+    PHASHTABLEENTRY         *m_ppValueEntries; // Entry holding each value.
+    DWORD                    m_dwValueCapacity;
+#ifdef HASHTABLE_STATS
+    HASHTABLECOUNTERS        m_Counters;
+#endif
 } HASHTABLE, *PHASHTABLE, **PPHASHTABLE;
 
-BOOL IsPrime(WORD wValue);
-
-WORD NextPrime(WORD wValue);
+// NOTE: Walks the table's value array. The table must not be modified while a
+// cursor is in use.
+typedef struct HASHTABLECURSOR
+{
+    PHASHTABLE m_pHashTable;
+    DWORD      m_dwIndex;
+} HASHTABLECURSOR, *PHASHTABLECURSOR;
 
+// NOTE: HashTableDefaultHash is used when pfnHashFunction is NULL.
 RETURNTYPE
 HashTableInit(PPHASHTABLE ppHashTable,
-              WORD        wCapacity,
-              DWORD (*pfnHashFunction)(PVOID));
+              DWORD       dwCapacity,
+              DWORD (*pfnHashFunction)(PVOID, WORD, ULONGLONG),
+              DWORD dwFlags);
 
+// NOTE: Lookups don't lock and never write, writers and walks still have to
+// be serialised by the caller. Readers call EpochEnter on pEpoch before a
+// lookup and EpochExit once done with its result, a re-hash hands the old
+// slots to EpochDefer instead of freeing them under a reader, and the caller
+// calls EpochReclaim once it has released its write lock. A lookup that
+// overlaps an insert or removal is retried. For this the table gives up
+// incremental growth, a re-hash copies every entry at once.
+RETURNTYPE
+HashTableInitReadMostly(PPHASHTABLE   ppHashTable,
+                        DWORD         dwCapacity,
+                        DWORD (*pfnHashFunction)(PVOID, WORD, ULONGLONG),
+                        DWORD         dwFlags,
+                        struct EPOCH *pEpoch);
+
+// NOTE: Returns ERR_INVALID_PARAM if the key is already in the table, the
+// Hashed variant below returns DUPLICATE_KEY.
 RETURNTYPE
 HashTableNewEntry(PHASHTABLE pHashTable,
                   PVOID      pData,
@@ -177,7 +307,87 @@ HashTableReturnEntry(PHASHTABLE pHashTable, PCHAR pszKey, WORD wKeyLen);
 PVOID
 HashTableDestroyEntry(PHASHTABLE pHashTable, PCHAR pszKey, WORD wKeyLen);
 
+// NOTE: Looks up dwCount keys at once, ppData[i] receives key i's data or
+// NULL. The keys are hashed and their groups and entries prefetched a batch
+// at a time before any is compared, so the cache misses of different keys
+// overlap instead of being paid one after another. Returns the number found.
+#define HASHTABLE_BATCH 16
+
+DWORD
+HashTableReturnEntries(PHASHTABLE pHashTable,
+                       PCHAR     *ppszKeys,
+                       PWORD      pwKeyLens,
+                       DWORD      dwCount,
+                       PVOID     *ppData);
+
+// NOTE: The key's hash with the table's function and seed. Tables made by
+// HashTableInit in the same process hash a key the same way when they use the
+// same function, so callers that route keys across several tables can hash
+// once and pass the result to the Hashed variants below.
+DWORD
+HashTableHash(PHASHTABLE pHashTable, PCHAR pszKey, WORD wKeyLen);
+
+RETURNTYPE
+HashTableNewEntryHashed(PHASHTABLE pHashTable,
+                        PVOID      pData,
+                        PCHAR      pszKey,
+                        WORD       wKeyLen,
+                        DWORD      dwHash);
+
+PVOID
+HashTableReturnEntryHashed(PHASHTABLE pHashTable,
+                           PCHAR      pszKey,
+                           WORD       wKeyLen,
+                           DWORD      dwHash);
+
+PVOID
+HashTableDestroyEntryHashed(PHASHTABLE pHashTable,
+                            PCHAR      pszKey,
+                            WORD       wKeyLen,
+                            DWORD      dwHash);
+
+// NOTE: Calls pfnVisit on every stored entry's data, in no particular order,
+// until it returns FALSE. The table must not be modified during the walk.
+VOID
+HashTableForEach(PHASHTABLE pHashTable,
+                 BOOL (*pfnVisit)(PVOID pData, PVOID pContext),
+                 PVOID pContext);
+
+// NOTE: Every entry's data is also kept in one contiguous array, so walking
+// the table costs its size rather than its capacity and reads no keys.
+// Removals move the last value into the gap, order isn't kept.
+VOID
+HashTableCursorInit(PHASHTABLE pHashTable, PHASHTABLECURSOR pCursor);
+
+// NOTE: Returns the next entry's data, NULL once every entry has been seen.
+PVOID
+HashTableCursorNext(PHASHTABLECURSOR pCursor);
+
+// NOTE: The value array itself, valid until the table is next modified.
+// *pdwCount receives the number of values.
+PVOID *
+HashTableValues(PHASHTABLE pHashTable, PDWORD pdwCount);
+
+// NOTE: Tables only grow as entries are added, removals never resize them so
+// a logout costs no more than a lookup. Call this off the latency critical
+// paths, from a timer for instance, like any other write. It finishes an
+// unfinished migration and shrinks a table left mostly empty after a peak to
+// twice its current entries, so it neither grows nor shrinks again until the
+// entries double or halve.
+RETURNTYPE
+HashTableMaintenance(PHASHTABLE pHashTable);
+
 RETURNTYPE
 HashTableDestroy(PHASHTABLE pHashTable, VOID (*pfnFreeFunction)(PVOID));
 
+#ifdef HASHTABLE_STATS
+// NOTE: Adds the table's counters and a walk of its slots to pStats, so the
+// shards of one table can be summed. The walk reads every control byte, the
+// table must not be modified meanwhile. A re-hash is timed from the decision
+// to grow to the new array being ready, the migration after it is spread
+// over later operations and not counted.
+VOID
+HashTableGetStats(PHASHTABLE pHashTable, PHASHTABLESTATS pStats);
+#endif
+
 // End of file
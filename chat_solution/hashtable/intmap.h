@@ -0,0 +1,366 @@
+// NOTE: No include guard on purpose. Every inclusion generates one map for
+// an integer key type. Define INTMAP_TYPE, INTMAP_PREFIX and INTMAP_KEY
+// before including this file, e.g.
+//
+//     #define INTMAP_TYPE   SOCKETMAP
+//     #define INTMAP_PREFIX SocketMap
+//     #define INTMAP_KEY    SOCKET
+//     #include "../hashtable/intmap.h"
+//
+// That gives SOCKETMAP, PSOCKETMAP, PPSOCKETMAP and SocketMapInit(),
+// SocketMapInsert(), SocketMapFind(), SocketMapRemove(),
+// SocketMapMaintenance(), SocketMapSize() and SocketMapDestroy(). All of them
+// are static inline, so the key compare and hash fold into the caller.
+//
+// Unlike HASHTABLE the key is the integer itself. There is no byte key to
+// copy, hash or compare, and a slot is only the key and its data. The map is
+// not thread safe, callers hold their own lock.
+
+#include <Windows.h>
+
+#include "hashtable.h"
+
+#if !defined(INTMAP_TYPE) || !defined(INTMAP_PREFIX) || !defined(INTMAP_KEY)
+#error "Define INTMAP_TYPE, INTMAP_PREFIX and INTMAP_KEY before intmap.h"
+#endif
+
+#ifndef INTMAP_COMMON
+#define INTMAP_COMMON
+
+#define INTMAP_MIN_CAPACITY 16
+
+// NOTE: Grows past half full and shrinks from maintenance below an eighth,
+// to a quarter, so a map sitting on a boundary does not resize back and
+// forth.
+#define INTMAP_GROW_DIVISOR   2
+#define INTMAP_SHRINK_DIVISOR 8
+
+#define INTMAP_CONCAT_(a, b) a##b
+#define INTMAP_CONCAT(a, b)  INTMAP_CONCAT_(a, b)
+#define INTMAP_NAME(name)    INTMAP_CONCAT(INTMAP_PREFIX, name)
+
+// NOTE: Keys such as sockets and ids are small and step by a constant, so
+// their low bits on their own would cluster. The 64-bit finaliser from
+// MurmurHash3 spreads every key bit over the low bits used for the index.
+static inline ULONGLONG IntMapMix(ULONGLONG ullKey)
+{
+    ullKey ^= ullKey >> 33;
+    ullKey *= 0xFF51AFD7ED558CCDull;
+    ullKey ^= ullKey >> 33;
+    ullKey *= 0xC4CEB9FE1A85EC53ull;
+    ullKey ^= ullKey >> 33;
+    return ullKey;
+}
+
+// NOTE: Smallest power of two that is at least dwEntries times
+// dwDivisor, and never below INTMAP_MIN_CAPACITY. Returns 0 if that does not
+// fit in a DWORD.
+static inline DWORD IntMapCapacity(DWORD dwEntries, DWORD dwDivisor)
+{
+    ULONGLONG ullNeeded   = (ULONGLONG)dwEntries * dwDivisor;
+    ULONGLONG ullCapacity = INTMAP_MIN_CAPACITY;
+
+    while (ullCapacity < ullNeeded)
+    {
+        ullCapacity <<= 1;
+    }
+
+    return (ullCapacity > MAXDWORD) ? 0 : (DWORD)ullCapacity;
+}
+
+#endif // INTMAP_COMMON
+
+#define INTMAP_SLOT    INTMAP_CONCAT(INTMAP_TYPE, SLOT)
+#define INTMAP_PSLOT   INTMAP_CONCAT(P, INTMAP_SLOT)
+#define INTMAP_PTYPE   INTMAP_CONCAT(P, INTMAP_TYPE)
+#define INTMAP_PPTYPE  INTMAP_CONCAT(PP, INTMAP_TYPE)
+
+// NOTE: A NULL m_pData marks an empty slot, so NULL cannot be stored.
+typedef struct INTMAP_SLOT
+{
+    INTMAP_KEY m_Key;
+    PVOID      m_pData;
+} INTMAP_SLOT, *INTMAP_PSLOT;
+
+typedef struct INTMAP_TYPE
+{
+    INTMAP_PSLOT m_pSlots;
+    DWORD        m_dwMask; // Capacity - 1, the capacity is a power of two.
+    DWORD        m_dwSize;
+} INTMAP_TYPE, *INTMAP_PTYPE, **INTMAP_PPTYPE;
+
+static inline DWORD INTMAP_NAME(Home)(INTMAP_PTYPE pMap, INTMAP_KEY Key)
+{
+    return (DWORD)IntMapMix((ULONGLONG)Key) & pMap->m_dwMask;
+}
+
+// NOTE: Linear probing from the home slot. Returns the slot holding Key, or
+// the empty slot the probe ended on. The load cap keeps one empty.
+static inline DWORD INTMAP_NAME(Probe)(INTMAP_PTYPE pMap, INTMAP_KEY Key)
+{
+    DWORD dwSlot = INTMAP_NAME(Home)(pMap, Key);
+
+    while ((NULL != pMap->m_pSlots[dwSlot].m_pData) &&
+           (Key != pMap->m_pSlots[dwSlot].m_Key))
+    {
+        dwSlot = (dwSlot + 1) & pMap->m_dwMask;
+    }
+
+    return dwSlot;
+}
+
+// NOTE: Moves every entry to a new slot array of dwCapacity slots.
+static inline RETURNTYPE INTMAP_NAME(Resize)(INTMAP_PTYPE pMap,
+                                             DWORD        dwCapacity)
+{
+    INTMAP_PSLOT pOldSlots = pMap->m_pSlots;
+    DWORD        dwOldMask = pMap->m_dwMask;
+    INTMAP_PSLOT pSlots    = NULL;
+
+    // NOTE: ZeroingHeapFree takes a DWORD byte count.
+    if ((0 == dwCapacity) || (dwCapacity > (MAXDWORD / sizeof(INTMAP_SLOT))))
+    {
+        DEBUG_PRINT("Capacity too large");
+        return ERR_MEMORY_ALLOCATION;
+    }
+
+    pSlots = (INTMAP_PSLOT)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                     dwCapacity * sizeof(INTMAP_SLOT));
+    if (NULL == pSlots)
+    {
+        DEBUG_ERROR("Failed to allocate slots");
+        return ERR_MEMORY_ALLOCATION;
+    }
+
+    pMap->m_pSlots = pSlots;
+    pMap->m_dwMask = dwCapacity - 1;
+
+    if (NULL != pOldSlots)
+    {
+        for (DWORD dwSlot = 0; dwSlot <= dwOldMask; dwSlot++)
+        {
+            if (NULL != pOldSlots[dwSlot].m_pData)
+            {
+                pSlots[INTMAP_NAME(Probe)(pMap, pOldSlots[dwSlot].m_Key)] =
+                    pOldSlots[dwSlot];
+            }
+        }
+
+        ZeroingHeapFree(GetProcessHeap(), NO_OPTION, (PVOID *)&pOldSlots,
+                        (dwOldMask + 1) * (DWORD)sizeof(INTMAP_SLOT));
+    }
+
+    return SUCCESS;
+}
+
+static inline RETURNTYPE INTMAP_NAME(Init)(INTMAP_PPTYPE ppMap,
+                                           DWORD         dwCapacity)
+{
+    RETURNTYPE   Return = ERR_GENERIC;
+    INTMAP_PTYPE pMap   = NULL;
+
+    if (NULL == ppMap)
+    {
+        DEBUG_PRINT("Input NULL");
+        goto EXIT;
+    }
+
+    pMap = (INTMAP_PTYPE)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                   sizeof(INTMAP_TYPE));
+    if (NULL == pMap)
+    {
+        DEBUG_ERROR("Failed to allocate map");
+        Return = ERR_MEMORY_ALLOCATION;
+        goto EXIT;
+    }
+
+    Return = INTMAP_NAME(Resize)(
+        pMap, IntMapCapacity(dwCapacity, INTMAP_GROW_DIVISOR));
+    if (SUCCESS != Return)
+    {
+        ZeroingHeapFree(GetProcessHeap(), NO_OPTION, (PVOID *)&pMap,
+                        sizeof(INTMAP_TYPE));
+        goto EXIT;
+    }
+
+    *ppMap = pMap;
+EXIT:
+    return Return;
+}
+
+// NOTE: Returns ERR_INVALID_PARAM if Key is already in the map.
+static inline RETURNTYPE INTMAP_NAME(Insert)(INTMAP_PTYPE pMap,
+                                             INTMAP_KEY   Key,
+                                             PVOID        pData)
+{
+    RETURNTYPE Return = SUCCESS;
+    DWORD      dwSlot = 0;
+
+    if ((NULL == pMap) || (NULL == pData))
+    {
+        DEBUG_PRINT("Input NULL");
+        return ERR_GENERIC;
+    }
+
+    if (((pMap->m_dwSize + 1) * (ULONGLONG)INTMAP_GROW_DIVISOR) >
+        ((ULONGLONG)pMap->m_dwMask + 1))
+    {
+        Return = INTMAP_NAME(Resize)(
+            pMap, IntMapCapacity(pMap->m_dwSize + 1, INTMAP_GROW_DIVISOR));
+        if (SUCCESS != Return)
+        {
+            return Return;
+        }
+    }
+
+    dwSlot = INTMAP_NAME(Probe)(pMap, Key);
+    if (NULL != pMap->m_pSlots[dwSlot].m_pData)
+    {
+        DEBUG_PRINT("Key already in map");
+        return ERR_INVALID_PARAM;
+    }
+
+    pMap->m_pSlots[dwSlot].m_Key   = Key;
+    pMap->m_pSlots[dwSlot].m_pData = pData;
+    pMap->m_dwSize++;
+    return SUCCESS;
+}
+
+static inline PVOID INTMAP_NAME(Find)(INTMAP_PTYPE pMap, INTMAP_KEY Key)
+{
+    if (NULL == pMap)
+    {
+        DEBUG_PRINT("Input NULL");
+        return NULL;
+    }
+
+    return pMap->m_pSlots[INTMAP_NAME(Probe)(pMap, Key)].m_pData;
+}
+
+// NOTE: Backward shift deletion. Entries after the removed one move back
+// into the hole unless that would put them before their home slot, so no
+// tombstones build up and probes stay as short as after a fresh insert.
+static inline PVOID INTMAP_NAME(Remove)(INTMAP_PTYPE pMap, INTMAP_KEY Key)
+{
+    DWORD dwHole = 0;
+    DWORD dwNext = 0;
+    PVOID pData  = NULL;
+
+    if (NULL == pMap)
+    {
+        DEBUG_PRINT("Input NULL");
+        return NULL;
+    }
+
+    dwHole = INTMAP_NAME(Probe)(pMap, Key);
+    pData  = pMap->m_pSlots[dwHole].m_pData;
+    if (NULL == pData)
+    {
+        return NULL;
+    }
+
+    dwNext = dwHole;
+    for (;;)
+    {
+        DWORD dwHome = 0;
+
+        dwNext = (dwNext + 1) & pMap->m_dwMask;
+        if (NULL == pMap->m_pSlots[dwNext].m_pData)
+        {
+            break;
+        }
+
+        // NOTE: The entry may move if its home is not cyclically within
+        // (dwHole, dwNext], i.e. its probe passed through the hole.
+        dwHome = INTMAP_NAME(Home)(pMap, pMap->m_pSlots[dwNext].m_Key);
+        if (((dwNext - dwHome) & pMap->m_dwMask) >=
+            ((dwNext - dwHole) & pMap->m_dwMask))
+        {
+            pMap->m_pSlots[dwHole] = pMap->m_pSlots[dwNext];
+            dwHole                 = dwNext;
+        }
+    }
+
+    pMap->m_pSlots[dwHole].m_Key   = 0;
+    pMap->m_pSlots[dwHole].m_pData = NULL;
+    pMap->m_dwSize--;
+    return pData;
+}
+
+static inline DWORD INTMAP_NAME(Size)(INTMAP_PTYPE pMap)
+{
+    if (NULL == pMap)
+    {
+        DEBUG_PRINT("Input NULL");
+        return 0;
+    }
+
+    return pMap->m_dwSize;
+}
+
+// NOTE: Inserts never shrink the map. Call this off the hot path, e.g. from
+// a timer, to hand back slots after a burst of connections has drained.
+static inline RETURNTYPE INTMAP_NAME(Maintenance)(INTMAP_PTYPE pMap)
+{
+    DWORD dwCapacity = 0;
+
+    if (NULL == pMap)
+    {
+        DEBUG_PRINT("Input NULL");
+        return ERR_GENERIC;
+    }
+
+    if (((ULONGLONG)pMap->m_dwSize * INTMAP_SHRINK_DIVISOR) >=
+        ((ULONGLONG)pMap->m_dwMask + 1))
+    {
+        return SUCCESS;
+    }
+
+    dwCapacity = IntMapCapacity(pMap->m_dwSize, INTMAP_GROW_DIVISOR * 2);
+    if (dwCapacity >= (pMap->m_dwMask + 1))
+    {
+        return SUCCESS;
+    }
+
+    return INTMAP_NAME(Resize)(pMap, dwCapacity);
+}
+
+static inline RETURNTYPE INTMAP_NAME(Destroy)(INTMAP_PTYPE pMap,
+                                              VOID (*pfnFreeFunction)(PVOID))
+{
+    if (NULL == pMap)
+    {
+        DEBUG_PRINT("Input NULL");
+        return ERR_GENERIC;
+    }
+
+    if (NULL != pMap->m_pSlots)
+    {
+        for (DWORD dwSlot = 0; dwSlot <= pMap->m_dwMask; dwSlot++)
+        {
+            if ((NULL != pfnFreeFunction) &&
+                (NULL != pMap->m_pSlots[dwSlot].m_pData))
+            {
+                pfnFreeFunction(pMap->m_pSlots[dwSlot].m_pData);
+            }
+        }
+
+        ZeroingHeapFree(GetProcessHeap(), NO_OPTION,
+                        (PVOID *)&pMap->m_pSlots,
+                        (pMap->m_dwMask + 1) * (DWORD)sizeof(INTMAP_SLOT));
+    }
+
+    ZeroingHeapFree(GetProcessHeap(), NO_OPTION, (PVOID *)&pMap,
+                    sizeof(INTMAP_TYPE));
+    return SUCCESS;
+}
+
+#undef INTMAP_PPTYPE
+#undef INTMAP_PTYPE
+#undef INTMAP_PSLOT
+#undef INTMAP_SLOT
+#undef INTMAP_TYPE
+#undef INTMAP_PREFIX
+#undef INTMAP_KEY
+
+// End of file
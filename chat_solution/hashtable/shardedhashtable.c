@@ -0,0 +1,369 @@
+#include <Windows.h>
+#include <stdio.h>
+
+#include "shardedhashtable.h"
+
+// NOTE: The hash's low bits already pick the control byte and the group
+// within a shard, the top bits are left for choosing the shard.
+static inline PHASHTABLESHARD ShardForHash(PSHARDEDHASHTABLE pShardedTable,
+                                           DWORD             dwHash)
+{
+    return &pShardedTable->m_aShards[dwHash >> (32 - SHARD_BITS)];
+}
+
+// NOTE: A write's re-hash only defers the old slots, see EpochDefer. They and
+// anything retired earlier are freed here once the shard lock is released,
+// so no free function runs under it.
+static inline VOID ShardedHashTableReclaim(PSHARDEDHASHTABLE pShardedTable)
+{
+    if (NULL != pShardedTable->m_pEpoch)
+    {
+        EpochReclaim(pShardedTable->m_pEpoch);
+    }
+}
+
+RETURNTYPE
+ShardedHashTableInit(PPSHARDEDHASHTABLE ppShardedTable,
+                     DWORD              dwCapacity,
+                     DWORD (*pfnHashFunction)(PVOID, WORD, ULONGLONG),
+                     DWORD dwFlags)
+{
+    RETURNTYPE        Return        = ERR_GENERIC;
+    PSHARDEDHASHTABLE pShardedTable = NULL;
+
+    if (NULL == ppShardedTable)
+    {
+        DEBUG_PRINT("Input NULL");
+        goto EXIT;
+    }
+
+    pShardedTable = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY,
+                              sizeof(SHARDEDHASHTABLE));
+    if (NULL == pShardedTable)
+    {
+        DEBUG_ERROR("Failed to allocate sharded hash table");
+        Return = ERR_MEMORY_ALLOCATION;
+        goto EXIT;
+    }
+
+    if (HASHTABLE_READ_MOSTLY & dwFlags)
+    {
+        Return = EpochInit(&pShardedTable->m_pEpoch);
+        if (SUCCESS != Return)
+        {
+            DEBUG_PRINT("EpochInit failed");
+            goto CLEAN;
+        }
+    }
+
+    for (DWORD dwShard = 0; dwShard < SHARD_COUNT; dwShard++)
+    {
+        InitializeSRWLock(&pShardedTable->m_aShards[dwShard].m_Lock);
+
+        if (NULL != pShardedTable->m_pEpoch)
+        {
+            Return = HashTableInitReadMostly(
+                &pShardedTable->m_aShards[dwShard].m_pHashTable,
+                (dwCapacity / SHARD_COUNT) + 1, pfnHashFunction, dwFlags,
+                pShardedTable->m_pEpoch);
+        }
+        else
+        {
+            Return = HashTableInit(
+                &pShardedTable->m_aShards[dwShard].m_pHashTable,
+                (dwCapacity / SHARD_COUNT) + 1, pfnHashFunction, dwFlags);
+        }
+        if (SUCCESS != Return)
+        {
+            DEBUG_PRINT("HashTableInit failed");
+            goto CLEAN;
+        }
+    }
+
+    *ppShardedTable = pShardedTable;
+    goto EXIT;
+CLEAN:
+    ShardedHashTableDestroy(pShardedTable, NULL);
+EXIT:
+    return Return;
+}
+
+RETURNTYPE
+ShardedHashTableNewEntry(PSHARDEDHASHTABLE pShardedTable,
+                         PVOID             pData,
+                         PCHAR             pszKey,
+                         WORD              wKeyLen)
+{
+    RETURNTYPE      Return = ERR_GENERIC;
+    PHASHTABLESHARD pShard = NULL;
+    DWORD           dwHash = 0;
+
+    if ((NULL == pShardedTable) || (NULL == pszKey))
+    {
+        DEBUG_PRINT("Input NULL");
+        goto EXIT;
+    }
+
+    // NOTE: Every shard hashes with the same function and process seed, so
+    // the first shard's table hashes for all of them.
+    dwHash = HashTableHash(pShardedTable->m_aShards[0].m_pHashTable, pszKey,
+                           wKeyLen);
+    pShard = ShardForHash(pShardedTable, dwHash);
+
+    AcquireSRWLockExclusive(&pShard->m_Lock);
+    Return = HashTableNewEntryHashed(pShard->m_pHashTable, pData, pszKey,
+                                     wKeyLen, dwHash);
+    ReleaseSRWLockExclusive(&pShard->m_Lock);
+    ShardedHashTableReclaim(pShardedTable);
+
+    if (SUCCESS == Return)
+    {
+        InterlockedIncrement(&pShardedTable->m_lSize);
+    }
+EXIT:
+    return Return;
+}
+
+BOOL
+ShardedHashTableVisitEntry(PSHARDEDHASHTABLE pShardedTable,
+                           PCHAR             pszKey,
+                           WORD              wKeyLen,
+                           VOID (*pfnVisit)(PVOID pData, PVOID pContext),
+                           PVOID pContext)
+{
+    PHASHTABLESHARD pShard = NULL;
+    DWORD           dwHash = 0;
+    PVOID           pData  = NULL;
+
+    if ((NULL == pShardedTable) || (NULL == pszKey) || (NULL == pfnVisit))
+    {
+        DEBUG_PRINT("Input NULL");
+        return FALSE;
+    }
+
+    dwHash = HashTableHash(pShardedTable->m_aShards[0].m_pHashTable, pszKey,
+                           wKeyLen);
+    pShard = ShardForHash(pShardedTable, dwHash);
+
+    // NOTE: Read-mostly tables only take the shared lock for a thread the
+    // epoch had no record left for.
+    if ((NULL != pShardedTable->m_pEpoch) &&
+        EpochEnter(pShardedTable->m_pEpoch))
+    {
+        pData = HashTableReturnEntryHashed(pShard->m_pHashTable, pszKey,
+                                           wKeyLen, dwHash);
+        if (NULL != pData)
+        {
+            pfnVisit(pData, pContext);
+        }
+        EpochExit(pShardedTable->m_pEpoch);
+    }
+    else
+    {
+        AcquireSRWLockShared(&pShard->m_Lock);
+        pData = HashTableReturnEntryHashed(pShard->m_pHashTable, pszKey,
+                                           wKeyLen, dwHash);
+        if (NULL != pData)
+        {
+            pfnVisit(pData, pContext);
+        }
+        ReleaseSRWLockShared(&pShard->m_Lock);
+    }
+
+    return (NULL != pData);
+}
+
+PVOID
+ShardedHashTableDestroyEntry(PSHARDEDHASHTABLE pShardedTable,
+                             PCHAR             pszKey,
+                             WORD              wKeyLen)
+{
+    PHASHTABLESHARD pShard = NULL;
+    DWORD           dwHash = 0;
+    PVOID           pData  = NULL;
+
+    if ((NULL == pShardedTable) || (NULL == pszKey))
+    {
+        DEBUG_PRINT("Input NULL");
+        return NULL;
+    }
+
+    dwHash = HashTableHash(pShardedTable->m_aShards[0].m_pHashTable, pszKey,
+                           wKeyLen);
+    pShard = ShardForHash(pShardedTable, dwHash);
+
+    AcquireSRWLockExclusive(&pShard->m_Lock);
+    pData = HashTableDestroyEntryHashed(pShard->m_pHashTable, pszKey, wKeyLen,
+                                        dwHash);
+    ReleaseSRWLockExclusive(&pShard->m_Lock);
+    ShardedHashTableReclaim(pShardedTable);
+
+    if (NULL != pData)
+    {
+        InterlockedDecrement(&pShardedTable->m_lSize);
+    }
+
+    return pData;
+}
+
+VOID
+ShardedHashTableRetire(PSHARDEDHASHTABLE pShardedTable,
+                       PVOID             pData,
+                       VOID (*pfnFree)(PVOID))
+{
+    if ((NULL == pShardedTable) || (NULL == pfnFree))
+    {
+        DEBUG_PRINT("Input NULL");
+        return;
+    }
+
+    if (NULL != pShardedTable->m_pEpoch)
+    {
+        EpochRetire(pShardedTable->m_pEpoch, pData, pfnFree);
+    }
+    else
+    {
+        pfnFree(pData);
+    }
+}
+
+// NOTE: Lets ShardedHashTableForEach stop at the shard a visit stopped in.
+typedef struct SHARDVISIT
+{
+    BOOL (*pfnVisit)(PVOID pData, PVOID pContext);
+    PVOID pContext;
+    BOOL  bStopped;
+} SHARDVISIT, *PSHARDVISIT;
+
+static BOOL ShardVisit(PVOID pData, PVOID pContext)
+{
+    PSHARDVISIT pShardVisit = (PSHARDVISIT)pContext;
+
+    if (FALSE == pShardVisit->pfnVisit(pData, pShardVisit->pContext))
+    {
+        pShardVisit->bStopped = TRUE;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+VOID
+ShardedHashTableForEach(PSHARDEDHASHTABLE pShardedTable,
+                        BOOL (*pfnVisit)(PVOID pData, PVOID pContext),
+                        PVOID pContext)
+{
+    SHARDVISIT ShardVisitContext = {pfnVisit, pContext, FALSE};
+
+    if ((NULL == pShardedTable) || (NULL == pfnVisit))
+    {
+        DEBUG_PRINT("Input NULL");
+        return;
+    }
+
+    for (DWORD dwShard = 0;
+         (dwShard < SHARD_COUNT) && !ShardVisitContext.bStopped; dwShard++)
+    {
+        PHASHTABLESHARD pShard = &pShardedTable->m_aShards[dwShard];
+
+        // NOTE: A removal moves values within the value array, so walks take
+        // the shard's lock even for read-mostly tables.
+        AcquireSRWLockShared(&pShard->m_Lock);
+        HashTableForEach(pShard->m_pHashTable, ShardVisit, &ShardVisitContext);
+        ReleaseSRWLockShared(&pShard->m_Lock);
+    }
+}
+
+VOID
+ShardedHashTableMaintenance(PSHARDEDHASHTABLE pShardedTable)
+{
+    if (NULL == pShardedTable)
+    {
+        DEBUG_PRINT("Input NULL");
+        return;
+    }
+
+    for (DWORD dwShard = 0; dwShard < SHARD_COUNT; dwShard++)
+    {
+        PHASHTABLESHARD pShard = &pShardedTable->m_aShards[dwShard];
+
+        AcquireSRWLockExclusive(&pShard->m_Lock);
+        if (SUCCESS != HashTableMaintenance(pShard->m_pHashTable))
+        {
+            DEBUG_PRINT("HashTableMaintenance failed");
+        }
+        ReleaseSRWLockExclusive(&pShard->m_Lock);
+    }
+    ShardedHashTableReclaim(pShardedTable);
+}
+
+DWORD
+ShardedHashTableSize(PSHARDEDHASHTABLE pShardedTable)
+{
+    if (NULL == pShardedTable)
+    {
+        DEBUG_PRINT("Input NULL");
+        return 0;
+    }
+
+    return (DWORD)pShardedTable->m_lSize;
+}
+
+#ifdef HASHTABLE_STATS
+VOID
+ShardedHashTableGetStats(PSHARDEDHASHTABLE pShardedTable,
+                         PHASHTABLESTATS   pStats)
+{
+    if ((NULL == pShardedTable) || (NULL == pStats))
+    {
+        DEBUG_PRINT("Input NULL");
+        return;
+    }
+
+    ZeroMemory(pStats, sizeof(HASHTABLESTATS));
+    for (DWORD dwShard = 0; dwShard < SHARD_COUNT; dwShard++)
+    {
+        PHASHTABLESHARD pShard = &pShardedTable->m_aShards[dwShard];
+
+        AcquireSRWLockShared(&pShard->m_Lock);
+        HashTableGetStats(pShard->m_pHashTable, pStats);
+        ReleaseSRWLockShared(&pShard->m_Lock);
+    }
+}
+#endif // HASHTABLE_STATS
+
+RETURNTYPE
+ShardedHashTableDestroy(PSHARDEDHASHTABLE pShardedTable,
+                        VOID (*pfnFreeFunction)(PVOID))
+{
+    RETURNTYPE Return = SUCCESS;
+
+    if (NULL == pShardedTable)
+    {
+        DEBUG_PRINT("Input NULL");
+        return ERR_GENERIC;
+    }
+
+    for (DWORD dwShard = 0; dwShard < SHARD_COUNT; dwShard++)
+    {
+        if ((NULL != pShardedTable->m_aShards[dwShard].m_pHashTable) &&
+            (SUCCESS !=
+             HashTableDestroy(pShardedTable->m_aShards[dwShard].m_pHashTable,
+                              pfnFreeFunction)))
+        {
+            DEBUG_PRINT("HashTableDestroy failed");
+            Return = ERR_GENERIC;
+        }
+    }
+
+    if (NULL != pShardedTable->m_pEpoch)
+    {
+        EpochDestroy(pShardedTable->m_pEpoch);
+    }
+
+    ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pShardedTable,
+                    sizeof(SHARDEDHASHTABLE));
+    return Return;
+}
+
+// End of file
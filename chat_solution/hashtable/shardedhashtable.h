@@ -0,0 +1,102 @@
+#pragma once
+
+#include <Windows.h>
+
+#include "epoch.h"
+#include "hashtable.h"
+
+// NOTE: A hash table split into shards, each with its own hash table and
+// SRWLOCK. The top bits of a key's hash pick the shard, so operations on keys
+// in different shards never wait on each other and lookups within a shard
+// share the lock. Must be a power of two.
+#define SHARD_COUNT 16
+#define SHARD_BITS  4
+
+// NOTE: Each shard is padded to a cache line, so taking one shard's lock
+// doesn't invalidate its neighbours for other cores.
+typedef struct DECLSPEC_CACHEALIGN HASHTABLESHARD
+{
+    SRWLOCK    m_Lock;
+    PHASHTABLE m_pHashTable;
+} HASHTABLESHARD, *PHASHTABLESHARD;
+
+typedef struct SHARDEDHASHTABLE
+{
+    HASHTABLESHARD m_aShards[SHARD_COUNT];
+    LONG volatile  m_lSize;  // Entries across all shards.
+    PEPOCH         m_pEpoch; // Shared by the shards, NULL unless read-mostly.
+} SHARDEDHASHTABLE, *PSHARDEDHASHTABLE, **PPSHARDEDHASHTABLE;
+
+// NOTE: dwCapacity is spread over the shards, pfnHashFunction and dwFlags are
+// passed to every shard's HashTableInit. With HASHTABLE_READ_MOSTLY lookups
+// take no lock, only writers and walks lock their shard, and removed data has
+// to go through ShardedHashTableRetire.
+RETURNTYPE
+ShardedHashTableInit(PPSHARDEDHASHTABLE ppShardedTable,
+                     DWORD              dwCapacity,
+                     DWORD (*pfnHashFunction)(PVOID, WORD, ULONGLONG),
+                     DWORD dwFlags);
+
+// NOTE: Returns DUPLICATE_KEY if the key is already in the table.
+RETURNTYPE
+ShardedHashTableNewEntry(PSHARDEDHASHTABLE pShardedTable,
+                         PVOID             pData,
+                         PCHAR             pszKey,
+                         WORD              wKeyLen);
+
+// NOTE: Calls pfnVisit with the key's data while holding its shard's lock
+// shared, or from inside the epoch for read-mostly tables, so the data can't
+// be freed until pfnVisit returns. Returns FALSE without calling pfnVisit if
+// the key isn't in the table.
+BOOL
+ShardedHashTableVisitEntry(PSHARDEDHASHTABLE pShardedTable,
+                           PCHAR             pszKey,
+                           WORD              wKeyLen,
+                           VOID (*pfnVisit)(PVOID pData, PVOID pContext),
+                           PVOID pContext);
+
+// NOTE: Returns the removed entry's data, the caller owns it afterwards. A
+// read-mostly table's readers may still be visiting it, so it has to be freed
+// through ShardedHashTableRetire.
+PVOID
+ShardedHashTableDestroyEntry(PSHARDEDHASHTABLE pShardedTable,
+                             PCHAR             pszKey,
+                             WORD              wKeyLen);
+
+// NOTE: Calls pfnFree(pData) once no visit can still see it, right away
+// unless the table is read-mostly.
+VOID
+ShardedHashTableRetire(PSHARDEDHASHTABLE pShardedTable,
+                       PVOID             pData,
+                       VOID (*pfnFree)(PVOID));
+
+// NOTE: Walks the shards one at a time, each under its lock shared. Entries
+// added or removed in other shards during the walk may or may not be seen.
+VOID
+ShardedHashTableForEach(PSHARDEDHASHTABLE pShardedTable,
+                        BOOL (*pfnVisit)(PVOID pData, PVOID pContext),
+                        PVOID pContext);
+
+// NOTE: Runs HashTableMaintenance on each shard in turn under its lock, only
+// one shard's writers wait at a time.
+VOID
+ShardedHashTableMaintenance(PSHARDEDHASHTABLE pShardedTable);
+
+DWORD
+ShardedHashTableSize(PSHARDEDHASHTABLE pShardedTable);
+
+#ifdef HASHTABLE_STATS
+// NOTE: Fills pStats with the sum of every shard's statistics, each shard
+// walked under its lock shared.
+VOID
+ShardedHashTableGetStats(PSHARDEDHASHTABLE pShardedTable,
+                         PHASHTABLESTATS   pStats);
+#endif
+
+// NOTE: Not thread safe, every other user of the table must be done with it.
+// Data still waiting on ShardedHashTableRetire is freed here.
+RETURNTYPE
+ShardedHashTableDestroy(PSHARDEDHASHTABLE pShardedTable,
+                        VOID (*pfnFreeFunction)(PVOID));
+
+// End of file
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <Windows.h>
+
+#include "linkedlist.h"
+
+// NOTE: A pool of fixed size blocks kept on a lock-free free list. Any thread
+// may take or return a block, taking one from the list is a single atomic
+// pop, and only an empty list falls back to the heap. Blocks come back
+// unzeroed, with whatever their last owner left in them.
+//
+//     BLOCKPOOL Pool;
+//     BlockPoolInit(&Pool, 256, 1024);
+//     PVOID pBlock = BlockPoolAlloc(&Pool);
+//     BlockPoolFree(&Pool, pBlock);
+//     BlockPoolDestroy(&Pool);
+//
+// The list keeps at most m_wMaxFree blocks, so a burst doesn't leave its peak
+// allocated for good; blocks returned past that go back to the heap. Blocks
+// are heap allocations, which are aligned as the list requires.
+typedef struct BLOCKPOOL
+{
+    SLIST_HEADER  m_FreeList;
+    DWORD         m_dwBlockSize;
+    WORD          m_wMaxFree;
+    LONG volatile m_lBlocks; // Allocated from the heap and not yet freed.
+} BLOCKPOOL, *PBLOCKPOOL;
+
+static inline VOID BlockPoolInit(PBLOCKPOOL pPool,
+                                 DWORD      dwBlockSize,
+                                 WORD       wMaxFree)
+{
+    if (NULL == pPool)
+    {
+        DEBUG_PRINT("NULL input");
+        return;
+    }
+
+    InitializeSListHead(&pPool->m_FreeList);
+    pPool->m_dwBlockSize = (dwBlockSize < sizeof(SLIST_ENTRY))
+                               ? (DWORD)sizeof(SLIST_ENTRY)
+                               : dwBlockSize;
+    pPool->m_wMaxFree    = wMaxFree;
+    pPool->m_lBlocks     = 0;
+}
+
+static inline PVOID BlockPoolAlloc(PBLOCKPOOL pPool)
+{
+    PVOID pBlock = NULL;
+
+    if (NULL == pPool)
+    {
+        DEBUG_PRINT("NULL input");
+        return NULL;
+    }
+
+    pBlock = InterlockedPopEntrySList(&pPool->m_FreeList);
+    if (NULL != pBlock)
+    {
+        return pBlock;
+    }
+
+    pBlock = HeapAlloc(GetProcessHeap(), NO_OPTION, pPool->m_dwBlockSize);
+    if (NULL == pBlock)
+    {
+        DEBUG_ERROR("Failed to allocate block");
+        return NULL;
+    }
+
+    InterlockedIncrement(&pPool->m_lBlocks);
+    return pBlock;
+}
+
+static inline VOID BlockPoolFree(PBLOCKPOOL pPool, PVOID pBlock)
+{
+    if ((NULL == pPool) || (NULL == pBlock))
+    {
+        DEBUG_PRINT("NULL input");
+        return;
+    }
+
+    // NOTE: The depth is read before the push, so racing frees can leave the
+    // list a few blocks over m_wMaxFree. It only bounds what the pool keeps.
+    if (QueryDepthSList(&pPool->m_FreeList) >= pPool->m_wMaxFree)
+    {
+        HeapFree(GetProcessHeap(), NO_OPTION, pBlock);
+        InterlockedDecrement(&pPool->m_lBlocks);
+        return;
+    }
+
+    InterlockedPushEntrySList(&pPool->m_FreeList, (PSLIST_ENTRY)pBlock);
+}
+
+// NOTE: Frees the blocks on the free list. Blocks still taken are the
+// caller's to hand back first, m_lBlocks counts them.
+static inline VOID BlockPoolDestroy(PBLOCKPOOL pPool)
+{
+    PSLIST_ENTRY pEntry = NULL;
+
+    if (NULL == pPool)
+    {
+        DEBUG_PRINT("NULL input");
+        return;
+    }
+
+    pEntry = InterlockedFlushSList(&pPool->m_FreeList);
+    while (NULL != pEntry)
+    {
+        PSLIST_ENTRY pNext = pEntry->Next;
+
+        HeapFree(GetProcessHeap(), NO_OPTION, pEntry);
+        InterlockedDecrement(&pPool->m_lBlocks);
+        pEntry = pNext;
+    }
+}
+
+// End of file
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <Windows.h>
+
+#include "linkedlist.h"
+
+// NOTE: An intrusive list keeps its links inside the objects it holds rather
+// than in nodes of its own. Objects embed a LISTLINK and the list is told the
+// link's offset once, so pushing and removing never allocate and a walk only
+// touches the objects themselves. An object can be on as many lists at once
+// as it has links, but only once on each.
+//
+//     typedef struct MSG { LISTLINK m_Link; ... } MSG;
+//     INTRUSIVELIST List;
+//     INTRUSIVE_LIST_INIT(&List, MSG, m_Link);
+//     IntrusiveListPushBack(&List, pMsg);
+//
+// Best suited to queues, pushed at one end and popped at the other. A walk
+// has to load each object to find the next, so walking a long list of
+// objects spread over the heap is slower than walking LINKEDLIST's pooled
+// nodes, whose loads of the objects don't depend on each other.
+//
+// The list is not thread safe, callers hold their own lock.
+typedef struct LISTLINK
+{
+    struct LISTLINK *m_pNext;
+    struct LISTLINK *m_pPrev;
+} LISTLINK, *PLISTLINK;
+
+typedef struct INTRUSIVELIST
+{
+    PLISTLINK m_pHead;
+    PLISTLINK m_pTail;
+    DWORD     m_dwSize;
+    DWORD     m_dwLinkOffset; // Offset of the LISTLINK within each object.
+} INTRUSIVELIST, *PINTRUSIVELIST;
+
+#define INTRUSIVE_LIST_INIT(pList, Type, Field)                                \
+    IntrusiveListInit((pList), (DWORD)FIELD_OFFSET(Type, Field))
+
+// NOTE: Convert between an object and its link with the list's offset.
+#define LIST_LINK(pList, pObject)                                              \
+    ((PLISTLINK)((PBYTE)(pObject) + (pList)->m_dwLinkOffset))
+#define LIST_OBJECT(pList, pLink)                                              \
+    ((PVOID)((PBYTE)(pLink) - (pList)->m_dwLinkOffset))
+
+static inline VOID IntrusiveListInit(PINTRUSIVELIST pList, DWORD dwLinkOffset)
+{
+    if (NULL == pList)
+    {
+        DEBUG_PRINT("NULL input");
+        return;
+    }
+
+    pList->m_pHead        = NULL;
+    pList->m_pTail        = NULL;
+    pList->m_dwSize       = 0;
+    pList->m_dwLinkOffset = dwLinkOffset;
+}
+
+static inline VOID IntrusiveListPushBack(PINTRUSIVELIST pList, PVOID pObject)
+{
+    PLISTLINK pLink = NULL;
+
+    if ((NULL == pList) || (NULL == pObject))
+    {
+        DEBUG_PRINT("NULL input");
+        return;
+    }
+
+    pLink          = LIST_LINK(pList, pObject);
+    pLink->m_pNext = NULL;
+    pLink->m_pPrev = pList->m_pTail;
+    if (NULL == pList->m_pTail)
+    {
+        pList->m_pHead = pLink;
+    }
+    else
+    {
+        pList->m_pTail->m_pNext = pLink;
+    }
+    pList->m_pTail = pLink;
+    pList->m_dwSize += 1;
+}
+
+static inline VOID IntrusiveListPushFront(PINTRUSIVELIST pList, PVOID pObject)
+{
+    PLISTLINK pLink = NULL;
+
+    if ((NULL == pList) || (NULL == pObject))
+    {
+        DEBUG_PRINT("NULL input");
+        return;
+    }
+
+    pLink          = LIST_LINK(pList, pObject);
+    pLink->m_pPrev = NULL;
+    pLink->m_pNext = pList->m_pHead;
+    if (NULL == pList->m_pHead)
+    {
+        pList->m_pTail = pLink;
+    }
+    else
+    {
+        pList->m_pHead->m_pPrev = pLink;
+    }
+    pList->m_pHead = pLink;
+    pList->m_dwSize += 1;
+}
+
+// NOTE: pObject must be on this list.
+static inline VOID IntrusiveListRemove(PINTRUSIVELIST pList, PVOID pObject)
+{
+    PLISTLINK pLink = NULL;
+
+    if ((NULL == pList) || (NULL == pObject))
+    {
+        DEBUG_PRINT("NULL input");
+        return;
+    }
+
+    pLink = LIST_LINK(pList, pObject);
+    if (NULL == pLink->m_pPrev)
+    {
+        pList->m_pHead = pLink->m_pNext;
+    }
+    else
+    {
+        pLink->m_pPrev->m_pNext = pLink->m_pNext;
+    }
+    if (NULL == pLink->m_pNext)
+    {
+        pList->m_pTail = pLink->m_pPrev;
+    }
+    else
+    {
+        pLink->m_pNext->m_pPrev = pLink->m_pPrev;
+    }
+    pLink->m_pNext = NULL;
+    pLink->m_pPrev = NULL;
+    pList->m_dwSize -= 1;
+}
+
+// NOTE: Returns the first object, NULL if the list is empty.
+static inline PVOID IntrusiveListFirst(PINTRUSIVELIST pList)
+{
+    if ((NULL == pList) || (NULL == pList->m_pHead))
+    {
+        return NULL;
+    }
+
+    return LIST_OBJECT(pList, pList->m_pHead);
+}
+
+// NOTE: Returns the object after pObject, NULL at the end of the list. Fetch
+// the next object before removing pObject during a walk.
+static inline PVOID IntrusiveListNext(PINTRUSIVELIST pList, PVOID pObject)
+{
+    PLISTLINK pLink = NULL;
+
+    if ((NULL == pList) || (NULL == pObject))
+    {
+        DEBUG_PRINT("NULL input");
+        return NULL;
+    }
+
+    pLink = LIST_LINK(pList, pObject);
+    if (NULL == pLink->m_pNext)
+    {
+        return NULL;
+    }
+
+    return LIST_OBJECT(pList, pLink->m_pNext);
+}
+
+static inline PVOID IntrusiveListPopFront(PINTRUSIVELIST pList)
+{
+    PVOID pObject = IntrusiveListFirst(pList);
+
+    if (NULL != pObject)
+    {
+        IntrusiveListRemove(pList, pObject);
+    }
+
+    return pObject;
+}
+
+// NOTE: Empties the list, handing every object to pfnFreeFunction if it
+// isn't NULL. The list itself stays usable.
+static inline VOID IntrusiveListClear(PINTRUSIVELIST pList,
+                                      VOID (*pfnFreeFunction)(PVOID))
+{
+    PVOID pObject = NULL;
+
+    while (NULL != (pObject = IntrusiveListPopFront(pList)))
+    {
+        if (NULL != pfnFreeFunction)
+        {
+            pfnFreeFunction(pObject);
+        }
+    }
+}
+
+// End of file
@@ -3,20 +3,68 @@
 
 #include "linkedlist.h"
 
-static PLINKEDLISTNODE CreateNode()
+static DWORD ChunkBytes(DWORD dwNodes)
 {
-    PLINKEDLISTNODE pLinkedListNode =
-        HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(LINKEDLISTNODE));
+    return sizeof(LINKEDLISTCHUNK) + (dwNodes * sizeof(LINKEDLISTNODE));
+}
 
-    if (NULL == pLinkedListNode)
+// NOTE: Adds a chunk of dwNodes nodes to the free list.
+static RETURNTYPE LinkedListGrow(PLINKEDLIST pLinkedList, DWORD dwNodes)
+{
+    PLINKEDLISTCHUNK pChunk =
+        HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, ChunkBytes(dwNodes));
+    PLINKEDLISTNODE pNodes = NULL;
+
+    if (NULL == pChunk)
+    {
+        DEBUG_ERROR("Failed to allocate node chunk");
+        return ERR_MEMORY_ALLOCATION;
+    }
+
+    pChunk->m_dwNodes      = dwNodes;
+    pChunk->m_pNext        = pLinkedList->m_pChunks;
+    pLinkedList->m_pChunks = pChunk;
+    pLinkedList->m_dwHeapAllocs += 1;
+
+    pNodes = (PLINKEDLISTNODE)(pChunk + 1);
+    for (DWORD dwNode = 0; dwNode < dwNodes; dwNode++)
     {
-        DEBUG_ERROR("Failed to create node");
+        pNodes[dwNode].m_pNext    = pLinkedList->m_pFreeNodes;
+        pLinkedList->m_pFreeNodes = &pNodes[dwNode];
     }
 
+    return SUCCESS;
+}
+
+static PLINKEDLISTNODE CreateNode(PLINKEDLIST pLinkedList)
+{
+    PLINKEDLISTNODE pLinkedListNode = NULL;
+
+    if (NULL == pLinkedList->m_pFreeNodes)
+    {
+        if (SUCCESS != LinkedListGrow(pLinkedList, pLinkedList->m_dwNextChunk))
+        {
+            DEBUG_PRINT("Failed to create node");
+            return NULL;
+        }
+
+        if (LIST_CHUNK_MAX > pLinkedList->m_dwNextChunk)
+        {
+            pLinkedList->m_dwNextChunk *= 2;
+        }
+    }
+
+    pLinkedListNode           = pLinkedList->m_pFreeNodes;
+    pLinkedList->m_pFreeNodes = pLinkedListNode->m_pNext;
+    pLinkedListNode->m_pNext  = NULL;
+
     return pLinkedListNode;
 }
 
-static RETURNTYPE DestroyNode(PLINKEDLISTNODE pLinkedListNode)
+// NOTE: The node goes back to the list's free list, its chunk is only freed
+// with the list.
+static RETURNTYPE DestroyNode(PLINKEDLIST     pLinkedList,
+                              PLINKEDLISTNODE pLinkedListNode)
 {
     RETURNTYPE Return = ERR_GENERIC;
 
@@ -26,8 +74,9 @@ static RETURNTYPE DestroyNode(PLINKEDLISTNODE pLinkedListNode)
         goto EXIT;
     }
 
-    ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pLinkedListNode,
-                    sizeof(LINKEDLISTNODE));
+    pLinkedListNode->m_pData  = NULL;
+    pLinkedListNode->m_pNext  = pLinkedList->m_pFreeNodes;
+    pLinkedList->m_pFreeNodes = pLinkedListNode;
 
     Return = SUCCESS;
 EXIT:
@@ -36,6 +85,12 @@ EXIT:
 
 RETURNTYPE
 LinkedListInit(PPLINKEDLIST ppLinkedList)
+{
+    return LinkedListInitCapacity(ppLinkedList, 0);
+}
+
+RETURNTYPE
+LinkedListInitCapacity(PPLINKEDLIST ppLinkedList, DWORD dwCapacity)
 {
     RETURNTYPE  Return = ERR_GENERIC;
     PLINKEDLIST pLinkedList =
@@ -48,11 +103,35 @@ LinkedListInit(PPLINKEDLIST ppLinkedList)
         goto EXIT;
     }
 
-    pLinkedList->m_pHead = NULL;
-    pLinkedList->m_pTail = NULL;
-    pLinkedList->m_wSize = 0;
-    *ppLinkedList        = pLinkedList;
-    Return               = SUCCESS;
+    pLinkedList->m_pHead       = NULL;
+    pLinkedList->m_pTail       = NULL;
+    pLinkedList->m_dwSize      = 0;
+    pLinkedList->m_dwNextChunk = LIST_CHUNK_MIN;
+
+    if (0 != dwCapacity)
+    {
+        if (dwCapacity > ((MAXDWORD - sizeof(LINKEDLISTCHUNK)) /
+                          sizeof(LINKEDLISTNODE)))
+        {
+            DEBUG_PRINT("Capacity too large");
+            Return = ERR_INVALID_PARAM;
+            goto CLEAN;
+        }
+
+        Return = LinkedListGrow(pLinkedList, dwCapacity);
+        if (SUCCESS != Return)
+        {
+            DEBUG_PRINT("LinkedListGrow failed");
+            goto CLEAN;
+        }
+    }
+
+    *ppLinkedList = pLinkedList;
+    Return        = SUCCESS;
+    goto EXIT;
+CLEAN:
+    ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pLinkedList,
+                    sizeof(LINKEDLIST));
 EXIT:
     return Return;
 }
@@ -63,7 +142,7 @@ static RETURNTYPE LinkedListInsertFirst(PLINKEDLIST     pLinkedList,
     pLinkedListNode->m_pNext = pLinkedListNode;
     pLinkedList->m_pHead     = pLinkedListNode;
     pLinkedList->m_pTail     = pLinkedListNode;
-    pLinkedList->m_wSize     = 1;
+    pLinkedList->m_dwSize    = 1;
 
     return SUCCESS;
 }
@@ -74,7 +153,7 @@ static RETURNTYPE LinkedListInsertBegin(PLINKEDLIST     pLinkedList,
     pLinkedListNode->m_pNext      = pLinkedList->m_pHead;
     pLinkedList->m_pHead          = pLinkedListNode;
     pLinkedList->m_pTail->m_pNext = pLinkedListNode;
-    pLinkedList->m_wSize += 1;
+    pLinkedList->m_dwSize += 1;
 
     return SUCCESS;
 }
@@ -85,38 +164,38 @@ static RETURNTYPE LinkedListInsertEnd(PLINKEDLIST     pLinkedList,
     pLinkedListNode->m_pNext      = pLinkedList->m_pHead;
     pLinkedList->m_pTail->m_pNext = pLinkedListNode;
     pLinkedList->m_pTail          = pLinkedListNode;
-    pLinkedList->m_wSize += 1;
+    pLinkedList->m_dwSize += 1;
 
     return SUCCESS;
 }
 
 static RETURNTYPE LinkedListInsertAtIndex(PLINKEDLIST     pLinkedList,
                                           PLINKEDLISTNODE pLinkedListNode,
-                                          WORD            wIndex)
+                                          DWORD           dwIndex)
 {
     RETURNTYPE Return = ERR_GENERIC;
     // See explanation below for selection of pTail herev
-    PLINKEDLISTNODE pTempNode    = pLinkedList->m_pTail;
-    WORD            wTargetIndex = wIndex;
-    wIndex                       = 0;
+    PLINKEDLISTNODE pTempNode     = pLinkedList->m_pTail;
+    DWORD           dwTargetIndex = dwIndex;
+    dwIndex                       = 0;
 
     do
     {
         pTempNode = pTempNode->m_pNext;
-        wIndex += 1;
+        dwIndex += 1;
 
         if (NULL == pTempNode->m_pNext)
         {
             DEBUG_PRINT("NULL node");
             goto EXIT;
         }
-    } while (wIndex != wTargetIndex);
+    } while (dwIndex != dwTargetIndex);
 
     // Now the node is placed before our target node index: i.e. if we are
     // trying to place a node at index 1, we'll have the list index 0 node.
-    pLinkedListNode->m_pNext = pTempNode->m_pNext->m_pNext;
+    pLinkedListNode->m_pNext = pTempNode->m_pNext;
     pTempNode->m_pNext       = pLinkedListNode;
-    pLinkedList->m_wSize += 1;
+    pLinkedList->m_dwSize += 1;
 
     Return = SUCCESS;
 EXIT:
@@ -124,7 +203,7 @@ EXIT:
 }
 
 RETURNTYPE
-LinkedListInsert(PLINKEDLIST pLinkedList, PVOID pData, WORD wIndex)
+LinkedListInsert(PLINKEDLIST pLinkedList, PVOID pData, DWORD dwIndex)
 {
     RETURNTYPE      Return          = ERR_GENERIC;
     PLINKEDLISTNODE pLinkedListNode = NULL;
@@ -135,13 +214,19 @@ LinkedListInsert(PLINKEDLIST pLinkedList, PVOID pData, WORD wIndex)
         goto EXIT;
     }
 
-    if (wIndex > pLinkedList->m_wSize)
+    if (dwIndex > pLinkedList->m_dwSize)
     {
         DEBUG_PRINT("List index out of range");
         goto EXIT;
     }
 
-    pLinkedListNode = CreateNode();
+    if (MAXDWORD == pLinkedList->m_dwSize)
+    {
+        DEBUG_PRINT("List full");
+        goto EXIT;
+    }
+
+    pLinkedListNode = CreateNode(pLinkedList);
     if (NULL == pLinkedListNode)
     {
         DEBUG_PRINT("CreateNode failed");
@@ -154,7 +239,7 @@ LinkedListInsert(PLINKEDLIST pLinkedList, PVOID pData, WORD wIndex)
     if (NULL == pLinkedList->m_pHead)
     {
         // If the head is NULL but the size isn't 0, let's return error
-        if (pLinkedList->m_wSize != 0)
+        if (pLinkedList->m_dwSize != 0)
         {
             DEBUG_PRINT("List head NULL");
             goto EXIT;
@@ -171,24 +256,29 @@ LinkedListInsert(PLINKEDLIST pLinkedList, PVOID pData, WORD wIndex)
         goto EXIT;
     }
 
-    if (0 == wIndex)
+    if (0 == dwIndex)
     {
         Return = LinkedListInsertBegin(pLinkedList, pLinkedListNode);
         goto EXIT;
     }
-    else if (wIndex == pLinkedList->m_wSize)
+    else if (dwIndex == pLinkedList->m_dwSize)
     {
         Return = LinkedListInsertEnd(pLinkedList, pLinkedListNode);
         goto EXIT;
     }
     else
     {
-        Return = LinkedListInsertAtIndex(pLinkedList, pLinkedListNode, wIndex);
+        Return =
+            LinkedListInsertAtIndex(pLinkedList, pLinkedListNode, dwIndex);
         goto EXIT;
     }
 
     Return = SUCCESS;
 EXIT:
+    if ((SUCCESS != Return) && (NULL != pLinkedListNode))
+    {
+        DestroyNode(pLinkedList, pLinkedListNode);
+    }
     return Return;
 }
 
@@ -197,11 +287,11 @@ static PVOID LinkedListRemoveLast(PLINKEDLIST pLinkedList)
     PLINKEDLISTNODE pTempNode = pLinkedList->m_pHead;
     pLinkedList->m_pHead      = NULL;
     pLinkedList->m_pTail      = NULL;
-    pLinkedList->m_wSize      = 0;
+    pLinkedList->m_dwSize     = 0;
 
     PVOID pData = pTempNode->m_pData;
 
-    if (EXIT_FAILURE == DestroyNode(pTempNode))
+    if (EXIT_FAILURE == DestroyNode(pLinkedList, pTempNode))
     {
         DEBUG_PRINT("DestroyNode failed");
         return NULL;
@@ -215,11 +305,11 @@ static PVOID LinkedListRemoveBegin(PLINKEDLIST pLinkedList)
     PLINKEDLISTNODE pTempNode     = pLinkedList->m_pHead;
     pLinkedList->m_pHead          = pTempNode->m_pNext;
     pLinkedList->m_pTail->m_pNext = pLinkedList->m_pHead;
-    pLinkedList->m_wSize -= 1;
+    pLinkedList->m_dwSize -= 1;
 
     PVOID pData = pTempNode->m_pData;
 
-    if (EXIT_FAILURE == DestroyNode(pTempNode))
+    if (EXIT_FAILURE == DestroyNode(pLinkedList, pTempNode))
     {
         DEBUG_PRINT("DestroyNode failed");
         return NULL;
@@ -228,40 +318,40 @@ static PVOID LinkedListRemoveBegin(PLINKEDLIST pLinkedList)
     return pData;
 }
 
-static PVOID LinkedListRemoveAtIndex(PLINKEDLIST pLinkedList, WORD wIndex)
+static PVOID LinkedListRemoveAtIndex(PLINKEDLIST pLinkedList, DWORD dwIndex)
 {
     PLINKEDLISTNODE pTempNode   = pLinkedList->m_pTail;
     PLINKEDLISTNODE pDeleteNode = NULL;
     PVOID           pData       = NULL;
 
-    WORD wTargetIndex = wIndex;
-    wIndex            = 0;
+    DWORD dwTargetIndex = dwIndex;
+    dwIndex             = 0;
 
     do
     {
         pTempNode = pTempNode->m_pNext;
-        wIndex += 1;
+        dwIndex += 1;
 
         if (NULL == pTempNode->m_pNext)
         {
             DEBUG_PRINT("NULL node");
             goto EXIT;
         }
-    } while (wIndex != wTargetIndex);
+    } while (dwIndex != dwTargetIndex);
 
     // Now the node is placed before our target node index: i.e. if we are
     // trying to place a node at index 1, we'll have the list index 0 node.
     pDeleteNode        = pTempNode->m_pNext;
     pTempNode->m_pNext = pDeleteNode->m_pNext;
-    if (wTargetIndex == (pLinkedList->m_wSize - 1))
+    if (dwTargetIndex == (pLinkedList->m_dwSize - 1))
     {
         pLinkedList->m_pTail = pTempNode;
     }
-    pLinkedList->m_wSize -= 1;
+    pLinkedList->m_dwSize -= 1;
 
     pData = pDeleteNode->m_pData;
 
-    if (SUCCESS != DestroyNode(pDeleteNode))
+    if (SUCCESS != DestroyNode(pLinkedList, pDeleteNode))
     {
         DEBUG_PRINT("DestroyNode failed");
         pData = NULL;
@@ -274,7 +364,7 @@ EXIT:
 
 PVOID
 LinkedListRemove(PLINKEDLIST pLinkedList,
-                 WORD        wIndex,
+                 DWORD       dwIndex,
                  VOID (*pfnFreeFunction)(PVOID))
 {
     PVOID pData = NULL;
@@ -285,23 +375,23 @@ LinkedListRemove(PLINKEDLIST pLinkedList,
         goto EXIT;
     }
 
-    if (wIndex > (pLinkedList->m_wSize - 1))
+    if (dwIndex > (pLinkedList->m_dwSize - 1))
     {
         DEBUG_PRINT("List index out of range");
         goto EXIT;
     }
 
-    if (1 == pLinkedList->m_wSize)
+    if (1 == pLinkedList->m_dwSize)
     {
         pData = LinkedListRemoveLast(pLinkedList);
     }
-    else if (0 == wIndex)
+    else if (0 == dwIndex)
     {
         pData = LinkedListRemoveBegin(pLinkedList);
     }
     else
     {
-        pData = LinkedListRemoveAtIndex(pLinkedList, wIndex);
+        pData = LinkedListRemoveAtIndex(pLinkedList, dwIndex);
     }
 
     if (NULL == pData)
@@ -329,24 +419,24 @@ static PVOID LinkedListReturnBegin(PLINKEDLIST pLinkedList)
     return pLinkedList->m_pHead->m_pData;
 }
 
-static PVOID LinkedListReturnAtIndex(PLINKEDLIST pLinkedList, WORD wIndex)
+static PVOID LinkedListReturnAtIndex(PLINKEDLIST pLinkedList, DWORD dwIndex)
 {
     PLINKEDLISTNODE pTempNode = pLinkedList->m_pTail;
 
-    WORD wTargetIndex = wIndex;
-    wIndex            = 0;
+    DWORD dwTargetIndex = dwIndex;
+    dwIndex             = 0;
 
     do
     {
         pTempNode = pTempNode->m_pNext;
-        wIndex += 1;
+        dwIndex += 1;
 
         if (NULL == pTempNode->m_pNext)
         {
             DEBUG_PRINT("NULL node");
             return NULL;
         }
-    } while (wIndex != wTargetIndex);
+    } while (dwIndex != dwTargetIndex);
 
     // Now the node is placed before our target node index: i.e. if we are
     // trying to place a node at index 1, we'll have the list index 0 node.
@@ -355,7 +445,7 @@ static PVOID LinkedListReturnAtIndex(PLINKEDLIST pLinkedList, WORD wIndex)
 }
 
 PVOID
-LinkedListReturn(PLINKEDLIST pLinkedList, WORD wIndex)
+LinkedListReturn(PLINKEDLIST pLinkedList, DWORD dwIndex)
 {
     PVOID pData = NULL;
 
@@ -367,13 +457,13 @@ LinkedListReturn(PLINKEDLIST pLinkedList, WORD wIndex)
         goto EXIT;
     }
 
-    if (wIndex > (pLinkedList->m_wSize - 1))
+    if (dwIndex > (pLinkedList->m_dwSize - 1))
     {
         DEBUG_PRINT("List index out of range");
         goto EXIT;
     }
 
-    if (1 == pLinkedList->m_wSize)
+    if (1 == pLinkedList->m_dwSize)
     {
         pData = LinkedListReturnLast(pLinkedList);
         if (NULL == pData)
@@ -383,7 +473,7 @@ LinkedListReturn(PLINKEDLIST pLinkedList, WORD wIndex)
         goto EXIT;
     }
 
-    if (0 == wIndex)
+    if (0 == dwIndex)
     {
         pData = LinkedListReturnBegin(pLinkedList);
         if (NULL == pData)
@@ -394,7 +484,7 @@ LinkedListReturn(PLINKEDLIST pLinkedList, WORD wIndex)
     }
     else
     {
-        pData = LinkedListReturnAtIndex(pLinkedList, wIndex);
+        pData = LinkedListReturnAtIndex(pLinkedList, dwIndex);
         if (NULL == pData)
         {
             DEBUG_PRINT("LinkedListReturnAtIndex failed");
@@ -406,6 +496,98 @@ EXIT:
     return pData;
 }
 
+VOID
+LinkedListCursorInit(PLINKEDLIST pLinkedList, PLINKEDLISTCURSOR pCursor)
+{
+    if ((NULL == pLinkedList) || (NULL == pCursor))
+    {
+        DEBUG_PRINT("NULL input");
+        return;
+    }
+
+    // NOTE: The list is circular, so the tail comes before the head.
+    pCursor->m_pLinkedList = pLinkedList;
+    pCursor->m_pPrev       = pLinkedList->m_pTail;
+    pCursor->m_pCurrent    = NULL;
+    pCursor->m_dwRemaining = pLinkedList->m_dwSize;
+}
+
+PVOID
+LinkedListCursorNext(PLINKEDLISTCURSOR pCursor)
+{
+    if (NULL == pCursor)
+    {
+        DEBUG_PRINT("NULL input");
+        return NULL;
+    }
+
+    if (0 == pCursor->m_dwRemaining)
+    {
+        return NULL;
+    }
+
+    if (NULL != pCursor->m_pCurrent)
+    {
+        pCursor->m_pPrev = pCursor->m_pCurrent;
+    }
+    pCursor->m_pCurrent = pCursor->m_pPrev->m_pNext;
+    pCursor->m_dwRemaining -= 1;
+
+    return pCursor->m_pCurrent->m_pData;
+}
+
+PVOID
+LinkedListCursorRemove(PLINKEDLISTCURSOR pCursor,
+                       VOID (*pfnFreeFunction)(PVOID))
+{
+    PLINKEDLIST     pLinkedList = NULL;
+    PLINKEDLISTNODE pDeleteNode = NULL;
+    PVOID           pData       = NULL;
+
+    if ((NULL == pCursor) || (NULL == pCursor->m_pCurrent))
+    {
+        DEBUG_PRINT("NULL input/No current node");
+        return NULL;
+    }
+
+    pLinkedList = pCursor->m_pLinkedList;
+    pDeleteNode = pCursor->m_pCurrent;
+
+    if (1 == pLinkedList->m_dwSize)
+    {
+        pLinkedList->m_pHead = NULL;
+        pLinkedList->m_pTail = NULL;
+    }
+    else
+    {
+        pCursor->m_pPrev->m_pNext = pDeleteNode->m_pNext;
+        if (pDeleteNode == pLinkedList->m_pHead)
+        {
+            pLinkedList->m_pHead = pDeleteNode->m_pNext;
+        }
+        if (pDeleteNode == pLinkedList->m_pTail)
+        {
+            pLinkedList->m_pTail = pCursor->m_pPrev;
+        }
+    }
+    pLinkedList->m_dwSize -= 1;
+    pCursor->m_pCurrent = NULL;
+
+    pData = pDeleteNode->m_pData;
+    if (SUCCESS != DestroyNode(pLinkedList, pDeleteNode))
+    {
+        DEBUG_PRINT("DestroyNode failed");
+        return NULL;
+    }
+
+    if (NULL != pfnFreeFunction)
+    {
+        pfnFreeFunction(pData);
+    }
+
+    return pData;
+}
+
 RETURNTYPE
 LinkedListDestroy(PLINKEDLIST pLinkedList, VOID (*pfnFreeFunction)(PVOID))
 {
@@ -422,7 +604,7 @@ LinkedListDestroy(PLINKEDLIST pLinkedList, VOID (*pfnFreeFunction)(PVOID))
         goto EXIT;
     }
 
-    while (0 < pLinkedList->m_wSize)
+    while (0 < pLinkedList->m_dwSize)
     {
         if (NULL == pTempNode)
         {
@@ -437,16 +619,25 @@ LinkedListDestroy(PLINKEDLIST pLinkedList, VOID (*pfnFreeFunction)(PVOID))
             pfnFreeFunction(pTempNode->m_pData);
         }
 
-        if (SUCCESS != DestroyNode(pTempNode))
+        if (SUCCESS != DestroyNode(pLinkedList, pTempNode))
         {
             DEBUG_PRINT("DestroyNode failed");
             goto EXIT;
         }
 
-        pLinkedList->m_wSize -= 1;
+        pLinkedList->m_dwSize -= 1;
         pTempNode = pTempNode2;
     }
 
+    while (NULL != pLinkedList->m_pChunks)
+    {
+        PLINKEDLISTCHUNK pChunk = pLinkedList->m_pChunks;
+
+        pLinkedList->m_pChunks = pChunk->m_pNext;
+        ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pChunk,
+                        ChunkBytes(pChunk->m_dwNodes));
+    }
+
     ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pLinkedList,
                     sizeof(LINKEDLIST));
 
@@ -460,9 +651,9 @@ EXIT:
 VOID PrintList(PLINKEDLIST pLinkedList)
 {
     PLINKEDLISTNODE pTempNode = NULL;
-    WORD            wIndex    = 0;
+    DWORD           dwIndex   = 0;
 
-    if (0 == pLinkedList->m_wSize)
+    if (0 == pLinkedList->m_dwSize)
     {
         printf("[]\n");
         return;
@@ -471,7 +662,7 @@ VOID PrintList(PLINKEDLIST pLinkedList)
     printf("[");
     pTempNode = pLinkedList->m_pHead;
 
-    for (wIndex = 0; wIndex < pLinkedList->m_wSize; wIndex++)
+    for (dwIndex = 0; dwIndex < pLinkedList->m_dwSize; dwIndex++)
     {
         printf("%u ", *(WORD *)pTempNode->m_pData);
         pTempNode = pTempNode->m_pNext;
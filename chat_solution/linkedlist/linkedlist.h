@@ -137,26 +137,73 @@ typedef struct LINKEDLISTNODE
     struct LINKEDLISTNODE *m_pNext;
 } LINKEDLISTNODE, *PLINKEDLISTNODE;
 
+// NOTE: Nodes are carved out of chunks the list allocates itself and go back
+// to the list's free list when removed, so inserts only call the heap once
+// every node allocated so far is in use. Chunks double in size from
+// LIST_CHUNK_MIN nodes up to LIST_CHUNK_MAX.
+#define LIST_CHUNK_MIN 16
+#define LIST_CHUNK_MAX 4096
+
+// NOTE: Followed in the same allocation by m_dwNodes nodes.
+typedef struct LINKEDLISTCHUNK
+{
+    struct LINKEDLISTCHUNK *m_pNext;
+    DWORD                   m_dwNodes;
+} LINKEDLISTCHUNK, *PLINKEDLISTCHUNK;
+
 typedef struct LINKEDLIST
 {
     struct LINKEDLISTNODE *m_pHead;
     struct LINKEDLISTNODE *m_pTail;
-    WORD                   m_wSize; // Max size is 65535.
+    DWORD                  m_dwSize;
+    PLINKEDLISTNODE        m_pFreeNodes;   // Linked through m_pNext.
+    PLINKEDLISTCHUNK       m_pChunks;
+    DWORD                  m_dwNextChunk;  // Nodes in the next chunk.
+    DWORD                  m_dwHeapAllocs; // Chunks allocated so far.
 } LINKEDLIST, *PLINKEDLIST, **PPLINKEDLIST;
 
+// NOTE: Walks a list from its head in O(1) per step, where LinkedListReturn
+// and LinkedListRemove walk from the tail up to the index on every call.
+// Changing the list other than through the cursor invalidates it.
+typedef struct LINKEDLISTCURSOR
+{
+    PLINKEDLIST     m_pLinkedList;
+    PLINKEDLISTNODE m_pPrev;      // Node before the next one returned.
+    PLINKEDLISTNODE m_pCurrent;   // Last returned, NULL once removed.
+    DWORD           m_dwRemaining;
+} LINKEDLISTCURSOR, *PLINKEDLISTCURSOR;
+
 RETURNTYPE
 LinkedListInit(PPLINKEDLIST ppLinkedList);
 
+// NOTE: Allocates room for dwCapacity nodes up front, inserts up to that many
+// don't call the heap.
+RETURNTYPE
+LinkedListInitCapacity(PPLINKEDLIST ppLinkedList, DWORD dwCapacity);
+
 RETURNTYPE
-LinkedListInsert(PLINKEDLIST pLinkedList, PVOID pData, WORD wIndex);
+LinkedListInsert(PLINKEDLIST pLinkedList, PVOID pData, DWORD dwIndex);
 
 PVOID
 LinkedListRemove(PLINKEDLIST pLinkedList,
-                 WORD        wIndex,
+                 DWORD       dwIndex,
                  VOID (*pfnFreeFunction)(PVOID));
 
 PVOID
-LinkedListReturn(PLINKEDLIST pLinkedList, WORD wIndex);
+LinkedListReturn(PLINKEDLIST pLinkedList, DWORD dwIndex);
+
+VOID
+LinkedListCursorInit(PLINKEDLIST pLinkedList, PLINKEDLISTCURSOR pCursor);
+
+// NOTE: Returns the next node's data, NULL once every node has been seen.
+PVOID
+LinkedListCursorNext(PLINKEDLISTCURSOR pCursor);
+
+// NOTE: Removes the node LinkedListCursorNext last returned and returns its
+// data, the next call to LinkedListCursorNext carries on after it.
+PVOID
+LinkedListCursorRemove(PLINKEDLISTCURSOR pCursor,
+                       VOID (*pfnFreeFunction)(PVOID));
 
 RETURNTYPE
 LinkedListDestroy(PLINKEDLIST pLinkedList, VOID (*pfnFreeFunction)(PVOID));
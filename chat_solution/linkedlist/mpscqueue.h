@@ -0,0 +1,161 @@
+#pragma once
+
+#include <Windows.h>
+
+#include "intrusivelist.h"
+
+// NOTE: A lock-free queue for many producers and a single consumer, linked
+// through a LISTLINK inside each object like INTRUSIVELIST, of which only
+// m_pNext is used. Pushing is one atomic exchange and never waits, popping
+// never waits either, so any number of threads can push while one drains.
+//
+//     MPSCQUEUE Queue;
+//     MPSC_QUEUE_INIT(&Queue, MSG, m_Link);
+//     MpscQueuePush(&Queue, pMsg);         // Any thread.
+//     pMsg = MpscQueuePop(&Queue);         // The consumer only.
+//
+// The consumer is whichever thread the caller lets drain, at most one at a
+// time. A push that has swapped the tail but not yet linked the previous
+// object hides itself and everything after it, so Pop can return NULL while
+// a push is finishing. The pushing thread has to check for a consumer once
+// its push returns, as the server does with the user's send flag.
+//
+// The queue points at a stub object inside itself, so it can't be moved or
+// copied once initialized.
+typedef struct MPSCQUEUE
+{
+    PLISTLINK volatile m_pTail; // Swapped by producers.
+    PLISTLINK          m_pHead; // Only touched by the consumer.
+    LISTLINK           m_Stub;
+    DWORD              m_dwLinkOffset;
+} MPSCQUEUE, *PMPSCQUEUE;
+
+#define MPSC_QUEUE_INIT(pQueue, Type, Field)                                   \
+    MpscQueueInit((pQueue), (DWORD)FIELD_OFFSET(Type, Field))
+
+static inline VOID MpscQueueInit(PMPSCQUEUE pQueue, DWORD dwLinkOffset)
+{
+    if (NULL == pQueue)
+    {
+        DEBUG_PRINT("NULL input");
+        return;
+    }
+
+    pQueue->m_Stub.m_pNext = NULL;
+    pQueue->m_Stub.m_pPrev = NULL;
+    pQueue->m_pHead        = &pQueue->m_Stub;
+    pQueue->m_pTail        = &pQueue->m_Stub;
+    pQueue->m_dwLinkOffset = dwLinkOffset;
+}
+
+static inline VOID MpscQueuePushLink(PMPSCQUEUE pQueue, PLISTLINK pLink)
+{
+    PLISTLINK pPrev = NULL;
+
+    pLink->m_pNext = NULL;
+    pPrev = (PLISTLINK)InterlockedExchangePointer(
+        (PVOID volatile *)&pQueue->m_pTail, pLink);
+
+    // NOTE: Publishes pLink to the consumer, everything written to the object
+    // before the push is visible once the consumer reads this link.
+    WritePointerRelease((PVOID volatile *)&pPrev->m_pNext, pLink);
+}
+
+static inline VOID MpscQueuePush(PMPSCQUEUE pQueue, PVOID pObject)
+{
+    if ((NULL == pQueue) || (NULL == pObject))
+    {
+        DEBUG_PRINT("NULL input");
+        return;
+    }
+
+    MpscQueuePushLink(pQueue,
+                      (PLISTLINK)((PBYTE)pObject + pQueue->m_dwLinkOffset));
+}
+
+// NOTE: Consumer only. Returns the oldest object, NULL if the queue is empty
+// or a push is still linking the next one in.
+static inline PVOID MpscQueuePop(PMPSCQUEUE pQueue)
+{
+    PLISTLINK pHead = NULL;
+    PLISTLINK pNext = NULL;
+
+    if (NULL == pQueue)
+    {
+        DEBUG_PRINT("NULL input");
+        return NULL;
+    }
+
+    pHead = pQueue->m_pHead;
+    pNext = (PLISTLINK)ReadPointerAcquire((PVOID volatile *)&pHead->m_pNext);
+
+    if (&pQueue->m_Stub == pHead)
+    {
+        if (NULL == pNext)
+        {
+            return NULL;
+        }
+
+        pQueue->m_pHead = pNext;
+        pHead           = pNext;
+        pNext           = (PLISTLINK)ReadPointerAcquire(
+            (PVOID volatile *)&pHead->m_pNext);
+    }
+
+    if (NULL != pNext)
+    {
+        pQueue->m_pHead = pNext;
+        return (PBYTE)pHead - pQueue->m_dwLinkOffset;
+    }
+
+    // NOTE: pHead is the last object. Unless a push is under way, the stub
+    // goes in behind it so taking it out never leaves the tail dangling.
+    if (pHead != ReadPointerAcquire((PVOID volatile *)&pQueue->m_pTail))
+    {
+        return NULL;
+    }
+
+    MpscQueuePushLink(pQueue, &pQueue->m_Stub);
+    pNext = (PLISTLINK)ReadPointerAcquire((PVOID volatile *)&pHead->m_pNext);
+    if (NULL != pNext)
+    {
+        pQueue->m_pHead = pNext;
+        return (PBYTE)pHead - pQueue->m_dwLinkOffset;
+    }
+
+    return NULL;
+}
+
+// NOTE: TRUE if no push has completed since the consumer last emptied the
+// queue. Any thread may ask, but the answer is only a hint to the caller
+// unless it is the consumer.
+static inline BOOL MpscQueueIsEmpty(PMPSCQUEUE pQueue)
+{
+    if (NULL == pQueue)
+    {
+        DEBUG_PRINT("NULL input");
+        return TRUE;
+    }
+
+    return (&pQueue->m_Stub == pQueue->m_pHead) &&
+           (NULL == ReadPointerAcquire(
+                        (PVOID volatile *)&pQueue->m_Stub.m_pNext));
+}
+
+// NOTE: Pops every object, handing each to pfnFreeFunction if it isn't NULL.
+// No thread may be pushing.
+static inline VOID MpscQueueClear(PMPSCQUEUE pQueue,
+                                  VOID (*pfnFreeFunction)(PVOID))
+{
+    PVOID pObject = NULL;
+
+    while (NULL != (pObject = MpscQueuePop(pQueue)))
+    {
+        if (NULL != pfnFreeFunction)
+        {
+            pfnFreeFunction(pObject);
+        }
+    }
+}
+
+// End of file
@@ -0,0 +1,351 @@
+#include <Windows.h>
+#include <stdio.h>
+
+#include "unrolledlist.h"
+
+#define UNROLLED_HALF (UNROLLED_SLOTS / 2)
+
+static PUNROLLEDNODE CreateUnrolledNode(PUNROLLEDLIST pUnrolledList)
+{
+    PUNROLLEDNODE pNode =
+        HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(UNROLLEDNODE));
+
+    if (NULL == pNode)
+    {
+        DEBUG_ERROR("Failed to allocate node");
+        return NULL;
+    }
+
+    pUnrolledList->m_dwNodes += 1;
+    return pNode;
+}
+
+static VOID DestroyUnrolledNode(PUNROLLEDLIST pUnrolledList,
+                                PUNROLLEDNODE pNode)
+{
+    ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pNode, sizeof(UNROLLEDNODE));
+    pUnrolledList->m_dwNodes -= 1;
+}
+
+// NOTE: Skips whole nodes to the one holding dwIndex, which must be below
+// the list's size. *ppPrev receives the node before it, NULL for the head.
+static PUNROLLEDNODE FindNode(PUNROLLEDLIST  pUnrolledList,
+                              DWORD          dwIndex,
+                              PDWORD         pdwSlot,
+                              PUNROLLEDNODE *ppPrev)
+{
+    PUNROLLEDNODE pPrev = NULL;
+    PUNROLLEDNODE pNode = pUnrolledList->m_pHead;
+
+    while (dwIndex >= pNode->m_dwCount)
+    {
+        dwIndex -= pNode->m_dwCount;
+        pPrev = pNode;
+        pNode = pNode->m_pNext;
+    }
+
+    *pdwSlot = dwIndex;
+    if (NULL != ppPrev)
+    {
+        *ppPrev = pPrev;
+    }
+    return pNode;
+}
+
+RETURNTYPE
+UnrolledListInit(PPUNROLLEDLIST ppUnrolledList)
+{
+    PUNROLLEDLIST pUnrolledList = NULL;
+
+    if (NULL == ppUnrolledList)
+    {
+        DEBUG_PRINT("NULL input");
+        return ERR_GENERIC;
+    }
+
+    pUnrolledList =
+        HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(UNROLLEDLIST));
+    if (NULL == pUnrolledList)
+    {
+        DEBUG_ERROR("Failed to initialize list");
+        return ERR_MEMORY_ALLOCATION;
+    }
+
+    *ppUnrolledList = pUnrolledList;
+    return SUCCESS;
+}
+
+RETURNTYPE
+UnrolledListInsert(PUNROLLEDLIST pUnrolledList, PVOID pData, DWORD dwIndex)
+{
+    PUNROLLEDNODE pNode   = NULL;
+    PUNROLLEDNODE pSplit  = NULL;
+    DWORD         dwSlot  = 0;
+
+    if ((NULL == pUnrolledList) || (NULL == pData))
+    {
+        DEBUG_PRINT("NULL input");
+        return ERR_GENERIC;
+    }
+
+    if (dwIndex > pUnrolledList->m_dwSize)
+    {
+        DEBUG_PRINT("List index out of range");
+        return ERR_GENERIC;
+    }
+
+    if (MAXDWORD == pUnrolledList->m_dwSize)
+    {
+        DEBUG_PRINT("List full");
+        return ERR_GENERIC;
+    }
+
+    // NOTE: Appends fill the tail and only start a node once it is full, so
+    // a list built in order packs every node but the last.
+    if (dwIndex == pUnrolledList->m_dwSize)
+    {
+        pNode = pUnrolledList->m_pTail;
+        if ((NULL == pNode) || (UNROLLED_SLOTS == pNode->m_dwCount))
+        {
+            pNode = CreateUnrolledNode(pUnrolledList);
+            if (NULL == pNode)
+            {
+                DEBUG_PRINT("CreateUnrolledNode failed");
+                return ERR_MEMORY_ALLOCATION;
+            }
+
+            if (NULL == pUnrolledList->m_pTail)
+            {
+                pUnrolledList->m_pHead = pNode;
+            }
+            else
+            {
+                pUnrolledList->m_pTail->m_pNext = pNode;
+            }
+            pUnrolledList->m_pTail = pNode;
+        }
+
+        pNode->m_apData[pNode->m_dwCount] = pData;
+        pNode->m_dwCount += 1;
+        pUnrolledList->m_dwSize += 1;
+        return SUCCESS;
+    }
+
+    pNode = FindNode(pUnrolledList, dwIndex, &dwSlot, NULL);
+
+    // NOTE: A full node hands its upper half to a new node after it.
+    if (UNROLLED_SLOTS == pNode->m_dwCount)
+    {
+        pSplit = CreateUnrolledNode(pUnrolledList);
+        if (NULL == pSplit)
+        {
+            DEBUG_PRINT("CreateUnrolledNode failed");
+            return ERR_MEMORY_ALLOCATION;
+        }
+
+        CopyMemory(pSplit->m_apData, &pNode->m_apData[UNROLLED_HALF],
+                   (UNROLLED_SLOTS - UNROLLED_HALF) * sizeof(PVOID));
+        ZeroMemory(&pNode->m_apData[UNROLLED_HALF],
+                   (UNROLLED_SLOTS - UNROLLED_HALF) * sizeof(PVOID));
+        pSplit->m_dwCount = UNROLLED_SLOTS - UNROLLED_HALF;
+        pNode->m_dwCount  = UNROLLED_HALF;
+
+        pSplit->m_pNext = pNode->m_pNext;
+        pNode->m_pNext  = pSplit;
+        if (pUnrolledList->m_pTail == pNode)
+        {
+            pUnrolledList->m_pTail = pSplit;
+        }
+
+        if (dwSlot > UNROLLED_HALF)
+        {
+            dwSlot -= UNROLLED_HALF;
+            pNode = pSplit;
+        }
+    }
+
+    MoveMemory(&pNode->m_apData[dwSlot + 1], &pNode->m_apData[dwSlot],
+               (pNode->m_dwCount - dwSlot) * sizeof(PVOID));
+    pNode->m_apData[dwSlot] = pData;
+    pNode->m_dwCount += 1;
+    pUnrolledList->m_dwSize += 1;
+
+    return SUCCESS;
+}
+
+PVOID
+UnrolledListRemove(PUNROLLEDLIST pUnrolledList,
+                   DWORD         dwIndex,
+                   VOID (*pfnFreeFunction)(PVOID))
+{
+    PUNROLLEDNODE pPrev  = NULL;
+    PUNROLLEDNODE pNode  = NULL;
+    PUNROLLEDNODE pNext  = NULL;
+    DWORD         dwSlot = 0;
+    PVOID         pData  = NULL;
+
+    if (NULL == pUnrolledList)
+    {
+        DEBUG_PRINT("NULL input");
+        return NULL;
+    }
+
+    if (dwIndex >= pUnrolledList->m_dwSize)
+    {
+        DEBUG_PRINT("List index out of range");
+        return NULL;
+    }
+
+    pNode = FindNode(pUnrolledList, dwIndex, &dwSlot, &pPrev);
+    pData = pNode->m_apData[dwSlot];
+
+    pNode->m_dwCount -= 1;
+    MoveMemory(&pNode->m_apData[dwSlot], &pNode->m_apData[dwSlot + 1],
+               (pNode->m_dwCount - dwSlot) * sizeof(PVOID));
+    pNode->m_apData[pNode->m_dwCount] = NULL;
+    pUnrolledList->m_dwSize -= 1;
+
+    if (0 == pNode->m_dwCount)
+    {
+        if (NULL == pPrev)
+        {
+            pUnrolledList->m_pHead = pNode->m_pNext;
+        }
+        else
+        {
+            pPrev->m_pNext = pNode->m_pNext;
+        }
+        if (pUnrolledList->m_pTail == pNode)
+        {
+            pUnrolledList->m_pTail = pPrev;
+        }
+        DestroyUnrolledNode(pUnrolledList, pNode);
+    }
+    else if ((pNode->m_dwCount < UNROLLED_HALF) &&
+             (NULL != (pNext = pNode->m_pNext)) &&
+             ((pNode->m_dwCount + pNext->m_dwCount) <= UNROLLED_SLOTS))
+    {
+        // NOTE: Merging keeps nodes at least half full on average, so a
+        // scan still reads few nodes after many removals.
+        CopyMemory(&pNode->m_apData[pNode->m_dwCount], pNext->m_apData,
+                   pNext->m_dwCount * sizeof(PVOID));
+        pNode->m_dwCount += pNext->m_dwCount;
+        pNode->m_pNext = pNext->m_pNext;
+        if (pUnrolledList->m_pTail == pNext)
+        {
+            pUnrolledList->m_pTail = pNode;
+        }
+        DestroyUnrolledNode(pUnrolledList, pNext);
+    }
+
+    if (NULL != pfnFreeFunction)
+    {
+        pfnFreeFunction(pData);
+    }
+
+    return pData;
+}
+
+PVOID
+UnrolledListReturn(PUNROLLEDLIST pUnrolledList, DWORD dwIndex)
+{
+    PUNROLLEDNODE pNode  = NULL;
+    DWORD         dwSlot = 0;
+    DWORD         dwTailStart = 0;
+
+    if (NULL == pUnrolledList)
+    {
+        DEBUG_PRINT("NULL input");
+        return NULL;
+    }
+
+    if (dwIndex >= pUnrolledList->m_dwSize)
+    {
+        DEBUG_PRINT("List index out of range");
+        return NULL;
+    }
+
+    // NOTE: The tail is reached without a walk, like LINKEDLIST's.
+    dwTailStart = pUnrolledList->m_dwSize - pUnrolledList->m_pTail->m_dwCount;
+    if (dwIndex >= dwTailStart)
+    {
+        return pUnrolledList->m_pTail->m_apData[dwIndex - dwTailStart];
+    }
+
+    pNode = FindNode(pUnrolledList, dwIndex, &dwSlot, NULL);
+    return pNode->m_apData[dwSlot];
+}
+
+VOID
+UnrolledListCursorInit(PUNROLLEDLIST       pUnrolledList,
+                       PUNROLLEDLISTCURSOR pCursor)
+{
+    if ((NULL == pUnrolledList) || (NULL == pCursor))
+    {
+        DEBUG_PRINT("NULL input");
+        return;
+    }
+
+    pCursor->m_pNode  = pUnrolledList->m_pHead;
+    pCursor->m_dwSlot = 0;
+}
+
+PVOID
+UnrolledListCursorNext(PUNROLLEDLISTCURSOR pCursor)
+{
+    if (NULL == pCursor)
+    {
+        DEBUG_PRINT("NULL input");
+        return NULL;
+    }
+
+    while ((NULL != pCursor->m_pNode) &&
+           (pCursor->m_dwSlot >= pCursor->m_pNode->m_dwCount))
+    {
+        pCursor->m_pNode  = pCursor->m_pNode->m_pNext;
+        pCursor->m_dwSlot = 0;
+    }
+
+    if (NULL == pCursor->m_pNode)
+    {
+        return NULL;
+    }
+
+    return pCursor->m_pNode->m_apData[pCursor->m_dwSlot++];
+}
+
+RETURNTYPE
+UnrolledListDestroy(PUNROLLEDLIST pUnrolledList,
+                    VOID (*pfnFreeFunction)(PVOID))
+{
+    PUNROLLEDNODE pNode = NULL;
+
+    if (NULL == pUnrolledList)
+    {
+        DEBUG_PRINT("NULL input");
+        return ERR_GENERIC;
+    }
+
+    pNode = pUnrolledList->m_pHead;
+    while (NULL != pNode)
+    {
+        PUNROLLEDNODE pNext = pNode->m_pNext;
+
+        if (NULL != pfnFreeFunction)
+        {
+            for (DWORD dwSlot = 0; dwSlot < pNode->m_dwCount; dwSlot++)
+            {
+                pfnFreeFunction(pNode->m_apData[dwSlot]);
+            }
+        }
+
+        DestroyUnrolledNode(pUnrolledList, pNode);
+        pNode = pNext;
+    }
+
+    ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pUnrolledList,
+                    sizeof(UNROLLEDLIST));
+    return SUCCESS;
+}
+
+// End of file
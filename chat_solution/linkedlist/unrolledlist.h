@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Windows.h>
+
+#include "linkedlist.h"
+
+// NOTE: An unrolled list keeps up to UNROLLED_SLOTS data pointers per node,
+// in index order, so a scan reads one node per UNROLLED_SLOTS entries where
+// LINKEDLIST reads one per entry, and an index is found by skipping whole
+// nodes. It takes the same indices and gives the same results as LINKEDLIST.
+// A full node splits in half to make room and a node left less than half
+// full takes in its successor's entries if they fit.
+//
+// Lookups by index gain the most. A scan of a LINKEDLIST built by appending
+// already reads its pooled nodes in address order, so scans only gain once
+// inserts and removals have scattered those nodes.
+//
+// Sized so a node is two cache lines on x64.
+#define UNROLLED_SLOTS 14
+
+typedef struct UNROLLEDNODE
+{
+    struct UNROLLEDNODE *m_pNext;
+    DWORD                m_dwCount;
+    PVOID                m_apData[UNROLLED_SLOTS];
+} UNROLLEDNODE, *PUNROLLEDNODE;
+
+typedef struct UNROLLEDLIST
+{
+    PUNROLLEDNODE m_pHead;
+    PUNROLLEDNODE m_pTail;
+    DWORD         m_dwSize;
+    DWORD         m_dwNodes;
+} UNROLLEDLIST, *PUNROLLEDLIST, **PPUNROLLEDLIST;
+
+// NOTE: Changing the list invalidates the cursor.
+typedef struct UNROLLEDLISTCURSOR
+{
+    PUNROLLEDNODE m_pNode;
+    DWORD         m_dwSlot;
+} UNROLLEDLISTCURSOR, *PUNROLLEDLISTCURSOR;
+
+RETURNTYPE
+UnrolledListInit(PPUNROLLEDLIST ppUnrolledList);
+
+RETURNTYPE
+UnrolledListInsert(PUNROLLEDLIST pUnrolledList, PVOID pData, DWORD dwIndex);
+
+PVOID
+UnrolledListRemove(PUNROLLEDLIST pUnrolledList,
+                   DWORD         dwIndex,
+                   VOID (*pfnFreeFunction)(PVOID));
+
+PVOID
+UnrolledListReturn(PUNROLLEDLIST pUnrolledList, DWORD dwIndex);
+
+VOID
+UnrolledListCursorInit(PUNROLLEDLIST       pUnrolledList,
+                       PUNROLLEDLISTCURSOR pCursor);
+
+// NOTE: Returns the next entry's data, NULL once every entry has been seen.
+PVOID
+UnrolledListCursorNext(PUNROLLEDLISTCURSOR pCursor);
+
+RETURNTYPE
+UnrolledListDestroy(PUNROLLEDLIST pUnrolledList,
+                    VOID (*pfnFreeFunction)(PVOID));
+
+// End of file
@@ -13,7 +13,6 @@
 #include "s_worker.h"
 #include "s_message.h"
 #include "s_main.h"
-#include "Queue.h"
 
 extern volatile BOOL g_bServerState;
 extern HANDLE        g_hShutdownEvent;
@@ -202,6 +201,125 @@ ThreadShutDown(PSERVERCHATARGS pServerArgs)
 	}
 }
 
+//NOTE: Printing is opt-in, like HASHTABLE_STATS. Without SEND_STATS defined
+// the counters are still kept but the timer stays quiet.
+#ifdef SEND_STATS
+//NOTE: Prints the send queue totals when they moved since the last print, so
+// the caps can be tuned from how often each policy kicks in.
+static VOID
+PrintSendQueueStats(PUSERS pUsers)
+{
+	SENDQUEUESTATS Stats;
+	Stats.m_llBroadcastsDropped =
+		ReadAcquire64(&pUsers->m_SendQueueStats.m_llBroadcastsDropped);
+	Stats.m_llMsgsDropped =
+		ReadAcquire64(&pUsers->m_SendQueueStats.m_llMsgsDropped);
+	Stats.m_llDisconnects =
+		ReadAcquire64(&pUsers->m_SendQueueStats.m_llDisconnects);
+	Stats.m_llDirectRejected =
+		ReadAcquire64(&pUsers->m_SendQueueStats.m_llDirectRejected);
+	Stats.m_llSendCalls =
+		ReadAcquire64(&pUsers->m_SendQueueStats.m_llSendCalls);
+	Stats.m_llMsgsSent =
+		ReadAcquire64(&pUsers->m_SendQueueStats.m_llMsgsSent);
+
+	//NOTE: Under a broadcast storm messages per send shows how much each
+	// coalesced send carries, see SENDBATCH.
+	if (Stats.m_llMsgsSent != pUsers->m_PrintedStats.m_llMsgsSent)
+	{
+		wprintf(L"Sends: %lld messages in %lld WSASend calls, %.2f per "
+			"call.\n", Stats.m_llMsgsSent, Stats.m_llSendCalls,
+			(0 == Stats.m_llSendCalls) ? 0.0 :
+			(double)Stats.m_llMsgsSent / (double)Stats.m_llSendCalls);
+	}
+
+	if ((Stats.m_llBroadcastsDropped ==
+			pUsers->m_PrintedStats.m_llBroadcastsDropped) &&
+		(Stats.m_llMsgsDropped == pUsers->m_PrintedStats.m_llMsgsDropped) &&
+		(Stats.m_llDisconnects == pUsers->m_PrintedStats.m_llDisconnects) &&
+		(Stats.m_llDirectRejected ==
+			pUsers->m_PrintedStats.m_llDirectRejected))
+	{
+		pUsers->m_PrintedStats = Stats;
+		return;
+	}
+
+	wprintf(L"Send queues full: %lld broadcasts dropped, %lld messages "
+		"dropped, %lld disconnects, %lld direct messages rejected.\n",
+		Stats.m_llBroadcastsDropped, Stats.m_llMsgsDropped,
+		Stats.m_llDisconnects, Stats.m_llDirectRejected);
+	pUsers->m_PrintedStats = Stats;
+}
+
+//NOTE: Prints each lane's queue delay over the last period, for lanes that
+// sent anything in it. The maximum is reset so each print shows its period's.
+static VOID
+PrintSendLaneStats(PUSERS pUsers)
+{
+	static const PCWSTR paLaneNames[SEND_LANES] =
+		{ L"control", L"direct", L"broadcast" };
+	LARGE_INTEGER liFrequency;
+	QueryPerformanceFrequency(&liFrequency);
+	double dTicksPerUs = (double)liFrequency.QuadPart / 1000000.0;
+
+	for (DWORD dwLane = 0; dwLane < SEND_LANES; dwLane++)
+	{
+		PSENDLANESTATS pStats = &pUsers->m_aLaneStats[dwLane];
+		PSENDLANESTATS pPrinted = &pUsers->m_aPrintedLaneStats[dwLane];
+		LONG64 llMsgs = ReadAcquire64(&pStats->m_llMsgs);
+		LONG64 llDelayTotal = ReadAcquire64(&pStats->m_llDelayTotal);
+		LONG64 llDelayMax = InterlockedExchange64(&pStats->m_llDelayMax, 0);
+
+		if (llMsgs == pPrinted->m_llMsgs)
+		{
+			continue;
+		}
+
+		wprintf(L"Send lane %s: %lld messages, queued %.1f us on average, "
+			"%.1f us at most.\n", paLaneNames[dwLane],
+			llMsgs - pPrinted->m_llMsgs,
+			(double)(llDelayTotal - pPrinted->m_llDelayTotal) /
+			((double)(llMsgs - pPrinted->m_llMsgs) * dTicksPerUs),
+			(double)llDelayMax / dTicksPerUs);
+		pPrinted->m_llMsgs = llMsgs;
+		pPrinted->m_llDelayTotal = llDelayTotal;
+	}
+}
+#endif // SEND_STATS
+
+//NOTE: Runs on the thread pool every MAINTENANCE_PERIOD_MS, so shrinking
+//the users tables never happens on a worker handling a logout.
+static VOID CALLBACK
+UsersMaintenance(PTP_CALLBACK_INSTANCE pInstance, PVOID pContext,
+	PTP_TIMER pTimer)
+{
+	PUSERS pUsers = (PUSERS)pContext;
+
+	UNREFERENCED_PARAMETER(pInstance);
+	UNREFERENCED_PARAMETER(pTimer);
+
+	ShardedHashTableMaintenance(pUsers->m_pUsersHTable);
+
+	DWORD dwWaitResult = CustomWaitForSingleObject(
+		pUsers->m_haUsersHandles[NEW_USERS_MUTEX], INFINITE);
+	if (WAIT_OBJECT_0 != dwWaitResult)
+	{
+		DEBUG_ERROR("CustomWaitForSingleObject failed");
+		return;
+	}
+
+	if (SUCCESS != SocketMapMaintenance(pUsers->m_pNewUsersTable))
+	{
+		DEBUG_PRINT("SocketMapMaintenance failed");
+	}
+	ReleaseMutex(pUsers->m_haUsersHandles[NEW_USERS_MUTEX]);
+
+#ifdef SEND_STATS
+	PrintSendQueueStats(pUsers);
+	PrintSendLaneStats(pUsers);
+#endif // SEND_STATS
+}
+
 PUSERS
 CreateUsers(PSERVERCHATARGS pServerArgs)
 {
@@ -214,53 +332,69 @@ CreateUsers(PSERVERCHATARGS pServerArgs)
 	}
 
 	pUsers->m_dwMaxClients = pServerArgs->m_dwMaxClients;
-	//WARNING: Max clients set to 65535, so conversion to WORD type for entry
-	// into the following function does not result in any data loss.
-    if (SUCCESS != HashTableInit(&pUsers->m_pUsersHTable,
-                                 (WORD)pServerArgs->m_dwMaxClients, NULL))
+	pUsers->m_dwSendQueueMsgs = pServerArgs->m_dwSendQueueMsgs;
+	pUsers->m_dwSendQueueBytes = pServerArgs->m_dwSendQueueBytes;
+	pUsers->m_dwSendPolicy = pServerArgs->m_dwSendPolicy;
+
+	MsgPoolsInit(&pUsers->m_MsgPools);
+
+    if (SUCCESS != ShardedHashTableInit(&pUsers->m_pUsersHTable,
+                                        pServerArgs->m_dwMaxClients, NULL,
+                                        HASHTABLE_CAPACITY_POW2 |
+                                            HASHTABLE_READ_MOSTLY))
 	{
-		DEBUG_PRINT("HashTableInit failed");
+		DEBUG_PRINT("ShardedHashTableInit failed");
 		ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pUsers, sizeof(USERS));
 		return NULL;
 	}
 
 
-    if (SUCCESS != HashTableInit(&pUsers->m_pNewUsersTable,
-                                 (WORD)pServerArgs->m_dwMaxClients, NULL))
+	if (SUCCESS != SocketMapInit(&pUsers->m_pNewUsersTable,
+		pServerArgs->m_dwMaxClients))
 	{
-		DEBUG_PRINT("HashTableInit failed");
+		DEBUG_PRINT("SocketMapInit failed");
+		ShardedHashTableDestroy(pUsers->m_pUsersHTable, NULL);
 		ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pUsers, sizeof(USERS));
-		HashTableDestroy(pUsers->m_pUsersHTable, NULL);
 		return NULL;
 	}
 	pUsers->m_haUsersHandles[STD_OUT_MUTEX] =
 		pServerArgs->m_haSharedHandles[STD_OUT_MUTEX];
 	pUsers->m_haUsersHandles[STD_ERR_MUTEX] =
 		pServerArgs->m_haSharedHandles[STD_ERR_MUTEX];
-	pUsers->m_haUsersHandles[USERS_WRITE_MUTEX] = CreateMutexW(NULL, FALSE,
-		NULL);
 	pUsers->m_haUsersHandles[NEW_USERS_MUTEX] = CreateMutexW(NULL, FALSE,
 		NULL);
-	//NOTE: The initial count on the semaphore is zero because no threads will
-	//be reading initially.
-	pUsers->m_haUsersHandles[USERS_READ_SEMAPHORE] = CreateSemaphoreW(NULL,
-		pServerArgs->m_dwMaxClients, pServerArgs->m_dwMaxClients, NULL);
-	//NOTE: Event will auto reset after releasing a thread
-	pUsers->m_haUsersHandles[READERS_DONE_EVENT] = CreateEventW(NULL, FALSE,
-		FALSE, NULL);
-
-	if ((NULL == pUsers->m_haUsersHandles[USERS_WRITE_MUTEX]) ||
-		(NULL == pUsers->m_haUsersHandles[NEW_USERS_MUTEX]) ||
-		(NULL == pUsers->m_haUsersHandles[USERS_READ_SEMAPHORE]) ||
-		(NULL == pUsers->m_haUsersHandles[READERS_DONE_EVENT]))
+
+	if (NULL == pUsers->m_haUsersHandles[NEW_USERS_MUTEX])
 	{
 		DEBUG_ERROR("CreateMutexW failed");
+		ShardedHashTableDestroy(pUsers->m_pUsersHTable, NULL);
+		SocketMapDestroy(pUsers->m_pNewUsersTable, NULL);
 		ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pUsers, sizeof(USERS));
-		HashTableDestroy(pUsers->m_pUsersHTable, NULL);
-		HashTableDestroy(pUsers->m_pNewUsersTable, NULL);
 		return NULL;
 	}
 
+	pUsers->m_pMaintenanceTimer = CreateThreadpoolTimer(UsersMaintenance,
+		pUsers, NULL);
+	if (NULL == pUsers->m_pMaintenanceTimer)
+	{
+		DEBUG_ERROR("CreateThreadpoolTimer failed");
+		CloseHandle(pUsers->m_haUsersHandles[NEW_USERS_MUTEX]);
+		ShardedHashTableDestroy(pUsers->m_pUsersHTable, NULL);
+		SocketMapDestroy(pUsers->m_pNewUsersTable, NULL);
+		ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pUsers, sizeof(USERS));
+		return NULL;
+	}
+
+	//NOTE: A negative due time is relative, in 100 nanosecond units.
+	ULARGE_INTEGER uliDueTime;
+	uliDueTime.QuadPart =
+		(ULONGLONG)(-((LONGLONG)MAINTENANCE_PERIOD_MS * 10000));
+	FILETIME ftDueTime;
+	ftDueTime.dwLowDateTime = uliDueTime.LowPart;
+	ftDueTime.dwHighDateTime = uliDueTime.HighPart;
+	SetThreadpoolTimer(pUsers->m_pMaintenanceTimer, &ftDueTime,
+		MAINTENANCE_PERIOD_MS, NO_OPTION);
+
 	return pUsers;
 }
 
@@ -278,34 +412,23 @@ CreateUser(PSERVERCHATARGS pServerArgs, PUSERS pUsers, SOCKET ClientSocket)
 		return NULL;
 	}
 
+	//NOTE: The connection's reference, see UserRelease.
+	pUser->m_lRefs = 1;
 
-	pUser->m_haSharedHandles[SEND_MUTEX] = CreateMutexW(NULL, FALSE,
-		NULL);
 	//NOTE: Event is manual reset and the initial state is signaled.
 	pUser->m_haSharedHandles[SEND_DONE_EVENT] = CreateEventW(NULL, TRUE,
 		TRUE, NULL);
 
-	if ((NULL == pUser->m_haSharedHandles[SEND_DONE_EVENT])  ||
-		(NULL == pUser->m_haSharedHandles[SEND_MUTEX]))
+	if (NULL == pUser->m_haSharedHandles[SEND_DONE_EVENT])
 	{
-		DEBUG_ERROR("CreateMutexW failed");
+		DEBUG_ERROR("CreateEventW failed");
 		ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pUser,
 			sizeof(USER));
 
 		return NULL;
 	}
 
-	pUser->m_SendMsgQueue = QueueInit();
-
-	if (NULL == pUser->m_SendMsgQueue)
-	{
-		DEBUG_ERROR("QueueInit failed");
-
-		ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pUser,
-			sizeof(USER));
-
-		return NULL;
-	}
+	SendLanesInit(pUser);
 
 	pUser->m_haSharedHandles[STD_OUT_MUTEX] =
 		pServerArgs->m_haSharedHandles[STD_OUT_MUTEX];
@@ -316,6 +439,8 @@ CreateUser(PSERVERCHATARGS pServerArgs, PUSERS pUsers, SOCKET ClientSocket)
 	pUser->m_plBeingDestroyed = NOT_DESTROYING;
 
 	//NOTE: Setting conditions for asycronous recv.
+	pUser->m_RecvMsg.m_pBodyBufferOne = pUser->m_caRecvBodyOne;
+	pUser->m_RecvMsg.m_pBodyBufferTwo = pUser->m_caRecvBodyTwo;
 	ResetChatRecv(&pUser->m_RecvMsg);
 
 	return pUser;
@@ -326,6 +451,15 @@ ServerShutDown(PSERVERCHATARGS pServerArgs, PUSERS pUsers)
 {
 	g_bServerState = STOP;
 
+	//NOTE: No maintenance may be running once the tables are destroyed.
+	if ((NULL != pUsers) && (NULL != pUsers->m_pMaintenanceTimer))
+	{
+		SetThreadpoolTimer(pUsers->m_pMaintenanceTimer, NULL, 0, 0);
+		WaitForThreadpoolTimerCallbacks(pUsers->m_pMaintenanceTimer, TRUE);
+		CloseThreadpoolTimer(pUsers->m_pMaintenanceTimer);
+		pUsers->m_pMaintenanceTimer = NULL;
+	}
+
 	if (S_OK != ThreadShutDown(pServerArgs))
 	{
 		DEBUG_PRINT("ThreadShutDown failed");
@@ -336,20 +470,23 @@ ServerShutDown(PSERVERCHATARGS pServerArgs, PUSERS pUsers)
 		DEBUG_PRINT("CloseHandle failed");
 	}
 
-	if (SUCCESS != HashTableDestroy(pUsers->m_pUsersHTable,
+	if (SUCCESS != ShardedHashTableDestroy(pUsers->m_pUsersHTable,
 		UserFreeFunction))
 	{
-		DEBUG_PRINT("HashTableDestroy failed");
+		DEBUG_PRINT("ShardedHashTableDestroy failed");
 	}
 
-	if (SUCCESS != HashTableDestroy(pUsers->m_pNewUsersTable,
+	if (SUCCESS != SocketMapDestroy(pUsers->m_pNewUsersTable,
 		UserFreeFunction))
 	{
-		DEBUG_PRINT("HashTableDestroy failed");
+		DEBUG_PRINT("SocketMapDestroy failed");
 	}
 
 	NetCleanup(pServerArgs->m_ListenSocket, DO_CLEAN);
 
+	//NOTE: Every message was freed along with its user.
+	MsgPoolsDestroy(&pUsers->m_MsgPools);
+
 	//NOTE: All server processes have now been shutdown, now let's free the
 	// memory.
 	ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pUsers,
@@ -410,13 +547,12 @@ ServerListen(PSERVERCHATARGS pServerArgs)
 			return SRV_SHUTDOWN_ERR;
 		}
 
-		WORD wResult = HashTableNewEntry(pUsers->m_pNewUsersTable, pUser,
-			(PCHAR)&(pUser->m_ClientSocket),
-			(sizeof(SOCKET) / sizeof(WCHAR)));
+		WORD wResult = SocketMapInsert(pUsers->m_pNewUsersTable,
+			pUser->m_ClientSocket, pUser);
 		ReleaseMutex(pUsers->m_haUsersHandles[NEW_USERS_MUTEX]);
 		if (SUCCESS != wResult)
 		{
-			DEBUG_PRINT("HashTableNewEntry failed");
+			DEBUG_PRINT("SocketMapInsert failed");
 			UserFreeFunction((PVOID)pUser);
 			ServerShutDown(pServerArgs, pUsers);
 			return SRV_SHUTDOWN_ERR;
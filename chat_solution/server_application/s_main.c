@@ -92,12 +92,74 @@ MaxClientsCheck(DWORD dwMaxClients)
 	return SUCCESS;
 }
 
+//NOTE: Send queue caps may be left off the command line to take defaults.
+static INT
+SendQueueArgs(INT argc, PTSTR argv[], PSERVERCHATARGS pChatArgs)
+{
+	PWCHAR pcCheck = NULL;
+
+	pChatArgs->m_dwSendQueueMsgs = SEND_QUEUE_DEFAULT_MSGS;
+	pChatArgs->m_dwSendQueueBytes = SEND_QUEUE_DEFAULT_KB * 1024;
+	pChatArgs->m_dwSendPolicy = SEND_POLICY_DROP_OLDEST;
+
+	if (4 < argc)
+	{
+		pChatArgs->m_dwSendQueueMsgs = wcstoul(argv[4], &pcCheck, BASE_10);
+		if ((0 == pChatArgs->m_dwSendQueueMsgs) ||
+			(SEND_QUEUE_MAX_MSGS < pChatArgs->m_dwSendQueueMsgs) ||
+			((NULL != pcCheck) && (*pcCheck != L'\0')))
+		{
+			DEBUG_PRINT("Invalid send queue messages");
+			return ERR_INVALID_PARAM;
+		}
+	}
+
+	if (5 < argc)
+	{
+		DWORD dwKilobytes = wcstoul(argv[5], &pcCheck, BASE_10);
+		if ((0 == dwKilobytes) || (SEND_QUEUE_MAX_KB < dwKilobytes) ||
+			((NULL != pcCheck) && (*pcCheck != L'\0')))
+		{
+			DEBUG_PRINT("Invalid send queue KB");
+			return ERR_INVALID_PARAM;
+		}
+		pChatArgs->m_dwSendQueueBytes = dwKilobytes * 1024;
+	}
+
+	if (6 < argc)
+	{
+		if (0 == _wcsicmp(argv[6], L"drop"))
+		{
+			pChatArgs->m_dwSendPolicy = SEND_POLICY_DROP_OLDEST;
+		}
+		else if (0 == _wcsicmp(argv[6], L"disconnect"))
+		{
+			pChatArgs->m_dwSendPolicy = SEND_POLICY_DISCONNECT;
+		}
+		else if (0 == _wcsicmp(argv[6], L"reject"))
+		{
+			pChatArgs->m_dwSendPolicy = SEND_POLICY_REJECT;
+		}
+		else
+		{
+			DEBUG_PRINT("Invalid send queue policy");
+			return ERR_INVALID_PARAM;
+		}
+	}
+
+	return SUCCESS;
+}
+
 static VOID
 PrintHelp()
 {
 	wprintf(L"\nChat Server Usage:\nserver_application.exe <bind_ip"
-		"> <bind_port> <max number of clients>\nExample:server_application.exe "
-		"192.168.0.10 1234 5.\n");
+		"> <bind_port> <max number of clients> [send queue messages] [send "
+		"queue KB] [drop|disconnect|reject]\nExample:server_application.exe "
+		"192.168.0.10 1234 5.\nA user's send queue holds 256 messages or "
+		"1024 KB by default. Once full, the oldest broadcasts queued for it "
+		"are dropped, the user is disconnected, or direct messages to it are "
+		"rejected.\n");
 }
 
 static INT
@@ -105,7 +167,7 @@ CommandLineArgs(INT argc, PTSTR argv[], PSERVERCHATARGS pChatArgs)
 {
 	PWCHAR pcCheck = NULL;
 
-	if (4 != argc)
+	if ((4 > argc) || (7 < argc))
 	{
 		DEBUG_PRINT("Invalid Number of arguments");
         return ERR_INVALID_PARAM;
@@ -140,6 +202,11 @@ CommandLineArgs(INT argc, PTSTR argv[], PSERVERCHATARGS pChatArgs)
         return ERR_INVALID_PARAM;
 	}
 
+	if (SUCCESS != SendQueueArgs(argc, argv, pChatArgs))
+	{
+		DEBUG_PRINT("SendQueueArgs failed");
+		return ERR_INVALID_PARAM;
+	}
 
 	return SUCCESS;
 }
@@ -7,7 +7,6 @@
  *********************************************************************/
 
 #include "s_message.h"
-#include "Queue.h"
 
 #include "s_main.h"
 
@@ -30,151 +29,228 @@ ResetChatRecv(PMSGHOLDER pMsgHolder)
 	pMsgHolder->m_dwBytesMoved = 0;
 }
 
-//WARNING: pUser print mutexes must already be created.
-//NOTE: Pushes the message onto the queue and returns a pointer to the
-// message.
-static PMSGHOLDER
-CreateMsg(PUSER pUser)
+//NOTE: Sends whatever the user's batch has left, from m_dwFirstBuffer on.
+HRESULT
+SendBatch(PUSER pUser)
 {
-	PMSGHOLDER pMsgHolder = HeapAlloc(GetProcessHeap(),
-		HEAP_ZERO_MEMORY,
-		sizeof(MSGHOLDER));
-	if (NULL == pMsgHolder)
+	PSENDBATCH pBatch = &pUser->m_SendBatch;
+	PMSGHOLDER pCarrier = pBatch->m_apMsgs[0];
+
+	ZeroMemory(&pCarrier->m_wsaOverlapped, sizeof(OVERLAPPED));
+	InterlockedIncrement64(&pUser->m_pUsers->m_SendQueueStats.m_llSendCalls);
+
+	//NOTE: Released by the worker that handles the completion. The caller
+	// keeps the user alive by a reference of its own, or from inside the
+	// epoch, so a send that fails here can't free the user from under it.
+	InterlockedIncrement(&pUser->m_lRefs);
+	INT iResult = WSASend(pUser->m_ClientSocket,
+		&pBatch->m_wsaBuffers[pBatch->m_dwFirstBuffer],
+		pBatch->m_dwBuffers - pBatch->m_dwFirstBuffer,
+		&pBatch->m_dwBytesMoved, pBatch->m_dwFlags,
+		&pCarrier->m_wsaOverlapped, NULL);
+
+	if (SOCKET_ERROR == iResult)
 	{
-        DEBUG_ERROR("HeapAlloc()");
-		return NULL;
+		iResult = WSAGetLastError();
+		if (WSA_IO_PENDING != iResult)
+		{
+			DEBUG_ERROR_SUPPLIED(iResult, "WSASend()");
+			InterlockedDecrement(&pUser->m_lRefs);
+			return CLIENT_REMOVE_ERR;
+		}
 	}
 
-	WORD wResult = QueuePush(pUser->m_SendMsgQueue, pMsgHolder);
-	if (SUCCESS != wResult)
-    {
-        DEBUG_PRINT("QueuePush()");
-		return NULL;
+	return S_OK;
+}
+
+//NOTE: Only called by the thread holding m_plSendOccuring, which makes it the
+// send queue's one consumer. Pops the next batch and starts its send, or
+// gives the flag up once the queue is empty. A message pushed after the last
+// pop but before the flag was given up would have nobody to send it, so the
+// queue is checked again afterwards and the flag retaken if needed.
+HRESULT
+SendQueuedMsg(PUSER pUser)
+{
+	for (;;)
+	{
+		if (0 != FillSendBatch(pUser))
+		{
+			HRESULT hResult = SendBatch(pUser);
+			if (S_OK != hResult)
+			{
+				AbortQueuedSend(pUser);
+			}
+
+			return hResult;
+		}
+
+		BOOL bResult = SetEvent(pUser->m_haSharedHandles[SEND_DONE_EVENT]);
+		InterlockedExchange(&pUser->m_plSendOccuring, 0);
+		if (FALSE == bResult)
+		{
+			DEBUG_ERROR("SetEvent()");
+			return SRV_SHUTDOWN_ERR;
+		}
+
+		//NOTE: If the original value wasn't zero, a producer took the flag
+		// after it was given up and is sending the queue.
+		if ((TRUE == SendLanesEmpty(pUser)) ||
+			(0 != InterlockedCompareExchange(&pUser->m_plSendOccuring, 1, 0)))
+		{
+			return S_OK;
+		}
+
+		ResetEvent(pUser->m_haSharedHandles[SEND_DONE_EVENT]);
 	}
+}
 
-	return pMsgHolder;
+//NOTE: Drops the batch a send failed to start for and gives up
+// m_plSendOccuring. The batch is released first, the next thread to take the
+// flag would overwrite m_SendBatch.
+VOID
+AbortQueuedSend(PUSER pUser)
+{
+	ReleaseSendBatch(pUser);
+	SetEvent(pUser->m_haSharedHandles[SEND_DONE_EVENT]);
+	InterlockedExchange(&pUser->m_plSendOccuring, 0);
 }
 
-PMSGHOLDER
-AddMsgToQueue(PUSER pUser, INT8 iType, INT8 iSubType,
-	INT8 iOpcode, WORD wLenOne, WORD wLenTwo, PWSTR pszDataOne,
-	PWSTR pszDataTwo)
+//NOTE: The user is to be disconnected for not reading its messages. A
+// reply's user is the one whose request is being handled, whose worker
+// removes it. Anyone else is removed by cancelling their IO, which fails
+// their pending receive for the worker that picks that up.
+static HRESULT
+SendQueueOverflowed(PUSER pUser, INT8 iSendClass)
 {
-	PMSGHOLDER pMsgHolder = CreateMsg(pUser);
-	if (NULL == pMsgHolder)
-    {
-        DEBUG_PRINT("CreateMsg()");
-		return NULL;
+	if (SEND_CLASS_REPLY == iSendClass)
+	{
+		return CLIENT_REMOVE_ERR;
 	}
 
-	//NOTE: Preparing packet header.
-	pMsgHolder->m_Header.iType = iType;
-	pMsgHolder->m_Header.iSubType = iSubType;
-	pMsgHolder->m_Header.iOpcode = iOpcode;
-	pMsgHolder->m_Header.wLenOne = htons(wLenOne);
-	pMsgHolder->m_Header.wLenTwo = htons(wLenTwo);
+	CancelIoEx((HANDLE)pUser->m_ClientSocket, NULL);
+	return S_OK;
+}
 
-	//NOTE: wcscpy_s requires inclusion of terminating NULL byte in length.
-	if (0 < wLenOne)
-    {
-        errno_t eResult =
-            wcscpy_s(pMsgHolder->m_pBodyBufferOne, BUFF_SIZE + 1,
-			pszDataOne);
-		if (0 != eResult)
-        {
-            DEBUG_ERROR_SUPPLIED(eResult, "CreateMsg()");
-			return NULL;
-		}
-	}
-	if (0 < wLenTwo)
+//NOTE: Any number of threads can queue to the same user at once without
+// waiting, the one that finds no send occuring drains the queue.
+//NOTE: A message a full send queue drops is not an error, S_OK is returned.
+// Only a direct message turned away returns SEND_QUEUE_FULL. Replies are
+// never dropped, see SEND_REPLY_MAX.
+//NOTE: Called once a message is queued. The message may already be sent and
+// freed by the thread that held the flag before, SendQueuedMsg sends
+// whatever is next.
+static HRESULT
+StartQueuedSend(PUSER pUser)
+{
+	//NOTE: If the original value wasn't zero, the function will return success
+	// - another function is handling the sending of the queue.
+	if (0 != InterlockedCompareExchange(&pUser->m_plSendOccuring, 1, 0))
 	{
-        errno_t eResult =
-            wcscpy_s(pMsgHolder->m_pBodyBufferTwo, BUFF_SIZE + 1,
-			pszDataTwo);
-		if (0 != eResult)
-        {
-            DEBUG_ERROR_SUPPLIED(eResult, "wcscpy_s()");
-			return NULL;
-		}
+		return S_OK;
 	}
 
-	WstrHostToNet(pMsgHolder->m_pBodyBufferOne, wLenOne);
-	WstrHostToNet(pMsgHolder->m_pBodyBufferTwo, wLenTwo);
+	ResetEvent(pUser->m_haSharedHandles[SEND_DONE_EVENT]);
+	if (S_OK != SendQueuedMsg(pUser))
+	{
+		DEBUG_PRINT("SendQueuedMsg()");
+		return NON_FATAL_ERR;
+	}
 
-	//NOTE: Preparing WSABuf struct.
-	pMsgHolder->m_wsaBuffer[HEADER_INDEX].len = HEADER_LEN;
-	pMsgHolder->m_wsaBuffer[HEADER_INDEX].buf = (PCHAR)&pMsgHolder->m_Header;
-	pMsgHolder->m_wsaBuffer[BODY_INDEX_1].len = wLenOne * sizeof(WCHAR);
-	pMsgHolder->m_wsaBuffer[BODY_INDEX_1].buf =
-		(PCHAR)pMsgHolder->m_pBodyBufferOne;
-	pMsgHolder->m_wsaBuffer[BODY_INDEX_2].len = wLenTwo * sizeof(WCHAR);
-	pMsgHolder->m_wsaBuffer[BODY_INDEX_2].buf =
-		(PCHAR)pMsgHolder->m_pBodyBufferTwo;
-	pMsgHolder->m_dwBytestoMove = HEADER_LEN + ((wLenOne + wLenTwo) *
-		sizeof(WCHAR));
-	pMsgHolder->m_iOperationType = SEND_OP;
-
-	return pMsgHolder;
+	return S_OK;
 }
 
+//NOTE: Queues a message around a body the caller already built, so a
+// broadcast encodes its text once and each recipient only takes a reference.
+// pBody is NULL when both lengths are zero.
 HRESULT
-ManageMsgQueueAdd(PUSER pUser, INT8 iType, INT8 iSubType,
-	INT8 iOpcode, WORD wLenOne, WORD wLenTwo, PWSTR pszDataOne,
-	PWSTR pszDataTwo)
+ManageBodyMsgQueueAdd(PUSER pUser, INT8 iSendClass, INT8 iType,
+	INT8 iSubType, INT8 iOpcode, WORD wLenOne, WORD wLenTwo, PMSGBODY pBody)
 {
-	InterlockedIncrement(&pUser->m_plThreadsWaiting);
-
-	DWORD dwWaitResult = CustomWaitForSingleObject(
-		pUser->m_haSharedHandles[SEND_MUTEX], INFINITE);
-	InterlockedDecrement(&pUser->m_plThreadsWaiting);
-	//NOTE: Maybe handle wait abandoned differently than wait failed in the
-	// future.
-	if (WAIT_OBJECT_0 != dwWaitResult)
+	DWORD dwBytes = HEADER_LEN + ((wLenOne + wLenTwo) * sizeof(WCHAR));
+	HRESULT hResult = SendQueueReserve(pUser, iSendClass, dwBytes);
+	if (S_FALSE == hResult)
 	{
-        if ((WAIT_OBJECT_0 + 1) != dwWaitResult)
-		{
-            DEBUG_PRINT("shutdown observed");
-            return SRV_SHUTDOWN_ERR;
-		}
-        DEBUG_ERROR("CustomWaitForSingleObject()");
-		return SRV_SHUTDOWN_ERR;
+		return S_OK;
+	}
+	if (CLIENT_REMOVE_ERR == hResult)
+	{
+		return SendQueueOverflowed(pUser, iSendClass);
+	}
+	if (S_OK != hResult)
+	{
+		return hResult;
 	}
 
 	PMSGHOLDER pMsgHolder =
-        AddMsgToQueue(pUser, iType, iSubType, iOpcode, wLenOne, wLenTwo,
-                      pszDataOne, pszDataTwo);
+        AddMsgToQueue(pUser, iSendClass, iType, iSubType, iOpcode, wLenOne,
+                      wLenTwo, pBody);
 	if (NULL == pMsgHolder)
     {
         DEBUG_PRINT("AddMsgToQueue()");
+		SendQueueUnreserve(pUser, iSendClass, dwBytes);
 		return SRV_SHUTDOWN_ERR;
 	}
 
-	//NOTE: If the original value wasn't zero, the function will return success
-	// - another function is handling the sending of the queue.
-	if (0 != InterlockedCompareExchange(&pUser->m_plSendOccuring, 1, 0))
+	return StartQueuedSend(pUser);
+}
+
+//NOTE: Queues one of the STATIC_PACKETS as a reply, see AddStaticMsgToQueue.
+HRESULT
+ManageStaticMsgQueueAdd(PUSER pUser, DWORD dwPacket)
+{
+	HRESULT hResult = SendQueueReserve(pUser, SEND_CLASS_REPLY, HEADER_LEN);
+	if (CLIENT_REMOVE_ERR == hResult)
 	{
-		ReleaseMutex(pUser->m_haSharedHandles[SEND_MUTEX]);
-		return S_OK;
+		return SendQueueOverflowed(pUser, SEND_CLASS_REPLY);
+	}
+	if (S_OK != hResult)
+	{
+		return hResult;
 	}
 
-	ResetEvent(pUser->m_haSharedHandles[SEND_DONE_EVENT]);
-	ReleaseMutex(pUser->m_haSharedHandles[SEND_MUTEX]);
+	if (NULL == AddStaticMsgToQueue(pUser, dwPacket))
+	{
+		DEBUG_PRINT("AddStaticMsgToQueue()");
+		SendQueueUnreserve(pUser, SEND_CLASS_REPLY, HEADER_LEN);
+		return SRV_SHUTDOWN_ERR;
+	}
 
-	INT iResult = WSASend(pUser->m_ClientSocket, pMsgHolder->m_wsaBuffer,
-		THREE_BUFFERS, &pMsgHolder->m_dwBytesMoved, pMsgHolder->m_dwFlags,
-		&pMsgHolder->m_wsaOverlapped, NULL);
+	return StartQueuedSend(pUser);
+}
 
-	if (SOCKET_ERROR == iResult)
+HRESULT
+ManageClassMsgQueueAdd(PUSER pUser, INT8 iSendClass, INT8 iType,
+	INT8 iSubType, INT8 iOpcode, WORD wLenOne, WORD wLenTwo,
+	PWSTR pszDataOne, PWSTR pszDataTwo)
+{
+	if ((0 == wLenOne) && (0 == wLenTwo))
 	{
-		iResult = WSAGetLastError();
-		if (WSA_IO_PENDING != iResult)
-		{
-            DEBUG_ERROR_SUPPLIED(iResult, "WSAGetLastError");
-			return NON_FATAL_ERR;
-		}
+		return ManageBodyMsgQueueAdd(pUser, iSendClass, iType, iSubType,
+			iOpcode, wLenOne, wLenTwo, NULL);
 	}
 
-	return S_OK;
+	PMSGPOOLS pPools = &pUser->m_pUsers->m_MsgPools;
+	PMSGBODY pBody = CreateMsgBody(pPools, wLenOne, wLenTwo, pszDataOne,
+		pszDataTwo);
+	if (NULL == pBody)
+	{
+		DEBUG_PRINT("CreateMsgBody()");
+		return SRV_SHUTDOWN_ERR;
+	}
+
+	HRESULT hResult = ManageBodyMsgQueueAdd(pUser, iSendClass, iType,
+		iSubType, iOpcode, wLenOne, wLenTwo, pBody);
+	ReleaseMsgBody(pPools, pBody);
+	return hResult;
+}
+
+HRESULT
+ManageMsgQueueAdd(PUSER pUser, INT8 iType, INT8 iSubType,
+	INT8 iOpcode, WORD wLenOne, WORD wLenTwo, PWSTR pszDataOne,
+	PWSTR pszDataTwo)
+{
+	return ManageClassMsgQueueAdd(pUser, SEND_CLASS_REPLY, iType, iSubType,
+		iOpcode, wLenOne, wLenTwo, pszDataOne, pszDataTwo);
 }
 
 //End of file
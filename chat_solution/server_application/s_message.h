@@ -7,21 +7,35 @@
  *********************************************************************/
 #pragma once
 #include "s_shared.h"
+#include "s_sendqueue.h"
 
 VOID
 ResetChatRecv(PMSGHOLDER pMsgHolder);
 
-PMSGHOLDER
-AddMsgToQueue(PUSER pUser, INT8 iType, INT8 iSubType,
-	INT8 iOpcode, WORD wLenOne, WORD wLenTwo, PWSTR pszDataOne,
-	PWSTR pszDataTwo);
+HRESULT
+SendBatch(PUSER pUser);
+
+HRESULT
+SendQueuedMsg(PUSER pUser);
+
+VOID
+AbortQueuedSend(PUSER pUser);
+
+HRESULT
+ManageBodyMsgQueueAdd(PUSER pUser, INT8 iSendClass, INT8 iType,
+	INT8 iSubType, INT8 iOpcode, WORD wLenOne, WORD wLenTwo, PMSGBODY pBody);
+
+HRESULT
+ManageStaticMsgQueueAdd(PUSER pUser, DWORD dwPacket);
+
+HRESULT
+ManageClassMsgQueueAdd(PUSER pUser, INT8 iSendClass, INT8 iType,
+	INT8 iSubType, INT8 iOpcode, WORD wLenOne, WORD wLenTwo,
+	PWSTR pszDataOne, PWSTR pszDataTwo);
 
 HRESULT
 ManageMsgQueueAdd(PUSER pUser, INT8 iType, INT8 iSubType,
 	INT8 iOpcode, WORD wLenOne, WORD wLenTwo, PWSTR pszDataOne,
 	PWSTR pszDataTwo);
 
-VOID
-FreeMsg(PVOID pParam);
-
  //End of file
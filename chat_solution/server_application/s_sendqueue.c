@@ -0,0 +1,593 @@
+/*****************************************************************//**
+ * \file   s_sendqueue.c
+ * \brief
+ *
+ * \author chris
+ * \date   October 2024
+ *********************************************************************/
+
+#include "s_sendqueue.h"
+
+//NOTE: Each user's send queue, from building a queued message to gathering
+// the lanes into a send batch, with the caps and policies in between. Nothing
+// here touches a socket, the sends themselves are in s_message.c.
+
+//NOTE: Indexed by STATIC_PACKET_*. Both lengths are zero, which is the same
+// in either byte order, so the packets are on the wire as they stand.
+static const CHATMSG g_aStaticPackets[STATIC_PACKETS] = {
+	{ TYPE_FAILURE, STYPE_EMPTY, REJECT_SRV_BUSY },
+	{ TYPE_FAILURE, STYPE_EMPTY, REJECT_SRV_ERR },
+	{ TYPE_FAILURE, STYPE_EMPTY, REJECT_INVALID_PACKET },
+	{ TYPE_FAILURE, STYPE_EMPTY, REJECT_UNAME_LEN },
+	{ TYPE_FAILURE, STYPE_EMPTY, REJECT_USER_LOGGED },
+	{ TYPE_FAILURE, STYPE_EMPTY, REJECT_USER_NOT_EXIST },
+	{ TYPE_FAILURE, STYPE_EMPTY, REJECT_MSG_LEN },
+	{ TYPE_FAILURE, STYPE_EMPTY, REJECT_SRV_FULL },
+	{ TYPE_ACCOUNT, STYPE_LOGIN, OPCODE_ACK },
+	{ TYPE_ACCOUNT, STYPE_LOGOUT, OPCODE_ACK },
+	{ TYPE_CHAT, STYPE_EMPTY, OPCODE_ACK },
+	{ TYPE_BROADCAST, STYPE_EMPTY, OPCODE_ACK },
+};
+
+VOID
+MsgPoolsInit(PMSGPOOLS pPools)
+{
+	static const DWORD daClassBytes[MSG_BODY_CLASSES] = MSG_BODY_CLASS_BYTES;
+	BlockPoolInit(&pPools->m_Records, sizeof(MSGHOLDER), MSG_POOL_MAX_FREE);
+	for (DWORD dwClass = 0; dwClass < MSG_BODY_CLASSES; dwClass++)
+	{
+		BlockPoolInit(&pPools->m_aBodies[dwClass], daClassBytes[dwClass],
+			MSG_POOL_MAX_FREE);
+	}
+}
+
+//NOTE: Every message has to have been freed.
+VOID
+MsgPoolsDestroy(PMSGPOOLS pPools)
+{
+	BlockPoolDestroy(&pPools->m_Records);
+	for (DWORD dwClass = 0; dwClass < MSG_BODY_CLASSES; dwClass++)
+	{
+		BlockPoolDestroy(&pPools->m_aBodies[dwClass]);
+	}
+}
+
+VOID
+SendLanesInit(PUSER pUser)
+{
+	for (DWORD dwLane = 0; dwLane < SEND_LANES; dwLane++)
+	{
+		MPSC_QUEUE_INIT(&pUser->m_aSendLanes[dwLane].m_Queue, MSGHOLDER,
+			m_SendLink);
+		INTRUSIVE_LIST_INIT(&pUser->m_aSendLanes[dwLane].m_Backlog,
+			MSGHOLDER, m_SendLink);
+	}
+	InitializeSRWLock(&pUser->m_SendBacklogLock);
+}
+
+//NOTE: Frees the batch and everything still queued, without giving their
+// room back. Only for a user being freed.
+VOID
+SendLanesClear(PUSER pUser)
+{
+	for (DWORD dwMsg = 0; dwMsg < pUser->m_SendBatch.m_dwMsgs; dwMsg++)
+	{
+		FreeMsg(pUser->m_SendBatch.m_apMsgs[dwMsg]);
+	}
+	for (DWORD dwLane = 0; dwLane < SEND_LANES; dwLane++)
+	{
+		IntrusiveListClear(&pUser->m_aSendLanes[dwLane].m_Backlog, FreeMsg);
+		MpscQueueClear(&pUser->m_aSendLanes[dwLane].m_Queue, FreeMsg);
+	}
+}
+
+//NOTE: The push publishes pMsgHolder to whichever thread drains the queue,
+// so it comes last.
+static VOID
+PushQueuedMsg(PUSER pUser, PMSGHOLDER pMsgHolder)
+{
+	LARGE_INTEGER liQueuedAt;
+	QueryPerformanceCounter(&liQueuedAt);
+	pMsgHolder->m_llQueuedAt = liQueuedAt.QuadPart;
+	MpscQueuePush(&pUser->m_aSendLanes[pMsgHolder->m_iSendClass].m_Queue,
+		pMsgHolder);
+}
+
+//NOTE: Copies both strings into a body from the server's pools and encodes
+// them for the wire, holding one reference for the caller. Every message
+// queued with the body takes its own, see MSGBODY.
+PMSGBODY
+CreateMsgBody(PMSGPOOLS pPools, WORD wLenOne, WORD wLenTwo,
+	PWSTR pszDataOne, PWSTR pszDataTwo)
+{
+	static const DWORD daClassBytes[MSG_BODY_CLASSES] = MSG_BODY_CLASS_BYTES;
+	DWORD dwBytes = FIELD_OFFSET(MSGBODY, m_caText) +
+		((wLenOne + 1 + wLenTwo + 1) * sizeof(WCHAR));
+	INT8 iClass = 0;
+	while ((MSG_BODY_CLASSES > iClass) && (daClassBytes[iClass] < dwBytes))
+	{
+		iClass++;
+	}
+	if (MSG_BODY_CLASSES == iClass)
+	{
+		DEBUG_PRINT("Message body too long");
+		return NULL;
+	}
+
+	PMSGBODY pBody = BlockPoolAlloc(&pPools->m_aBodies[iClass]);
+	if (NULL == pBody)
+	{
+        DEBUG_PRINT("BlockPoolAlloc()");
+		return NULL;
+	}
+
+	pBody->m_lRefs = 1;
+	pBody->m_dwBytes = dwBytes;
+	pBody->m_iClass = iClass;
+
+	//NOTE: Each string has room for its length and a terminating NULL. The
+	// text is encoded as it's copied.
+	PWCHAR pTextTwo = pBody->m_caText + wLenOne + 1;
+	WstrHostToNetCopy(pBody->m_caText, pszDataOne, wLenOne);
+	pBody->m_caText[wLenOne] = L'\0';
+	WstrHostToNetCopy(pTextTwo, pszDataTwo, wLenTwo);
+	pTextTwo[wLenTwo] = L'\0';
+	return pBody;
+}
+
+//NOTE: The last reference returns the body to its pool. Only the bytes the
+// body used can hold its text.
+VOID
+ReleaseMsgBody(PMSGPOOLS pPools, PMSGBODY pBody)
+{
+	if (0 != InterlockedDecrement(&pBody->m_lRefs))
+	{
+		return;
+	}
+
+	INT8 iClass = pBody->m_iClass;
+	SecureZeroMemory(pBody, pBody->m_dwBytes);
+	BlockPoolFree(&pPools->m_aBodies[iClass], pBody);
+}
+
+VOID
+FreeMsg(PVOID pParam)
+{
+	PMSGHOLDER pMsgHolder = (PMSGHOLDER)pParam;
+	PMSGPOOLS pPools = pMsgHolder->m_pPools;
+
+	//NOTE: Reply slots belong to their user, ReleaseQueuedMsg returns them.
+	if (NULL == pPools)
+	{
+		return;
+	}
+	if (NULL != pMsgHolder->m_pBody)
+	{
+		ReleaseMsgBody(pPools, pMsgHolder->m_pBody);
+	}
+	SecureZeroMemory(pMsgHolder, sizeof(MSGHOLDER));
+	BlockPoolFree(&pPools->m_Records, pMsgHolder);
+}
+
+//NOTE: Builds a message around pBody, which is NULL for a header-only
+// packet, and pushes it onto the user's send queue. The message takes its
+// own reference to the body.
+PMSGHOLDER
+AddMsgToQueue(PUSER pUser, INT8 iSendClass, INT8 iType, INT8 iSubType,
+	INT8 iOpcode, WORD wLenOne, WORD wLenTwo, PMSGBODY pBody)
+{
+	PMSGPOOLS pPools = &pUser->m_pUsers->m_MsgPools;
+	PMSGHOLDER pMsgHolder = BlockPoolAlloc(&pPools->m_Records);
+	if (NULL == pMsgHolder)
+    {
+        DEBUG_PRINT("BlockPoolAlloc()");
+		return NULL;
+	}
+
+	ZeroMemory(pMsgHolder, sizeof(MSGHOLDER));
+	pMsgHolder->m_pPools = pPools;
+	if (NULL != pBody)
+	{
+		InterlockedIncrement(&pBody->m_lRefs);
+		pMsgHolder->m_pBody = pBody;
+		pMsgHolder->m_pBodyBufferOne = pBody->m_caText;
+		pMsgHolder->m_pBodyBufferTwo = pBody->m_caText + wLenOne + 1;
+	}
+
+	//NOTE: Preparing packet header.
+	pMsgHolder->m_Header.iType = iType;
+	pMsgHolder->m_Header.iSubType = iSubType;
+	pMsgHolder->m_Header.iOpcode = iOpcode;
+	pMsgHolder->m_Header.wLenOne = htons(wLenOne);
+	pMsgHolder->m_Header.wLenTwo = htons(wLenTwo);
+
+	//NOTE: Preparing WSABuf struct.
+	pMsgHolder->m_wsaBuffer[HEADER_INDEX].len = HEADER_LEN;
+	pMsgHolder->m_wsaBuffer[HEADER_INDEX].buf = (PCHAR)&pMsgHolder->m_Header;
+	pMsgHolder->m_wsaBuffer[BODY_INDEX_1].len = wLenOne * sizeof(WCHAR);
+	pMsgHolder->m_wsaBuffer[BODY_INDEX_1].buf =
+		(PCHAR)pMsgHolder->m_pBodyBufferOne;
+	pMsgHolder->m_wsaBuffer[BODY_INDEX_2].len = wLenTwo * sizeof(WCHAR);
+	pMsgHolder->m_wsaBuffer[BODY_INDEX_2].buf =
+		(PCHAR)pMsgHolder->m_pBodyBufferTwo;
+	pMsgHolder->m_dwBytestoMove = HEADER_LEN + ((wLenOne + wLenTwo) *
+		sizeof(WCHAR));
+	pMsgHolder->m_iOperationType = SEND_OP;
+	pMsgHolder->m_iSendClass = iSendClass;
+	PushQueuedMsg(pUser, pMsgHolder);
+	return pMsgHolder;
+}
+
+//NOTE: Takes a free reply slot, NULL when all of them are queued.
+static PMSGHOLDER
+ClaimReplySlot(PUSER pUser)
+{
+	LONG lUsed = pUser->m_lReplySlotsUsed;
+	for (;;)
+	{
+		LONG lSlot = 0;
+		while ((REPLY_SLOTS > lSlot) && (0 != (lUsed & (1 << lSlot))))
+		{
+			lSlot++;
+		}
+		if (REPLY_SLOTS == lSlot)
+		{
+			return NULL;
+		}
+
+		LONG lSeen = InterlockedCompareExchange(&pUser->m_lReplySlotsUsed,
+			lUsed | (1 << lSlot), lUsed);
+		if (lSeen == lUsed)
+		{
+			return &pUser->m_aReplySlots[lSlot];
+		}
+		lUsed = lSeen;
+	}
+}
+
+//NOTE: Queues one of the read-only STATIC_PACKETS in a reply slot, or a
+// pooled record once they are all queued. Either way nothing is encoded or
+// copied, the header buffer points into the table.
+PMSGHOLDER
+AddStaticMsgToQueue(PUSER pUser, DWORD dwPacket)
+{
+	PMSGHOLDER pMsgHolder = ClaimReplySlot(pUser);
+	if (NULL == pMsgHolder)
+	{
+		PMSGPOOLS pPools = &pUser->m_pUsers->m_MsgPools;
+		pMsgHolder = BlockPoolAlloc(&pPools->m_Records);
+		if (NULL == pMsgHolder)
+		{
+			DEBUG_PRINT("BlockPoolAlloc()");
+			return NULL;
+		}
+		ZeroMemory(pMsgHolder, sizeof(MSGHOLDER));
+		pMsgHolder->m_pPools = pPools;
+	}
+
+	pMsgHolder->m_wsaBuffer[HEADER_INDEX].len = HEADER_LEN;
+	pMsgHolder->m_wsaBuffer[HEADER_INDEX].buf =
+		(PCHAR)&g_aStaticPackets[dwPacket];
+	pMsgHolder->m_dwBytestoMove = HEADER_LEN;
+	pMsgHolder->m_iOperationType = SEND_OP;
+	pMsgHolder->m_iSendClass = SEND_CLASS_REPLY;
+	PushQueuedMsg(pUser, pMsgHolder);
+	return pMsgHolder;
+}
+
+VOID
+SendQueueUnreserve(PUSER pUser, INT8 iSendClass, DWORD dwBytes)
+{
+	if (SEND_CLASS_REPLY == iSendClass)
+	{
+		InterlockedDecrement(&pUser->m_lQueuedReplies);
+	}
+	InterlockedDecrement(&pUser->m_lQueuedMsgs);
+	InterlockedAdd(&pUser->m_lQueuedBytes, -(LONG)dwBytes);
+}
+
+//NOTE: Counts dwBytes more against the user's caps, backing out if either
+// is exceeded. Producers reserve before they build, so two racing for the
+// last room can both back out, and neither goes over.
+static BOOL
+SendQueueFits(PUSER pUser, DWORD dwBytes)
+{
+	PUSERS pUsers = pUser->m_pUsers;
+	LONG lMsgs = InterlockedIncrement(&pUser->m_lQueuedMsgs);
+	LONG lBytes = InterlockedAdd(&pUser->m_lQueuedBytes, (LONG)dwBytes);
+
+	if (((DWORD)lMsgs <= pUsers->m_dwSendQueueMsgs) &&
+		((DWORD)lBytes <= pUsers->m_dwSendQueueBytes))
+	{
+		return TRUE;
+	}
+
+	SendQueueUnreserve(pUser, SEND_CLASS_BROADCAST, dwBytes);
+	return FALSE;
+}
+
+//NOTE: Frees a popped message and gives its room back to the user's caps.
+VOID
+ReleaseQueuedMsg(PUSER pUser, PMSGHOLDER pMsgHolder)
+{
+	SendQueueUnreserve(pUser, pMsgHolder->m_iSendClass,
+		pMsgHolder->m_dwBytestoMove);
+	if (NULL != pMsgHolder->m_pPools)
+	{
+		FreeMsg(pMsgHolder);
+		return;
+	}
+
+	LONG lSlot = (LONG)(pMsgHolder - pUser->m_aReplySlots);
+	InterlockedAnd(&pUser->m_lReplySlotsUsed, ~(1 << lSlot));
+}
+
+//NOTE: Frees every message of the batch in flight and empties it.
+VOID
+ReleaseSendBatch(PUSER pUser)
+{
+	PSENDBATCH pBatch = &pUser->m_SendBatch;
+	for (DWORD dwMsg = 0; dwMsg < pBatch->m_dwMsgs; dwMsg++)
+	{
+		ReleaseQueuedMsg(pUser, pBatch->m_apMsgs[dwMsg]);
+		pBatch->m_apMsgs[dwMsg] = NULL;
+	}
+	pBatch->m_dwMsgs = 0;
+	pBatch->m_dwBuffers = 0;
+}
+
+//NOTE: Takes the lane's oldest message, NULL if it has none. The caller holds
+// the backlog lock.
+static PMSGHOLDER
+PopSendLane(PSENDLANE pLane)
+{
+	PMSGHOLDER pMsgHolder = IntrusiveListPopFront(&pLane->m_Backlog);
+	if (NULL == pMsgHolder)
+	{
+		pMsgHolder = MpscQueuePop(&pLane->m_Queue);
+	}
+
+	return pMsgHolder;
+}
+
+//NOTE: Adds up to dwMaxMsgs of the lane's messages to the batch. Returns
+// FALSE once the batch is full in messages or bytes. A message that would
+// take the batch over SEND_BATCH_BYTES goes back to the front of its lane.
+static BOOL
+FillFromSendLane(PSENDBATCH pBatch, PSENDLANE pLane, DWORD dwMaxMsgs,
+	LONGLONG llNow, PSENDLANESTATS pDelays)
+{
+	for (DWORD dwTaken = 0; dwTaken < dwMaxMsgs; dwTaken++)
+	{
+		if (SEND_BATCH_MSGS == pBatch->m_dwMsgs)
+		{
+			return FALSE;
+		}
+
+		PMSGHOLDER pMsgHolder = PopSendLane(pLane);
+		if (NULL == pMsgHolder)
+		{
+			return TRUE;
+		}
+
+		if ((0 != pBatch->m_dwMsgs) && ((pBatch->m_dwBytestoMove +
+			pMsgHolder->m_dwBytestoMove) > SEND_BATCH_BYTES))
+		{
+			IntrusiveListPushFront(&pLane->m_Backlog, pMsgHolder);
+			return FALSE;
+		}
+
+		//NOTE: Empty bodies are left out, a batch of short messages would
+		// otherwise carry as many empty buffers as full ones.
+		for (DWORD dwBuffer = 0; dwBuffer < THREE_BUFFERS; dwBuffer++)
+		{
+			if (0 != pMsgHolder->m_wsaBuffer[dwBuffer].len)
+			{
+				pBatch->m_wsaBuffers[pBatch->m_dwBuffers++] =
+					pMsgHolder->m_wsaBuffer[dwBuffer];
+			}
+		}
+		pBatch->m_dwBytestoMove += pMsgHolder->m_dwBytestoMove;
+		pBatch->m_apMsgs[pBatch->m_dwMsgs++] = pMsgHolder;
+
+		LONGLONG llDelay = llNow - pMsgHolder->m_llQueuedAt;
+		pDelays->m_llMsgs++;
+		pDelays->m_llDelayTotal += llDelay;
+		if (llDelay > pDelays->m_llDelayMax)
+		{
+			pDelays->m_llDelayMax = llDelay;
+		}
+	}
+
+	return TRUE;
+}
+
+//NOTE: Adds a batch's delays to the server's totals, once per lane per batch
+// rather than once per message.
+static VOID
+AddLaneDelays(PUSERS pUsers, SENDLANESTATS aDelays[SEND_LANES])
+{
+	for (DWORD dwLane = 0; dwLane < SEND_LANES; dwLane++)
+	{
+		PSENDLANESTATS pStats = &pUsers->m_aLaneStats[dwLane];
+		if (0 == aDelays[dwLane].m_llMsgs)
+		{
+			continue;
+		}
+
+		InterlockedAdd64(&pStats->m_llMsgs, aDelays[dwLane].m_llMsgs);
+		InterlockedAdd64(&pStats->m_llDelayTotal,
+			aDelays[dwLane].m_llDelayTotal);
+
+		LONG64 llMax = ReadAcquire64(&pStats->m_llDelayMax);
+		while (aDelays[dwLane].m_llDelayMax > llMax)
+		{
+			LONG64 llSeen = InterlockedCompareExchange64(
+				&pStats->m_llDelayMax, aDelays[dwLane].m_llDelayMax, llMax);
+			if (llSeen == llMax)
+			{
+				break;
+			}
+			llMax = llSeen;
+		}
+	}
+}
+
+//NOTE: The consumer's pop, gathering messages from the user's lanes into its
+// send batch until it is full or the lanes run dry, see SEND_LANE_WEIGHTS.
+// Returns the number gathered.
+DWORD
+FillSendBatch(PUSER pUser)
+{
+	static const DWORD daWeights[SEND_LANES] = SEND_LANE_WEIGHTS;
+	SENDLANESTATS aDelays[SEND_LANES] = { 0 };
+	PSENDBATCH pBatch = &pUser->m_SendBatch;
+	pBatch->m_dwMsgs = 0;
+	pBatch->m_dwBuffers = 0;
+	pBatch->m_dwFirstBuffer = 0;
+	pBatch->m_dwBytestoMove = 0;
+	pBatch->m_dwBytesMovedTotal = 0;
+	pBatch->m_dwBytesMoved = 0;
+	pBatch->m_dwFlags = 0;
+
+	LARGE_INTEGER liNow;
+	QueryPerformanceCounter(&liNow);
+
+	AcquireSRWLockExclusive(&pUser->m_SendBacklogLock);
+	BOOL bRoom = TRUE;
+	for (DWORD dwLane = 0; (TRUE == bRoom) && (dwLane < SEND_LANES);
+		dwLane++)
+	{
+		bRoom = FillFromSendLane(pBatch, &pUser->m_aSendLanes[dwLane],
+			daWeights[dwLane], liNow.QuadPart, &aDelays[dwLane]);
+	}
+	for (DWORD dwLane = 0; (TRUE == bRoom) && (dwLane < SEND_LANES);
+		dwLane++)
+	{
+		bRoom = FillFromSendLane(pBatch, &pUser->m_aSendLanes[dwLane],
+			SEND_BATCH_MSGS, liNow.QuadPart, &aDelays[dwLane]);
+	}
+	ReleaseSRWLockExclusive(&pUser->m_SendBacklogLock);
+
+	AddLaneDelays(pUser->m_pUsers, aDelays);
+	return pBatch->m_dwMsgs;
+}
+
+//NOTE: TRUE if no lane has anything queued. Only a hint unless the caller
+// holds m_plSendOccuring.
+BOOL
+SendLanesEmpty(PUSER pUser)
+{
+	for (DWORD dwLane = 0; dwLane < SEND_LANES; dwLane++)
+	{
+		PSENDLANE pLane = &pUser->m_aSendLanes[dwLane];
+		if ((FALSE == MpscQueueIsEmpty(&pLane->m_Queue)) ||
+			(0 != pLane->m_Backlog.m_dwSize))
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+//NOTE: Frees the oldest broadcasts queued for the user until dwBytes more
+// would fit. The send in flight is never touched. Only the broadcast lane's
+// one consumer may pop its queue, so under the backlog lock this thread takes
+// that role and moves everything queued so far into the lane's backlog, where
+// any entry can be removed.
+static VOID
+DropOldestBroadcasts(PUSER pUser, DWORD dwBytes)
+{
+	PUSERS pUsers = pUser->m_pUsers;
+	PSENDLANE pLane = &pUser->m_aSendLanes[SEND_CLASS_BROADCAST];
+	PMSGHOLDER pMsgHolder = NULL;
+
+	AcquireSRWLockExclusive(&pUser->m_SendBacklogLock);
+	while (NULL != (pMsgHolder = MpscQueuePop(&pLane->m_Queue)))
+	{
+		IntrusiveListPushBack(&pLane->m_Backlog, pMsgHolder);
+	}
+
+	while ((NULL != (pMsgHolder = IntrusiveListFirst(&pLane->m_Backlog))) &&
+		(((DWORD)pUser->m_lQueuedMsgs >= pUsers->m_dwSendQueueMsgs) ||
+		(((DWORD)pUser->m_lQueuedBytes + dwBytes) >
+			pUsers->m_dwSendQueueBytes)))
+	{
+		IntrusiveListRemove(&pLane->m_Backlog, pMsgHolder);
+		ReleaseQueuedMsg(pUser, pMsgHolder);
+		InterlockedIncrement64(
+			&pUsers->m_SendQueueStats.m_llBroadcastsDropped);
+	}
+	ReleaseSRWLockExclusive(&pUser->m_SendBacklogLock);
+}
+
+//NOTE: Makes room for a message of dwBytes under the user's caps, running
+// the server's send policy if it doesn't fit. Returns S_OK once the room is
+// reserved, S_FALSE if the message is to be dropped and SEND_QUEUE_FULL if it
+// is to be turned back to its sender. CLIENT_REMOVE_ERR says the user is to
+// be disconnected, the message is dropped with it. A reply always takes its
+// room, past the caps if need be, unless the user has SEND_REPLY_MAX of them
+// unread.
+HRESULT
+SendQueueReserve(PUSER pUser, INT8 iSendClass, DWORD dwBytes)
+{
+	PUSERS pUsers = pUser->m_pUsers;
+
+	if (SEND_CLASS_REPLY == iSendClass)
+	{
+		if (SEND_REPLY_MAX < InterlockedIncrement(&pUser->m_lQueuedReplies))
+		{
+			InterlockedDecrement(&pUser->m_lQueuedReplies);
+			InterlockedIncrement64(&pUsers->m_SendQueueStats.m_llDisconnects);
+			return CLIENT_REMOVE_ERR;
+		}
+		InterlockedIncrement(&pUser->m_lQueuedMsgs);
+		InterlockedAdd(&pUser->m_lQueuedBytes, (LONG)dwBytes);
+		return S_OK;
+	}
+
+	if (TRUE == SendQueueFits(pUser, dwBytes))
+	{
+		return S_OK;
+	}
+
+	switch (pUsers->m_dwSendPolicy)
+	{
+	case SEND_POLICY_DROP_OLDEST:
+		DropOldestBroadcasts(pUser, dwBytes);
+		if (TRUE == SendQueueFits(pUser, dwBytes))
+		{
+			return S_OK;
+		}
+		break;
+
+	case SEND_POLICY_DISCONNECT:
+		//NOTE: Only the first overflow disconnects, the user's messages are
+		// dropped until it is gone.
+		if (0 == InterlockedCompareExchange(&pUser->m_lOverflowed, 1, 0))
+		{
+			InterlockedIncrement64(&pUsers->m_SendQueueStats.m_llDisconnects);
+			InterlockedIncrement64(&pUsers->m_SendQueueStats.m_llMsgsDropped);
+			return CLIENT_REMOVE_ERR;
+		}
+		break;
+
+	case SEND_POLICY_REJECT:
+		if (SEND_CLASS_DIRECT == iSendClass)
+		{
+			InterlockedIncrement64(
+				&pUsers->m_SendQueueStats.m_llDirectRejected);
+			return SEND_QUEUE_FULL;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	InterlockedIncrement64(&pUsers->m_SendQueueStats.m_llMsgsDropped);
+	return S_FALSE;
+}
+
+//End of file
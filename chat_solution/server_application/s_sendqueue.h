@@ -0,0 +1,58 @@
+/*****************************************************************//**
+ * \file   s_sendqueue.h
+ * \brief
+ *
+ * \author chris
+ * \date   October 2024
+ *********************************************************************/
+#pragma once
+#include "s_shared.h"
+
+VOID
+MsgPoolsInit(PMSGPOOLS pPools);
+
+VOID
+MsgPoolsDestroy(PMSGPOOLS pPools);
+
+VOID
+SendLanesInit(PUSER pUser);
+
+VOID
+SendLanesClear(PUSER pUser);
+
+PMSGBODY
+CreateMsgBody(PMSGPOOLS pPools, WORD wLenOne, WORD wLenTwo,
+	PWSTR pszDataOne, PWSTR pszDataTwo);
+
+VOID
+ReleaseMsgBody(PMSGPOOLS pPools, PMSGBODY pBody);
+
+VOID
+FreeMsg(PVOID pParam);
+
+PMSGHOLDER
+AddMsgToQueue(PUSER pUser, INT8 iSendClass, INT8 iType, INT8 iSubType,
+	INT8 iOpcode, WORD wLenOne, WORD wLenTwo, PMSGBODY pBody);
+
+PMSGHOLDER
+AddStaticMsgToQueue(PUSER pUser, DWORD dwPacket);
+
+HRESULT
+SendQueueReserve(PUSER pUser, INT8 iSendClass, DWORD dwBytes);
+
+VOID
+SendQueueUnreserve(PUSER pUser, INT8 iSendClass, DWORD dwBytes);
+
+DWORD
+FillSendBatch(PUSER pUser);
+
+BOOL
+SendLanesEmpty(PUSER pUser);
+
+VOID
+ReleaseQueuedMsg(PUSER pUser, PMSGHOLDER pMsgHolder);
+
+VOID
+ReleaseSendBatch(PUSER pUser);
+
+//End of file
@@ -7,17 +7,10 @@
  *********************************************************************/
 
 #include "s_shared.h"
-#include "Queue.h"
+#include "s_sendqueue.h"
 
 extern volatile BOOL g_bServerState;
 
-VOID
-FreeMsg(PVOID pParam)
-{
-	PMSGHOLDER pMsgHolder = (PMSGHOLDER)pParam;
-	ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pMsgHolder, sizeof(MSGHOLDER));
-}
-
 // NOTE: Mutexes are released on their own.
 VOID
 UserFreeFunction(PVOID pParam)
@@ -39,10 +32,26 @@ UserFreeFunction(PVOID pParam)
         DEBUG_PRINT("closesocket()");
 	}
 
-	if (SUCCESS != QueueDestroy(pTempUser->m_SendMsgQueue, FreeMsg))
-    {
-        DEBUG_PRINT("QueueDestroy()");
-    }
+	SendLanesClear(pTempUser);
 
     ZeroingHeapFree(GetProcessHeap(), NO_OPTION, &pTempUser, sizeof(USER));
 }
+
+//NOTE: Drops a reference to the user, freeing it with the last. The
+// connection holds one until it is removed, and every WSASend posted holds
+// one until its completion is handled. A user removed from the table can
+// still be sent to by a direct message that found it just before, its send
+// keeps the user alive until it completes.
+VOID
+UserRelease(PVOID pParam)
+{
+	if (NULL == pParam)
+	{
+		return;
+	}
+
+	if (0 == InterlockedDecrement(&((PUSER)pParam)->m_lRefs))
+	{
+		UserFreeFunction(pParam);
+	}
+}
@@ -13,10 +13,18 @@
 //		are made, they should be made to both. So we'll keep them in the client
 //		folder.
 #include "../hashtable/hashtable.h"
+#include "../hashtable/shardedhashtable.h"
+#include "../linkedlist/blockpool.h"
 #include "../linkedlist/linkedlist.h"
+#include "../linkedlist/mpscqueue.h"
 #include "../networking/networking.h"
 #include "Messages.h"
-#include "Queue.h"
+
+//NOTE: Connections that have not logged in yet are keyed by their socket.
+#define INTMAP_TYPE   SOCKETMAP
+#define INTMAP_PREFIX SocketMap
+#define INTMAP_KEY    SOCKET
+#include "../hashtable/intmap.h"
 
 #define BUFF_SIZE 1024
 
@@ -44,6 +52,7 @@
 #define CLIENT_SHUTDOWN 0x0002
 #define NON_FATAL_ERR_CODE 0x0003
 #define HEADER_SIZE_PACKET_CODE 0x0003
+#define SEND_QUEUE_FULL_CODE 0x0004
 
 //NOTE: defined according to msdn standards.
 #define CUSTOMER_DEFINED_BIT 0x20000000
@@ -59,16 +68,19 @@ NON_FATAL_ERR_CODE) |  CUSTOMER_DEFINED_BIT)
 //NOTE: Custom HRESULT success values.
 #define HEADER_SIZE_PACKET (MAKE_HRESULT(SEVERITY_SUCCESS, \
  FACILITY_SERVER, HEADER_SIZE_PACKET_CODE) |  CUSTOMER_DEFINED_BIT)
+//NOTE: A direct message was turned away by a full send queue, the sender is
+// told with REJECT_SRV_BUSY.
+#define SEND_QUEUE_FULL (MAKE_HRESULT(SEVERITY_SUCCESS, \
+ FACILITY_SERVER, SEND_QUEUE_FULL_CODE) |  CUSTOMER_DEFINED_BIT)
 
 //NOTE: macros defining which handle is which index in the array.
 //WARNING: Thread print functions lock and release STDOUT/STDERR custom
 //mutexes.
 #define NUM_HANDLES 3
-#define NUM_HANDLES_USER 4
+#define NUM_HANDLES_USER 3
 #define STD_OUT_MUTEX 0
 #define STD_ERR_MUTEX 1
-#define SEND_MUTEX 2 //NOTE: Will only be a part of USER struct
-#define SEND_DONE_EVENT 3 //NOTE: Will only be a part of USER struct
+#define SEND_DONE_EVENT 2 //NOTE: Will only be a part of USER struct
 #define IOCP_HANDLE 2 //NOTE: Will only be a part of SERVERCHATARGS struct
 
 typedef struct SERVERCHATARGS {
@@ -77,24 +89,126 @@ typedef struct SERVERCHATARGS {
 	PWSTR   m_pszBindPort;
 	DWORD   m_dwMaxClients;
 	DWORD   m_dwThreadCount;
+	DWORD   m_dwSendQueueMsgs;
+	DWORD   m_dwSendQueueBytes;
+	DWORD   m_dwSendPolicy;
 	HANDLE	m_haSharedHandles[NUM_HANDLES];
 	SOCKET  m_ListenSocket;
 	PHANDLE m_phThreads;
 } SERVERCHATARGS, * PSERVERCHATARGS;
 
-#define NUM_HANDLES_USERS 6
-#define USERS_WRITE_MUTEX 2
-#define USERS_READ_SEMAPHORE 3
-#define READERS_DONE_EVENT 4
-#define NEW_USERS_MUTEX 5
-
+#define NUM_HANDLES_USERS 3
+#define NEW_USERS_MUTEX 2
+
+//NOTE: How often the users tables are checked for room left over from a
+//busier time. Tables never shrink on a logout, only from this timer.
+#define MAINTENANCE_PERIOD_MS 10000
+
+//NOTE: What happens once a message would take a user's send queue over its
+// cap in messages or bytes. A client that stops reading would otherwise have
+// every broadcast queued for it until the server runs out of memory.
+#define SEND_POLICY_DROP_OLDEST 0 //Oldest queued broadcasts make room.
+#define SEND_POLICY_DISCONNECT 1 //The slow client is disconnected.
+#define SEND_POLICY_REJECT 2 //Direct messages go back to their sender.
+#define SEND_QUEUE_DEFAULT_MSGS 256
+#define SEND_QUEUE_DEFAULT_KB 1024
+#define SEND_QUEUE_MAX_MSGS 65535
+#define SEND_QUEUE_MAX_KB (1024 * 1024)
+
+//NOTE: Replies are never dropped, a client waits on each one. They count
+// towards the caps, so broadcasts make room for them, but are only bounded
+// by SEND_REPLY_MAX. Each request gets one reply, a client with that many
+// unread is sending requests without reading and is disconnected.
+#define SEND_REPLY_MAX 256
+
+//NOTE: A message's send class says which messages a full send queue may drop
+// or turn away, and which of the user's send lanes it waits in. The lanes
+// are drained in class order, control replies first, so a client waiting on
+// an ACK isn't held up behind a backlog of broadcasts. Each batch first takes
+// up to its lane's weight from every lane in turn, then fills up in class
+// order, so under load the lower lanes still get their share of each send.
+#define SEND_CLASS_REPLY 0 //Replies to the user's own requests.
+#define SEND_CLASS_DIRECT 1 //Direct messages from another user.
+#define SEND_CLASS_BROADCAST 2
+#define SEND_LANES 3
+#define SEND_LANE_WEIGHTS { 8, 4, 4 } //Messages per batch, SEND_BATCH_MSGS.
+
+//NOTE: Time messages spent queued in each lane, across all users, counted
+// in QueryPerformanceCounter ticks. With SEND_STATS defined the maintenance
+// timer prints them and resets the maximum.
+typedef struct SENDLANESTATS {
+	LONG64 volatile m_llMsgs;
+	LONG64 volatile m_llDelayTotal;
+	LONG64 volatile m_llDelayMax;
+} SENDLANESTATS, * PSENDLANESTATS;
+
+//NOTE: Totals across all users, always counted and, with SEND_STATS
+// defined, printed by the maintenance timer when they change. Under every
+// policy a message that still doesn't fit is dropped.
+typedef struct SENDQUEUESTATS {
+	LONG64 volatile m_llBroadcastsDropped; //Oldest, to make room.
+	LONG64 volatile m_llMsgsDropped; //New messages that didn't fit.
+	LONG64 volatile m_llDisconnects;
+	LONG64 volatile m_llDirectRejected; //Returned as REJECT_SRV_BUSY.
+	LONG64 volatile m_llSendCalls; //WSASends issued, see SENDBATCH.
+	LONG64 volatile m_llMsgsSent; //Messages those sends completed.
+} SENDQUEUESTATS, * PSENDQUEUESTATS;
+
+//NOTE: A message body holds both strings, already in network byte order,
+// each with its terminator. It is never written once built, so every queued
+// message with the same text references one body, and the last reference
+// released returns it. A broadcast encodes its text once for all recipients.
+typedef struct MSGBODY {
+	LONG volatile m_lRefs;
+	DWORD         m_dwBytes; //Used of the block, zeroed when it's returned.
+	INT8          m_iClass; //Of MSG_BODY_CLASS_BYTES.
+	WCHAR         m_caText[ANYSIZE_ARRAY];
+} MSGBODY, * PMSGBODY;
+
+//NOTE: Queued messages are a small record plus, unless the packet is only a
+// header, a reference to one body. Bodies come from the smallest size class
+// they fit, most chat fits the first two.
+#define MSG_BODY_CLASSES 4
+#define MSG_BODY_MAX_BYTES \
+	(FIELD_OFFSET(MSGBODY, m_caText) + ((BUFF_SIZE + 1) * 2 * sizeof(WCHAR)))
+#define MSG_BODY_CLASS_BYTES { 64, 256, 2048, MSG_BODY_MAX_BYTES }
+#define MSG_POOL_MAX_FREE 1024 //Blocks each pool keeps for reuse.
+typedef struct MSGPOOLS {
+	BLOCKPOOL m_Records; //MSGHOLDERs.
+	BLOCKPOOL m_aBodies[MSG_BODY_CLASSES];
+} MSGPOOLS, * PMSGPOOLS;
+
+//NOTE: Replies that are only a header and never change, the ACKs and the
+// rejects, are sent straight from a read-only table of wire packets. Rejects
+// are indexed by their REJECT_* code.
+#define STATIC_PACKET_REJECT(iReject) (iReject)
+#define STATIC_PACKET_LOGIN_ACK 8
+#define STATIC_PACKET_LOGOUT_ACK 9
+#define STATIC_PACKET_CHAT_ACK 10
+#define STATIC_PACKET_BROADCAST_ACK 11
+#define STATIC_PACKETS 12
+
+//NOTE: Each user keeps a few records to queue static packets in, so one
+// usually takes no allocation at all. Past that they take a pooled record.
+#define REPLY_SLOTS 4
+
+//NOTE: m_pUsersHTable locks per shard, see shardedhashtable.h.
 typedef struct USERS {
 
-	PHASHTABLE    m_pNewUsersTable;
-	PHASHTABLE    m_pUsersHTable;
-	HANDLE	      m_haUsersHandles[NUM_HANDLES_USERS];
-	LONG volatile m_plReaderCount;
-	DWORD	      m_dwMaxClients; //We'll differentiate users and
+	PSOCKETMAP        m_pNewUsersTable;
+	PSHARDEDHASHTABLE m_pUsersHTable;
+	HANDLE	          m_haUsersHandles[NUM_HANDLES_USERS];
+	PTP_TIMER         m_pMaintenanceTimer;
+	DWORD             m_dwSendQueueMsgs; //Per user caps, see SEND_POLICY_*.
+	DWORD             m_dwSendQueueBytes;
+	DWORD             m_dwSendPolicy;
+	SENDQUEUESTATS    m_SendQueueStats;
+	SENDQUEUESTATS    m_PrintedStats; //As last printed by the timer.
+	SENDLANESTATS     m_aLaneStats[SEND_LANES];
+	SENDLANESTATS     m_aPrintedLaneStats[SEND_LANES];
+	MSGPOOLS          m_MsgPools;
+	LONG volatile     m_lLoginSlots; //Taken against m_dwMaxClients.
+	DWORD	          m_dwMaxClients; //We'll differentiate users and
 							   //clients later, for now it's both.
 	//TODO: We'll potentially add the sessionID table later.
 	/*PHASHTABLE m_pSessionsTable;
@@ -200,6 +314,10 @@ typedef enum
     do                                                                         \
     {                                                                          \
     } while (0)
+#define DEBUG_ERROR_SUPPLIED(error_code, fmt, ...)                             \
+    do                                                                         \
+    {                                                                          \
+    } while (0)
 #define DEBUG_WSAERROR(fmt, ...)                                               \
     do                                                                         \
     {                                                                          \
@@ -240,19 +358,55 @@ static inline VOID ZeroingHeapFree(HANDLE hHeap,
 //NOTE: The Msg Holder struct contains state information about packets
 // received by the server. Enables the server to handle partial receives and
 // partial sends during asychronous operations.
+//NOTE: Sends are queued on their user through m_SendLink, queueing one never
+// allocates more than the holder itself or waits on a lock.
+//NOTE: m_iSendClass is one of SEND_CLASS_*.
 typedef struct MSGHOLDER {
 	OVERLAPPED m_wsaOverlapped;
+	LISTLINK   m_SendLink;
 	WSABUF     m_wsaBuffer[THREE_BUFFERS];
 	CHATMSG	   m_Header;
-	WCHAR	   m_pBodyBufferOne[BUFF_SIZE + 1];
-	WCHAR	   m_pBodyBufferTwo[BUFF_SIZE + 1];
+	PWCHAR     m_pBodyBufferOne; //Into m_pBody, see MSGBODY.
+	PWCHAR     m_pBodyBufferTwo;
+	PMSGPOOLS  m_pPools; //NULL for m_RecvMsg and m_aReplySlots, see USER.
+	PMSGBODY   m_pBody; //NULL for a header-only packet, holds a reference.
 	DWORD      m_dwBytestoMove;
 	DWORD	   m_dwBytesMovedTotal;
 	DWORD	   m_dwBytesMoved;
 	DWORD	   m_dwFlags;
+	LONGLONG   m_llQueuedAt; //QueryPerformanceCounter, for SENDLANESTATS.
 	INT8	   m_iOperationType;
+	INT8	   m_iSendClass;
 } MSGHOLDER, *PMSGHOLDER;
 
+//NOTE: Producers push onto m_Queue without waiting. m_Backlog holds messages
+// the consumer popped but put back, or a producer moved off m_Queue to trim,
+// which are older than anything on m_Queue and so go first.
+typedef struct SENDLANE {
+	MPSCQUEUE      m_Queue; //MSGHOLDERs linked through m_SendLink.
+	INTRUSIVELIST  m_Backlog;
+} SENDLANE, *PSENDLANE;
+
+//NOTE: A user's queued messages are gathered into one vectored WSASend, up to
+// SEND_BATCH_MSGS messages or SEND_BATCH_BYTES, so a broadcast storm costs a
+// syscall and a completion per batch rather than per message. The batch's
+// buffers are copies of its messages' and run across message boundaries, a
+// partial send only moves m_dwFirstBuffer along them. The send goes out on the
+// first message's OVERLAPPED, so the worker still sees a SEND_OP.
+#define SEND_BATCH_MSGS 16
+#define SEND_BATCH_BYTES (64 * 1024)
+typedef struct SENDBATCH {
+	PMSGHOLDER m_apMsgs[SEND_BATCH_MSGS];
+	WSABUF     m_wsaBuffers[SEND_BATCH_MSGS * THREE_BUFFERS];
+	DWORD      m_dwMsgs;
+	DWORD      m_dwBuffers;
+	DWORD      m_dwFirstBuffer; //First buffer not yet sent in full.
+	DWORD      m_dwBytestoMove;
+	DWORD	   m_dwBytesMovedTotal;
+	DWORD	   m_dwBytesMoved;
+	DWORD	   m_dwFlags;
+} SENDBATCH, *PSENDBATCH;
+
 //NOTE: The USER struct will be the IO Completion Key for waiting threads.
 //NOTE: Doesn't not include hIOCP bc it will be the worker thread's only arg.
 //NOTE: Stucture values all initialized to zero.
@@ -262,12 +416,22 @@ typedef struct USER {
 	SOCKET	       m_ClientSocket;
 	HANDLE         m_haSharedHandles[NUM_HANDLES_USER];
 	WORD	       m_wNegotiatedState;
-	LONG volatile  m_plSendOccuring;
+	LONG volatile  m_plSendOccuring; //Held by the thread draining the lanes.
 	LONG volatile  m_plRecvOccuring;
-	LONG volatile  m_plThreadsWaiting;
 	LONG volatile  m_plBeingDestroyed;
+	LONG volatile  m_lRefs; //The connection's, plus one per WSASend posted.
 	MSGHOLDER      m_RecvMsg;
-	PQUEUE		   m_SendMsgQueue;
+	WCHAR          m_caRecvBodyOne[BUFF_SIZE + 1]; //m_RecvMsg's bodies.
+	WCHAR          m_caRecvBodyTwo[BUFF_SIZE + 1];
+	SENDLANE       m_aSendLanes[SEND_LANES]; //Indexed by SEND_CLASS_*.
+	SENDBATCH      m_SendBatch; //Popped and in flight, see SendQueuedMsg.
+	LONG volatile  m_lQueuedMsgs; //Queued or in flight, against the caps.
+	LONG volatile  m_lQueuedBytes;
+	LONG volatile  m_lOverflowed; //Set once a disconnect was started.
+	LONG volatile  m_lQueuedReplies; //Against SEND_REPLY_MAX.
+	SRWLOCK        m_SendBacklogLock; //Held to pop the lanes.
+	MSGHOLDER      m_aReplySlots[REPLY_SLOTS]; //See STATIC_PACKETS.
+	LONG volatile  m_lReplySlotsUsed; //Bit per slot.
 	PUSERS	       m_pUsers;
 } USER, * PUSER;
 
@@ -294,9 +458,9 @@ typedef struct USER {
 #define MIN_THREADS 8
 
 VOID
-FreeMsg(PVOID pParam);
+UserFreeFunction(PVOID pParam);
 
 VOID
-UserFreeFunction(PVOID pParam);
+UserRelease(PVOID pParam);
 
 //End of file
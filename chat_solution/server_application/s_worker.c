@@ -47,45 +47,6 @@ CustomConsoleWrite(PWCHAR pszCustomOutput, DWORD dwCustomLen)
     return S_OK;
 }
 
-//NOTE: Calling function will need to release users mutex.
-//NOTE: on success, S_OK returned. on failure, SRV_SHUTDOWN_ERR returned -
-//if the mutex cannot be locked with an infinite time limit, a fatal error
-//has occured.
-static HRESULT
-UsersTableWriter(PUSER pUser)
-{
-	HANDLE pUserWriteMutex =
-		pUser->m_pUsers->m_haUsersHandles[USERS_WRITE_MUTEX];
-
-	//NOTE: Use same logic cycle as register to access users hash table.
-	DWORD dwWaitResult = CustomWaitForSingleObject(pUserWriteMutex, INFINITE);
-
-	if (WAIT_OBJECT_0 != dwWaitResult)
-	{
-		DEBUG_ERROR("CustomWaitForSingleObject failed");
-		return SRV_SHUTDOWN_ERR;
-	}
-
-	//NOTE: This comparison means that at least one reader is currently using
-	// the semaphore.
-	if (0 != pUser->m_pUsers->m_plReaderCount)
-	{
-		//NOTE: Waiting for a reader to signal that no more readers are using
-		// the semaphore.
-		dwWaitResult = CustomWaitForSingleObject(
-			pUser->m_pUsers->m_haUsersHandles[READERS_DONE_EVENT], INFINITE);
-
-		if (WAIT_OBJECT_0 != dwWaitResult)
-		{
-			ReleaseMutex(pUserWriteMutex);
-			DEBUG_ERROR("CustomWaitForSingleObject failed");
-			return SRV_SHUTDOWN_ERR;
-		}
-	}
-
-	return S_OK;
-}
-
 //NOTE: Called when
 static HRESULT
 WorkerWSARecv(PUSER pUser)
@@ -176,61 +137,36 @@ WorkerPartialRecv(PUSER pUser)
 	return WorkerWSARecv(pUser);
 }
 
-//WARNING: Assumes packet header length = 7 and contains correct lengths of
-// wide char strings one and two.
+//NOTE: Skips the buffers the last send finished and trims the one it stopped
+// in. The batch's buffers run across message boundaries, so a send may stop in
+// any of its messages.
 static HRESULT
-WorkerPartialSend(PMSGHOLDER pMsgHolder, SOCKET ClientSocket)
+WorkerPartialSend(PUSER pUser, DWORD dwBytesTransferred)
 {
-	//NOTE: WorkerThread() established that BytesSent < BytestoSend.
-	CHATMSG pChatMsg = pMsgHolder->m_Header;
-	WORD wLenOne = ntohs(pChatMsg.wLenOne);
-	WORD wLenTwo = ntohs(pChatMsg.wLenTwo);
-	WORD wBytesOne = wLenOne * sizeof(WCHAR);
-	WORD wBytesTwo = wLenTwo * sizeof(WCHAR);
-
-	if (pMsgHolder->m_dwBytesMovedTotal < HEADER_LEN)
-	{
-		pMsgHolder->m_wsaBuffer[HEADER_INDEX].buf =
-			(PCHAR)&(pMsgHolder->m_Header) + pMsgHolder->m_dwBytesMovedTotal;
-		pMsgHolder->m_wsaBuffer[HEADER_INDEX].len = HEADER_LEN -
-			pMsgHolder->m_dwBytesMovedTotal;
-	}
-	else if (pMsgHolder->m_dwBytesMovedTotal < ((DWORD)HEADER_LEN + wBytesOne))
+	//NOTE: WorkerSendOP() established that BytesSent < BytestoSend.
+	PSENDBATCH pBatch = &pUser->m_SendBatch;
+	while (pBatch->m_dwFirstBuffer < pBatch->m_dwBuffers)
 	{
-		DWORD dwDataOneBytesSent = pMsgHolder->m_dwBytesMovedTotal -
-			HEADER_LEN;
-		pMsgHolder->m_wsaBuffer[HEADER_INDEX].len = 0;
-		pMsgHolder->m_wsaBuffer[BODY_INDEX_1].buf =
-			(PCHAR)pMsgHolder->m_pBodyBufferOne + dwDataOneBytesSent;
-		pMsgHolder->m_wsaBuffer[BODY_INDEX_1].len = wLenOne -
-			dwDataOneBytesSent;
-	}
-	else
-	{
-		DWORD dwDataTwoBytesSent = pMsgHolder->m_dwBytesMovedTotal -
-			(wBytesOne + HEADER_LEN);
-		pMsgHolder->m_wsaBuffer[HEADER_INDEX].len = 0;
-		pMsgHolder->m_wsaBuffer[BODY_INDEX_1].len = 0;
-		pMsgHolder->m_wsaBuffer[BODY_INDEX_2].buf =
-			(PCHAR)pMsgHolder->m_pBodyBufferTwo + dwDataTwoBytesSent;
-		pMsgHolder->m_wsaBuffer[BODY_INDEX_2].len = wBytesTwo -
-			dwDataTwoBytesSent;
-	}
+		LPWSABUF pBuffer = &pBatch->m_wsaBuffers[pBatch->m_dwFirstBuffer];
+		if (dwBytesTransferred < pBuffer->len)
+		{
+			pBuffer->buf += dwBytesTransferred;
+			pBuffer->len -= dwBytesTransferred;
+			break;
+		}
 
-	INT iResult = WSASend(ClientSocket, pMsgHolder->m_wsaBuffer,
-		THREE_BUFFERS, &pMsgHolder->m_dwBytesMoved, pMsgHolder->m_dwFlags,
-		&pMsgHolder->m_wsaOverlapped, NULL);
+		dwBytesTransferred -= pBuffer->len;
+		pBatch->m_dwFirstBuffer++;
+	}
 
-	if (SOCKET_ERROR == iResult)
+	HRESULT hResult = SendBatch(pUser);
+	if (S_OK != hResult)
 	{
-		iResult = WSAGetLastError();
-		if (WSA_IO_PENDING != iResult)
-		{
-            DEBUG_WSAERROR("WSASend failed");
-            SetEvent(g_hShutdownEvent);
-			g_bServerState = STOP;
-			return CLIENT_REMOVE_ERR;
-		}
+		DEBUG_PRINT("SendBatch failed");
+		AbortQueuedSend(pUser);
+		SetEvent(g_hShutdownEvent);
+		g_bServerState = STOP;
+		return hResult;
 	}
 
 	return S_OK;
@@ -239,31 +175,35 @@ WorkerPartialSend(PMSGHOLDER pMsgHolder, SOCKET ClientSocket)
 static HRESULT
 CheckforUser(PUSER pUser, PCHATMSG pChatMsg)
 {
-	//NOTE: The server has reached max capacity.
-	if (pUser->m_pUsers->m_pUsersHTable->m_wSize >=
-		pUser->m_pUsers->m_dwMaxClients)
+	//NOTE: The server has reached max capacity. Logins on different shards
+	// don't lock each other out, so each takes a slot before it inserts and
+	// gives it back if it doesn't get in. The slot is given back on logout.
+	PUSERS pUsers = pUser->m_pUsers;
+	if ((LONG)pUsers->m_dwMaxClients <
+		InterlockedIncrement(&pUsers->m_lLoginSlots))
 	{
-		ReleaseMutex(pUser->m_pUsers->m_haUsersHandles[USERS_WRITE_MUTEX]);
-		return ManageMsgQueueAdd(pUser, TYPE_FAILURE, STYPE_EMPTY,
-			REJECT_SRV_FULL, 0, 0, NULL, NULL);
+		InterlockedDecrement(&pUsers->m_lLoginSlots);
+		return ManageStaticMsgQueueAdd(pUser,
+			STATIC_PACKET_REJECT(REJECT_SRV_FULL));
 	}
 
-    WORD wResult = HashTableNewEntry(pUser->m_pUsers->m_pUsersHTable, pUser,
-                                     (PCHAR)pChatMsg->pszDataOne,
-                                     (pChatMsg->wLenOne) * sizeof(WCHAR));
-	ReleaseMutex(pUser->m_pUsers->m_haUsersHandles[USERS_WRITE_MUTEX]);
+    WORD wResult = ShardedHashTableNewEntry(
+        pUsers->m_pUsersHTable, pUser, (PCHAR)pChatMsg->pszDataOne,
+        (pChatMsg->wLenOne) * sizeof(WCHAR));
 
-	if (SUCCESS != wResult)
+	if (DUPLICATE_KEY == wResult)
 	{
-		DEBUG_ERROR("HashTableNewEntry failed");
-		return SRV_SHUTDOWN_ERR;
+		//NOTE: User is already present.
+		InterlockedDecrement(&pUsers->m_lLoginSlots);
+		return ManageStaticMsgQueueAdd(pUser,
+			STATIC_PACKET_REJECT(REJECT_USER_LOGGED));
 	}
 
-	if (DUPLICATE_KEY == wResult)
+	if (SUCCESS != wResult)
 	{
-		//NOTE: User is already present.
-		return ManageMsgQueueAdd(pUser, TYPE_FAILURE, STYPE_EMPTY,
-			REJECT_USER_LOGGED, 0, 0, NULL, NULL);
+		DEBUG_ERROR("HashTableNewEntry failed");
+		InterlockedDecrement(&pUsers->m_lLoginSlots);
+		return SRV_SHUTDOWN_ERR;
 	}
 
 	pUser->m_wNegotiatedState = NEGOTIATED;
@@ -280,176 +220,144 @@ CheckforUser(PUSER pUser, PCHATMSG pChatMsg)
 		return SRV_SHUTDOWN_ERR;
 	}
 
-	HashTableDestroyEntry(pUser->m_pUsers->m_pNewUsersTable,
-		(PCHAR)&(pUser->m_ClientSocket), (sizeof(SOCKET) / sizeof(WCHAR)));
+	SocketMapRemove(pUser->m_pUsers->m_pNewUsersTable,
+		pUser->m_ClientSocket);
 	ReleaseMutex(pUser->m_pUsers->m_haUsersHandles[NEW_USERS_MUTEX]);
 
 	//Successful login.
-	return ManageMsgQueueAdd(pUser, TYPE_ACCOUNT, STYPE_LOGIN,
-		OPCODE_ACK, 0, 0, NULL, NULL);
+	return ManageStaticMsgQueueAdd(pUser, STATIC_PACKET_LOGIN_ACK);
 }
 
+//NOTE: Message sent to every user in the users table by a table walk.
+// pBody is encoded once before the walk, each recipient's queued message
+// only takes a reference to it.
+typedef struct BROADCAST {
+	PUSER    pSkipUser; //NULL to send to every user.
+	WORD     wUserLen;
+	PWCHAR   pszUsername;
+	WORD     wMsgLen;
+	PWCHAR   pszMsg;
+	PMSGBODY pBody;
+	HRESULT  hResult;
+} BROADCAST, * PBROADCAST;
+
+//NOTE: State for building the user list during a table walk.
+typedef struct USERLIST {
+	PWCHAR  pUserListTracker;
+	rsize_t rsLengthLeft;
+	PSIZE_T pUsersLen;
+	BOOL    bFailed;
+} USERLIST, * PUSERLIST;
+
 static HRESULT
-LoginBroadcast(PUSER pSendingUser, WORD wMsgLen, PWCHAR pszMsg)
+BroadcastSend(PUSER pUser, PBROADCAST pBroadcast)
 {
-	PHASHTABLE pUsersTable = pSendingUser->m_pUsers->m_pUsersHTable;
-	for (WORD wCounter = 0; wCounter < pUsersTable->m_wCapacity;
-		wCounter++)
-	{
-		PLINKEDLIST pLinkedList = pUsersTable->m_ppTable[wCounter];
-
-		if (NULL != pLinkedList)
-		{
-			PLINKEDLISTNODE pTempNode = pLinkedList->m_pTail;
-
-			for (WORD wCounter2 = 0; wCounter2 < pLinkedList->m_wSize;
-				wCounter2++)
-			{
-				pTempNode = pTempNode->m_pNext;
-				PHASHTABLEENTRY pTempEntry =
-					(PHASHTABLEENTRY)pTempNode->m_pData;
-				PUSER pUser = (PUSER)pTempEntry->m_pData;
-				if (pUser != pSendingUser)
-				{
-					HRESULT hResult = ManageMsgQueueAdd(pUser, TYPE_CHAT,
-						STYPE_EMPTY, OPCODE_RES,
-						pSendingUser->m_wUsernameLen, wMsgLen,
-						pSendingUser->m_caUsername, pszMsg);
-
-					if (S_OK != hResult)
-					{
-						//NOTE: Error information will be printed, but the other
-						// client's IOCP packet can handle the failure.
-						DEBUG_ERROR("ManageMsgQueueAdd failed");
-						return hResult;
-					}
-				}
-			}
-		}
-	}
-
-	return S_OK;
+	return ManageBodyMsgQueueAdd(pUser, SEND_CLASS_BROADCAST, TYPE_CHAT,
+		STYPE_EMPTY, OPCODE_RES, pBroadcast->wUserLen, pBroadcast->wMsgLen,
+		pBroadcast->pBody);
 }
 
-//NOTE: See README for logic explanation.
+//NOTE: Builds the broadcast's body, walks the users table with pfnVisit and
+// drops the walk's reference. Queued messages keep the body until sent.
 static HRESULT
-HandleClientRegistration(PUSER pUser, PCHATMSG pChatMsg)
+WalkBroadcast(PUSERS pUsers, PBROADCAST pBroadcast,
+	BOOL (*pfnVisit)(PVOID pData, PVOID pContext))
 {
-	if ((TYPE_ACCOUNT != pChatMsg->iType) ||
-		(STYPE_LOGIN != pChatMsg->iSubType) ||
-		(OPCODE_REQ != pChatMsg->iOpcode))
+	PMSGPOOLS pPools = &pUsers->m_MsgPools;
+	pBroadcast->pBody = CreateMsgBody(pPools, pBroadcast->wUserLen,
+		pBroadcast->wMsgLen, pBroadcast->pszUsername, pBroadcast->pszMsg);
+	if (NULL == pBroadcast->pBody)
 	{
-		//NOTE: Invalid packet.
-		return ManageMsgQueueAdd(pUser, TYPE_FAILURE, STYPE_EMPTY,
-			REJECT_INVALID_PACKET, 0, 0, NULL, NULL);
+		DEBUG_PRINT("CreateMsgBody()");
+		return SRV_SHUTDOWN_ERR;
 	}
 
-	if (pChatMsg->wLenOne > MAX_UNAME_LEN)
-	{
-		//NOTE: username too long.
-		return ManageMsgQueueAdd(pUser, TYPE_FAILURE, STYPE_EMPTY,
-			REJECT_UNAME_LEN, 0, 0, NULL, NULL);
-	}
+	ShardedHashTableForEach(pUsers->m_pUsersHTable, pfnVisit, pBroadcast);
+	ReleaseMsgBody(pPools, pBroadcast->pBody);
+	return pBroadcast->hResult;
+}
 
-	//NOTE: Handles writer mutex lock logic.
-	HRESULT hResult = UsersTableWriter(pUser);
-	if (S_OK != hResult)
+static BOOL
+LoginBroadcastVisit(PVOID pData, PVOID pContext)
+{
+	PUSER      pUser      = (PUSER)pData;
+	PBROADCAST pBroadcast = (PBROADCAST)pContext;
+
+	if (pUser == pBroadcast->pSkipUser)
 	{
-		DEBUG_ERROR("UsersTableWriter failed");
-		return hResult;
+		return TRUE;
 	}
 
-	//NOTE: Write mutex released inside of CheckforUser fn. This ensures mutex
-	// unlock prior to message send.
-	hResult = CheckforUser(pUser, pChatMsg);
-	if (S_OK != hResult)
+	pBroadcast->hResult = BroadcastSend(pUser, pBroadcast);
+	if (S_OK != pBroadcast->hResult)
 	{
-		DEBUG_ERROR("CheckforUser failed");
-		return hResult;
+		//NOTE: Error information will be printed, but the other
+		// client's IOCP packet can handle the failure.
+		DEBUG_ERROR("ManageMsgQueueAdd failed");
+		return FALSE;
 	}
 
-	//NOTE: Broadcasting that the user has logged in.
-	return LoginBroadcast(pUser, 19, L"User has logged in.");
+	return TRUE;
 }
 
 static HRESULT
-SendOtherClientMessage(PUSER pUser, PUSER pTargetUser, PCHATMSG pChatMsg)
+LoginBroadcast(PUSER pSendingUser, WORD wMsgLen, PWCHAR pszMsg)
 {
-	HRESULT hResult = ManageMsgQueueAdd(pTargetUser, TYPE_CHAT, STYPE_EMPTY,
-		OPCODE_RES, pUser->m_wUsernameLen, pChatMsg->wLenTwo,
-		pUser->m_caUsername, pChatMsg->pszDataTwo);
+	BROADCAST Broadcast = { pSendingUser, pSendingUser->m_wUsernameLen,
+		pSendingUser->m_caUsername, wMsgLen, pszMsg, NULL, S_OK };
 
-	if (S_OK != hResult)
-	{
-		DEBUG_ERROR("CustomWaitForSingleObject failed");
-		return hResult;
-	}
-
-	return ManageMsgQueueAdd(pUser, TYPE_CHAT, STYPE_EMPTY,
-		OPCODE_ACK, 0, 0, NULL, NULL);
+	return WalkBroadcast(pSendingUser->m_pUsers, &Broadcast,
+		LoginBroadcastVisit);
 }
 
+//NOTE: See README for logic explanation.
 static HRESULT
-UsersTableReaderStart(PUSERS pUsers)
+HandleClientRegistration(PUSER pUser, PCHATMSG pChatMsg)
 {
-	DWORD dwWaitResult = CustomWaitForSingleObject(
-		pUsers->m_haUsersHandles[USERS_WRITE_MUTEX], INFINITE);
-
-	if (WAIT_OBJECT_0 != dwWaitResult)
+	if ((TYPE_ACCOUNT != pChatMsg->iType) ||
+		(STYPE_LOGIN != pChatMsg->iSubType) ||
+		(OPCODE_REQ != pChatMsg->iOpcode))
 	{
-		DEBUG_ERROR("CustomWaitForSingleObject failed");
-		return SRV_SHUTDOWN_ERR;
+		//NOTE: Invalid packet.
+		return ManageStaticMsgQueueAdd(pUser,
+			STATIC_PACKET_REJECT(REJECT_INVALID_PACKET));
 	}
 
-	dwWaitResult = CustomWaitForSingleObject(
-		pUsers->m_haUsersHandles[USERS_READ_SEMAPHORE], INFINITE);
-
-	if (WAIT_OBJECT_0 != dwWaitResult)
+	if (pChatMsg->wLenOne > MAX_UNAME_LEN)
 	{
-		ReleaseMutex(pUsers->m_haUsersHandles[USERS_WRITE_MUTEX]);
-		DEBUG_ERROR("CustomWaitForSingleObject failed");
-		return SRV_SHUTDOWN_ERR;
+		//NOTE: username too long.
+		return ManageStaticMsgQueueAdd(pUser,
+			STATIC_PACKET_REJECT(REJECT_UNAME_LEN));
 	}
 
-	InterlockedIncrement(&pUsers->m_plReaderCount);
-
-	if (FALSE == ResetEvent(
-		pUsers->m_haUsersHandles[READERS_DONE_EVENT]))
+	HRESULT hResult = CheckforUser(pUser, pChatMsg);
+	if (S_OK != hResult)
 	{
-		ReleaseMutex(pUsers->m_haUsersHandles[USERS_WRITE_MUTEX]);
-		ReleaseSemaphore(
-			pUsers->m_haUsersHandles[USERS_READ_SEMAPHORE], 1, NULL);
-		DEBUG_ERROR("ResetEvent failed");
-		return SRV_SHUTDOWN_ERR;
+		DEBUG_ERROR("CheckforUser failed");
+		return hResult;
 	}
 
-	ReleaseMutex(pUsers->m_haUsersHandles[USERS_WRITE_MUTEX]);
-
-	return S_OK;
+	//NOTE: Broadcasting that the user has logged in.
+	return LoginBroadcast(pUser, 19, L"User has logged in.");
 }
 
-static HRESULT
-UsersTableReaderFinish(PUSERS pUsers)
+//NOTE: Direct message handed to the target user during the table visit.
+typedef struct DIRECTMSG {
+	PUSER    pUser;
+	PCHATMSG pChatMsg;
+	HRESULT  hResult;
+} DIRECTMSG, * PDIRECTMSG;
+
+static VOID
+SendOtherClientVisit(PVOID pData, PVOID pContext)
 {
-	//NOTE: If this reader is the last, decrement and send the signal.
-	ReleaseSemaphore(
-		pUsers->m_haUsersHandles[USERS_READ_SEMAPHORE], 1, NULL);
-	if (1 >= InterlockedCompareExchange(&pUsers->m_plReaderCount,
-		0, 1))
-	{
-		if (FALSE == SetEvent(
-			pUsers->m_haUsersHandles[READERS_DONE_EVENT]))
-		{
-			DEBUG_ERROR("SetEvent failed");
-			return SRV_SHUTDOWN_ERR;
-		}
-	}
-	else
-	{
-		InterlockedDecrement(&pUsers->m_plReaderCount);
-	}
+	PUSER      pTargetUser = (PUSER)pData;
+	PDIRECTMSG pDirectMsg  = (PDIRECTMSG)pContext;
 
-	return S_OK;
+	pDirectMsg->hResult = ManageClassMsgQueueAdd(pTargetUser,
+		SEND_CLASS_DIRECT, TYPE_CHAT, STYPE_EMPTY, OPCODE_RES,
+		pDirectMsg->pUser->m_wUsernameLen, pDirectMsg->pChatMsg->wLenTwo,
+		pDirectMsg->pUser->m_caUsername, pDirectMsg->pChatMsg->pszDataTwo);
 }
 
 //TODO: Move this fn and helper to s_message.c
@@ -463,70 +371,69 @@ HandleClientMessage(PUSER pUser, PCHATMSG pChatMsg)
 		(OPCODE_REQ != pChatMsg->iOpcode))
 	{
 		//NOTE: Invalid packet.
-		return ManageMsgQueueAdd(pUser, TYPE_FAILURE, STYPE_EMPTY,
-			REJECT_INVALID_PACKET, 0, 0, NULL, NULL);
+		return ManageStaticMsgQueueAdd(pUser,
+			STATIC_PACKET_REJECT(REJECT_INVALID_PACKET));
 	}
 
 	if (pChatMsg->wLenOne > MAX_UNAME_LEN)
 	{
 		//NOTE: username too long.
-		return ManageMsgQueueAdd(pUser, TYPE_FAILURE, STYPE_EMPTY,
-			REJECT_UNAME_LEN, 0, 0, NULL, NULL);
+		return ManageStaticMsgQueueAdd(pUser,
+			STATIC_PACKET_REJECT(REJECT_UNAME_LEN));
 	}
 
 	if (pChatMsg->wLenTwo > MAX_MSG_LEN_CHAT)
 	{
 		//NOTE: message too long.
-		return ManageMsgQueueAdd(pUser, TYPE_FAILURE, STYPE_EMPTY,
-			REJECT_MSG_LEN, 0, 0, NULL, NULL);
+		return ManageStaticMsgQueueAdd(pUser,
+			STATIC_PACKET_REJECT(REJECT_MSG_LEN));
 	}
 
-	//NOTE: Performs logic that allows reader to access users hash table.
-	// USer required to call UsersTableReaderFinish() to release semaphore and
-	// decrement m_plReaderCount.
-	HRESULT hResult = UsersTableReaderStart(pUser->m_pUsers);
-	if (S_OK != hResult)
-	{
-		DEBUG_ERROR("UsersTableReaderStart failed");
-		return hResult;
-	}
-
-    PUSER pTargetUser = HashTableReturnEntry(
-        pUser->m_pUsers->m_pUsersHTable, (PCHAR)pChatMsg->pszDataOne,
-        (pChatMsg->wLenOne) * sizeof(WCHAR));
-
-	if (NULL == pTargetUser)
+	//NOTE: The target can log out during the visit, but isn't freed until the
+	// visit ends, and a send started to it holds a reference, see UserRelease.
+	DIRECTMSG DirectMsg = { pUser, pChatMsg, S_OK };
+    if (FALSE == ShardedHashTableVisitEntry(
+                     pUser->m_pUsers->m_pUsersHTable,
+                     (PCHAR)pChatMsg->pszDataOne,
+                     (pChatMsg->wLenOne) * sizeof(WCHAR),
+                     SendOtherClientVisit, &DirectMsg))
 	{
 		//NOTE: User does not exist.
-		hResult = ManageMsgQueueAdd(pUser, TYPE_FAILURE, STYPE_EMPTY,
-			REJECT_USER_NOT_EXIST, 0, 0, NULL, NULL);
+		return ManageStaticMsgQueueAdd(pUser,
+			STATIC_PACKET_REJECT(REJECT_USER_NOT_EXIST));
 	}
-	else
+
+	if (SEND_QUEUE_FULL == DirectMsg.hResult)
 	{
-		hResult = SendOtherClientMessage(pUser, pTargetUser, pChatMsg);
+		//NOTE: The target's send queue is full.
+		return ManageStaticMsgQueueAdd(pUser,
+			STATIC_PACKET_REJECT(REJECT_SRV_BUSY));
 	}
 
-	if (S_OK != hResult)
+	if (S_OK != DirectMsg.hResult)
 	{
-		DEBUG_ERROR("SendOtherClientMessage failed");
-
-		if (S_OK != UsersTableReaderFinish(pUser->m_pUsers))
-		{
-			DEBUG_ERROR("UsersTableReaderFinish failed");
-			return SRV_SHUTDOWN_ERR;
-		}
-
-		return hResult;
+		DEBUG_ERROR("ManageMsgQueueAdd failed");
+		return DirectMsg.hResult;
 	}
 
-	hResult = UsersTableReaderFinish(pUser->m_pUsers);
+	return ManageStaticMsgQueueAdd(pUser, STATIC_PACKET_CHAT_ACK);
+}
 
-	if (S_OK != hResult)
+static BOOL
+LogoutBroadcastVisit(PVOID pData, PVOID pContext)
+{
+	PBROADCAST pBroadcast = (PBROADCAST)pContext;
+
+	pBroadcast->hResult = BroadcastSend((PUSER)pData, pBroadcast);
+	if (SRV_SHUTDOWN_ERR == pBroadcast->hResult)
 	{
-		DEBUG_ERROR("UsersTableReaderFinish failed");
+		//NOTE: Error information will be printed, but the other
+		// client's IOCP packet can handle the failure.
+		DEBUG_PRINT("ManageMsgQueueAdd failed");
+		return FALSE;
 	}
 
-	return hResult;
+	return TRUE;
 }
 
 //NOTE: Utilized following a logout.
@@ -534,58 +441,16 @@ static HRESULT
 LogoutBroadcast(PUSERS pUsers, WORD wUserlen, PWCHAR pszUsername, WORD wMsgLen,
 	PWCHAR pszMsg)
 {
-	HRESULT hResult = UsersTableReaderStart(pUsers);
-	if (S_OK != hResult)
-	{
-		DEBUG_ERROR("UsersTableReaderStart failed");
-		return hResult;
-	}
+	BROADCAST Broadcast = { NULL, wUserlen, pszUsername, wMsgLen, pszMsg,
+		NULL, S_OK };
 
-	PHASHTABLE pUsersTable = pUsers->m_pUsersHTable;
-	for (WORD wCounter = 0; wCounter < pUsersTable->m_wCapacity;
-		wCounter++)
+	if (SRV_SHUTDOWN_ERR ==
+		WalkBroadcast(pUsers, &Broadcast, LogoutBroadcastVisit))
 	{
-		PLINKEDLIST pLinkedList = pUsersTable->m_ppTable[wCounter];
-
-		if (NULL != pLinkedList)
-		{
-			PLINKEDLISTNODE pTempNode = pLinkedList->m_pTail;
-
-			for (WORD wCounter2 = 0; wCounter2 < pLinkedList->m_wSize;
-				wCounter2++)
-			{
-				pTempNode = pTempNode->m_pNext;
-				PHASHTABLEENTRY pTempEntry =
-					(PHASHTABLEENTRY)pTempNode->m_pData;
-				PUSER pUser = (PUSER)pTempEntry->m_pData;
-				hResult = ManageMsgQueueAdd(pUser, TYPE_CHAT,
-					STYPE_EMPTY, OPCODE_RES, wUserlen, wMsgLen, pszUsername,
-					pszMsg);
-
-				if (SRV_SHUTDOWN_ERR == hResult)
-				{
-					//NOTE: Error information will be printed, but the other
-					// client's IOCP packet can handle the failure.
-					DEBUG_PRINT("ManageMsgQueueAdd failed");
-
-					if (S_OK != UsersTableReaderFinish(pUser->m_pUsers))
-					{
-						DEBUG_ERROR("UsersTableReaderFinish failed");
-					}
-
-					return SRV_SHUTDOWN_ERR;
-				}
-			}
-		}
+		return SRV_SHUTDOWN_ERR;
 	}
 
-	hResult = UsersTableReaderFinish(pUsers);
-
-	if (S_OK != hResult)
-	{
-		DEBUG_ERROR("UsersTableReaderFinish failed");
-	}
-	return hResult;
+	return S_OK;
 }
 
 static HRESULT
@@ -596,11 +461,11 @@ HandleLogout(PUSER pUser)
 	wcscpy_s(caUsername, (MAX_UNAME_LEN + 1), pUser->m_caUsername);
 	WORD wUserlen = pUser->m_wUsernameLen;
 	//NOTE: Send user ack packet.
-	HRESULT hResult = ManageMsgQueueAdd(pUser, TYPE_ACCOUNT, STYPE_LOGOUT,
-		OPCODE_ACK, 0, 0, NULL, NULL);
+	HRESULT hResult = ManageStaticMsgQueueAdd(pUser,
+		STATIC_PACKET_LOGOUT_ACK);
 	if (S_OK != hResult)
 	{
-		DEBUG_ERROR("ManageMsgQueueAdd failed");
+		DEBUG_ERROR("ManageStaticMsgQueueAdd failed");
 		return hResult;
 	}
 
@@ -618,18 +483,9 @@ HandleLogout(PUSER pUser)
 		}
 	}
 
-	//NOTE: Handles writer mutex lock logic.
-	hResult = UsersTableWriter(pUser);
-	if (S_OK != hResult)
-	{
-		DEBUG_ERROR("UsersTableWriter failed");
-		return hResult;
-	}
-
-	PUSER pTempUser = HashTableDestroyEntry(pUser->m_pUsers->m_pUsersHTable,
-                                            (PCHAR)pUser->m_caUsername,
-                                            (pUser->m_wUsernameLen) * sizeof(WCHAR));
-	ReleaseMutex(pUser->m_pUsers->m_haUsersHandles[USERS_WRITE_MUTEX]);
+    PUSER pTempUser = ShardedHashTableDestroyEntry(
+        pUser->m_pUsers->m_pUsersHTable, (PCHAR)pUser->m_caUsername,
+        (pUser->m_wUsernameLen) * sizeof(WCHAR));
 
 	if (NULL == pTempUser)
 	{
@@ -637,23 +493,60 @@ HandleLogout(PUSER pUser)
 		DEBUG_ERROR("HashTableDestroyEntry failed");
 		return SRV_SHUTDOWN_ERR;
 	}
+	InterlockedDecrement(&pUser->m_pUsers->m_lLoginSlots);
 
-	UserFreeFunction((PVOID)pTempUser);
-    return LogoutBroadcast(pUsers, wUserlen, caUsername, 24 * sizeof(WCHAR),
+	// NOTE: Direct messages look users up without a lock, one may still be
+	// queueing to this user until its epoch ends. Only the connection's
+	// reference is dropped then, see UserRelease.
+	ShardedHashTableRetire(pUser->m_pUsers->m_pUsersHTable, pTempUser,
+		UserRelease);
+    return LogoutBroadcast(pUsers, wUserlen, caUsername, 24,
 		L"User has left the server");
 }
 
+static BOOL
+CreateListVisit(PVOID pData, PVOID pContext)
+{
+	PUSER     pUser     = (PUSER)pData;
+	PUSERLIST pUserList = (PUSERLIST)pContext;
+
+	//NOTE: Users can log in on other shards after the list was sized, those
+	// that don't fit are left off this list.
+	if ((SIZE_T)pUser->m_wUsernameLen + 2 > pUserList->rsLengthLeft)
+	{
+		return FALSE;
+	}
+
+	if (0 != wcscpy_s(pUserList->pUserListTracker,
+		pUserList->rsLengthLeft,
+		pUser->m_caUsername))
+	{
+		DEBUG_ERROR("wcscpy_s failed");
+		pUserList->bFailed = TRUE;
+		return FALSE;
+	}
+	pUserList->pUserListTracker += pUser->m_wUsernameLen;
+	pUserList->pUserListTracker[0] = L'\n';
+	pUserList->pUserListTracker += 1;
+	*pUserList->pUsersLen += pUser->m_wUsernameLen + 1;
+	pUserList->rsLengthLeft -= (pUser->m_wUsernameLen + 1);
+
+	return TRUE;
+}
+
 //NOTE: Gets a list of all users in the hash table.
-//NOTE: Calling function is responsible for freeing allocated space.
+//NOTE: Calling function is responsible for freeing allocated space, the
+// allocation's size is returned in pcbUserListSize.
 //TODO: May need adjustment if table gets to big (updaing a list instead of
 // generating a new one each time.
 static PWCHAR
-CreateList(PHASHTABLE pUsersTable, PSIZE_T pUsersLen)
+CreateList(PSHARDEDHASHTABLE pUsersTable, PSIZE_T pUsersLen,
+	PSIZE_T pcbUserListSize)
 {
 	// NOTE: Space allocated for:
 	// NULL terminator + ((Max username len + newline) * (number of users))
 	SIZE_T cchUserListSize =
-		((MAX_UNAME_LEN + 1) * pUsersTable->m_wSize) + 1;
+		((MAX_UNAME_LEN + 1) * (SIZE_T)ShardedHashTableSize(pUsersTable)) + 1;
 	SIZE_T cbUserListSize = cchUserListSize * sizeof(WCHAR);
 
 	PWCHAR pUserList =
@@ -664,42 +557,17 @@ CreateList(PHASHTABLE pUsersTable, PSIZE_T pUsersLen)
 		return NULL;
 	}
 
-	PWCHAR  pUserListTracker = pUserList;
-	rsize_t rsLengthLeft     = cchUserListSize;
-	for (WORD wCounter = 0; wCounter < pUsersTable->m_wCapacity; wCounter++)
-	{
-		PLINKEDLIST pLinkedList = pUsersTable->m_ppTable[wCounter];
+	USERLIST UserList = { pUserList, cchUserListSize, pUsersLen, FALSE };
 
-		if (NULL != pLinkedList)
-		{
-			PLINKEDLISTNODE pTempNode = pLinkedList->m_pTail;
-
-			for (WORD wCounter2 = 0; wCounter2 < pLinkedList->m_wSize;
-				wCounter2++)
-			{
-				pTempNode = pTempNode->m_pNext;
-				PHASHTABLEENTRY pTempEntry =
-					(PHASHTABLEENTRY)pTempNode->m_pData;
-				PUSER pUser = (PUSER)pTempEntry->m_pData;
-				if (0 != wcscpy_s(pUserListTracker,
-					rsLengthLeft,
-					pUser->m_caUsername))
-				{
-					DEBUG_ERROR("wcscpy_s failed");
-					ZeroingHeapFree(GetProcessHeap(), NO_OPTION, (PVOID)&pUserList,
-						(1 + ((MAX_UNAME_LEN + 1) * pUsersTable->m_wSize *
-							sizeof(WCHAR))));
-					return NULL;
-				}
-				pUserListTracker += pUser->m_wUsernameLen;
-				pUserListTracker[0] = L'\n';
-                pUserListTracker += 1;
-                *pUsersLen += pUser->m_wUsernameLen + 1;
-				rsLengthLeft -= (pUser->m_wUsernameLen + 1);
-			}
-		}
+	ShardedHashTableForEach(pUsersTable, CreateListVisit, &UserList);
+	if (UserList.bFailed)
+	{
+		ZeroingHeapFree(GetProcessHeap(), NO_OPTION, (PVOID)&pUserList,
+			(DWORD)cbUserListSize);
+		return NULL;
 	}
 
+	*pcbUserListSize = cbUserListSize;
 	return pUserList;
 }
 
@@ -711,29 +579,17 @@ HandleList(PUSER pUser, PCHATMSG pChatMsg)
 		(OPCODE_REQ != pChatMsg->iOpcode))
 	{
 		//NOTE: Invalid packet.
-		return ManageMsgQueueAdd(pUser, TYPE_FAILURE, STYPE_EMPTY,
-			REJECT_INVALID_PACKET, 0, 0, NULL, NULL);
+		return ManageStaticMsgQueueAdd(pUser,
+			STATIC_PACKET_REJECT(REJECT_INVALID_PACKET));
 	}
 
-	//reader for hash table mutex
-	HRESULT hResult = UsersTableReaderStart(pUser->m_pUsers);
-	if (S_OK != hResult)
-	{
-		DEBUG_ERROR("UsersTableReaderStart failed");
-		return hResult;
-    }
-
 	SIZE_T stUserListLen = 0;
-    PWCHAR pUserList =
-        CreateList(pUser->m_pUsers->m_pUsersHTable, &stUserListLen);
+	SIZE_T cbUserListSize = 0;
+    PWCHAR pUserList = CreateList(pUser->m_pUsers->m_pUsersHTable,
+                                  &stUserListLen, &cbUserListSize);
     if ((NULL == pUserList) || (0 == stUserListLen))
 	{
 		DEBUG_ERROR("CreateList failed");
-
-		if (S_OK != UsersTableReaderFinish(pUser->m_pUsers))
-		{
-			DEBUG_ERROR("UsersTableReaderFinish failed");
-		}
 		return SRV_SHUTDOWN_ERR;
     }
 
@@ -743,70 +599,41 @@ HandleList(PUSER pUser, PCHATMSG pChatMsg)
 // that list will not list all of them.
 #pragma warning(push)
 #pragma warning(disable : 4244)
-    hResult = ManageMsgQueueAdd(pUser, TYPE_LIST, STYPE_EMPTY, OPCODE_RES,
-                                stUserListLen, 0, pUserList, NULL);
+    HRESULT hResult = ManageMsgQueueAdd(pUser, TYPE_LIST, STYPE_EMPTY,
+                                        OPCODE_RES, stUserListLen, 0,
+                                        pUserList, NULL);
 #pragma warning(pop)
-	ZeroingHeapFree(GetProcessHeap(), NO_OPTION, (PVOID)&pUserList, (1 +
-		((MAX_UNAME_LEN + 1) * pUser->m_pUsers->m_pUsersHTable->m_wSize *
-			sizeof(WCHAR))));
+	ZeroingHeapFree(GetProcessHeap(), NO_OPTION, (PVOID)&pUserList,
+		(DWORD)cbUserListSize);
 
 	if (S_OK != hResult)
 	{
 		DEBUG_ERROR("ManageMsgQueueAdd failed");
-
-		if (S_OK != UsersTableReaderFinish(pUser->m_pUsers))
-		{
-			DEBUG_ERROR("UsersTableReaderFinish failed");
-			return SRV_SHUTDOWN_ERR;
-		}
-
-		return hResult;
 	}
 
-	hResult = UsersTableReaderFinish(pUser->m_pUsers);
+	return hResult;
+}
 
-	if (S_OK != hResult)
+static BOOL
+BroadcastVisit(PVOID pData, PVOID pContext)
+{
+	if (S_OK != BroadcastSend((PUSER)pData, (PBROADCAST)pContext))
 	{
-		DEBUG_ERROR("UsersTableReaderFinish failed");
+		//NOTE: Error information will be printed, but the other
+		// client's IOCP packet can handle the failure.
+		DEBUG_ERROR("ManageMsgQueueAdd failed");
 	}
 
-	return hResult;
+	return TRUE;
 }
 
 static VOID
 CreateBroadcast(PUSER pSendingUser, WORD wMsgLen, PWCHAR pszMsg)
 {
-	PHASHTABLE pUsersTable = pSendingUser->m_pUsers->m_pUsersHTable;
-	for (WORD wCounter = 0; wCounter < pUsersTable->m_wCapacity;
-		wCounter++)
-	{
-		PLINKEDLIST pLinkedList = pUsersTable->m_ppTable[wCounter];
-
-		if (NULL != pLinkedList)
-		{
-			PLINKEDLISTNODE pTempNode = pLinkedList->m_pTail;
+	BROADCAST Broadcast = { NULL, pSendingUser->m_wUsernameLen,
+		pSendingUser->m_caUsername, wMsgLen, pszMsg, NULL, S_OK };
 
-			for (WORD wCounter2 = 0; wCounter2 < pLinkedList->m_wSize;
-				wCounter2++)
-			{
-				pTempNode = pTempNode->m_pNext;
-				PHASHTABLEENTRY pTempEntry =
-					(PHASHTABLEENTRY)pTempNode->m_pData;
-				PUSER pUser = (PUSER)pTempEntry->m_pData;
-				HRESULT hResult = ManageMsgQueueAdd(pUser, TYPE_CHAT,
-					STYPE_EMPTY, OPCODE_RES,
-					pSendingUser->m_wUsernameLen, wMsgLen,
-					pSendingUser->m_caUsername, pszMsg);
-
-				if (S_OK != hResult)
-				{
-					//NOTE: Error information will be printed, but the other
-					// client's IOCP packet can handle the failure.
-					DEBUG_ERROR("ManageMsgQueueAdd failed");
-				}
-			}
-		}
-	}
+	WalkBroadcast(pSendingUser->m_pUsers, &Broadcast, BroadcastVisit);
 }
 
 static HRESULT
@@ -817,30 +644,13 @@ HandleBroadcast(PUSER pUser, PCHATMSG pChatMsg)
 		(OPCODE_REQ != pChatMsg->iOpcode))
 	{
 		//NOTE: Invalid packet.
-		return ManageMsgQueueAdd(pUser, TYPE_FAILURE, STYPE_EMPTY,
-			REJECT_INVALID_PACKET, 0, 0, NULL, NULL);
-	}
-
-	//NOTE: Need to call readers finish.
-	HRESULT hResult = UsersTableReaderStart(pUser->m_pUsers);
-	if (S_OK != hResult)
-	{
-		DEBUG_ERROR("UsersTableReaderStart failed");
-		return hResult;
+		return ManageStaticMsgQueueAdd(pUser,
+			STATIC_PACKET_REJECT(REJECT_INVALID_PACKET));
 	}
 
 	CreateBroadcast(pUser, pChatMsg->wLenOne, pChatMsg->pszDataOne);
 
-	hResult = UsersTableReaderFinish(pUser->m_pUsers);
-
-	if (S_OK != hResult)
-	{
-		DEBUG_ERROR("UsersTableReaderFinish failed");
-		return hResult;
-	}
-
-	return ManageMsgQueueAdd(pUser, TYPE_BROADCAST,
-		STYPE_EMPTY, OPCODE_ACK, 0, 0, NULL, NULL);
+	return ManageStaticMsgQueueAdd(pUser, STATIC_PACKET_BROADCAST_ACK);
 }
 
 static HRESULT
@@ -856,8 +666,8 @@ HandleClientPacket(PUSER pUser, PCHATMSG pChatMsg)
 		}
 		else
 		{
-			return ManageMsgQueueAdd(pUser, TYPE_FAILURE, STYPE_EMPTY,
-				REJECT_INVALID_PACKET, 0, 0, NULL, NULL);
+			return ManageStaticMsgQueueAdd(pUser,
+				STATIC_PACKET_REJECT(REJECT_INVALID_PACKET));
 		}
 
 	case TYPE_CHAT:
@@ -871,8 +681,8 @@ HandleClientPacket(PUSER pUser, PCHATMSG pChatMsg)
 
 	default:
 		//NOTE: Sending failure packet if packet invalid.
-		return ManageMsgQueueAdd(pUser, TYPE_FAILURE, STYPE_EMPTY,
-			REJECT_INVALID_PACKET, 0, 0, NULL, NULL);
+		return ManageStaticMsgQueueAdd(pUser,
+			STATIC_PACKET_REJECT(REJECT_INVALID_PACKET));
 	}
 }
 
@@ -907,29 +717,19 @@ WorkerRecvOP(PUSER pUser, DWORD dwBytesTransferred)
 	ChatMsgCopy.pszDataOne = pszDataOne;
 	ChatMsgCopy.pszDataTwo = pszDataTwo;
 
+	//NOTE: Lengths under MAX_MSG_LEN_CHAT fit the receive buffers and the
+	// copies, each is converted to host byte order as it's copied.
 	if ((0 < ChatMsgCopy.wLenOne) && (ChatMsgCopy.wLenOne < MAX_MSG_LEN_CHAT))
 	{
-		errno_t eResult = wmemcpy_s(pszDataOne, (BUFF_SIZE + 1),
-			pUser->m_RecvMsg.m_pBodyBufferOne, ChatMsgCopy.wLenOne);
-		if (0 != eResult)
-		{
-            DEBUG_ERROR_SUPPLIED(eResult, "wmemcpy_s failed");
-			return SRV_SHUTDOWN_ERR;
-		}
-		WstrNetToHost(pszDataOne, ChatMsgCopy.wLenOne);
+		WstrNetToHostCopy(pszDataOne, pUser->m_RecvMsg.m_pBodyBufferOne,
+			ChatMsgCopy.wLenOne);
 		/*wprintf(L"string one:%s\n", pszDataOne);*/
 	}
 
 	if ((0 < ChatMsgCopy.wLenTwo) && (ChatMsgCopy.wLenTwo < MAX_MSG_LEN_CHAT))
 	{
-		errno_t eResult = wmemcpy_s(pszDataTwo, (BUFF_SIZE + 1),
-			pUser->m_RecvMsg.m_pBodyBufferTwo, ChatMsgCopy.wLenTwo);
-		if (0 != eResult)
-		{
-            DEBUG_ERROR_SUPPLIED(eResult, "wmemcpy_s failed");
-			return SRV_SHUTDOWN_ERR;
-		}
-		WstrNetToHost(pszDataTwo, ChatMsgCopy.wLenTwo);
+		WstrNetToHostCopy(pszDataTwo, pUser->m_RecvMsg.m_pBodyBufferTwo,
+			ChatMsgCopy.wLenTwo);
 		/*wprintf(L"string two:%s\n", pszDataTwo);*/
 	}
 
@@ -971,80 +771,20 @@ WorkerRecvOP(PUSER pUser, DWORD dwBytesTransferred)
 	return S_OK;
 }
 
-static HRESULT
-CheckSendQueue(PUSER pUser)
-{
-	PMSGHOLDER pMsgHolder = QueuePeek(pUser->m_SendMsgQueue);
-
-	if (NULL == pMsgHolder)
-	{
-		DEBUG_ERROR("CustomWaitForSingleObject failed");
-		return SRV_SHUTDOWN_ERR;
-	}
-
-	INT iResult = WSASend(pUser->m_ClientSocket, pMsgHolder->m_wsaBuffer,
-		THREE_BUFFERS, &pMsgHolder->m_dwBytesMoved, pMsgHolder->m_dwFlags,
-		&pMsgHolder->m_wsaOverlapped, NULL);
-
-	if (SOCKET_ERROR == iResult)
-	{
-		iResult = WSAGetLastError();
-		if (WSA_IO_PENDING != iResult)
-		{
-			DEBUG_WSAERROR("WSASend failed");
-			return CLIENT_REMOVE_ERR;
-		}
-	}
-
-	return S_OK;
-}
-
+//NOTE: Only called by the thread holding m_plSendOccuring, after the send in
+// flight completed in full.
 static HRESULT
 ManageSendQueue(PUSER pUser)
 {
-	InterlockedIncrement(&pUser->m_plThreadsWaiting);
-
-	DWORD dwWaitResult = CustomWaitForSingleObject(
-		pUser->m_haSharedHandles[SEND_MUTEX], INFINITE);
-	InterlockedDecrement(&pUser->m_plThreadsWaiting);
-
-	//NOTE: Maybe handle wait abandoned differently than wait failed in the
-	// future.
-	if (WAIT_OBJECT_0 != dwWaitResult)
-	{
-		DEBUG_ERROR("CustomWaitForSingleObject failed");
-		return SRV_SHUTDOWN_ERR;
-	}
-
 	//NOTE: The full send was successful. Remove memory allocated for this send.
-	if (SUCCESS != QueuePopRemove(pUser->m_SendMsgQueue, FreeMsg))
-	{
-		ReleaseMutex(pUser->m_haSharedHandles[SEND_MUTEX]);
-		DEBUG_ERROR("QueuePopRemove failed");
-		return SRV_SHUTDOWN_ERR;
-	}
-
-	if (0 == pUser->m_SendMsgQueue->m_iSize)
-	{
-		//NOTE: plSendOccuring only updated when sends are initiated: only
-		// initiated by the recvOP fn.
-		InterlockedDecrement(&pUser->m_plSendOccuring);
-		BOOL bResult = SetEvent(pUser->m_haSharedHandles[SEND_DONE_EVENT]);
-		ReleaseMutex(pUser->m_haSharedHandles[SEND_MUTEX]);
-		if (FALSE == bResult)
-		{
-			DEBUG_ERROR("SetEvent failed");
-			return SRV_SHUTDOWN_ERR;
-		}
-		return S_OK;
-	}
-
-	HRESULT hResult = CheckSendQueue(pUser);
-	ReleaseMutex(pUser->m_haSharedHandles[SEND_MUTEX]);
+	InterlockedAdd64(&pUser->m_pUsers->m_SendQueueStats.m_llMsgsSent,
+		pUser->m_SendBatch.m_dwMsgs);
+	ReleaseSendBatch(pUser);
 
+	HRESULT hResult = SendQueuedMsg(pUser);
 	if (S_OK != hResult)
 	{
-		DEBUG_WSAERROR("WSASend failed");
+		DEBUG_PRINT("SendQueuedMsg failed");
 		return hResult;
 	}
 
@@ -1057,17 +797,17 @@ static HRESULT
 WorkerSendOP(PUSER pUser, DWORD dwBytesTransferred)
 {
 	HRESULT hResult = S_OK;
-	PMSGHOLDER pSendHolder = QueuePeek(pUser->m_SendMsgQueue);
-	if (NULL == pSendHolder)
+	PSENDBATCH pBatch = &pUser->m_SendBatch;
+	if (0 == pBatch->m_dwMsgs)
 	{
-		DEBUG_ERROR("QueuePeek failed");
+		DEBUG_PRINT("No send in flight");
 		return SRV_SHUTDOWN_ERR;
 	}
 
-	pSendHolder->m_dwBytesMovedTotal += dwBytesTransferred;
-	if (pSendHolder->m_dwBytesMovedTotal < pSendHolder->m_dwBytestoMove)
+	pBatch->m_dwBytesMovedTotal += dwBytesTransferred;
+	if (pBatch->m_dwBytesMovedTotal < pBatch->m_dwBytestoMove)
 	{
-		hResult = WorkerPartialSend(pSendHolder, pUser->m_ClientSocket);
+		hResult = WorkerPartialSend(pUser, dwBytesTransferred);
 		if (S_OK != hResult)
 		{
 			DEBUG_ERROR("WorkerPartialSend failed");
@@ -1078,16 +818,11 @@ WorkerSendOP(PUSER pUser, DWORD dwBytesTransferred)
 	}
 
 	//NOTE: Send was completed, lets check queue for more sends.
+	//NOTE: ManageSendQueue gives up m_plSendOccuring itself when it fails.
 	hResult = ManageSendQueue(pUser);
 	if (S_OK != hResult)
 	{
 		DEBUG_ERROR("ManageSendQueue failed");
-
-		//TODO: should we keep this?
-		//NOTE: If the previous function failed and didn't decrement
-		// m_plSendOccuring, it is done here.
-		InterlockedExchange(&pUser->m_plSendOccuring, 0);
-
 		return hResult;
 	}
 
@@ -1121,14 +856,6 @@ WorkerSendOP(PUSER pUser, DWORD dwBytesTransferred)
 static HRESULT
 ClientShutdown(PUSER pUser)
 {
-	//NOTE: Handles writer mutex lock logic.
-	HRESULT hResult = UsersTableWriter(pUser);
-	if (S_OK != hResult)
-	{
-		DEBUG_ERROR("UsersTableWriter failed");
-		return hResult;
-	}
-
 	//NOTE: Waiting for m_plSendOccuring to go to zero.
 	if (pUser->m_plSendOccuring != 0)
 	{
@@ -1141,23 +868,28 @@ ClientShutdown(PUSER pUser)
 		}
 	}
 
-	PUSER pTempUser = HashTableDestroyEntry(pUser->m_pUsers->m_pUsersHTable,
-                                            (PCHAR)pUser->m_caUsername,
-                                            (pUser->m_wUsernameLen) * sizeof(WCHAR));
-	ReleaseMutex(pUser->m_pUsers->m_haUsersHandles[USERS_WRITE_MUTEX]);
+    PUSER pTempUser = ShardedHashTableDestroyEntry(
+        pUser->m_pUsers->m_pUsersHTable, (PCHAR)pUser->m_caUsername,
+        (pUser->m_wUsernameLen) * sizeof(WCHAR));
 	if (NULL == pTempUser)
 	{
 		DEBUG_ERROR("HashTableDestroyEntry failed");
 		UserFreeFunction((PVOID)pUser);
 		return SRV_SHUTDOWN_ERR;
 	}
+	InterlockedDecrement(&pUser->m_pUsers->m_lLoginSlots);
 
-	UserFreeFunction((PVOID)pTempUser);
+	ShardedHashTableRetire(pUser->m_pUsers->m_pUsersHTable, pTempUser,
+		UserRelease);
 	return S_OK;
 }
 
+//NOTE: iOperationType is the completed operation's, read before it was
+// handled, a send's carrier is freed with its batch. bBatchReleased is TRUE
+// once a completed send was handled, its batch was released and
+// m_plSendOccuring given up, by ManageSendQueue or AbortQueuedSend.
 static HRESULT
-HandleClientShutdown(PUSER pUser, PMSGHOLDER pMsgHolder)
+HandleClientShutdown(PUSER pUser, INT8 iOperationType, BOOL bBatchReleased)
 {
 	//NOTE: Utilized for sending logout broadcast.
 	PUSERS pUsers = pUser->m_pUsers;
@@ -1168,7 +900,7 @@ HandleClientShutdown(PUSER pUser, PMSGHOLDER pMsgHolder)
 	if (NEGOTIATED == pUser->m_wNegotiatedState)
 	{
 		//NOTE: Fatal client error, call for deletion.
-		if (RECV_OP == pMsgHolder->m_iOperationType)
+		if (RECV_OP == iOperationType)
 		{
 			//NOTE: There will always be at least one receive that will come
 			// through. Function waits for this IOCP return to conduct shutdown.
@@ -1185,12 +917,21 @@ HandleClientShutdown(PUSER pUser, PMSGHOLDER pMsgHolder)
 					g_bServerState = STOP;
 				}
                 return LogoutBroadcast(pUsers, wUserlen, caUsername,
-                                       24 * sizeof(WCHAR),
+                                       24,
 					L"User has left the server");
 			}
 		}
+		else if (TRUE == bBatchReleased)
+		{
+			//NOTE: The batch and the flag may already be another producer's.
+			// The pending receive fails and removes the client.
+			CancelIoEx((HANDLE)pUser->m_ClientSocket, NULL);
+		}
 		else
 		{
+			//NOTE: The failed send is dropped before the flag is given up, the
+			// next thread to take it would overwrite m_SendBatch.
+			ReleaseSendBatch(pUser);
 			if (1 == InterlockedCompareExchange(&pUser->m_plSendOccuring, 0, 1))
 			{
 				//NOTE: If the send operation didn't transfer any bytes, we'll
@@ -1219,21 +960,19 @@ HandleClientShutdown(PUSER pUser, PMSGHOLDER pMsgHolder)
 			return SRV_SHUTDOWN_ERR;
 		}
 
-		PUSER pTempUser = HashTableDestroyEntry(
-			pUser->m_pUsers->m_pNewUsersTable,
-			(PCHAR)&(pUser->m_ClientSocket),
-			(sizeof(SOCKET) / sizeof(WCHAR)));
+		PUSER pTempUser = SocketMapRemove(pUser->m_pUsers->m_pNewUsersTable,
+			pUser->m_ClientSocket);
 		ReleaseMutex(pUser->m_pUsers->m_haUsersHandles[NEW_USERS_MUTEX]);
 
 		if (NULL == pTempUser)
 		{
-			DEBUG_ERROR("HashTableDestroyEntry failed");
+			DEBUG_PRINT("SocketMapRemove failed");
 			UserFreeFunction((PVOID)pUser);
 			return SRV_SHUTDOWN_ERR;
 		}
 
-		UserFreeFunction((PVOID)pTempUser);
-        return LogoutBroadcast(pUsers, wUserlen, caUsername, 24 * sizeof(WCHAR),
+		UserRelease((PVOID)pTempUser);
+        return LogoutBroadcast(pUsers, wUserlen, caUsername, 24,
 			L"User has left the server");
 	}
 
@@ -1264,20 +1003,27 @@ WorkerThread(PVOID pParam)
 		PUSER pUser = (PUSER)pulUserHolder;
 		//NOTE: lpOverLapped is the first member of our MSGHOLDER struct.
 		PMSGHOLDER pMsgHolder = (PMSGHOLDER)lpOverLapped;
+		//NOTE: A send's carrier is freed with its batch, read before.
+		INT8 iOperationType = pMsgHolder->m_iOperationType;
 
 		if ((FALSE == bResult) || (0 == dwBytesTransferred))
 		{
-			if (SRV_SHUTDOWN_ERR == HandleClientShutdown(pUser, pMsgHolder))
+			if (SRV_SHUTDOWN_ERR ==
+				HandleClientShutdown(pUser, iOperationType, FALSE))
 			{
 				//NOTE: Thread print dereference could cause errors.
 				DEBUG_ERROR("GetQueuedCompletionStatus failed");
 				return ERR_GENERIC;
 			}
+			if (SEND_OP == iOperationType)
+			{
+				UserRelease(pUser);
+			}
 			continue;
 		}
 
 		//NOTE: RecvOP and SendOP contain most of server functionality.
-		if (RECV_OP == pMsgHolder->m_iOperationType)
+		if (RECV_OP == iOperationType)
 		{
 			hResult = WorkerRecvOP(pUser, dwBytesTransferred);
 		}
@@ -1300,7 +1046,8 @@ WorkerThread(PVOID pParam)
 			//NOTE: Error that requires client shutdown but not server shutdown.
 			CustomConsoleWrite(L"WorkerThread(): Removing client due to: CLIENT_REMOVE_ERR",
 				55);
-			if (SRV_SHUTDOWN_ERR == HandleClientShutdown(pUser, pMsgHolder))
+			if (SRV_SHUTDOWN_ERR ==
+				HandleClientShutdown(pUser, iOperationType, TRUE))
 			{
 				DEBUG_ERROR("HandleClientShutdown failed");
 				return ERR_GENERIC;
@@ -1321,6 +1068,13 @@ WorkerThread(PVOID pParam)
             SetEvent(g_hShutdownEvent);
 			break;
 		}
+
+		//NOTE: The send's reference, see SendBatch. Nothing touches the user
+		// after, it may be freed here.
+		if (SEND_OP == iOperationType)
+		{
+			UserRelease(pUser);
+		}
 	}
 	return SUCCESS;
 }